@@ -39,4 +39,15 @@ elseif(UNIX AND NOT APPLE)
   endif()
   find_package(GetTime REQUIRED)
   target_link_libraries(Abstraction INTERFACE GetTime)
+
+  # Before glibc 2.34, shm_open (used by the DDSI shared-memory transport)
+  # was in librt
+  include(CheckLibraryExists)
+  check_library_exists(c shm_open "" HAVE_SHM_OPEN_IN_C)
+  if(NOT HAVE_SHM_OPEN_IN_C)
+    check_library_exists(rt shm_open "" HAVE_SHM_OPEN_IN_RT)
+    if(HAVE_SHM_OPEN_IN_RT)
+      target_link_libraries(Abstraction INTERFACE rt)
+    endif()
+  endif()
 endif()
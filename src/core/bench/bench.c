@@ -0,0 +1,334 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "bench.h"
+
+/* ddsbench: microbenchmarks of the data structures on the hot paths.
+
+   Every measurement is printed as one CSV record:
+
+     benchmark,variant,threads,ops,ns_per_op,mops
+
+   where ns_per_op is the wall-clock time per operation per thread and
+   mops the aggregate throughput in millions of operations per second.
+   Each benchmark is repeated and the best run is reported, and a file
+   with the output of an earlier run can be given to compare against,
+   which appends the old ns_per_op and the relative change. */
+
+static const struct bench *benches[] = {
+    &bench_avl,
+    &bench_hh,
+    &bench_ehh,
+    &bench_chh,
+    &bench_fibheap,
+    &bench_thread_pool,
+    &bench_handleserver,
+    &bench_freelist,
+    &bench_defrag,
+    &bench_reorder,
+    &bench_stream
+};
+
+struct result {
+    char name[32];
+    char variant[64];
+    uint32_t nthreads;
+    uint64_t nops;
+    double ns_per_op;
+};
+
+struct results {
+    uint32_t n, size;
+    struct result *rs;
+};
+
+static struct results current, baseline;
+
+/*************************************************************************************************/
+
+int64_t bench_time (void)
+{
+    os_time t = os_timeGetMonotonic ();
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+uint32_t bench_random (uint64_t *state)
+{
+    /* xorshift64* */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t) ((*state * UINT64_C (2685821657736338717)) >> 32);
+}
+
+uint32_t *bench_permutation (uint32_t n, uint64_t seed)
+{
+    uint32_t *p = os_malloc (n * sizeof (*p));
+    uint64_t state = seed | 1;
+    uint32_t i;
+    for (i = 0; i < n; i++)
+        p[i] = i;
+    for (i = n; i > 1; i--) {
+        const uint32_t j = bench_random (&state) % i;
+        const uint32_t t = p[i - 1];
+        p[i - 1] = p[j];
+        p[j] = t;
+    }
+    return p;
+}
+
+static struct result *lookup_result (struct results *rs, const char *name, const char *variant, uint32_t nthreads)
+{
+    uint32_t i;
+    for (i = 0; i < rs->n; i++) {
+        struct result *r = &rs->rs[i];
+        if (r->nthreads == nthreads && strcmp (r->name, name) == 0 && strcmp (r->variant, variant) == 0)
+            return r;
+    }
+    return NULL;
+}
+
+static struct result *add_result (struct results *rs, const char *name, const char *variant, uint32_t nthreads)
+{
+    struct result *r;
+    if (rs->n == rs->size) {
+        rs->size = rs->size ? 2 * rs->size : 32;
+        rs->rs = os_realloc (rs->rs, rs->size * sizeof (*rs->rs));
+    }
+    r = &rs->rs[rs->n++];
+    memset (r, 0, sizeof (*r));
+    (void) snprintf (r->name, sizeof (r->name), "%s", name);
+    (void) snprintf (r->variant, sizeof (r->variant), "%s", variant);
+    r->nthreads = nthreads;
+    return r;
+}
+
+void bench_report (const char *name, const char *variant, uint32_t nthreads, uint64_t nops, int64_t elapsed)
+{
+    const double ns_per_op = (nops > 0) ? (double) elapsed * nthreads / (double) nops : 0.0;
+    struct result *r;
+    if ((r = lookup_result (&current, name, variant, nthreads)) == NULL) {
+        r = add_result (&current, name, variant, nthreads);
+    } else if (ns_per_op >= r->ns_per_op) {
+        return;
+    }
+    r->nops = nops;
+    r->ns_per_op = ns_per_op;
+}
+
+/*************************************************************************************************/
+
+struct thread_arg {
+    uint64_t (*f) (uint32_t i, void *arg);
+    void *arg;
+    uint32_t i;
+    uint64_t nops;
+    os_threadId tid;
+};
+
+static struct {
+    os_mutex lock;
+    os_cond cond;
+    uint32_t nready;
+    int go;
+} gate;
+
+static uint32_t bench_thread (void *varg)
+{
+    struct thread_arg *a = varg;
+    os_mutexLock (&gate.lock);
+    gate.nready++;
+    os_condBroadcast (&gate.cond);
+    while (!gate.go)
+        os_condWait (&gate.cond, &gate.lock);
+    os_mutexUnlock (&gate.lock);
+    a->nops = a->f (a->i, a->arg);
+    return 0;
+}
+
+uint64_t bench_run_threads (uint32_t nthreads, uint64_t (*f) (uint32_t i, void *arg), void *arg, int64_t *elapsed)
+{
+    struct thread_arg *as = os_malloc (nthreads * sizeof (*as));
+    os_threadAttr attr;
+    uint64_t nops = 0;
+    int64_t t0;
+    uint32_t i;
+
+    os_mutexInit (&gate.lock);
+    os_condInit (&gate.cond, &gate.lock);
+    gate.nready = 0;
+    gate.go = 0;
+    os_threadAttrInit (&attr);
+    for (i = 0; i < nthreads; i++) {
+        as[i].f = f;
+        as[i].arg = arg;
+        as[i].i = i;
+        as[i].nops = 0;
+        if (os_threadCreate (&as[i].tid, "bench", &attr, bench_thread, &as[i]) != os_resultSuccess) {
+            fprintf (stderr, "ddsbench: failed to create thread\n");
+            exit (2);
+        }
+    }
+    os_mutexLock (&gate.lock);
+    while (gate.nready < nthreads)
+        os_condWait (&gate.cond, &gate.lock);
+    gate.go = 1;
+    t0 = bench_time ();
+    os_condBroadcast (&gate.cond);
+    os_mutexUnlock (&gate.lock);
+    for (i = 0; i < nthreads; i++) {
+        (void) os_threadWaitExit (as[i].tid, NULL);
+        nops += as[i].nops;
+    }
+    *elapsed = bench_time () - t0;
+    os_condDestroy (&gate.cond);
+    os_mutexDestroy (&gate.lock);
+    os_free (as);
+    return nops;
+}
+
+/*************************************************************************************************/
+
+static int read_baseline (const char *file)
+{
+    char line[256];
+    FILE *fp;
+    if ((fp = fopen (file, "r")) == NULL)
+        return -1;
+    while (fgets (line, sizeof (line), fp)) {
+        char name[32], variant[64];
+        unsigned nthreads;
+        unsigned long long nops;
+        double ns_per_op;
+        /* header and anything else that doesn't look like a record is skipped */
+        if (sscanf (line, "%31[^,],%63[^,],%u,%llu,%lf", name, variant, &nthreads, &nops, &ns_per_op) == 5) {
+            struct result *r = add_result (&baseline, name, variant, nthreads);
+            r->nops = nops;
+            r->ns_per_op = ns_per_op;
+        }
+    }
+    fclose (fp);
+    return 0;
+}
+
+static void print_results (uint32_t first)
+{
+    uint32_t i;
+    for (i = first; i < current.n; i++) {
+        const struct result *r = &current.rs[i];
+        const struct result *b;
+        printf ("%s,%s,%u,%"PRIu64",%.2f,%.3f", r->name, r->variant, r->nthreads, r->nops, r->ns_per_op,
+                (r->ns_per_op > 0) ? r->nthreads * 1e3 / r->ns_per_op : 0.0);
+        if (baseline.n > 0) {
+            if ((b = lookup_result (&baseline, r->name, r->variant, r->nthreads)) != NULL && b->ns_per_op > 0)
+                printf (",%.2f,%+.1f", b->ns_per_op, 100.0 * (r->ns_per_op - b->ns_per_op) / b->ns_per_op);
+            else
+                printf (",,");
+        }
+        printf ("\n");
+    }
+    fflush (stdout);
+}
+
+static bool parse_threads (struct bench_params *params, const char *arg)
+{
+    char *copy = os_strdup (arg), *cursor = copy, *tok;
+    params->nthreads = 0;
+    while ((tok = os_strsep (&cursor, ",")) != NULL) {
+        const int v = atoi (tok);
+        if (v < 1 || v > BENCH_MAX_THREADS || params->nthreads == sizeof (params->threads) / sizeof (params->threads[0])) {
+            os_free (copy);
+            return false;
+        }
+        params->threads[params->nthreads++] = (uint32_t) v;
+    }
+    os_free (copy);
+    return params->nthreads > 0;
+}
+
+static void usage (const char *argv0)
+{
+    size_t i;
+    fprintf (stderr, "\
+usage: %s [OPTIONS] [BENCHMARK...]\n\
+\n\
+OPTIONS:\n\
+  -n N         elements/operations per measurement (default 100000)\n\
+  -t THREADS   comma-separated thread counts for concurrent benchmarks\n\
+               (default 1,2,4)\n\
+  -r REPS      repetitions, the best is reported (default 3)\n\
+  -c FILE      compare with the output of an earlier run\n\
+\n\
+Runs all benchmarks, or those whose name is given. Benchmarks:\n", argv0);
+    for (i = 0; i < sizeof (benches) / sizeof (benches[0]); i++)
+        fprintf (stderr, "  %s\n", benches[i]->name);
+    exit (1);
+}
+
+int main (int argc, char **argv)
+{
+    struct bench_params params;
+    const char *baseline_file = NULL;
+    int reps = 3;
+    size_t i;
+    int opt, j;
+
+    memset (&params, 0, sizeof (params));
+    params.n = 100000;
+    (void) parse_threads (&params, "1,2,4");
+    while ((opt = os_getopt (argc, argv, "n:t:r:c:")) != -1) {
+        const char *arg = os_get_optarg ();
+        switch (opt) {
+            case 'n': params.n = (uint32_t) atoi (arg); break;
+            case 't': if (!parse_threads (&params, arg)) usage (argv[0]); break;
+            case 'r': reps = atoi (arg); break;
+            case 'c': baseline_file = arg; break;
+            default: usage (argv[0]); break;
+        }
+    }
+    if (params.n < 2 || reps < 1)
+        usage (argv[0]);
+    for (j = os_get_optind (); j < argc; j++) {
+        for (i = 0; i < sizeof (benches) / sizeof (benches[0]); i++)
+            if (strcmp (benches[i]->name, argv[j]) == 0)
+                break;
+        if (i == sizeof (benches) / sizeof (benches[0]))
+            usage (argv[0]);
+    }
+    if (baseline_file && read_baseline (baseline_file) < 0) {
+        fprintf (stderr, "ddsbench: %s: cannot read\n", baseline_file);
+        return 2;
+    }
+
+    os_osInit ();
+    printf ("benchmark,variant,threads,ops,ns_per_op,mops%s\n", baseline.n ? ",baseline_ns_per_op,change_pct" : "");
+    for (i = 0; i < sizeof (benches) / sizeof (benches[0]); i++) {
+        const uint32_t first = current.n;
+        int selected = (os_get_optind () == argc), r;
+        for (j = os_get_optind (); j < argc && !selected; j++)
+            selected = (strcmp (benches[i]->name, argv[j]) == 0);
+        if (!selected)
+            continue;
+        for (r = 0; r < reps; r++)
+            benches[i]->run (&params);
+        print_results (first);
+    }
+    os_osExit ();
+    os_free (current.rs);
+    os_free (baseline.rs);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "os/os.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+#define BENCH_MAX_THREADS 64
+
+struct bench_params {
+    uint32_t n;                   /* number of elements/operations per run */
+    uint32_t nthreads;            /* number of entries in threads */
+    uint32_t threads[16];         /* thread counts for concurrent benchmarks */
+};
+
+/* A benchmark runs all its variants once and calls bench_report for each
+   measurement; the driver runs it repeatedly and keeps the best result
+   of each (benchmark, variant, threads) triple. */
+struct bench {
+    const char *name;
+    void (*run) (const struct bench_params *params);
+};
+
+/* Monotonic time in ns */
+int64_t bench_time (void);
+
+void bench_report (const char *name, const char *variant, uint32_t nthreads, uint64_t nops, int64_t elapsed);
+
+/* Runs f (i, arg) for i in [0, nthreads) in nthreads threads that all start
+   at the same time, returns the sum of their results (the number of
+   operations they performed) and stores the wall-clock time from start to
+   the last one finishing in *elapsed */
+uint64_t bench_run_threads (uint32_t nthreads, uint64_t (*f) (uint32_t i, void *arg), void *arg, int64_t *elapsed);
+
+uint32_t bench_random (uint64_t *state);
+
+/* Random permutation of [0, n), to be freed with os_free */
+uint32_t *bench_permutation (uint32_t n, uint64_t seed);
+
+extern const struct bench bench_avl;
+extern const struct bench bench_hh;
+extern const struct bench bench_ehh;
+extern const struct bench bench_chh;
+extern const struct bench bench_fibheap;
+extern const struct bench bench_thread_pool;
+extern const struct bench bench_handleserver;
+extern const struct bench bench_freelist;
+extern const struct bench bench_defrag;
+extern const struct bench bench_reorder;
+extern const struct bench bench_stream;
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif /* BENCH_H */
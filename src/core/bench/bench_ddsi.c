@@ -0,0 +1,275 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os/os.h"
+#include "ddsi/q_freelist.h"
+#include "ddsi/q_radmin.h"
+#include "bench.h"
+
+/*************************************************************************************************/
+
+#define FL_BATCH 64
+
+struct flelem {
+    void *link;
+    char payload[56];
+};
+
+struct fl_arg {
+    struct nn_freelist fl;
+    uint32_t iters;
+};
+
+static uint64_t freelist_thread (uint32_t idx, void *varg)
+{
+    /* push a batch of elements, then pop as many back, like a thread that
+       frees and allocates serdatas in bursts; elements popped by one
+       thread may have been pushed by another */
+    struct fl_arg *arg = varg;
+    struct flelem *els[FL_BATCH];
+    uint64_t nops = 0;
+    uint32_t i, j;
+    (void) idx;
+    for (j = 0; j < FL_BATCH; j++)
+        els[j] = os_malloc (sizeof (*els[j]));
+    for (i = 0; i < arg->iters; i++) {
+        for (j = 0; j < FL_BATCH; j++) {
+            if (!nn_freelist_push (&arg->fl, els[j]))
+                os_free (els[j]);
+        }
+        for (j = 0; j < FL_BATCH; j++) {
+            if ((els[j] = nn_freelist_pop (&arg->fl)) == NULL)
+                els[j] = os_malloc (sizeof (*els[j]));
+        }
+        nops += 2 * FL_BATCH;
+    }
+    for (j = 0; j < FL_BATCH; j++)
+        os_free (els[j]);
+    return nops;
+}
+
+static void run_freelist (const struct bench_params *params)
+{
+    uint32_t t;
+    for (t = 0; t < params->nthreads; t++) {
+        const uint32_t nthreads = params->threads[t];
+        struct fl_arg arg;
+        uint64_t nops;
+        int64_t elapsed;
+        nn_freelist_init (&arg.fl, UINT32_MAX, offsetof (struct flelem, link));
+        arg.iters = params->n / FL_BATCH;
+        nops = bench_run_threads (nthreads, freelist_thread, &arg, &elapsed);
+        bench_report ("freelist", "push+pop", nthreads, nops, elapsed);
+        nn_freelist_fini (&arg.fl, os_free);
+    }
+}
+
+const struct bench bench_freelist = { "freelist", run_freelist };
+
+/*************************************************************************************************/
+
+/* Receive path from a single proxy writer without a delivery queue: every
+   fragment arrives in a packet of its own, goes through the defragmenter
+   and then the reorder admin, delivered samples are released at once. The
+   contents of the packets are never looked at. */
+
+struct radmin {
+    struct nn_rbufpool *rbp;
+    struct nn_defrag *defrag;
+    struct nn_reorder *reorder;
+    uint64_t delivered;
+};
+
+static void radmin_init (struct radmin *ra, uint32_t reorder_maxsamples)
+{
+    ra->rbp = nn_rbufpool_new (1048576, 65536);
+    ra->defrag = nn_defrag_new (NN_DEFRAG_DROP_LATEST, 16);
+    ra->reorder = nn_reorder_new (NN_REORDER_MODE_NORMAL, reorder_maxsamples);
+    ra->delivered = 0;
+}
+
+static void radmin_fini (struct radmin *ra)
+{
+    nn_reorder_free (ra->reorder);
+    nn_defrag_free (ra->defrag);
+    nn_rbufpool_free (ra->rbp);
+}
+
+static void radmin_feed (struct radmin *ra, seqno_t seq, uint32_t size, uint32_t fragsize, uint32_t min, uint32_t maxp1)
+{
+    struct nn_rmsg *rmsg = nn_rmsg_new (ra->rbp);
+    struct nn_rsample_info sampleinfo;
+    struct nn_rsample *rsample;
+    struct nn_rdata *rdata;
+
+    nn_rmsg_setsize (rmsg, maxp1 - min);
+    rdata = nn_rdata_new (rmsg, min, maxp1, 0, 0);
+    memset (&sampleinfo, 0, sizeof (sampleinfo));
+    sampleinfo.seq = seq;
+    sampleinfo.size = size;
+    sampleinfo.fragsize = fragsize;
+    if ((rsample = nn_defrag_rsample (ra->defrag, rdata, &sampleinfo)) != NULL) {
+        struct nn_rdata *fragchain = nn_rsample_fragchain (rsample);
+        struct nn_rsample_chain sc;
+        int refc_adjust = 0;
+        if (nn_reorder_rsample (&sc, ra->reorder, rsample, &refc_adjust, 0) > 0) {
+            while (sc.first) {
+                struct nn_rsample_chain_elem *e = sc.first;
+                sc.first = e->next;
+                ra->delivered++;
+                nn_fragchain_unref (e->fragchain);
+            }
+        }
+        nn_fragchain_adjust_refcount (fragchain, refc_adjust);
+    }
+    nn_rmsg_commit (rmsg);
+}
+
+static void check_delivered (const struct radmin *ra, uint64_t expected, const char *what)
+{
+    if (ra->delivered != expected) {
+        fprintf (stderr, "ddsbench: %s: delivered %"PRIu64" of %"PRIu64" samples\n", what, ra->delivered, expected);
+        abort ();
+    }
+}
+
+/*************************************************************************************************/
+
+enum frag_order { FRAG_INORDER, FRAG_REVERSE, FRAG_INTERLEAVED };
+
+static void defrag_one (const char *variant, uint32_t nsamples, uint32_t size, uint32_t fragsize, enum frag_order order)
+{
+    /* interleaving mixes the fragments of 4 consecutive samples, as
+       happens with retransmits overlapping with new data */
+    const uint32_t nfrags = (size + fragsize - 1) / fragsize;
+    const uint32_t group = (order == FRAG_INTERLEAVED) ? 4 : 1;
+    struct radmin ra;
+    int64_t t0;
+    uint32_t s, f, k;
+
+    nsamples -= nsamples % group;
+    radmin_init (&ra, 16);
+    t0 = bench_time ();
+    for (s = 0; s < nsamples; s += group) {
+        for (f = 0; f < nfrags; f++) {
+            const uint32_t fx = (order == FRAG_REVERSE) ? nfrags - 1 - f : f;
+            const uint32_t min = fx * fragsize;
+            const uint32_t maxp1 = (min + fragsize < size) ? min + fragsize : size;
+            for (k = 0; k < group; k++)
+                radmin_feed (&ra, s + k + 1, size, fragsize, min, maxp1);
+        }
+    }
+    bench_report ("defrag", variant, 1, nsamples, bench_time () - t0);
+    check_delivered (&ra, nsamples, "defrag");
+    radmin_fini (&ra);
+}
+
+static void run_defrag (const struct bench_params *params)
+{
+    const uint32_t nsamples = params->n / 16;
+    defrag_one ("16k/1k-inorder", nsamples, 16384, 1024, FRAG_INORDER);
+    defrag_one ("16k/1k-reverse", nsamples, 16384, 1024, FRAG_REVERSE);
+    defrag_one ("16k/1k-interleaved", nsamples, 16384, 1024, FRAG_INTERLEAVED);
+    defrag_one ("60k/1300-inorder", nsamples / 4, 61440, 1300, FRAG_INORDER);
+}
+
+const struct bench bench_defrag = { "defrag", run_defrag };
+
+/*************************************************************************************************/
+
+/* Arrival orders of sequence numbers: the samples a pattern "loses" are
+   retransmitted and arrive a while later, all samples eventually arrive
+   and get delivered exactly once. */
+enum loss_pattern { LOSS_NONE, LOSS_SWAP, LOSS_RANDOM, LOSS_BURST };
+
+struct arrival {
+    uint64_t key;
+    uint32_t seq;
+};
+
+static int cmp_arrival (const void *va, const void *vb)
+{
+    const struct arrival *a = va, *b = vb;
+    if (a->key != b->key)
+        return (a->key < b->key) ? -1 : 1;
+    return (a->seq == b->seq) ? 0 : (a->seq < b->seq) ? -1 : 1;
+}
+
+static uint32_t *make_arrivals (uint32_t n, enum loss_pattern pattern)
+{
+    struct arrival *as = os_malloc (n * sizeof (*as));
+    uint32_t *seqs = os_malloc (n * sizeof (*seqs));
+    uint64_t state = 12345;
+    uint32_t i, burst = 0;
+    for (i = 0; i < n; i++) {
+        uint32_t delay = 0;
+        switch (pattern) {
+            case LOSS_NONE:
+                break;
+            case LOSS_SWAP: /* pairs of adjacent samples swapped */
+                delay = (i % 2 == 0) ? 2 : 0;
+                break;
+            case LOSS_RANDOM: /* 1% lost, retransmitted 64 samples later */
+                delay = (bench_random (&state) % 100 == 0) ? 64 : 0;
+                break;
+            case LOSS_BURST: /* 16 consecutive out of every 1024 lost, retransmitted 256 samples later */
+                if (i % 1024 == 0)
+                    burst = 16;
+                if (burst > 0) {
+                    delay = 256;
+                    burst--;
+                }
+                break;
+        }
+        as[i].key = (uint64_t) i + delay;
+        as[i].seq = i + 1;
+    }
+    qsort (as, n, sizeof (*as), cmp_arrival);
+    for (i = 0; i < n; i++)
+        seqs[i] = as[i].seq;
+    os_free (as);
+    return seqs;
+}
+
+static void reorder_one (const char *variant, uint32_t n, uint32_t size, enum loss_pattern pattern)
+{
+    uint32_t *seqs = make_arrivals (n, pattern);
+    struct radmin ra;
+    int64_t t0;
+    uint32_t i;
+
+    /* the reorder admin must be able to hold everything that arrives
+       while waiting for a retransmit, else it drops samples that would
+       in reality be retransmitted once more */
+    radmin_init (&ra, 1024);
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        radmin_feed (&ra, seqs[i], size, size, 0, size);
+    bench_report ("reorder", variant, 1, n, bench_time () - t0);
+    check_delivered (&ra, n, "reorder");
+    radmin_fini (&ra);
+    os_free (seqs);
+}
+
+static void run_reorder (const struct bench_params *params)
+{
+    reorder_one ("inorder", params->n, 64, LOSS_NONE);
+    reorder_one ("swap", params->n, 64, LOSS_SWAP);
+    reorder_one ("random-1pct", params->n, 64, LOSS_RANDOM);
+    reorder_one ("burst-16of1024", params->n, 64, LOSS_BURST);
+}
+
+const struct bench bench_reorder = { "reorder", run_reorder };
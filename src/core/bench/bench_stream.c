@@ -0,0 +1,152 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddsc/dds.h"
+#include "dds__stream.h"
+#include "dds__key.h"
+#include "ddsi/ddsi_ser.h"
+#include "bench_types.h"
+#include "bench.h"
+
+/* Serializer cost per sample: writing the CDR representation, computing
+   the key hash and reading it back into a sample, for a few types that
+   exercise the memcpy path, string keys, bulk sequences and sequences
+   handled element by element. */
+
+static void fill_fixed (void *vs, uint32_t size)
+{
+    Bench_Fixed *s = vs;
+    (void) size;
+    s->id = 1; s->a = 2; s->b = 3; s->c = 4.0;
+}
+
+static void fill_stringkey (void *vs, uint32_t size)
+{
+    Bench_StringKey *s = vs;
+    (void) size;
+    s->name = dds_string_dup ("/robot/arm/joint_state/left");
+    s->seq = 1; s->ts = 2;
+}
+
+static void fill_payload (void *vs, uint32_t size)
+{
+    Bench_Payload *s = vs;
+    s->id = 1; s->seq = 2;
+    s->payload._length = s->payload._maximum = size;
+    s->payload._buffer = dds_alloc (size);
+    s->payload._release = true;
+    memset (s->payload._buffer, 0x55, size);
+}
+
+static void fill_numbers (void *vs, uint32_t size)
+{
+    Bench_Numbers *s = vs;
+    uint32_t i;
+    s->id = 1;
+    s->vals._length = s->vals._maximum = size;
+    s->vals._buffer = dds_alloc (size * sizeof (int32_t));
+    s->vals._release = true;
+    s->weights._length = s->weights._maximum = size;
+    s->weights._buffer = dds_alloc (size * sizeof (double));
+    s->weights._release = true;
+    for (i = 0; i < size; i++) {
+        ((int32_t *) s->vals._buffer)[i] = (int32_t) i;
+        ((double *) s->weights._buffer)[i] = (double) i / 3.0;
+    }
+}
+
+struct stream_case {
+    const char *variant;
+    const dds_topic_descriptor_t *desc;
+    void (*fill) (void *sample, uint32_t size);
+    uint32_t size;
+};
+
+static const struct stream_case stream_cases[] = {
+    { "Fixed", &Bench_Fixed_desc, fill_fixed, 0 },
+    { "StringKey", &Bench_StringKey_desc, fill_stringkey, 0 },
+    { "Payload-64", &Bench_Payload_desc, fill_payload, 64 },
+    { "Payload-1k", &Bench_Payload_desc, fill_payload, 1024 },
+    { "Payload-16k", &Bench_Payload_desc, fill_payload, 16384 },
+    { "Numbers-100", &Bench_Numbers_desc, fill_numbers, 100 }
+};
+
+static void stream_one (const struct stream_case *c, uint32_t n)
+{
+    const dds_topic_descriptor_t *desc = c->desc;
+    void *sample = dds_alloc (desc->m_size);
+    void *copy = dds_alloc (desc->m_size);
+    struct sertopic st;
+    dds_stream_t os, is;
+    dds_key_hash_t kh;
+    char variant[64];
+    int64_t t0;
+    uint32_t i;
+
+    /* the bits of a topic the serializer uses */
+    memset (&st, 0, sizeof (st));
+    st.type = (void *) desc;
+    st.nkeys = desc->m_nkeys;
+    st.keys = desc->m_keys;
+    if ((desc->m_flagset & DDS_TOPIC_NO_OPTIMIZE) == 0)
+        st.opt_size = dds_stream_check_optimize (desc);
+    c->fill (sample, c->size);
+    dds_stream_init (&os, 0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        dds_stream_reset (&os);
+        dds_stream_write_sample (&os, sample, &st);
+    }
+    (void) snprintf (variant, sizeof (variant), "%s-write", c->variant);
+    bench_report ("stream", variant, 1, n, bench_time () - t0);
+
+    memset (&kh, 0, sizeof (kh));
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        memset (kh.m_hash, 0, sizeof (kh.m_hash));
+        dds_key_gen (desc, &kh, sample);
+    }
+    (void) snprintf (variant, sizeof (variant), "%s-keyhash", c->variant);
+    bench_report ("stream", variant, 1, n, bench_time () - t0);
+
+    is = os;
+    is.m_size = os.m_index;
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        is.m_index = 0;
+        dds_stream_read_sample (&is, copy, &st);
+    }
+    (void) snprintf (variant, sizeof (variant), "%s-read", c->variant);
+    bench_report ("stream", variant, 1, n, bench_time () - t0);
+    if (is.m_failed || is.m_index != os.m_index) {
+        fprintf (stderr, "ddsbench: stream %s: read back failed\n", c->variant);
+        abort ();
+    }
+
+    dds_free (kh.m_key_buff);
+    dds_stream_fini (&os);
+    dds_sample_free (copy, desc, DDS_FREE_ALL);
+    dds_sample_free (sample, desc, DDS_FREE_ALL);
+}
+
+static void run_stream (const struct bench_params *params)
+{
+    size_t i;
+    for (i = 0; i < sizeof (stream_cases) / sizeof (stream_cases[0]); i++)
+        stream_one (&stream_cases[i], params->n);
+}
+
+const struct bench bench_stream = { "stream", run_stream };
@@ -0,0 +1,424 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "util/ut_avl.h"
+#include "util/ut_hopscotch.h"
+#include "util/ut_fibheap.h"
+#include "util/ut_thread_pool.h"
+#include "util/ut_handleserver.h"
+#include "bench.h"
+
+/* Keys are a random permutation of [0, n) for all the dictionaries,
+   lookups and deletes go in a different random order than inserts. */
+
+static int cmp_u32 (const void *va, const void *vb)
+{
+    const uint32_t *a = va, *b = vb;
+    return (*a == *b) ? 0 : (*a < *b) ? -1 : 1;
+}
+
+static uint32_t hash_u32 (const void *va)
+{
+    const uint32_t *a = va;
+    return (uint32_t) ((*a * UINT64_C (16292676669999574021)) >> 32);
+}
+
+static int equals_u32 (const void *va, const void *vb)
+{
+    const uint32_t *a = va, *b = vb;
+    return *a == *b;
+}
+
+static void check (int cond, const char *what)
+{
+    if (!cond) {
+        fprintf (stderr, "ddsbench: %s failed\n", what);
+        abort ();
+    }
+}
+
+/*************************************************************************************************/
+
+struct avlnode {
+    ut_avlNode_t avlnode;
+    uint32_t key;
+};
+
+static const ut_avlTreedef_t avl_td = UT_AVL_TREEDEF_INITIALIZER (offsetof (struct avlnode, avlnode), offsetof (struct avlnode, key), cmp_u32, 0);
+
+static void run_avl (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t *ins = bench_permutation (n, 1), *look = bench_permutation (n, 2);
+    struct avlnode *nodes = os_malloc (n * sizeof (*nodes));
+    ut_avlTree_t tree;
+    int64_t t0;
+    uint32_t i;
+
+    ut_avlInit (&avl_td, &tree);
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        nodes[i].key = ins[i];
+        ut_avlInsert (&avl_td, &tree, &nodes[i]);
+    }
+    bench_report ("avl", "insert", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_avlLookup (&avl_td, &tree, &look[i]) != NULL, "avl lookup");
+    bench_report ("avl", "lookup", 1, n, bench_time () - t0);
+
+    /* nodes[i] holds key ins[i]: delete in the order of look */
+    for (i = 0; i < n; i++)
+        ins[look[i]] = i;
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        ut_avlDelete (&avl_td, &tree, &nodes[ins[i]]);
+    bench_report ("avl", "delete", 1, n, bench_time () - t0);
+
+    check (ut_avlIsEmpty (&tree), "avl empty");
+    os_free (nodes);
+    os_free (look);
+    os_free (ins);
+}
+
+const struct bench bench_avl = { "avl", run_avl };
+
+/*************************************************************************************************/
+
+static void run_hh (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t *ins = bench_permutation (n, 1), *look = bench_permutation (n, 2);
+    struct ut_hh *hh = ut_hhNew (32, hash_u32, equals_u32);
+    int64_t t0;
+    uint32_t i;
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_hhAdd (hh, &ins[i]), "hh add");
+    bench_report ("hh", "insert", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_hhLookup (hh, &look[i]) != NULL, "hh lookup");
+    bench_report ("hh", "lookup", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_hhRemove (hh, &look[i]), "hh remove");
+    bench_report ("hh", "delete", 1, n, bench_time () - t0);
+
+    ut_hhFree (hh);
+    os_free (look);
+    os_free (ins);
+}
+
+const struct bench bench_hh = { "hh", run_hh };
+
+/*************************************************************************************************/
+
+static void run_ehh (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t *ins = bench_permutation (n, 1), *look = bench_permutation (n, 2);
+    struct ut_ehh *hh = ut_ehhNew (sizeof (uint32_t), 32, hash_u32, equals_u32);
+    int64_t t0;
+    uint32_t i;
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_ehhAdd (hh, &ins[i]), "ehh add");
+    bench_report ("ehh", "insert", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_ehhLookup (hh, &look[i]) != NULL, "ehh lookup");
+    bench_report ("ehh", "lookup", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        check (ut_ehhRemove (hh, &look[i]), "ehh remove");
+    bench_report ("ehh", "delete", 1, n, bench_time () - t0);
+
+    ut_ehhFree (hh);
+    os_free (look);
+    os_free (ins);
+}
+
+const struct bench bench_ehh = { "ehh", run_ehh };
+
+/*************************************************************************************************/
+
+/* The concurrent hash table hands old bucket arrays to a garbage
+   collector after resizing, as concurrent lookups may still be using
+   them; here they're simply kept until the end of the run. */
+struct chh_gc {
+    void *bs;
+    struct chh_gc *next;
+};
+
+static os_mutex chh_gc_lock;
+static struct chh_gc *chh_gc_list;
+
+static void chh_gc_buckets (void *bs)
+{
+    struct chh_gc *gc = os_malloc (sizeof (*gc));
+    gc->bs = bs;
+    os_mutexLock (&chh_gc_lock);
+    gc->next = chh_gc_list;
+    chh_gc_list = gc;
+    os_mutexUnlock (&chh_gc_lock);
+}
+
+struct chh_arg {
+    struct ut_chh *hh;
+    uint32_t n;
+    uint32_t nthreads;
+    const uint32_t *keys;
+    uint32_t *extra;
+};
+
+static uint64_t chh_lookup_thread (uint32_t idx, void *varg)
+{
+    struct chh_arg *arg = varg;
+    uint64_t state = idx + 1;
+    uint32_t i;
+    for (i = 0; i < arg->n; i++) {
+        const uint32_t key = bench_random (&state) % arg->n;
+        check (ut_chhLookup (arg->hh, &arg->keys[key]) != NULL, "chh lookup");
+    }
+    return arg->n;
+}
+
+static uint64_t chh_update_thread (uint32_t idx, void *varg)
+{
+    /* each thread adds and removes its own keys outside the prefilled
+       range while the others do the same */
+    struct chh_arg *arg = varg;
+    const uint32_t m = arg->n / arg->nthreads;
+    uint32_t * const keys = arg->extra + idx * m;
+    uint32_t i;
+    for (i = 0; i < m; i++) {
+        keys[i] = arg->n + idx * m + i;
+        check (ut_chhAdd (arg->hh, &keys[i]), "chh add");
+    }
+    for (i = 0; i < m; i++)
+        check (ut_chhRemove (arg->hh, &keys[i]), "chh remove");
+    return 2 * (uint64_t) m;
+}
+
+static void run_chh (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t *keys = bench_permutation (n, 1);
+    struct chh_arg arg;
+    uint32_t i, t;
+
+    os_mutexInit (&chh_gc_lock);
+    arg.hh = ut_chhNew (32, hash_u32, equals_u32, chh_gc_buckets);
+    arg.n = n;
+    arg.keys = keys;
+    arg.extra = os_malloc (n * sizeof (*arg.extra));
+    for (i = 0; i < n; i++)
+        check (ut_chhAdd (arg.hh, &keys[i]), "chh add");
+    for (t = 0; t < params->nthreads; t++) {
+        uint64_t nops;
+        int64_t elapsed;
+        arg.nthreads = params->threads[t];
+        nops = bench_run_threads (arg.nthreads, chh_lookup_thread, &arg, &elapsed);
+        bench_report ("chh", "lookup", arg.nthreads, nops, elapsed);
+        nops = bench_run_threads (arg.nthreads, chh_update_thread, &arg, &elapsed);
+        bench_report ("chh", "insert+delete", arg.nthreads, nops, elapsed);
+    }
+    ut_chhFree (arg.hh);
+    while (chh_gc_list) {
+        struct chh_gc *gc = chh_gc_list;
+        chh_gc_list = gc->next;
+        os_free (gc->bs);
+        os_free (gc);
+    }
+    os_mutexDestroy (&chh_gc_lock);
+    os_free (arg.extra);
+    os_free (keys);
+}
+
+const struct bench bench_chh = { "chh", run_chh };
+
+/*************************************************************************************************/
+
+struct fhnode {
+    ut_fibheapNode_t fhnode;
+    uint32_t key;
+};
+
+static int cmp_fhnode (const void *va, const void *vb)
+{
+    const struct fhnode *a = va, *b = vb;
+    return (a->key == b->key) ? 0 : (a->key < b->key) ? -1 : 1;
+}
+
+static const ut_fibheapDef_t fh_def = UT_FIBHEAPDEF_INITIALIZER (offsetof (struct fhnode, fhnode), cmp_fhnode);
+
+static void run_fibheap (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t *keys = bench_permutation (n, 1), *order = bench_permutation (n, 2);
+    struct fhnode *nodes = os_malloc (n * sizeof (*nodes));
+    ut_fibheap_t fh;
+    int64_t t0;
+    uint32_t i;
+
+    ut_fibheapInit (&fh_def, &fh);
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        nodes[i].key = keys[i];
+        ut_fibheapInsert (&fh_def, &fh, &nodes[i]);
+    }
+    bench_report ("fibheap", "insert", 1, n, bench_time () - t0);
+
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        struct fhnode *min = ut_fibheapExtractMin (&fh_def, &fh);
+        check (min != NULL && min->key == i, "fibheap extractmin");
+    }
+    bench_report ("fibheap", "extractmin", 1, n, bench_time () - t0);
+
+    /* the timed-event queue mostly deletes arbitrary nodes and decreases
+       keys when rescheduling */
+    for (i = 0; i < n; i++)
+        ut_fibheapInsert (&fh_def, &fh, &nodes[i]);
+    (void) ut_fibheapExtractMin (&fh_def, &fh);
+    t0 = bench_time ();
+    for (i = 0; i < n; i++) {
+        struct fhnode *x = &nodes[order[i]];
+        if (x->key > 0) {
+            x->key = 0;
+            ut_fibheapDecreaseKey (&fh_def, &fh, x);
+            check (ut_fibheapExtractMin (&fh_def, &fh) == x, "fibheap decreasekey");
+        }
+    }
+    bench_report ("fibheap", "decreasekey+extractmin", 1, n - 1, bench_time () - t0);
+
+    for (i = 0; i < n; i++) {
+        nodes[i].key = keys[i];
+        ut_fibheapInsert (&fh_def, &fh, &nodes[i]);
+    }
+    t0 = bench_time ();
+    for (i = 0; i < n; i++)
+        ut_fibheapDelete (&fh_def, &fh, &nodes[order[i]]);
+    bench_report ("fibheap", "delete", 1, n, bench_time () - t0);
+    check (ut_fibheapMin (&fh_def, &fh) == NULL, "fibheap empty");
+
+    os_free (nodes);
+    os_free (order);
+    os_free (keys);
+}
+
+const struct bench bench_fibheap = { "fibheap", run_fibheap };
+
+/*************************************************************************************************/
+
+static os_atomic_uint32_t tp_done = OS_ATOMIC_UINT32_INIT (0);
+
+static void tp_job (void *arg)
+{
+    (void) arg;
+    os_atomic_inc32 (&tp_done);
+}
+
+static void run_thread_pool (const struct bench_params *params)
+{
+    const uint32_t n = params->n;
+    uint32_t t, i;
+    for (t = 0; t < params->nthreads; t++) {
+        const uint32_t nthreads = params->threads[t];
+        const os_time delay = { 0, 10000 };
+        ut_thread_pool pool = ut_thread_pool_new (nthreads, nthreads, 0, NULL);
+        int64_t t0;
+        check (pool != NULL, "thread pool create");
+        os_atomic_st32 (&tp_done, 0);
+        t0 = bench_time ();
+        for (i = 0; i < n; i++)
+            check (ut_thread_pool_submit (pool, tp_job, NULL) == os_resultSuccess, "thread pool submit");
+        while (os_atomic_ld32 (&tp_done) < n)
+            os_nanoSleep (delay);
+        bench_report ("thread_pool", "submit+run", nthreads, n, bench_time () - t0);
+        ut_thread_pool_free (pool);
+    }
+}
+
+const struct bench bench_thread_pool = { "thread_pool", run_thread_pool };
+
+/*************************************************************************************************/
+
+#define HS_KIND 0x10000000
+
+static uint32_t hs_n;
+
+static uint64_t hs_create_delete_thread (uint32_t idx, void *varg)
+{
+    const os_time zero = { 0, 0 };
+    uint32_t i;
+    (void) idx;
+    for (i = 0; i < hs_n; i++) {
+        ut_handle_t hdl = ut_handle_create (HS_KIND, varg);
+        check (hdl > 0, "handle create");
+        check (ut_handle_delete (hdl, NULL, zero) == UT_HANDLE_OK, "handle delete");
+    }
+    return 2 * (uint64_t) hs_n;
+}
+
+static uint64_t hs_claim_release_thread (uint32_t idx, void *varg)
+{
+    /* all threads claim the same handle: the common case of many
+       application threads operating on one reader or writer */
+    const ut_handle_t hdl = *(const ut_handle_t *) varg;
+    uint32_t i;
+    (void) idx;
+    for (i = 0; i < hs_n; i++) {
+        void *arg;
+        check (ut_handle_claim (hdl, NULL, HS_KIND, &arg) == UT_HANDLE_OK, "handle claim");
+        ut_handle_release (hdl, NULL);
+    }
+    return hs_n;
+}
+
+static void run_handleserver (const struct bench_params *params)
+{
+    const os_time zero = { 0, 0 };
+    ut_handle_t hdl;
+    uint32_t t;
+
+    check (ut_handleserver_init () == UT_HANDLE_OK, "handleserver init");
+    hdl = ut_handle_create (HS_KIND, NULL);
+    check (hdl > 0, "handle create");
+    for (t = 0; t < params->nthreads; t++) {
+        const uint32_t nthreads = params->threads[t];
+        uint64_t nops;
+        int64_t elapsed;
+        hs_n = params->n / nthreads;
+        nops = bench_run_threads (nthreads, hs_create_delete_thread, NULL, &elapsed);
+        bench_report ("handleserver", "create+delete", nthreads, nops, elapsed);
+        nops = bench_run_threads (nthreads, hs_claim_release_thread, &hdl, &elapsed);
+        bench_report ("handleserver", "claim+release", nthreads, nops, elapsed);
+    }
+    check (ut_handle_delete (hdl, NULL, zero) == UT_HANDLE_OK, "handle delete");
+    ut_handleserver_fini ();
+}
+
+const struct bench bench_handleserver = { "handleserver", run_handleserver };
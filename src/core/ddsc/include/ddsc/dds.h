@@ -1065,6 +1065,83 @@ DDS_EXPORT dds_topic_filter_fn
 dds_topic_get_filter(
         dds_entity_t topic);
 
+/** Type of the value a field filter compares a field with */
+typedef enum dds_field_filter_kind
+{
+  DDS_FIELD_FILTER_INT,     /**< signed integer field, compared with m_value.i */
+  DDS_FIELD_FILTER_UINT,    /**< unsigned integer, enum or boolean field, compared with m_value.u */
+  DDS_FIELD_FILTER_FLOAT,   /**< float or double field, compared with m_value.f */
+  DDS_FIELD_FILTER_STRING   /**< (bounded) string field, compared with m_value.s */
+}
+dds_field_filter_kind_t;
+
+/** Comparison a field filter performs: field <op> value */
+typedef enum dds_field_filter_op
+{
+  DDS_FIELD_FILTER_EQ,
+  DDS_FIELD_FILTER_NE,
+  DDS_FIELD_FILTER_LT,
+  DDS_FIELD_FILTER_LE,
+  DDS_FIELD_FILTER_GT,
+  DDS_FIELD_FILTER_GE
+}
+dds_field_filter_op_t;
+
+/**
+ * @brief A single term of a field filter.
+ *
+ * The field is identified by its offset in the sample type (i.e., offsetof()
+ * of the member), which must be that of a primitive or string member of the
+ * topic's top-level type. A field filter is the conjunction of its terms.
+ *
+ * Unlike filter functions, field filters are evaluated directly on the
+ * serialized data, so samples that are rejected are never deserialized.
+ */
+typedef struct dds_field_filter
+{
+  size_t m_offset;
+  dds_field_filter_kind_t m_kind;
+  dds_field_filter_op_t m_op;
+  union
+  {
+    int64_t i;
+    uint64_t u;
+    double f;
+    const char *s;
+  } m_value;
+}
+dds_field_filter_t;
+
+/**
+ * @brief Sets a field filter on a topic.
+ *
+ * The field filter is applied in addition to a filter function set with
+ * dds_topic_set_filter. It may be replaced while data is arriving, in which
+ * case samples being stored concurrently are checked against either the old
+ * or the new filter.
+ *
+ * @param[in]  topic   The topic on which the content filter is set.
+ * @param[in]  nterms  The number of terms in the filter, 0 removes the filter.
+ * @param[in]  terms   The terms of the filter, copied by the call.
+ *
+ * @returns A dds_return_t indicating success or failure.
+ *
+ * @retval DDS_RETCODE_OK
+ *             The filter has been set.
+ * @retval DDS_RETCODE_BAD_PARAMETER
+ *             A term does not refer to a suitable field of the topic type.
+ * @retval DDS_RETCODE_ILLEGAL_OPERATION
+ *             The operation is invoked on an inappropriate object.
+ * @retval DDS_RETCODE_ALREADY_DELETED
+ *             The entity has already been deleted.
+ */
+_Pre_satisfies_((topic & DDS_ENTITY_KIND_MASK) == DDS_KIND_TOPIC)
+DDS_EXPORT dds_return_t
+dds_topic_set_field_filter(
+        _In_ dds_entity_t topic,
+        _In_ uint32_t nterms,
+        _In_reads_opt_(nterms) const dds_field_filter_t *terms);
+
 /**
  * @brief Creates a new instance of a DDS subscriber
  *
@@ -1823,6 +1900,38 @@ dds_create_querycondition(
         _In_ uint32_t mask,
         _In_ dds_querycondition_filter_fn filter);
 
+/**
+ * @brief Creates a querycondition with a field filter.
+ *
+ * Equivalent to dds_create_querycondition, except that the samples of
+ * interest are selected by a field filter (see dds_field_filter_t) rather
+ * than a callback, so that samples can be filtered without deserializing
+ * them.
+ *
+ * @param[in]  reader  Reader to associate the condition to.
+ * @param[in]  mask    Interest (dds_sample_state_t|dds_view_state_t|dds_instance_state_t).
+ * @param[in]  nterms  Number of terms in the filter.
+ * @param[in]  terms   The terms of the filter, copied by the call.
+ *
+ * @returns A valid condition handle or an error code
+ *
+ * @retval >=0
+ *             A valid condition handle.
+ * @retval DDS_RETCODE_BAD_PARAMETER
+ *             A term does not refer to a suitable field of the topic type.
+ * @retval DDS_RETCODE_ILLEGAL_OPERATION
+ *             The operation is invoked on an inappropriate object.
+ * @retval DDS_RETCODE_ALREADY_DELETED
+ *             The entity has already been deleted.
+ */
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+DDS_EXPORT dds_entity_t
+dds_create_querycondition_fields(
+        _In_ dds_entity_t reader,
+        _In_ uint32_t mask,
+        _In_ uint32_t nterms,
+        _In_reads_(nterms) const dds_field_filter_t *terms);
+
 /**
  * @brief Waitset attachment argument.
  *
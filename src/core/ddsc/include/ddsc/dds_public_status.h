@@ -170,6 +170,53 @@ typedef struct dds_inconsistent_topic_status
 }
 dds_inconsistent_topic_status_t;
 
+/**
+ * Cumulative statistics of a reader or writer, see dds_get_statistics.
+ * Counters that do not apply to the kind of entity are 0.
+ */
+typedef struct dds_statistics
+{
+  /* writer */
+  uint64_t samples_written;   /**< samples accepted for transmission */
+  uint64_t bytes_written;     /**< serialized payload bytes of those samples */
+  uint32_t acks_received;     /**< ACKNACKs without a retransmit request */
+  uint32_t nacks_received;    /**< ACKNACKs requesting a retransmit */
+  uint32_t rexmits;           /**< retransmitted samples and gaps (each retransmit counts) */
+  uint32_t rexmits_lost;      /**< requested samples no longer available */
+  uint32_t throttle_count;    /**< number of times write blocked on a full WHC */
+  dds_duration_t throttle_time; /**< total time spent blocked on a full WHC */
+  uint64_t whc_unacked_bytes; /**< current amount of unacknowledged data */
+  /* reader */
+  uint32_t samples_received;  /**< samples stored in the reader history */
+  uint32_t samples_rejected;  /**< reliable samples rejected by the reader history (retried later) */
+  uint32_t samples_dropped;   /**< best-effort samples rejected by the reader history (lost) */
+}
+dds_statistics_t;
+
+/**
+ * Number of buckets in a latency histogram. Bucket i covers
+ * [dds_latency_histogram_bucket_lower(i), dds_latency_histogram_bucket_lower(i+1)),
+ * the buckets are log-linear with 8 buckets per power of two ns, the last one
+ * collects everything above ~17 minutes.
+ */
+#define DDS_LATENCY_HISTOGRAM_BUCKETS 304
+
+/** Which latency of a reader a histogram covers, see dds_get_latency_histogram. */
+typedef enum dds_latency_kind
+{
+  DDS_LATENCY_SOURCE_TO_STORE, /**< source timestamp to insertion in the reader history */
+  DDS_LATENCY_STORE_TO_TAKE    /**< insertion in the reader history to being taken by the application */
+}
+dds_latency_kind_t;
+
+/** Latency histogram of a reader, durations in ns. */
+typedef struct dds_latency_histogram
+{
+  uint64_t count;                                  /**< total number of samples in buckets */
+  uint32_t buckets[DDS_LATENCY_HISTOGRAM_BUCKETS]; /**< number of samples per bucket */
+}
+dds_latency_histogram_t;
+
 
 /*
   get_<status> APIs return the status of an entity and resets the status
@@ -485,6 +532,108 @@ dds_get_requested_incompatible_qos_status (
         _In_  dds_entity_t reader,
         _Out_opt_ dds_requested_incompatible_qos_status_t * status);
 
+/**
+ * @brief Get cumulative statistics of a reader or writer
+ *
+ * Unlike the get_<status> operations, this neither resets the counters
+ * nor depends on the status being enabled. The writer counters are read
+ * as a consistent snapshot, the reader counters are updated without
+ * locking and may be slightly out of step with each other.
+ *
+ * @param[in]  entity  The reader or writer to get the statistics of
+ * @param[out] stats   The statistics
+ *
+ * @returns A dds_return_t indicating success or failure
+ *
+ * @retval DDS_RETCODE_OK
+ *            Success
+ * @retval DDS_RETCODE_BAD_PARAMETER
+ *            One of the given arguments is not valid.
+ * @retval DDS_RETCODE_ILLEGAL_OPERATION
+ *            The operation is invoked on an inappropriate object.
+ * @retval DDS_RETCODE_ALREADY_DELETED
+ *            The entity has already been deleted.
+ */
+_Pre_satisfies_(entity & DDS_ENTITY_KIND_MASK)
+DDS_EXPORT dds_return_t
+dds_get_statistics (
+        _In_  dds_entity_t entity,
+        _Out_ dds_statistics_t * stats);
+
+/**
+ * @brief Get a latency histogram of a reader
+ *
+ * Source-to-store latencies are measured from the source timestamp
+ * and therefore include any clock offset between the writing and the
+ * reading node; negative latencies are counted in the first bucket.
+ * Store-to-take latencies are only recorded for samples removed from
+ * the history by a take operation. The histograms accumulate until
+ * reset by dds_reset_latency_histograms.
+ *
+ * Only one in every Internal/LatencyHistogramInterval samples stored in
+ * the reader's history is timed; by default, that setting is 0 and the
+ * histograms remain empty.
+ *
+ * @param[in]  reader  The reader to get the histogram of
+ * @param[in]  kind    The latency to get the histogram of
+ * @param[out] hist    The histogram
+ *
+ * @returns A dds_return_t indicating success or failure
+ *
+ * @retval DDS_RETCODE_OK
+ *            Success
+ * @retval DDS_RETCODE_BAD_PARAMETER
+ *            One of the given arguments is not valid.
+ * @retval DDS_RETCODE_ILLEGAL_OPERATION
+ *            The operation is invoked on an inappropriate object.
+ * @retval DDS_RETCODE_ALREADY_DELETED
+ *            The entity has already been deleted.
+ */
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+DDS_EXPORT dds_return_t
+dds_get_latency_histogram (
+        _In_  dds_entity_t reader,
+        _In_  dds_latency_kind_t kind,
+        _Out_ dds_latency_histogram_t * hist);
+
+/**
+ * @brief Clear all latency histograms of a reader
+ *
+ * @param[in]  reader  The reader to reset the histograms of
+ *
+ * @returns A dds_return_t indicating success or failure, with the same
+ *          error codes as dds_get_latency_histogram
+ */
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+DDS_EXPORT dds_return_t
+dds_reset_latency_histograms (
+        _In_  dds_entity_t reader);
+
+/**
+ * @brief Lower bound (in ns) of a latency histogram bucket
+ *
+ * @param[in]  index   Bucket index, must be less than DDS_LATENCY_HISTOGRAM_BUCKETS
+ *
+ * @returns The smallest latency counted in the bucket
+ */
+DDS_EXPORT dds_duration_t
+dds_latency_histogram_bucket_lower (
+        _In_  uint32_t index);
+
+/**
+ * @brief Estimate a percentile from a latency histogram
+ *
+ * @param[in]  hist    The histogram
+ * @param[in]  p       The percentile, in [0,100]
+ *
+ * @returns The upper bound of the bucket containing the percentile
+ *          (so never an underestimate), 0 if the histogram is empty
+ */
+DDS_EXPORT dds_duration_t
+dds_latency_histogram_percentile (
+        _In_  const dds_latency_histogram_t * hist,
+        _In_  double p);
+
 #if defined (__cplusplus)
 }
 #endif
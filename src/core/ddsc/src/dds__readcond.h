@@ -18,6 +18,8 @@ _Must_inspect_result_ dds_readcond*
 dds_create_readcond(
         _In_ dds_reader *rd,
         _In_ dds_entity_kind_t kind,
-        _In_ uint32_t mask);
+        _In_ uint32_t mask,
+        _In_opt_ dds_querycondition_filter_fn filter,
+        _In_opt_ struct dds_stream_filter *fields);
 
 #endif
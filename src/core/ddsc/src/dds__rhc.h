@@ -65,6 +65,9 @@ dds_rhc_take(
         dds_readcond *cond);
 
 void dds_rhc_set_qos (struct rhc * rhc, const struct nn_xqos * qos);
+void dds_rhc_get_statistics (const struct rhc * rhc, dds_statistics_t * stats);
+void dds_rhc_get_latency_histogram (struct rhc * rhc, dds_latency_kind_t kind, dds_latency_histogram_t * hist);
+void dds_rhc_reset_latency_histograms (struct rhc * rhc);
 
 void dds_rhc_add_readcondition (dds_readcond * cond);
 void dds_rhc_remove_readcondition (dds_readcond * cond);
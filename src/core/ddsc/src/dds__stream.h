@@ -62,6 +62,18 @@ char * dds_stream_reuse_string
 );
 DDS_EXPORT void dds_stream_swap (void * buff, uint32_t size, uint32_t num);
 
+/* Field filters, evaluated on the serialised data */
+
+struct dds_stream_filter;
+struct dds_stream_filter * dds_stream_filter_new
+(
+  const dds_topic_descriptor_t * desc,
+  uint32_t nterms,
+  const dds_field_filter_t * terms
+);
+void dds_stream_filter_free (struct dds_stream_filter * filter);
+bool dds_stream_filter_accepts (const struct dds_stream_filter * filter, const struct serdata * sample);
+
 extern const uint32_t dds_op_size[5];
 
 /* For marshalling op code handling */
@@ -99,6 +99,7 @@ typedef struct dds_entity_deriver {
     dds_return_t (*validate_status)(uint32_t mask);
     dds_return_t (*propagate_status)(struct dds_entity *e, uint32_t mask, bool set);
     dds_return_t (*get_instance_hdl)(struct dds_entity *e, dds_instance_handle_t *i);
+    dds_return_t (*get_statistics)(struct dds_entity *e, dds_statistics_t *stats);
 }
 dds_entity_deriver;
 
@@ -223,6 +224,8 @@ typedef struct dds_readcond
   struct
   {
       dds_querycondition_filter_fn m_filter;
+      struct dds_stream_filter * m_fields;
+      uint32_t m_qcmask;
   } m_query;
 }
 dds_readcond;
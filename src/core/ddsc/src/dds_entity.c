@@ -970,6 +970,37 @@ dds_get_instance_handle(
 }
 
 
+_Pre_satisfies_(entity & DDS_ENTITY_KIND_MASK)
+dds_return_t
+dds_get_statistics(
+        _In_  dds_entity_t entity,
+        _Out_ dds_statistics_t *stats)
+{
+    dds_entity *e;
+    dds__retcode_t rc;
+    dds_return_t ret;
+
+    DDS_REPORT_STACK();
+
+    if (stats != NULL) {
+        rc = dds_entity_lock(entity, DDS_KIND_DONTCARE, &e);
+        if (rc == DDS_RETCODE_OK) {
+            if (e->m_deriver.get_statistics) {
+                ret = e->m_deriver.get_statistics(e, stats);
+            } else {
+                ret = DDS_ERRNO(DDS_RETCODE_ILLEGAL_OPERATION, "Statistics are only available for readers and writers");
+            }
+            dds_entity_unlock(e);
+        } else {
+            ret = DDS_ERRNO(rc, "Error occurred on locking entity");
+        }
+    } else {
+        ret = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Argument stats is NULL");
+    }
+    DDS_REPORT_FLUSH(ret < 0);
+    return ret;
+}
+
 _Check_return_ dds__retcode_t
 dds_valid_hdl(
         _In_ dds_entity_t hdl,
@@ -16,6 +16,7 @@
 #include "dds__querycond.h"
 #include "dds__readcond.h"
 #include "dds__err.h"
+#include "dds__stream.h"
 #include "ddsi/ddsi_ser.h"
 #include "dds__report.h"
 
@@ -34,27 +35,74 @@ dds_create_querycondition(
 
     DDS_REPORT_STACK();
 
+    rc = dds_reader_lock(reader, &r);
+    if (rc != DDS_RETCODE_OK) {
+        hdl = DDS_ERRNO(rc, "Error occurred on locking reader");
+        goto fail;
+    }
+    topic = r->m_topic->m_entity.m_hdl;
+    dds_reader_unlock(r);
+
+    /* The filter is applied to samples deserialised into the filter sample of
+     * the topic, including the samples already present in the reader. */
+    rc = dds_topic_lock(topic, &t);
+    if (rc != DDS_RETCODE_OK) {
+        hdl = DDS_ERRNO(rc, "Error occurred on locking topic");
+        goto fail;
+    }
+    if (t->m_stopic->filter_sample == NULL) {
+        t->m_stopic->filter_sample = dds_alloc(t->m_descriptor->m_size);
+    }
+    dds_topic_unlock(t);
+
     rc = dds_reader_lock(reader, &r);
     if (rc == DDS_RETCODE_OK) {
-        dds_readcond *cond = dds_create_readcond(r, DDS_KIND_COND_QUERY, mask);
+        dds_readcond *cond = dds_create_readcond(r, DDS_KIND_COND_QUERY, mask, filter, NULL);
         assert(cond);
         hdl = cond->m_entity.m_hdl;
-        cond->m_query.m_filter = filter;
-        topic = r->m_topic->m_entity.m_hdl;
         dds_reader_unlock(r);
-        rc = dds_topic_lock(topic, &t);
-        if (rc == DDS_RETCODE_OK) {
-            if (t->m_stopic->filter_sample == NULL) {
-                t->m_stopic->filter_sample = dds_alloc(t->m_descriptor->m_size);
-            }
-            dds_topic_unlock(t);
-        } else {
-            (void)dds_delete(hdl);
-            hdl = DDS_ERRNO(rc, "Error occurred on locking topic");
-        }
     } else {
         hdl = DDS_ERRNO(rc, "Error occurred on locking reader");
     }
+fail:
+    DDS_REPORT_FLUSH(hdl <= 0);
+    return hdl;
+}
+
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+DDS_EXPORT dds_entity_t
+dds_create_querycondition_fields(
+        _In_ dds_entity_t reader,
+        _In_ uint32_t mask,
+        _In_ uint32_t nterms,
+        _In_reads_(nterms) const dds_field_filter_t *terms)
+{
+    struct dds_stream_filter *filter;
+    dds_entity_t hdl;
+    dds__retcode_t rc;
+    dds_reader *r;
+
+    DDS_REPORT_STACK();
+
+    if ((nterms > 0) && (terms == NULL)) {
+        hdl = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Argument terms is NULL");
+        goto fail;
+    }
+    rc = dds_reader_lock(reader, &r);
+    if (rc != DDS_RETCODE_OK) {
+        hdl = DDS_ERRNO(rc, "Error occurred on locking reader");
+        goto fail;
+    }
+    filter = dds_stream_filter_new(r->m_topic->m_descriptor, nterms, terms);
+    if (filter != NULL) {
+        dds_readcond *cond = dds_create_readcond(r, DDS_KIND_COND_QUERY, mask, NULL, filter);
+        assert(cond);
+        hdl = cond->m_entity.m_hdl;
+    } else {
+        hdl = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Field filter does not match topic type");
+    }
+    dds_reader_unlock(r);
+fail:
     DDS_REPORT_FLUSH(hdl <= 0);
     return hdl;
 }
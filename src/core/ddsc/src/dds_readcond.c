@@ -15,6 +15,7 @@
 #include "dds__rhc.h"
 #include "dds__entity.h"
 #include "dds__err.h"
+#include "dds__stream.h"
 #include "ddsi/q_ephash.h"
 #include "ddsi/q_entity.h"
 #include "ddsi/q_thread.h"
@@ -24,7 +25,9 @@ static dds_return_t
 dds_readcond_delete(
         dds_entity *e)
 {
-    dds_rhc_remove_readcondition((dds_readcond*)e);
+    dds_readcond *cond = (dds_readcond*)e;
+    dds_rhc_remove_readcondition(cond);
+    dds_stream_filter_free(cond->m_query.m_fields);
     return DDS_RETCODE_OK;
 }
 
@@ -32,7 +35,9 @@ _Must_inspect_result_ dds_readcond*
 dds_create_readcond(
         _In_ dds_reader *rd,
         _In_ dds_entity_kind_t kind,
-        _In_ uint32_t mask)
+        _In_ uint32_t mask,
+        _In_opt_ dds_querycondition_filter_fn filter,
+        _In_opt_ struct dds_stream_filter *fields)
 {
     dds_readcond * cond = dds_alloc(sizeof(*cond));
     assert(kind == DDS_KIND_COND_READ || kind == DDS_KIND_COND_QUERY);
@@ -43,6 +48,8 @@ dds_create_readcond(
     cond->m_view_states = mask & DDS_ANY_VIEW_STATE;
     cond->m_instance_states = mask & DDS_ANY_INSTANCE_STATE;
     cond->m_rd_guid = ((dds_entity*)rd)->m_guid;
+    cond->m_query.m_filter = filter;
+    cond->m_query.m_fields = fields;
     dds_rhc_add_readcondition (cond);
     return cond;
 }
@@ -61,7 +68,7 @@ dds_create_readcondition(
 
     rc = dds_reader_lock(reader, &rd);
     if (rc == DDS_RETCODE_OK) {
-        dds_readcond *cond = dds_create_readcond(rd, DDS_KIND_COND_READ, mask);
+        dds_readcond *cond = dds_create_readcond(rd, DDS_KIND_COND_READ, mask, NULL, NULL);
         assert(cond);
         hdl = cond->m_entity.m_hdl;
         dds_reader_unlock(rd);
@@ -21,6 +21,7 @@
 #include "dds__err.h"
 #include "ddsi/q_entity.h"
 #include "ddsi/q_thread.h"
+#include "ddsi/q_lat_estim.h"
 #include "dds__report.h"
 #include "dds__builtin.h"
 
@@ -48,6 +49,17 @@ dds_reader_instance_hdl(
     return DDS_RETCODE_OK;
 }
 
+static dds_return_t
+dds_reader_statistics(
+        dds_entity *e,
+        dds_statistics_t *stats)
+{
+    assert(stats);
+    memset(stats, 0, sizeof(*stats));
+    dds_rhc_get_statistics(((dds_reader*)e)->m_rd->rhc, stats);
+    return DDS_RETCODE_OK;
+}
+
 static dds_return_t
 dds_reader_close(
         dds_entity *e)
@@ -435,6 +447,7 @@ dds_create_reader(
     rd->m_entity.m_deriver.set_qos = dds_reader_qos_set;
     rd->m_entity.m_deriver.validate_status = dds_reader_status_validate;
     rd->m_entity.m_deriver.get_instance_hdl = dds_reader_instance_hdl;
+    rd->m_entity.m_deriver.get_statistics = dds_reader_statistics;
 
     /* Extra claim of this reader to make sure that the delete waits until DDSI
      * has deleted its reader as well. This can be known through the callback. */
@@ -788,3 +801,72 @@ fail:
     DDS_REPORT_FLUSH(ret != DDS_RETCODE_OK);
     return ret;
 }
+
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+dds_return_t
+dds_get_latency_histogram (
+        _In_  dds_entity_t reader,
+        _In_  dds_latency_kind_t kind,
+        _Out_ dds_latency_histogram_t * hist)
+{
+    dds__retcode_t rc;
+    dds_reader *rd;
+    dds_return_t ret = DDS_RETCODE_OK;
+
+    DDS_REPORT_STACK();
+
+    if (hist == NULL || (kind != DDS_LATENCY_SOURCE_TO_STORE && kind != DDS_LATENCY_STORE_TO_TAKE)) {
+        ret = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Argument hist is NULL or kind is invalid");
+        goto fail;
+    }
+    rc = dds_reader_lock(reader, &rd);
+    if (rc != DDS_RETCODE_OK) {
+        ret = DDS_ERRNO(rc, "Error occurred on locking reader");
+        goto fail;
+    }
+    dds_rhc_get_latency_histogram(rd->m_rd->rhc, kind, hist);
+    dds_reader_unlock(rd);
+fail:
+    DDS_REPORT_FLUSH(ret != DDS_RETCODE_OK);
+    return ret;
+}
+
+_Pre_satisfies_((reader & DDS_ENTITY_KIND_MASK) == DDS_KIND_READER)
+dds_return_t
+dds_reset_latency_histograms (
+        _In_  dds_entity_t reader)
+{
+    dds__retcode_t rc;
+    dds_reader *rd;
+    dds_return_t ret = DDS_RETCODE_OK;
+
+    DDS_REPORT_STACK();
+
+    rc = dds_reader_lock(reader, &rd);
+    if (rc != DDS_RETCODE_OK) {
+        ret = DDS_ERRNO(rc, "Error occurred on locking reader");
+        goto fail;
+    }
+    dds_rhc_reset_latency_histograms(rd->m_rd->rhc);
+    dds_reader_unlock(rd);
+fail:
+    DDS_REPORT_FLUSH(ret != DDS_RETCODE_OK);
+    return ret;
+}
+
+dds_duration_t
+dds_latency_histogram_bucket_lower (
+        _In_  uint32_t index)
+{
+    assert(index < DDS_LATENCY_HISTOGRAM_BUCKETS);
+    return nn_lat_histogram_bucket_lower(index);
+}
+
+dds_duration_t
+dds_latency_histogram_percentile (
+        _In_  const dds_latency_histogram_t * hist,
+        _In_  double p)
+{
+    assert(hist);
+    return nn_lat_histogram_percentile(hist->buckets, p);
+}
@@ -12,19 +12,13 @@
 #include <assert.h>
 #include <string.h>
 
-#if HAVE_VALGRIND && ! defined (NDEBUG)
-#include <memcheck.h>
-#define USE_VALGRIND 1
-#else
-#define USE_VALGRIND 0
-#endif
-
 #include "os/os.h"
 
 #include "dds__entity.h"
 #include "dds__reader.h"
 #include "dds__rhc.h"
 #include "dds__tkmap.h"
+#include "dds__stream.h"
 #include "util/ut_hopscotch.h"
 
 #include "util/ut_avl.h"
@@ -36,6 +30,10 @@
 #include "ddsi/q_globals.h"
 #include "ddsi/q_radmin.h" /* sampleinfo */
 #include "ddsi/q_entity.h" /* proxy_writer_info */
+#include "ddsi/q_lat_estim.h"
+#include "ddsi/q_sampletrace.h"
+#include "ddsi/q_static_assert.h"
+#include "ddsi/q_time.h"
 #include "ddsi/sysdeps.h"
 #include "dds__report.h"
 
@@ -91,11 +89,16 @@
    QOS SUPPORT
    ===========
 
-   History is implemented as a (circular) linked list, but the invalid samples
-   model implemented here allows this to trivially be changed to an array of
-   samples, and this is probably profitable for shallow histories.  Currently
-   the instance has a single sample embedded in particular to optimise the
-   KEEP_LAST with depth=1 case.
+   History is implemented as a ring buffer of samples per instance, ordered
+   from old to new starting at "hist_first".  The first few slots are
+   embedded in the instance (as many as the history depth requires, up to
+   RHC_INLINE_HISTORY_DEPTH), so that in particular the KEEP_LAST with
+   depth=1 case never allocates.  Deeper histories move to a separately
+   allocated array on demand, doubling in size until it reaches the history
+   depth.  In the KEEP_LAST case, once the history is full, the oldest slot
+   is simply overwritten and "hist_first" advanced.  Taking samples compacts
+   the remaining ones in place, which costs nothing when the samples taken
+   are a prefix or a suffix of the history.
 
    BY_SOURCE ordering is implemented differently from OpenSplice and does not
    perform back-filling of the history.  The arguments against that can be
@@ -144,6 +147,24 @@
    from 0 to 1, as this indicates the attached waitsets must be signalled.
    The actual signalling of the waitsets then takes places later, by calling
    "signal_conditions" after releasing the RHC lock.
+
+   QUERY CONDITIONS
+   ================
+
+   Query conditions are read conditions with a filter. The first
+   RHC_MAX_QCONDS query conditions on a reader are each assigned a bit, and
+   the filters of those are evaluated once, when a sample is stored (or when
+   the condition is created, for the samples already present). The result is
+   kept in the sample ("conds"), so reading or taking through such a query
+   condition only needs to test a bit in each sample. Any further query
+   conditions evaluate their filter at the time of reading.
+
+   The trigger of a query condition with a bit counts the number of samples
+   (invalid samples included) matching it in instances of which the instance
+   and view states match. Most changes leave the instance and view states
+   alone, in which case the changes to the samples, recorded by bit in
+   "qc_delta", suffice for updating the triggers; if they do change, the
+   matching samples in the instance are counted.
 */
 
 static const status_cb_data_t dds_rhc_data_avail_cb_data = { DDS_DATA_AVAILABLE_STATUS, 0, 0, true };
@@ -214,13 +235,17 @@ static int lwregs_delete (struct lwregs *rt, uint64_t iid, uint64_t wr_iid)
  ******     RHC     ******
  *************************/
 
+#define RHC_INLINE_HISTORY_DEPTH 4
+#define RHC_MAX_QCONDS 32
+
 struct rhc_sample
 {
   struct serdata *sample;      /* serialised data (either just_key or real data) */
-  struct rhc_sample *next;     /* next sample in time ordering, or oldest sample if most recent */
   uint64_t wr_iid;             /* unique id for writer of this sample (perhaps better in serdata) */
   nn_wctime_t rtstamp;         /* reception timestamp (not really required; perhaps better in serdata) */
+  nn_mtime_t tstore;           /* time of insertion, for the store-to-take latency, 0 if not timed */
   bool isread;                 /* READ or NOT_READ sample state */
+  uint32_t conds;              /* query conditions matching this sample */
   unsigned disposed_gen;       /* snapshot of instance counter at time of insertion */
   unsigned no_writers_gen;     /* __/ */
 };
@@ -229,12 +254,14 @@ struct rhc_instance
 {
   uint64_t iid;                /* unique instance id, key of table, also serves as instance handle */
   uint64_t wr_iid;             /* unique of id of writer of latest sample or 0 */
-  struct rhc_sample *latest;   /* latest received sample; circular list old->new; null if no sample */
+  struct rhc_sample *samples;  /* history ring, either a_sample or a separately allocated array */
+  uint32_t hist_first;         /* index in samples of oldest sample (if nvsamples > 0) */
+  uint32_t hist_size;          /* number of slots in samples */
+  uint32_t hist_ninline;       /* number of slots in a_sample */
   unsigned nvsamples;          /* number of "valid" samples in instance */
   unsigned nvread;             /* number of READ "valid" samples in instance (0 <= nvread <= nvsamples) */
   uint32_t wrcount;            /* number of live writers */
   bool isnew;                  /* NEW or NOT_NEW view state */
-  bool a_sample_free;          /* whether or not a_sample is in use */
   bool isdisposed;             /* DISPOSED or NOT_DISPOSED (if not disposed, wrcount determines ALIVE/NOT_ALIVE_NO_WRITERS) */
   bool has_changed;            /* To track changes in an instance - if number of samples are added or data is overwritten */
   unsigned inv_exists : 1;     /* whether or not state change occurred since last sample (i.e., must return invalid sample) */
@@ -247,7 +274,7 @@ struct rhc_instance
   struct rhc_instance *next;   /* next non-empty instance in arbitrary ordering */
   struct rhc_instance *prev;
   struct tkmap_instance *tk;   /* backref into TK for unref'ing */
-  struct rhc_sample a_sample;  /* pre-allocated storage for 1 sample */
+  struct rhc_sample a_sample[]; /* pre-allocated storage for hist_ninline samples */
 };
 
 typedef enum rhc_store_result
@@ -267,6 +294,9 @@ struct rhc
   /* Instance/Sample maximums from resource limits QoS */
 
   os_atomic_uint32_t n_cbs;                /* # callbacks in progress */
+  os_atomic_uint32_t n_stored;             /* cum samples stored */
+  os_atomic_uint32_t n_rejected;           /* cum reliable samples rejected (to be retried by the caller) */
+  os_atomic_uint32_t n_dropped;            /* cum best-effort samples rejected (lost) */
   int32_t max_instances; /* FIXME: probably better as uint32_t with MAX_UINT32 for unlimited */
   int32_t max_samples;   /* FIXME: probably better as uint32_t with MAX_UINT32 for unlimited */
   int32_t max_samples_per_instance; /* FIXME: probably better as uint32_t with MAX_UINT32 for unlimited */
@@ -293,6 +323,24 @@ struct rhc
   os_mutex conds_lock;
   dds_readcond * conds;             /* List of associated read conditions */
   uint32_t nconds;                  /* Number of associated read conditions */
+  uint32_t qconds_mask;             /* Bits assigned to query conditions */
+
+  struct nn_lat_histogram lat_source_store; /* source timestamp to insertion (protected by lock) */
+  struct nn_lat_histogram lat_store_take;   /* insertion to take (protected by lock) */
+  uint32_t lat_nuntimed;                    /* samples stored since the last timed one (protected by lock) */
+
+  /* Changes to samples matching query conditions since the last call to
+     get_trigger_info for the pre-change state: per bit in "touched", the
+     changes in the number of read and unread samples matching it, and the
+     changes in the number of invalid samples (which match all) */
+  struct rhc_qc_delta
+  {
+    uint32_t touched;
+    int32_t nread[RHC_MAX_QCONDS];
+    int32_t nunread[RHC_MAX_QCONDS];
+    int32_t ninvread;
+    int32_t ninvunread;
+  } qc_delta;
 };
 
 struct trigger_info
@@ -313,7 +361,7 @@ struct trigger_info
 
 static unsigned qmask_of_inst (const struct rhc_instance *inst);
 static bool update_conditions_locked
-(struct rhc *rhc, const struct trigger_info *pre, const struct trigger_info *post, const struct serdata *sample);
+(struct rhc *rhc, const struct rhc_instance *inst, const struct trigger_info *pre, const struct trigger_info *post, const struct serdata *sample);
 static void signal_conditions (struct rhc *rhc);
 #ifndef NDEBUG
 static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds);
@@ -394,10 +442,49 @@ struct rhc * dds_rhc_new (dds_reader * reader, const struct sertopic * topic)
   rhc->instances = ut_hhNew (1, instance_iid_hash, instance_iid_eq);
   rhc->topic = topic;
   rhc->reader = reader;
+  nn_lat_histogram_init (&rhc->lat_source_store);
+  nn_lat_histogram_init (&rhc->lat_store_take);
 
   return rhc;
 }
 
+void dds_rhc_get_statistics (const struct rhc * rhc, dds_statistics_t * stats)
+{
+  /* Counters are updated outside the lock and there is no need for a
+     consistent snapshot, so simply load them */
+  stats->samples_received = os_atomic_ld32 (&rhc->n_stored);
+  stats->samples_rejected = os_atomic_ld32 (&rhc->n_rejected);
+  stats->samples_dropped = os_atomic_ld32 (&rhc->n_dropped);
+}
+
+void dds_rhc_get_latency_histogram (struct rhc * rhc, dds_latency_kind_t kind, dds_latency_histogram_t * hist)
+{
+  const struct nn_lat_histogram *lh = (kind == DDS_LATENCY_SOURCE_TO_STORE) ? &rhc->lat_source_store : &rhc->lat_store_take;
+  Q_STATIC_ASSERT_CODE (sizeof (hist->buckets) == sizeof (lh->count));
+  os_mutexLock (&rhc->lock);
+  memcpy (hist->buckets, lh->count, sizeof (hist->buckets));
+  os_mutexUnlock (&rhc->lock);
+  hist->count = nn_lat_histogram_total (hist->buckets);
+}
+
+void dds_rhc_reset_latency_histograms (struct rhc * rhc)
+{
+  os_mutexLock (&rhc->lock);
+  nn_lat_histogram_init (&rhc->lat_source_store);
+  nn_lat_histogram_init (&rhc->lat_store_take);
+  os_mutexUnlock (&rhc->lock);
+}
+
+static void rhc_record_take_latency (struct rhc *rhc, nn_mtime_t *tnow, const struct rhc_sample *sample)
+{
+  /* only read the clock if a timed sample is taken, once per take */
+  if (sample->tstore.v == 0)
+    return;
+  if (tnow->v == 0)
+    *tnow = now_mt ();
+  nn_lat_histogram_record (&rhc->lat_store_take, tnow->v - sample->tstore.v);
+}
+
 void dds_rhc_set_qos (struct rhc * rhc, const nn_xqos_t * qos)
 {
   /* Set read related QoS */
@@ -411,45 +498,86 @@ void dds_rhc_set_qos (struct rhc * rhc, const nn_xqos_t * qos)
   rhc->history_depth = (qos->history.kind == NN_KEEP_LAST_HISTORY_QOS) ? qos->history.depth : ~0u;
 }
 
-static struct rhc_sample * alloc_sample (struct rhc_instance *inst)
+static uint32_t inst_hist_index (const struct rhc_instance *inst, uint32_t i)
 {
-  if (inst->a_sample_free)
-  {
-    inst->a_sample_free = false;
-#if USE_VALGRIND
-    VALGRIND_MAKE_MEM_UNDEFINED (&inst->a_sample, sizeof (inst->a_sample));
-#endif
-    return &inst->a_sample;
-  }
-  else
-  {
-    /* This instead of sizeof(rhc_sample) gets us type checking */
-    struct rhc_sample *s;
-    s = dds_alloc (sizeof (*s));
-    return s;
-  }
+  /* Slot of the i-th oldest sample: i = 0 is the oldest, i = nvsamples-1 the latest */
+  const uint32_t idx = inst->hist_first + i;
+  assert (i < inst->hist_size);
+  return (idx >= inst->hist_size) ? idx - inst->hist_size : idx;
+}
+
+static struct rhc_sample *inst_sample (const struct rhc_instance *inst, uint32_t i)
+{
+  return &inst->samples[inst_hist_index (inst, i)];
+}
+
+static void inst_grow_history (const struct rhc *rhc, struct rhc_instance *inst)
+{
+  /* Move to a larger array, ordered old->new starting at index 0 */
+  const uint32_t max = rhc->history_depth;
+  const uint32_t size = (inst->hist_size < max / 2) ? 2 * inst->hist_size : max;
+  struct rhc_sample *samples;
+  uint32_t nfirst;
+  assert (inst->nvsamples == inst->hist_size && inst->hist_size < max);
+  samples = dds_alloc (size * sizeof (*samples));
+  nfirst = inst->hist_size - inst->hist_first;
+  memcpy (samples, inst->samples + inst->hist_first, nfirst * sizeof (*samples));
+  memcpy (samples + nfirst, inst->samples, inst->hist_first * sizeof (*samples));
+  if (inst->samples != inst->a_sample)
+  {
+    dds_free (inst->samples);
+  }
+  inst->samples = samples;
+  inst->hist_first = 0;
+  inst->hist_size = size;
+}
+
+static void qc_delta_reset (struct rhc *rhc)
+{
+  rhc->qc_delta.touched = 0;
+  rhc->qc_delta.ninvread = 0;
+  rhc->qc_delta.ninvunread = 0;
+}
+
+static bool qc_delta_pending (const struct rhc *rhc)
+{
+  return rhc->qc_delta.touched != 0 || rhc->qc_delta.ninvread != 0 || rhc->qc_delta.ninvunread != 0;
 }
 
-static void free_sample (struct rhc_instance *inst, struct rhc_sample *s)
+static void qc_delta_sample (struct rhc *rhc, uint32_t conds, bool isread, int32_t d)
 {
-  ddsi_serdata_unref (s->sample);
-  if (s == &inst->a_sample)
+  struct rhc_qc_delta * const qcd = &rhc->qc_delta;
+  uint32_t b;
+  for (b = 0; conds; b++, conds >>= 1)
   {
-    assert (!inst->a_sample_free);
-#if USE_VALGRIND
-    VALGRIND_MAKE_MEM_NOACCESS (&inst->a_sample, sizeof (inst->a_sample));
-#endif
-    inst->a_sample_free = true;
+    if (conds & 1)
+    {
+      if (!(qcd->touched & (1u << b)))
+      {
+        qcd->touched |= 1u << b;
+        qcd->nread[b] = 0;
+        qcd->nunread[b] = 0;
+      }
+      if (isread)
+        qcd->nread[b] += d;
+      else
+        qcd->nunread[b] += d;
+    }
   }
+}
+
+static void qc_delta_invsample (struct rhc *rhc, bool isread, int32_t d)
+{
+  if (isread)
+    rhc->qc_delta.ninvread += d;
   else
-  {
-    dds_free (s);
-  }
+    rhc->qc_delta.ninvunread += d;
 }
 
 static void inst_clear_invsample (struct rhc *rhc, struct rhc_instance *inst)
 {
   assert (inst->inv_exists);
+  qc_delta_invsample (rhc, inst->inv_isread, -1);
   inst->inv_exists = 0;
   if (inst->inv_isread)
   {
@@ -473,21 +601,21 @@ static void inst_set_invsample (struct rhc *rhc, struct rhc_instance *inst)
   inst->inv_exists = 1;
   inst->inv_isread = 0;
   rhc->n_invsamples++;
+  qc_delta_invsample (rhc, false, 1);
 }
 
 static void free_instance (void *vnode, void *varg)
 {
   struct rhc *rhc = varg;
   struct rhc_instance *inst = vnode;
-  struct rhc_sample *s = inst->latest;
   const bool was_empty = INST_IS_EMPTY (inst);
-  if (s)
+  if (inst->nvsamples > 0)
   {
-    do {
-      struct rhc_sample * const s1 = s->next;
-      free_sample (inst, s);
-      s = s1;
-    } while (s != inst->latest);
+    uint32_t i;
+    for (i = 0; i < inst->nvsamples; i++)
+    {
+      ddsi_serdata_unref (inst_sample (inst, i)->sample);
+    }
     rhc->n_vsamples -= inst->nvsamples;
     rhc->n_vread -= inst->nvread;
     inst->nvsamples = 0;
@@ -498,6 +626,10 @@ static void free_instance (void *vnode, void *varg)
   {
     remove_inst_from_nonempty_list (rhc, inst);
   }
+  if (inst->samples != inst->a_sample)
+  {
+    dds_free (inst->samples);
+  }
   dds_tkmap_instance_unref (inst->tk);
   dds_free (inst);
 }
@@ -548,15 +680,17 @@ static void init_trigger_info_nonmatch (struct trigger_info *info)
   info->has_changed = false;
 }
 
-static void get_trigger_info (struct trigger_info *info, struct rhc_instance *inst, bool pre)
+static void get_trigger_info (struct rhc *rhc, struct trigger_info *info, struct rhc_instance *inst, bool pre)
 {
   info->qminst = qmask_of_inst (inst);
   info->has_read = INST_HAS_READ (inst);
   info->has_not_read = INST_HAS_UNREAD (inst);
-  /* reset instance has_changed before adding/overwriting a sample */
+  /* reset instance has_changed and the query condition changes before
+     adding/overwriting a sample */
   if (pre)
   {
     inst->has_changed = false;
+    qc_delta_reset (rhc);
   }
   info->has_changed = inst->has_changed;
 }
@@ -567,6 +701,48 @@ static bool trigger_info_differs (const struct trigger_info *pre, const struct t
          pre->has_changed != post->has_changed;
 }
 
+static bool conditions_affected (const struct rhc *rhc, const struct trigger_info *pre, const struct trigger_info *post)
+{
+  return trigger_info_differs (pre, post) || qc_delta_pending (rhc);
+}
+
+static uint32_t rhc_eval_qconds (const struct rhc *rhc, const struct serdata *sample, uint32_t mask, bool deserialised)
+{
+  /* Evaluates the filters of the query conditions with a bit in mask, the
+     sample may already have been deserialised into the filter sample by the
+     content filter */
+  const dds_readcond *iter;
+  uint32_t conds = 0;
+
+  for (iter = rhc->conds; iter != NULL; iter = iter->m_rhc_next)
+  {
+    if ((iter->m_query.m_qcmask & mask) == 0)
+    {
+      continue;
+    }
+    if (iter->m_query.m_fields != NULL)
+    {
+      if (dds_stream_filter_accepts (iter->m_query.m_fields, sample))
+      {
+        conds |= iter->m_query.m_qcmask;
+      }
+    }
+    else if (iter->m_query.m_filter != NULL)
+    {
+      if (!deserialised)
+      {
+        deserialize_into ((char*) rhc->topic->filter_sample, sample);
+        deserialised = true;
+      }
+      if (iter->m_query.m_filter (rhc->topic->filter_sample))
+      {
+        conds |= iter->m_query.m_qcmask;
+      }
+    }
+  }
+  return conds;
+}
+
 static bool add_sample
 (
   struct rhc * rhc,
@@ -586,17 +762,22 @@ static bool add_sample
 
   /* We don't do backfilling in BY_SOURCE mode -- we could, but
      choose not to -- and having already filtered out samples
-     preceding inst->latest, we can simply insert it without any
+     preceding the latest sample, we can simply insert it without any
      searching */
   if (inst->nvsamples == rhc->history_depth)
   {
-    /* replace oldest sample; latest points to the latest one, the
-       list is circular from old -> new, so latest->next is the oldest */
+    /* replace oldest sample; the history is full, so the slot of the
+       oldest one becomes that of the latest one by advancing hist_first */
 
     inst_clear_invsample_if_exists (rhc, inst);
-    assert (inst->latest != NULL);
-    s = inst->latest->next;
+    assert (inst->nvsamples > 0 && inst->hist_size == inst->nvsamples);
+    s = &inst->samples[inst->hist_first];
+    if (++inst->hist_first == inst->hist_size)
+    {
+      inst->hist_first = 0;
+    }
     ddsi_serdata_unref (s->sample);
+    qc_delta_sample (rhc, s->conds, s->isread, -1);
     if (s->isread)
     {
       inst->nvread--;
@@ -632,17 +813,12 @@ static bool add_sample
 
     /* add new latest sample */
 
-    s = alloc_sample (inst);
-    inst_clear_invsample_if_exists (rhc, inst);
-    if (inst->latest == NULL)
+    if (inst->nvsamples == inst->hist_size)
     {
-      s->next = s;
-    }
-    else
-    {
-      s->next = inst->latest->next;
-      inst->latest->next = s;
+      inst_grow_history (rhc, inst);
     }
+    inst_clear_invsample_if_exists (rhc, inst);
+    s = inst_sample (inst, inst->nvsamples);
     inst->nvsamples++;
     rhc->n_vsamples++;
   }
@@ -650,10 +826,23 @@ static bool add_sample
   s->sample = ddsi_serdata_ref ((serdata_t) sample); /* drops const (tho refcount does change) */
   s->wr_iid = sampleinfo->pwr_info.iid;
   s->rtstamp = sampleinfo->reception_timestamp;
+  if (config.lat_histogram_interval > 0 && ++rhc->lat_nuntimed >= config.lat_histogram_interval)
+  {
+    rhc->lat_nuntimed = 0;
+    s->tstore = now_mt ();
+    nn_lat_histogram_record (&rhc->lat_source_store, now ().v - sample->v.msginfo.timestamp.v);
+  }
+  else
+  {
+    s->tstore.v = 0;
+  }
+  if (sample->v.trace_id)
+    nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_RHC_STORE, NULL, 0, sample->v.trace_id);
   s->isread = false;
   s->disposed_gen = inst->disposed_gen;
   s->no_writers_gen = inst->no_writers_gen;
-  inst->latest = s;
+  s->conds = (rhc->qconds_mask == 0) ? 0 : rhc_eval_qconds (rhc, sample, rhc->qconds_mask, rhc->topic->filter_fn != NULL);
+  qc_delta_sample (rhc, s->conds, false, 1);
 
   return true;
 }
@@ -662,7 +851,13 @@ static bool content_filter_accepts (const struct sertopic * topic, const struct
 {
   bool ret = true;
 
-  if (topic->filter_fn)
+  const struct dds_stream_filter *field_filter = os_atomic_ldvoidp (&topic->field_filter);
+
+  if (field_filter)
+  {
+    ret = dds_stream_filter_accepts (field_filter, sample);
+  }
+  if (ret && topic->filter_fn)
   {
     deserialize_into ((char*) topic->filter_sample, sample);
     ret = (topic->filter_fn) (topic->filter_sample, topic->filter_ctx);
@@ -670,6 +865,30 @@ static bool content_filter_accepts (const struct sertopic * topic, const struct
   return ret;
 }
 
+/* A query condition with a bit has been evaluated when the sample was
+   stored. Otherwise, one with a field filter is evaluated on the serialised
+   sample, so that samples it rejects need not be deserialised, and one with a
+   filter function is evaluated on the deserialised sample. */
+
+static bool cond_accepts_serialised (const dds_readcond * cond, const struct rhc_sample * sample)
+{
+  if (cond == NULL || dds_entity_kind (cond->m_entity.m_hdl) != DDS_KIND_COND_QUERY)
+    return true;
+  else if (cond->m_query.m_qcmask != 0)
+    return (sample->conds & cond->m_query.m_qcmask) != 0;
+  else
+    return cond->m_query.m_fields == NULL || dds_stream_filter_accepts (cond->m_query.m_fields, sample->sample);
+}
+
+static bool cond_accepts_deserialised (const dds_readcond * cond, const void * sample)
+{
+  return cond == NULL
+    || dds_entity_kind (cond->m_entity.m_hdl) != DDS_KIND_COND_QUERY
+    || cond->m_query.m_qcmask != 0
+    || cond->m_query.m_fields != NULL
+    || (cond->m_query.m_filter != NULL && cond->m_query.m_filter (sample));
+}
+
 static int inst_accepts_sample_by_writer_guid (const struct rhc_instance *inst, const struct nn_rsample_info *sampleinfo)
 {
   return inst->wr_iid == sampleinfo->pwr_info.iid ||
@@ -946,7 +1165,7 @@ static int rhc_unregister_updateinst
        unread, we don't bother, even though it means the application
        won't see the timestamp for the unregister event. It shouldn't
        care.) */
-    if (inst->latest == NULL /*|| inst->latest->isread*/)
+    if (inst->nvsamples == 0 /*|| latest sample isread*/)
     {
       inst_set_invsample (rhc, inst);
       update_inst (rhc, inst, pwr_info, tstamp);
@@ -987,7 +1206,7 @@ static void dds_rhc_unregister
   if (!rhc_unregister_isreg_w_sideeffects (rhc, inst, pwr_info->iid))
   {
     /* other registrations remain */
-    get_trigger_info (post, inst, false);
+    get_trigger_info (rhc, post, inst, false);
   }
   else if (rhc_unregister_updateinst (rhc, inst, pwr_info, tstamp))
   {
@@ -997,7 +1216,7 @@ static void dds_rhc_unregister
   else
   {
     /* no writers remain, but instance not empty */
-    get_trigger_info (post, inst, false);
+    get_trigger_info (rhc, post, inst, false);
   }
 }
 
@@ -1009,24 +1228,29 @@ static struct rhc_instance * alloc_new_instance
   struct tkmap_instance *tk
 )
 {
+  const uint32_t ninline = (rhc->history_depth < RHC_INLINE_HISTORY_DEPTH) ? rhc->history_depth : RHC_INLINE_HISTORY_DEPTH;
   struct rhc_instance *inst;
 
   dds_tkmap_instance_ref (tk);
-  inst = dds_alloc (sizeof (*inst));
+  inst = dds_alloc (sizeof (*inst) + ninline * sizeof (inst->a_sample[0]));
   inst->iid = tk->m_iid;
+  inst->samples = inst->a_sample;
+  inst->hist_first = 0;
+  inst->hist_size = ninline;
+  inst->hist_ninline = ninline;
   inst->tk = tk;
   inst->wrcount = (serdata->v.msginfo.statusinfo & NN_STATUSINFO_UNREGISTER) ? 0 : 1;
   inst->isdisposed = (serdata->v.msginfo.statusinfo & NN_STATUSINFO_DISPOSE);
   inst->isnew = true;
   inst->inv_exists = 0;
   inst->inv_isread = 0; /* don't care */
-  inst->a_sample_free = true;
   update_inst (rhc, inst, &sampleinfo->pwr_info, serdata->v.msginfo.timestamp);
   return inst;
 }
 
 static rhc_store_result_t rhc_store_new_instance
 (
+  struct rhc_instance ** out_inst,
   struct trigger_info * post,
   struct rhc *rhc,
   const struct nn_rsample_info *sampleinfo,
@@ -1090,8 +1314,9 @@ static rhc_store_result_t rhc_store_new_instance
   assert (ret);
   (void) ret;
   rhc->n_instances++;
-  get_trigger_info (post, inst, false);
+  get_trigger_info (rhc, post, inst, false);
 
+  *out_inst = inst;
   return RHC_STORED;
 }
 
@@ -1150,7 +1375,7 @@ bool dds_rhc_store
     else
     {
       TRACE ((" new instance"));
-      stored = rhc_store_new_instance (&post, rhc, sampleinfo, sample, tk, has_data, &cb_data);
+      stored = rhc_store_new_instance (&inst, &post, rhc, sampleinfo, sample, tk, has_data, &cb_data);
       if (stored != RHC_STORED)
       {
         goto error_or_nochange;
@@ -1168,7 +1393,7 @@ bool dds_rhc_store
     TRACE ((" instance rejects sample"));
 
 
-    get_trigger_info (&pre, inst, true);
+    get_trigger_info (rhc, &pre, inst, true);
     if (has_data || is_dispose)
     {
       dds_rhc_register (rhc, inst, wr_iid, false);
@@ -1179,7 +1404,7 @@ bool dds_rhc_store
     }
     else
     {
-      get_trigger_info (&post, inst, false);
+      get_trigger_info (rhc, &post, inst, false);
     }
     /* notify sample lost */
 
@@ -1193,7 +1418,7 @@ bool dds_rhc_store
   }
   else
   {
-    get_trigger_info (&pre, inst, true);
+    get_trigger_info (rhc, &pre, inst, true);
 
     if (has_data || is_dispose)
     {
@@ -1259,7 +1484,7 @@ bool dds_rhc_store
       }
 
       /* If instance became disposed, add an invalid sample if there are no samples left */
-      if (inst_became_disposed && (inst->latest == NULL ))
+      if (inst_became_disposed && inst->nvsamples == 0)
         inst_set_invsample (rhc, inst);
 
       update_inst (rhc, inst, &sampleinfo->pwr_info, sample->v.msginfo.timestamp);
@@ -1269,7 +1494,7 @@ bool dds_rhc_store
          guaranteed that we end up with a non-empty instance: for
          example, if the instance was disposed & empty, nothing
          changes. */
-      if (inst->latest || inst_became_disposed)
+      if (inst->nvsamples > 0 || inst_became_disposed)
       {
         if (was_empty)
         {
@@ -1310,7 +1535,7 @@ bool dds_rhc_store
     }
     else
     {
-      get_trigger_info (&post, inst, false);
+      get_trigger_info (rhc, &post, inst, false);
     }
   }
 
@@ -1321,13 +1546,18 @@ bool dds_rhc_store
   {
     notify_data_available = false;
   }
-  trigger_waitsets = trigger_info_differs (&pre, &post)
-    && update_conditions_locked (rhc, &pre, &post, sample);
+  trigger_waitsets = conditions_affected (rhc, &pre, &post)
+    && update_conditions_locked (rhc, inst, &pre, &post, sample);
 
   assert (rhc_check_counts_locked (rhc, true));
 
   os_mutexUnlock (&rhc->lock);
 
+  if (has_data)
+  {
+    os_atomic_inc32 (&rhc->n_stored);
+  }
+
   if (notify_data_available && (trigger_info_differs (&pre, &post)))
   {
     if (rhc->reader && (rhc->reader->m_entity.m_status_enable & DDS_DATA_AVAILABLE_STATUS))
@@ -1355,6 +1585,11 @@ error_or_nochange:
   os_mutexUnlock (&rhc->lock);
   TRACE ((")\n"));
 
+  if (stored == RHC_REJECTED)
+  {
+    os_atomic_inc32 (delivered ? &rhc->n_dropped : &rhc->n_rejected);
+  }
+
   /* Make any reader status callback */
 
   if (cb_data.status && rhc->reader && rhc->reader->m_entity.m_status_enable)
@@ -1393,7 +1628,7 @@ void dds_rhc_unregister_wr
     if (inst->wr_iid == wr_iid || lwregs_contains (&rhc->registrations, inst->iid, wr_iid))
     {
       struct trigger_info pre, post;
-      get_trigger_info (&pre, inst, true);
+      get_trigger_info (rhc, &pre, inst, true);
 
       TRACE (("  %"PRIx64":", inst->iid));
 
@@ -1403,7 +1638,7 @@ void dds_rhc_unregister_wr
         inst->isdisposed = true;
 
         /* Set invalid sample for disposing it (unregister may also set it for unregistering) */
-        if (inst->latest)
+        if (inst->nvsamples > 0)
         {
           assert (!inst->inv_exists);
           rhc->n_not_alive_disposed++;
@@ -1424,9 +1659,9 @@ void dds_rhc_unregister_wr
 
       TRACE (("\n"));
 
-      if (trigger_info_differs (&pre, &post))
+      if (conditions_affected (rhc, &pre, &post))
       {
-        if (update_conditions_locked (rhc, &pre, &post, NULL))
+        if (update_conditions_locked (rhc, inst, &pre, &post, NULL))
         {
           trigger_waitsets = true;
         }
@@ -1603,6 +1838,23 @@ static void patch_generations (dds_sample_info_t *si, uint32_t last_of_inst)
   }
 }
 
+static struct rhc_instance *first_nonempty_instance (const struct rhc *rhc, dds_instance_handle_t handle)
+{
+  /* A specific instance is looked up directly in the instance table,
+     otherwise iteration starts at the head of the non-empty list */
+  if (handle == DDS_HANDLE_NIL)
+  {
+    return rhc->nonempty_instances ? rhc->nonempty_instances->next : NULL;
+  }
+  else
+  {
+    struct rhc_instance dummy_instance, *inst;
+    dummy_instance.iid = handle;
+    inst = ut_hhLookup (rhc->instances, &dummy_instance);
+    return (inst && !INST_IS_EMPTY (inst)) ? inst : NULL;
+  }
+}
+
 static int dds_rhc_read_w_qminv
 (
   struct rhc *rhc, bool lock, void ** values, dds_sample_info_t *info_seq,
@@ -1610,6 +1862,7 @@ static int dds_rhc_read_w_qminv
 )
 {
   bool trigger_waitsets = false;
+  struct rhc_instance *inst;
   uint32_t n = 0;
   const struct dds_topic_descriptor * desc = (const struct dds_topic_descriptor *) rhc->topic->type;
 
@@ -1624,98 +1877,90 @@ static int dds_rhc_read_w_qminv
     rhc->n_not_alive_no_writers, rhc->n_new, rhc->n_vsamples, rhc->n_invsamples,
     rhc->n_vread, rhc->n_invread));
 
-  if (rhc->nonempty_instances)
+  if ((inst = first_nonempty_instance (rhc, handle)) != NULL)
   {
-    struct rhc_instance * inst = rhc->nonempty_instances->next;
     struct rhc_instance * const end = inst;
     do
     {
-      if (handle == DDS_HANDLE_NIL || inst->iid == handle)
+      if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
       {
-        if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
-        {
-          /* samples present & instance, view state matches */
-          struct trigger_info pre, post;
-          const unsigned nread = INST_NREAD (inst);
-          const uint32_t n_first = n;
-          get_trigger_info (&pre, inst, true);
+        /* samples present & instance, view state matches */
+        struct trigger_info pre, post;
+        const unsigned nread = INST_NREAD (inst);
+        const uint32_t n_first = n;
+        get_trigger_info (rhc, &pre, inst, true);
 
-          if (inst->latest)
+        if (inst->nvsamples > 0)
+        {
+          uint32_t i;
+          for (i = 0; i < inst->nvsamples; i++)
           {
-            struct rhc_sample *sample = inst->latest->next, * const end1 = sample;
-            do
+            struct rhc_sample * const sample = inst_sample (inst, i);
+            if ((QMASK_OF_SAMPLE (sample) & qminv) == 0 && cond_accepts_serialised (cond, sample))
             {
-              if ((QMASK_OF_SAMPLE (sample) & qminv) == 0)
+              /* sample state matches too */
+              set_sample_info (info_seq + n, inst, sample);
+              deserialize_into ((char*) values[n], sample->sample);
+              if (cond_accepts_deserialised (cond, values[n]))
               {
-                /* sample state matches too */
-                set_sample_info (info_seq + n, inst, sample);
-                deserialize_into ((char*) values[n], sample->sample);
-                if (cond == NULL
-                    || (dds_entity_kind(cond->m_entity.m_hdl) != DDS_KIND_COND_QUERY)
-                    || (cond->m_query.m_filter != NULL && cond->m_query.m_filter(values[n])))
+                if (!sample->isread)
                 {
-                  if (!sample->isread)
-                  {
-                    TRACE (("s"));
-                    sample->isread = true;
-                    inst->nvread++;
-                    rhc->n_vread++;
-                  }
-
-                  if (++n == max_samples)
-                  {
-                    break;
-                  }
+                  TRACE (("s"));
+                  qc_delta_sample (rhc, sample->conds, false, -1);
+                  qc_delta_sample (rhc, sample->conds, true, 1);
+                  sample->isread = true;
+                  inst->nvread++;
+                  rhc->n_vread++;
                 }
-                else
+
+                if (++n == max_samples)
                 {
-                  /* The filter didn't match, so free the deserialised copy. */
-                  dds_sample_free(values[n], desc, DDS_FREE_CONTENTS);
+                  break;
                 }
               }
-              sample = sample->next;
+              else
+              {
+                /* The filter didn't match, so free the deserialised copy. */
+                dds_sample_free(values[n], desc, DDS_FREE_CONTENTS);
+              }
             }
-            while (sample != end1);
           }
+        }
 
-          if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
+        if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
+        {
+          set_sample_info_invsample (info_seq + n, inst);
+          deserialize_into ((char*) values[n], inst->tk->m_sample);
+          if (!inst->inv_isread)
           {
-            set_sample_info_invsample (info_seq + n, inst);
-            deserialize_into ((char*) values[n], inst->tk->m_sample);
-            if (!inst->inv_isread)
-            {
-              inst->inv_isread = 1;
-              rhc->n_invread++;
-            }
-            ++n;
+            qc_delta_invsample (rhc, false, -1);
+            qc_delta_invsample (rhc, true, 1);
+            inst->inv_isread = 1;
+            rhc->n_invread++;
           }
+          ++n;
+        }
 
-          if (n > n_first && inst->isnew)
-          {
-            inst->isnew = false;
-            rhc->n_new--;
-          }
-          if (nread != INST_NREAD (inst))
+        if (n > n_first && inst->isnew)
+        {
+          inst->isnew = false;
+          rhc->n_new--;
+        }
+        if (nread != INST_NREAD (inst))
+        {
+          get_trigger_info (rhc, &post, inst, false);
+          if (update_conditions_locked (rhc, inst, &pre, &post, NULL))
           {
-            get_trigger_info (&post, inst, false);
-            if (update_conditions_locked (rhc, &pre, &post, NULL))
-            {
-              trigger_waitsets = true;
-            }
-          }
-
-          if (n > n_first) {
-              patch_generations (info_seq + n_first, n - n_first - 1);
+            trigger_waitsets = true;
           }
         }
-        if (inst->iid == handle)
-        {
-          break;
+
+        if (n > n_first) {
+            patch_generations (info_seq + n_first, n - n_first - 1);
         }
       }
-      inst = inst->next;
     }
-    while (inst != end && n < max_samples);
+    while (handle == DDS_HANDLE_NIL && (inst = inst->next) != end && n < max_samples);
   }
   TRACE (("read: returning %u\n", n));
   assert (rhc_check_counts_locked (rhc, true));
@@ -1736,9 +1981,11 @@ static int dds_rhc_take_w_qminv
 )
 {
   bool trigger_waitsets = false;
+  struct rhc_instance *inst;
   uint64_t iid;
   uint32_t n = 0;
   const struct dds_topic_descriptor * desc = (const struct dds_topic_descriptor *) rhc->topic->type;
+  nn_mtime_t tnow = { 0 };
 
   if (lock)
   {
@@ -1751,131 +1998,122 @@ static int dds_rhc_take_w_qminv
     rhc->n_not_alive_no_writers, rhc->n_new, rhc->n_vsamples,
     rhc->n_invsamples, rhc->n_vread, rhc->n_invread));
 
-  if (rhc->nonempty_instances)
+  if ((inst = first_nonempty_instance (rhc, handle)) != NULL)
   {
-    struct rhc_instance *inst = rhc->nonempty_instances->next;
-    unsigned n_insts = rhc->n_nonempty_instances;
+    unsigned n_insts = (handle == DDS_HANDLE_NIL) ? rhc->n_nonempty_instances : 1;
     while (n_insts-- > 0 && n < max_samples)
     {
       struct rhc_instance * const inst1 = inst->next;
       iid = inst->iid;
-      if (handle == DDS_HANDLE_NIL || iid == handle)
+      if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
       {
-        if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
-        {
-          struct trigger_info pre, post;
-          unsigned nvsamples = inst->nvsamples;
-          const uint32_t n_first = n;
-          get_trigger_info (&pre, inst, true);
+        struct trigger_info pre, post;
+        const uint32_t n_first = n;
+        get_trigger_info (rhc, &pre, inst, true);
 
-          if (inst->latest)
+        if (inst->nvsamples > 0)
+        {
+          /* Samples not taken are moved down to close the gaps left by the
+             taken ones, preserving the order; nkeep is the number retained
+             and ndrop the number taken before the first retained one */
+          const uint32_t nvsamples = inst->nvsamples;
+          uint32_t i, nkeep = 0, ndrop = 0;
+          for (i = 0; i < nvsamples; i++)
           {
-            struct rhc_sample * psample = inst->latest;
-            struct rhc_sample * sample = psample->next;
-            while (nvsamples--)
-            {
-              struct rhc_sample * const sample1 = sample->next;
+            struct rhc_sample * const sample = inst_sample (inst, i);
+            bool take = false;
 
-              if ((QMASK_OF_SAMPLE (sample) & qminv) != 0)
+            if (n < max_samples && (QMASK_OF_SAMPLE (sample) & qminv) == 0 && cond_accepts_serialised (cond, sample))
+            {
+              set_sample_info (info_seq + n, inst, sample);
+              deserialize_into ((char*) values[n], sample->sample);
+              if (cond_accepts_deserialised (cond, values[n]))
               {
-                psample = sample;
+                take = true;
               }
               else
               {
-                set_sample_info (info_seq + n, inst, sample);
-                deserialize_into ((char*) values[n], sample->sample);
-                if (cond == NULL
-                    || (dds_entity_kind(cond->m_entity.m_hdl) != DDS_KIND_COND_QUERY)
-                    || ( cond->m_query.m_filter != NULL && cond->m_query.m_filter(values[n])))
-                {
-                  rhc->n_vsamples--;
-                  if (sample->isread)
-                  {
-                    inst->nvread--;
-                    rhc->n_vread--;
-                  }
-
-                  if (--inst->nvsamples > 0)
-                  {
-                    if (inst->latest == sample) {
-                      inst->latest = psample;
-                    }
-                    psample->next = sample1;
-                  }
-                  else
-                  {
-                    inst->latest = NULL;
-                  }
-
-                  free_sample (inst, sample);
-
-                  if (++n == max_samples)
-                  {
-                    break;
-                  }
-                }
-                else
-                {
-                  /* The filter didn't match, so free the deserialised copy. */
-                  dds_sample_free(values[n], desc, DDS_FREE_CONTENTS);
-                }
+                /* The filter didn't match, so free the deserialised copy. */
+                dds_sample_free(values[n], desc, DDS_FREE_CONTENTS);
               }
-              sample = sample1;
             }
-          }
 
-          if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
-          {
-            set_sample_info_invsample (info_seq + n, inst);
-            deserialize_into ((char*) values[n], inst->tk->m_sample);
-            inst_clear_invsample (rhc, inst);
-            ++n;
+            if (take)
+            {
+              rhc_record_take_latency (rhc, &tnow, sample);
+              if (sample->sample->v.trace_id)
+                nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_TAKE, NULL, 0, sample->sample->v.trace_id);
+              qc_delta_sample (rhc, sample->conds, sample->isread, -1);
+              rhc->n_vsamples--;
+              if (sample->isread)
+              {
+                inst->nvread--;
+                rhc->n_vread--;
+              }
+              ddsi_serdata_unref (sample->sample);
+              ndrop += (nkeep == 0);
+              ++n;
+            }
+            else
+            {
+              if (ndrop + nkeep != i)
+              {
+                *inst_sample (inst, ndrop + nkeep) = *sample;
+              }
+              nkeep++;
+            }
           }
+          inst->hist_first = (nkeep == 0) ? 0 : inst_hist_index (inst, ndrop);
+          inst->nvsamples = nkeep;
+        }
+
+        if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
+        {
+          set_sample_info_invsample (info_seq + n, inst);
+          deserialize_into ((char*) values[n], inst->tk->m_sample);
+          inst_clear_invsample (rhc, inst);
+          ++n;
+        }
+
+        if (n > n_first && inst->isnew)
+        {
+          inst->isnew = false;
+          rhc->n_new--;
+        }
 
-          if (n > n_first && inst->isnew)
+        if (n > n_first)
+        {
+          /* if nsamples = 0, it won't match anything, so no need to do
+             anything here for drop_instance_noupdate_no_writers */
+          get_trigger_info (rhc, &post, inst, false);
+          if (update_conditions_locked (rhc, inst, &pre, &post, NULL))
           {
-            inst->isnew = false;
-            rhc->n_new--;
+            trigger_waitsets = true;
           }
+        }
+
+        if (INST_IS_EMPTY (inst))
+        {
+          remove_inst_from_nonempty_list (rhc, inst);
 
-          if (n > n_first)
+          if (inst->isdisposed)
           {
-            /* if nsamples = 0, it won't match anything, so no need to do
-               anything here for drop_instance_noupdate_no_writers */
-            get_trigger_info (&post, inst, false);
-            if (update_conditions_locked (rhc, &pre, &post, NULL))
-            {
-              trigger_waitsets = true;
-            }
+            rhc->n_not_alive_disposed--;
           }
-
-          if (INST_IS_EMPTY (inst))
+          if (inst->wrcount == 0)
           {
-            remove_inst_from_nonempty_list (rhc, inst);
-
-            if (inst->isdisposed)
+            TRACE (("take: iid %"PRIx64" #0,empty,drop\n", iid));
+            if (!inst->isdisposed)
             {
-              rhc->n_not_alive_disposed--;
-            }
-            if (inst->wrcount == 0)
-            {
-              TRACE (("take: iid %"PRIx64" #0,empty,drop\n", iid));
-              if (!inst->isdisposed)
-              {
-                /* disposed has priority over no writers (why not just 2 bits?) */
-                rhc->n_not_alive_no_writers--;
-              }
-              drop_instance_noupdate_no_writers (rhc, inst);
+              /* disposed has priority over no writers (why not just 2 bits?) */
+              rhc->n_not_alive_no_writers--;
             }
-          }
-
-          if (n > n_first) {
-              patch_generations (info_seq + n_first, n - n_first - 1);
+            drop_instance_noupdate_no_writers (rhc, inst);
           }
         }
-        if (iid == handle)
-        {
-          break;
+
+        if (n > n_first) {
+            patch_generations (info_seq + n_first, n - n_first - 1);
         }
       }
       inst = inst1;
@@ -1900,8 +2138,10 @@ static int dds_rhc_takecdr_w_qminv
  )
 {
   bool trigger_waitsets = false;
+  struct rhc_instance *inst;
   uint64_t iid;
   uint32_t n = 0;
+  nn_mtime_t tnow = { 0 };
 
   if (lock)
   {
@@ -1914,117 +2154,105 @@ static int dds_rhc_takecdr_w_qminv
           rhc->n_not_alive_no_writers, rhc->n_new, rhc->n_vsamples,
           rhc->n_invsamples, rhc->n_vread, rhc->n_invread));
 
-  if (rhc->nonempty_instances)
+  if ((inst = first_nonempty_instance (rhc, handle)) != NULL)
   {
-    struct rhc_instance *inst = rhc->nonempty_instances->next;
-    unsigned n_insts = rhc->n_nonempty_instances;
+    unsigned n_insts = (handle == DDS_HANDLE_NIL) ? rhc->n_nonempty_instances : 1;
     while (n_insts-- > 0 && n < max_samples)
     {
       struct rhc_instance * const inst1 = inst->next;
       iid = inst->iid;
-      if (handle == DDS_HANDLE_NIL || iid == handle)
+      if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
       {
-        if (!INST_IS_EMPTY (inst) && (qmask_of_inst (inst) & qminv) == 0)
-        {
-          struct trigger_info pre, post;
-          unsigned nvsamples = inst->nvsamples;
-          const uint32_t n_first = n;
-          get_trigger_info (&pre, inst, true);
+        struct trigger_info pre, post;
+        const uint32_t n_first = n;
+        get_trigger_info (rhc, &pre, inst, true);
 
-          if (inst->latest)
+        if (inst->nvsamples > 0)
+        {
+          const uint32_t nvsamples = inst->nvsamples;
+          uint32_t i, nkeep = 0, ndrop = 0;
+          for (i = 0; i < nvsamples; i++)
           {
-            struct rhc_sample * psample = inst->latest;
-            struct rhc_sample * sample = psample->next;
-            while (nvsamples--)
-            {
-              struct rhc_sample * const sample1 = sample->next;
+            struct rhc_sample * const sample = inst_sample (inst, i);
 
-              if ((QMASK_OF_SAMPLE (sample) & qminv) != 0)
+            if (n < max_samples && (QMASK_OF_SAMPLE (sample) & qminv) == 0)
+            {
+              set_sample_info (info_seq + n, inst, sample);
+              /* reference taken over by values[n] */
+              values[n] = sample->sample;
+              rhc_record_take_latency (rhc, &tnow, sample);
+              if (sample->sample->v.trace_id)
+                nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_TAKE, NULL, 0, sample->sample->v.trace_id);
+              qc_delta_sample (rhc, sample->conds, sample->isread, -1);
+              rhc->n_vsamples--;
+              if (sample->isread)
               {
-                psample = sample;
+                inst->nvread--;
+                rhc->n_vread--;
               }
-              else
+              ndrop += (nkeep == 0);
+              ++n;
+            }
+            else
+            {
+              if (ndrop + nkeep != i)
               {
-                set_sample_info (info_seq + n, inst, sample);
-                values[n] = ddsi_serdata_ref(sample->sample);
-                rhc->n_vsamples--;
-                if (sample->isread)
-                {
-                  inst->nvread--;
-                  rhc->n_vread--;
-                }
-                free_sample (inst, sample);
-
-                if (--inst->nvsamples > 0)
-                {
-                  psample->next = sample1;
-                }
-                else
-                {
-                  inst->latest = NULL;
-                }
-
-                if (++n == max_samples)
-                {
-                  break;
-                }
+                *inst_sample (inst, ndrop + nkeep) = *sample;
               }
-              sample = sample1;
+              nkeep++;
             }
           }
+          inst->hist_first = (nkeep == 0) ? 0 : inst_hist_index (inst, ndrop);
+          inst->nvsamples = nkeep;
+        }
 
-          if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
-          {
-            set_sample_info_invsample (info_seq + n, inst);
-            values[n] = ddsi_serdata_ref(inst->tk->m_sample);
-            inst_clear_invsample (rhc, inst);
-            ++n;
-          }
+        if (inst->inv_exists && n < max_samples && (QMASK_OF_INVSAMPLE (inst) & qminv) == 0)
+        {
+          set_sample_info_invsample (info_seq + n, inst);
+          values[n] = ddsi_serdata_ref(inst->tk->m_sample);
+          inst_clear_invsample (rhc, inst);
+          ++n;
+        }
 
-          if (n > n_first && inst->isnew)
+        if (n > n_first && inst->isnew)
+        {
+          inst->isnew = false;
+          rhc->n_new--;
+        }
+
+        if (n > n_first)
+        {
+          /* if nsamples = 0, it won't match anything, so no need to do
+           anything here for drop_instance_noupdate_no_writers */
+          get_trigger_info (rhc, &post, inst, false);
+          if (update_conditions_locked (rhc, inst, &pre, &post, NULL))
           {
-            inst->isnew = false;
-            rhc->n_new--;
+            trigger_waitsets = true;
           }
+        }
+
+        if (INST_IS_EMPTY (inst))
+        {
+          remove_inst_from_nonempty_list (rhc, inst);
 
-          if (n > n_first)
+          if (inst->isdisposed)
           {
-            /* if nsamples = 0, it won't match anything, so no need to do
-             anything here for drop_instance_noupdate_no_writers */
-            get_trigger_info (&post, inst, false);
-            if (update_conditions_locked (rhc, &pre, &post, NULL))
-            {
-              trigger_waitsets = true;
-            }
+            rhc->n_not_alive_disposed--;
           }
-
-          if (INST_IS_EMPTY (inst))
+          if (inst->wrcount == 0)
           {
-            remove_inst_from_nonempty_list (rhc, inst);
-
-            if (inst->isdisposed)
+            TRACE (("take: iid %"PRIx64" #0,empty,drop\n", iid));
+            if (!inst->isdisposed)
             {
-              rhc->n_not_alive_disposed--;
+              /* disposed has priority over no writers (why not just 2 bits?) */
+              rhc->n_not_alive_no_writers--;
             }
-            if (inst->wrcount == 0)
-            {
-              TRACE (("take: iid %"PRIx64" #0,empty,drop\n", iid));
-              if (!inst->isdisposed)
-              {
-                /* disposed has priority over no writers (why not just 2 bits?) */
-                rhc->n_not_alive_no_writers--;
-              }
-              drop_instance_noupdate_no_writers (rhc, inst);
-            }
-          }
-
-          if (n > n_first) {
-              patch_generations (info_seq + n_first, n - n_first - 1);
+            drop_instance_noupdate_no_writers (rhc, inst);
           }
         }
-        if (iid == handle)
-        {
-          break;
+
+        if (n > n_first) {
+            patch_generations (info_seq + n_first, n - n_first - 1);
         }
       }
       inst = inst1;
@@ -2068,6 +2296,45 @@ static uint32_t rhc_get_cond_trigger (struct rhc_instance * const inst, const dd
   return m ? 1 : 0;
 }
 
+static uint32_t rhc_get_qcond_trigger (const struct rhc_instance * const inst, const dds_readcond * const c)
+{
+  /* Number of samples in inst matching query condition c, ignoring the
+     instance and view states */
+  uint32_t i, m = 0;
+  assert (c->m_query.m_qcmask != 0);
+  for (i = 0; i < inst->nvsamples; i++)
+  {
+    const struct rhc_sample *sample = inst_sample (inst, i);
+    if ((sample->conds & c->m_query.m_qcmask) && (QMASK_OF_SAMPLE (sample) & c->m_qminv) == 0)
+    {
+      m++;
+    }
+  }
+  if (inst->inv_exists && (QMASK_OF_INVSAMPLE (inst) & c->m_qminv) == 0)
+  {
+    m++;
+  }
+  return m;
+}
+
+static int32_t qc_delta_of_cond (const struct rhc *rhc, const dds_readcond * const c)
+{
+  const struct rhc_qc_delta *qcd = &rhc->qc_delta;
+  const bool read = (c->m_qminv & DDS_READ_SAMPLE_STATE) == 0;
+  const bool unread = (c->m_qminv & DDS_NOT_READ_SAMPLE_STATE) == 0;
+  int32_t d = (read ? qcd->ninvread : 0) + (unread ? qcd->ninvunread : 0);
+  if (qcd->touched & c->m_query.m_qcmask)
+  {
+    uint32_t b = 0;
+    while (!(c->m_query.m_qcmask & (1u << b)))
+    {
+      b++;
+    }
+    d += (read ? qcd->nread[b] : 0) + (unread ? qcd->nunread[b] : 0);
+  }
+  return d;
+}
+
 void dds_rhc_add_readcondition (dds_readcond * cond)
 {
   /* On the assumption that a readcondition will be attached to a
@@ -2082,26 +2349,53 @@ void dds_rhc_add_readcondition (dds_readcond * cond)
   cond->m_qminv = qmask_from_dcpsquery (cond->m_sample_states, cond->m_view_states, cond->m_instance_states);
 
   os_mutexLock (&rhc->lock);
+  os_mutexLock (&rhc->conds_lock);
+  cond->m_rhc_next = rhc->conds;
+  rhc->nconds++;
+  rhc->conds = cond;
+  os_mutexUnlock (&rhc->conds_lock);
+
+  if (dds_entity_kind (cond->m_entity.m_hdl) == DDS_KIND_COND_QUERY && rhc->qconds_mask != ~0u)
+  {
+    /* Assign a free bit and evaluate the filter on the samples present */
+    uint32_t b = 0;
+    while (rhc->qconds_mask & (1u << b))
+    {
+      b++;
+    }
+    cond->m_query.m_qcmask = 1u << b;
+    rhc->qconds_mask |= cond->m_query.m_qcmask;
+  }
+
   for (inst = ut_hhIterFirst (rhc->instances, &iter); inst; inst = ut_hhIterNext (&iter))
   {
     if (dds_entity_kind(cond->m_entity.m_hdl) == DDS_KIND_COND_READ)
     {
       ((dds_entity*)cond)->m_trigger += rhc_get_cond_trigger (inst, cond);
-      if (((dds_entity*)cond)->m_trigger) {
-        dds_entity_status_signal((dds_entity*)cond);
+    }
+    else if (cond->m_query.m_qcmask != 0)
+    {
+      uint32_t i;
+      for (i = 0; i < inst->nvsamples; i++)
+      {
+        struct rhc_sample *sample = inst_sample (inst, i);
+        sample->conds |= rhc_eval_qconds (rhc, sample->sample, cond->m_query.m_qcmask, false);
+      }
+      if ((qmask_of_inst (inst) & cond->m_qminv) == 0)
+      {
+        ((dds_entity*)cond)->m_trigger += rhc_get_qcond_trigger (inst, cond);
       }
     }
   }
-  os_mutexLock (&rhc->conds_lock);
-  cond->m_rhc_next = rhc->conds;
-  rhc->nconds++;
-  rhc->conds = cond;
+  if (((dds_entity*)cond)->m_trigger) {
+    dds_entity_status_signal((dds_entity*)cond);
+  }
 
-  TRACE (("add_readcondition(%p, %x, %x, %x) => %p qminv %x ; rhc %u conds\n",
+  TRACE (("add_readcondition(%p, %x, %x, %x) => %p qminv %x qcmask %x ; rhc %u conds\n",
     (void *) rhc, cond->m_sample_states, cond->m_view_states,
-    cond->m_instance_states, cond, cond->m_qminv, rhc->nconds));
+    cond->m_instance_states, cond, cond->m_qminv, cond->m_query.m_qcmask, rhc->nconds));
 
-  os_mutexUnlock (&rhc->conds_lock);
+  assert (rhc_check_counts_locked (rhc, true));
   os_mutexUnlock (&rhc->lock);
 }
 
@@ -2133,17 +2427,36 @@ void dds_rhc_remove_readcondition (dds_readcond * cond)
     iter = iter->m_rhc_next;
   }
   os_mutexUnlock (&rhc->conds_lock);
+
+  if (cond->m_query.m_qcmask != 0)
+  {
+    /* Release the bit, the samples may no longer refer to it */
+    struct ut_hhIter hhiter;
+    struct rhc_instance *inst;
+    for (inst = ut_hhIterFirst (rhc->instances, &hhiter); inst; inst = ut_hhIterNext (&hhiter))
+    {
+      uint32_t i;
+      for (i = 0; i < inst->nvsamples; i++)
+      {
+        inst_sample (inst, i)->conds &= ~cond->m_query.m_qcmask;
+      }
+    }
+    rhc->qconds_mask &= ~cond->m_query.m_qcmask;
+    cond->m_query.m_qcmask = 0;
+  }
   os_mutexUnlock (&rhc->lock);
 }
 
 static bool update_conditions_locked
 (
-  struct rhc *rhc, const struct trigger_info *pre,
+  struct rhc *rhc, const struct rhc_instance *inst,
+  const struct trigger_info *pre,
   const struct trigger_info *post,
   const struct serdata *sample
 )
 {
-  /* Pre: rhc->lock held; returns 1 if triggering required, else 0. */
+  /* Pre: rhc->lock held; returns 1 if triggering required, else 0.
+     inst may no longer exist if post->qminst = ~0u (instance dropped). */
   bool trigger = false;
   dds_readcond * iter;
   int m_pre;
@@ -2161,6 +2474,42 @@ static bool update_conditions_locked
   iter = rhc->conds;
   while (iter)
   {
+    if (iter->m_query.m_qcmask != 0)
+    {
+      /* Query condition counting samples: if the instance matches both before
+         and after, only the changes to the samples matter, else all samples
+         in the instance that match (after the change) count */
+      const bool g_pre = (pre->qminst != ~0u) && ((pre->qminst & iter->m_qminv) == 0);
+      const bool g_post = (post->qminst != ~0u) && ((post->qminst & iter->m_qminv) == 0);
+      const int32_t d = qc_delta_of_cond (rhc, iter);
+      int32_t mdelta = 0;
+      if (g_pre && g_post)
+        mdelta = d;
+      else if (g_post)
+        mdelta = (int32_t) rhc_get_qcond_trigger (inst, iter);
+      else if (g_pre)
+        mdelta = d - ((post->qminst == ~0u) ? 0 : (int32_t) rhc_get_qcond_trigger (inst, iter));
+
+      TRACE (("  qcond %p: %+"PRId32, (void *) iter, mdelta));
+      if (mdelta != 0)
+      {
+        const uint32_t old_trigger = iter->m_entity.m_trigger;
+        assert (mdelta > 0 || old_trigger >= (uint32_t) -mdelta);
+        iter->m_entity.m_trigger = (uint32_t) ((int32_t) old_trigger + mdelta);
+        if (old_trigger == 0 && iter->m_entity.m_trigger > 0)
+        {
+          TRACE ((" (cond now triggers)"));
+          trigger = true;
+        }
+      }
+      if (iter->m_entity.m_trigger) {
+        dds_entity_status_signal(&(iter->m_entity));
+      }
+      TRACE (("\n"));
+      iter = iter->m_rhc_next;
+      continue;
+    }
+
     m_pre = ((pre->qminst & iter->m_qminv) == 0);
     m_post = ((post->qminst & iter->m_qminv) == 0);
 
@@ -2191,7 +2540,7 @@ static bool update_conditions_locked
     }
     else if (m_pre < m_post)
     {
-      if (sample && !deserialised && (dds_entity_kind(iter->m_entity.m_hdl) == DDS_KIND_COND_QUERY))
+      if (sample && !deserialised && (dds_entity_kind(iter->m_entity.m_hdl) == DDS_KIND_COND_QUERY) && iter->m_query.m_fields == NULL)
       {
         deserialize_into ((char*)rhc->topic->filter_sample, sample);
         deserialised = true;
@@ -2200,6 +2549,7 @@ static bool update_conditions_locked
       (
         (sample == NULL)
         || (dds_entity_kind(iter->m_entity.m_hdl) != DDS_KIND_COND_QUERY)
+        || (iter->m_query.m_fields != NULL && dds_stream_filter_accepts (iter->m_query.m_fields, sample))
         || (iter->m_query.m_filter != NULL && iter->m_query.m_filter (rhc->topic->filter_sample))
       )
       {
@@ -2301,7 +2651,6 @@ static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds)
     {
       /* samples present (or an invalid sample is) */
       unsigned n_vsamples_in_instance = 0, n_read_vsamples_in_instance = 0;
-      bool a_sample_free = true;
 
       n_nonempty_instances++;
       if (inst->isdisposed)
@@ -2315,24 +2664,19 @@ static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds)
         n_new++;
       }
 
-      if (inst->latest)
+      assert (inst->nvsamples <= inst->hist_size);
+      assert (inst->hist_first < inst->hist_size || inst->hist_size == 0);
+      assert ((inst->samples == inst->a_sample) == (inst->hist_size == inst->hist_ninline));
+      for (i = 0; i < inst->nvsamples; i++)
       {
-        struct rhc_sample *sample = inst->latest->next, * const end = sample;
-        do {
-          if (sample == &inst->a_sample)
-          {
-            assert (a_sample_free);
-            a_sample_free = false;
-          }
-          n_vsamples++;
-          n_vsamples_in_instance++;
-          if (sample->isread)
-          {
-            n_vread++;
-            n_read_vsamples_in_instance++;
-          }
-          sample = sample->next;
-        } while (sample != end);
+        const struct rhc_sample *sample = inst_sample (inst, i);
+        n_vsamples++;
+        n_vsamples_in_instance++;
+        if (sample->isread)
+        {
+          n_vread++;
+          n_read_vsamples_in_instance++;
+        }
       }
 
       if (inst->inv_exists)
@@ -2343,7 +2687,6 @@ static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds)
 
       assert (n_read_vsamples_in_instance == inst->nvread);
       assert (n_vsamples_in_instance == inst->nvsamples);
-      assert (a_sample_free == inst->a_sample_free);
 
       {
         dds_readcond * rciter = rhc->conds;
@@ -2353,6 +2696,10 @@ static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds)
           {
             cond_match_count[i] += rhc_get_cond_trigger (inst, rciter);
           }
+          else if (rciter->m_query.m_qcmask != 0 && (qmask_of_inst (inst) & rciter->m_qminv) == 0)
+          {
+            cond_match_count[i] += rhc_get_qcond_trigger (inst, rciter);
+          }
           rciter = rciter->m_rhc_next;
         }
       }
@@ -2374,7 +2721,7 @@ static int rhc_check_counts_locked (struct rhc *rhc, bool check_conds)
     dds_readcond * rciter = rhc->conds;
     for (i = 0; i < (rhc->nconds < CHECK_MAX_CONDS ? rhc->nconds : CHECK_MAX_CONDS); i++)
     {
-      if (dds_entity_kind(rciter->m_entity.m_hdl) == DDS_KIND_COND_READ)
+      if (dds_entity_kind(rciter->m_entity.m_hdl) == DDS_KIND_COND_READ || rciter->m_query.m_qcmask != 0)
       {
         assert (cond_match_count[i] == rciter->m_entity.m_trigger);
       }
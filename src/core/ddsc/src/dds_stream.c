@@ -1668,3 +1668,460 @@ void dds_stream_read_key
     }
   }
 }
+
+/*
+  Field filters: a conjunction of comparisons of top-level primitive and
+  string fields with constants, evaluated on the serialised representation
+  so that rejected samples need not be deserialised.
+
+  The fields are located by walking the ops of the type once, when the
+  filter is created. As long as only fixed-size fields precede a field, its
+  position in the CDR is known up front; otherwise the preceding strings and
+  sequences are skipped when the filter is evaluated. Any other kind of field
+  (structs, unions, sequences of structs, ...) ends the walk, and so fields
+  following it can't be used in a filter.
+*/
+
+#define DDS_STREAM_FILTER_DYNAMIC UINT32_MAX
+#define DDS_STREAM_FILTER_NOKEY UINT32_MAX
+
+struct dds_stream_filter_term
+{
+  const uint32_t * m_op;        /* ADR op of the field */
+  uint32_t m_pos;               /* CDR offset of field or DDS_STREAM_FILTER_DYNAMIC */
+  uint32_t m_key;               /* index in m_keys or DDS_STREAM_FILTER_NOKEY */
+  dds_field_filter_kind_t m_kind;
+  dds_field_filter_op_t m_cmp;
+  union { int64_t i; uint64_t u; double f; char * s; } m_value;
+};
+
+struct dds_stream_filter
+{
+  const dds_topic_descriptor_t * m_desc;
+  bool m_dynamic;
+  uint32_t m_nterms;
+  struct dds_stream_filter_term m_terms[];
+};
+
+/* Number of words in a top-level op that the filter can skip, 0 otherwise */
+
+static uint32_t dds_stream_filter_op_len (const uint32_t * op)
+{
+  if (DDS_OP (*op) != DDS_OP_ADR)
+  {
+    return 0;
+  }
+  switch (DDS_OP_TYPE (*op))
+  {
+    case DDS_OP_VAL_1BY:
+    case DDS_OP_VAL_2BY:
+    case DDS_OP_VAL_4BY:
+    case DDS_OP_VAL_8BY:
+    case DDS_OP_VAL_STR:
+      return 2;
+    case DDS_OP_VAL_BST:
+      return 3;
+    case DDS_OP_VAL_SEQ:
+    case DDS_OP_VAL_ARR:
+    {
+      const uint32_t len = (DDS_OP_TYPE (*op) == DDS_OP_VAL_ARR) ? 3 : 2;
+      switch (DDS_OP_SUBTYPE (*op))
+      {
+        case DDS_OP_VAL_1BY:
+        case DDS_OP_VAL_2BY:
+        case DDS_OP_VAL_4BY:
+        case DDS_OP_VAL_8BY:
+        case DDS_OP_VAL_STR:
+          return len;
+        case DDS_OP_VAL_BST:
+          /* an array of bounded strings has a padding word before the bound */
+          return (DDS_OP_TYPE (*op) == DDS_OP_VAL_ARR) ? 5 : 3;
+        default:
+          return 0;
+      }
+    }
+    default:
+      return 0;
+  }
+}
+
+static bool dds_stream_filter_term_fits (const dds_field_filter_t * term, const uint32_t * op)
+{
+  const uint32_t type = DDS_OP_TYPE (*op);
+  switch (term->m_kind)
+  {
+    case DDS_FIELD_FILTER_INT:
+    case DDS_FIELD_FILTER_UINT:
+      return type >= DDS_OP_VAL_1BY && type <= DDS_OP_VAL_8BY;
+    case DDS_FIELD_FILTER_FLOAT:
+      return type == DDS_OP_VAL_4BY || type == DDS_OP_VAL_8BY;
+    case DDS_FIELD_FILTER_STRING:
+      return (type == DDS_OP_VAL_STR || type == DDS_OP_VAL_BST) && term->m_value.s != NULL;
+  }
+  return false;
+}
+
+static uint32_t dds_stream_filter_key_index (const dds_topic_descriptor_t * desc, const uint32_t * op)
+{
+  uint32_t k;
+  if (*op & DDS_OP_FLAG_KEY)
+  {
+    for (k = 0; k < desc->m_nkeys; k++)
+    {
+      if (desc->m_ops + desc->m_keys[k].m_index == op)
+      {
+        return k;
+      }
+    }
+  }
+  return DDS_STREAM_FILTER_NOKEY;
+}
+
+struct dds_stream_filter * dds_stream_filter_new
+(
+  const dds_topic_descriptor_t * desc,
+  uint32_t nterms,
+  const dds_field_filter_t * terms
+)
+{
+  struct dds_stream_filter * filter;
+  const uint32_t * op = desc->m_ops;
+  uint32_t pos = 0, nfound = 0, len, i;
+  bool fixed = true;
+  bool * found;
+
+  for (i = 0; i < nterms; i++)
+  {
+    if ((unsigned) terms[i].m_op > DDS_FIELD_FILTER_GE)
+    {
+      return NULL;
+    }
+  }
+
+  /* Terms are stored in the order of the fields in the type, which allows
+     evaluating them in a single pass over the serialised data */
+  found = dds_alloc (nterms * sizeof (*found) + 1);
+  filter = dds_alloc (sizeof (*filter) + nterms * sizeof (filter->m_terms[0]));
+  filter->m_desc = desc;
+  filter->m_nterms = nterms;
+  while (nfound < nterms && (len = dds_stream_filter_op_len (op)) > 0)
+  {
+    const uint32_t type = DDS_OP_TYPE (*op);
+    uint32_t size = 0, align = 1;
+    if (type <= DDS_OP_VAL_8BY)
+    {
+      size = align = dds_op_size[type];
+    }
+    else if (type == DDS_OP_VAL_ARR && DDS_OP_SUBTYPE (*op) <= DDS_OP_VAL_8BY)
+    {
+      align = dds_op_size[DDS_OP_SUBTYPE (*op)];
+      size = op[2] * align;
+    }
+    pos = (pos + align - 1) & ~(align - 1);
+
+    for (i = 0; i < nterms; i++)
+    {
+      struct dds_stream_filter_term * t = &filter->m_terms[nfound];
+      if (!found[i] && terms[i].m_offset == op[1] && dds_stream_filter_term_fits (&terms[i], op))
+      {
+        found[i] = true;
+        t->m_op = op;
+        t->m_pos = fixed ? pos : DDS_STREAM_FILTER_DYNAMIC;
+        t->m_key = dds_stream_filter_key_index (desc, op);
+        t->m_kind = terms[i].m_kind;
+        t->m_cmp = terms[i].m_op;
+        if (t->m_kind == DDS_FIELD_FILTER_STRING)
+        {
+          t->m_value.s = dds_string_dup (terms[i].m_value.s);
+        }
+        else
+        {
+          memcpy (&t->m_value, &terms[i].m_value, sizeof (t->m_value));
+        }
+        filter->m_dynamic = filter->m_dynamic || !fixed;
+        nfound++;
+      }
+    }
+
+    if (size == 0)
+    {
+      fixed = false;
+    }
+    pos += size;
+    op += len;
+  }
+
+  dds_free (found);
+  if (nfound < nterms)
+  {
+    dds_stream_filter_free (filter);
+    return NULL;
+  }
+  return filter;
+}
+
+void dds_stream_filter_free (struct dds_stream_filter * filter)
+{
+  uint32_t i;
+  if (filter)
+  {
+    for (i = 0; i < filter->m_nterms; i++)
+    {
+      if (filter->m_terms[i].m_op && filter->m_terms[i].m_kind == DDS_FIELD_FILTER_STRING)
+      {
+        dds_string_free (filter->m_terms[i].m_value.s);
+      }
+    }
+    dds_free (filter);
+  }
+}
+
+/* The filter does its own bounds checking: DDS_IS_OK is a no-op in release builds */
+
+static bool dds_stream_filter_get_uint32 (dds_stream_t * is, uint32_t * val)
+{
+  DDS_CDR_ALIGN4 (is);
+  if (is->m_index + 4 > is->m_size)
+  {
+    return false;
+  }
+  DDS_IS_GET4 (is, *val, uint32_t);
+  return true;
+}
+
+static bool dds_stream_filter_skip_bytes (dds_stream_t * is, uint32_t num, uint32_t size)
+{
+  DDS_CDR_ALIGNTO (is, size);
+  if ((uint64_t) num * size > is->m_size - is->m_index)
+  {
+    return false;
+  }
+  is->m_index += num * size;
+  return true;
+}
+
+static bool dds_stream_filter_skip_strings (dds_stream_t * is, uint32_t num)
+{
+  uint32_t len;
+  while (num--)
+  {
+    if (!dds_stream_filter_get_uint32 (is, &len) || !dds_stream_filter_skip_bytes (is, len, 1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool dds_stream_filter_skip (dds_stream_t * is, const uint32_t * op)
+{
+  const uint32_t type = DDS_OP_TYPE (*op);
+  const uint32_t subtype = DDS_OP_SUBTYPE (*op);
+  uint32_t num;
+
+  switch (type)
+  {
+    case DDS_OP_VAL_1BY:
+    case DDS_OP_VAL_2BY:
+    case DDS_OP_VAL_4BY:
+    case DDS_OP_VAL_8BY:
+      return dds_stream_filter_skip_bytes (is, 1, dds_op_size[type]);
+    case DDS_OP_VAL_STR:
+    case DDS_OP_VAL_BST:
+      return dds_stream_filter_skip_strings (is, 1);
+    case DDS_OP_VAL_SEQ:
+    case DDS_OP_VAL_ARR:
+      if (type == DDS_OP_VAL_ARR)
+      {
+        num = op[2];
+      }
+      else if (!dds_stream_filter_get_uint32 (is, &num))
+      {
+        return false;
+      }
+      if (subtype <= DDS_OP_VAL_8BY)
+      {
+        return dds_stream_filter_skip_bytes (is, num, dds_op_size[subtype]);
+      }
+      return dds_stream_filter_skip_strings (is, num);
+    default:
+      assert (0);
+      return false;
+  }
+}
+
+static bool dds_stream_filter_compare (dds_field_filter_op_t cmp, int c)
+{
+  switch (cmp)
+  {
+    case DDS_FIELD_FILTER_EQ: return c == 0;
+    case DDS_FIELD_FILTER_NE: return c != 0;
+    case DDS_FIELD_FILTER_LT: return c < 0;
+    case DDS_FIELD_FILTER_LE: return c <= 0;
+    case DDS_FIELD_FILTER_GT: return c > 0;
+    case DDS_FIELD_FILTER_GE: return c >= 0;
+  }
+  return false;
+}
+
+#define DDS_STREAM_FILTER_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+static bool dds_stream_filter_eval (const struct dds_stream_filter_term * t, dds_stream_t * is)
+{
+  const uint32_t type = DDS_OP_TYPE (*t->m_op);
+  uint64_t raw = 0;
+  int c;
+
+  if (t->m_kind == DDS_FIELD_FILTER_STRING)
+  {
+    uint32_t len;
+    const char * str;
+    if (!dds_stream_filter_get_uint32 (is, &len) || len == 0 || len > is->m_size - is->m_index)
+    {
+      return false;
+    }
+    str = DDS_CDR_ADDRESS (is, const char);
+    if (str[len - 1] != 0)
+    {
+      return false;
+    }
+    c = strcmp (str, t->m_value.s);
+    return dds_stream_filter_compare (t->m_cmp, c);
+  }
+
+  DDS_CDR_ALIGNTO (is, dds_op_size[type]);
+  if (is->m_index + dds_op_size[type] > is->m_size)
+  {
+    return false;
+  }
+  switch (type)
+  {
+    case DDS_OP_VAL_1BY: { raw = DDS_IS_GET1 (is); break; }
+    case DDS_OP_VAL_2BY: { uint16_t v; DDS_IS_GET2 (is, v); raw = v; break; }
+    case DDS_OP_VAL_4BY: { uint32_t v; DDS_IS_GET4 (is, v, uint32_t); raw = v; break; }
+    case DDS_OP_VAL_8BY: { DDS_IS_GET8 (is, raw, uint64_t); break; }
+  }
+
+  switch (t->m_kind)
+  {
+    case DDS_FIELD_FILTER_INT:
+    {
+      /* sign-extend from the field size */
+      const uint32_t shift = 64 - 8 * dds_op_size[type];
+      const int64_t v = (int64_t) (raw << shift) >> shift;
+      c = DDS_STREAM_FILTER_CMP (v, t->m_value.i);
+      break;
+    }
+    case DDS_FIELD_FILTER_UINT:
+    {
+      c = DDS_STREAM_FILTER_CMP (raw, t->m_value.u);
+      break;
+    }
+    case DDS_FIELD_FILTER_FLOAT:
+    {
+      double v;
+      if (type == DDS_OP_VAL_4BY)
+      {
+        uint32_t r32 = (uint32_t) raw;
+        float f;
+        memcpy (&f, &r32, sizeof (f));
+        v = f;
+      }
+      else
+      {
+        memcpy (&v, &raw, sizeof (v));
+      }
+      /* NaN compares unequal to everything */
+      if (v != v || t->m_value.f != t->m_value.f)
+      {
+        return t->m_cmp == DDS_FIELD_FILTER_NE;
+      }
+      c = DDS_STREAM_FILTER_CMP (v, t->m_value.f);
+      break;
+    }
+    default:
+    {
+      return false;
+    }
+  }
+  return dds_stream_filter_compare (t->m_cmp, c);
+}
+
+/*
+  A key-only sample (dispose/unregister without data) has just the key
+  fields, in the order of m_keys. Only terms on key fields can be evaluated
+  and terms on other fields are considered satisfied.
+*/
+
+static bool dds_stream_filter_accepts_key (const struct dds_stream_filter * filter, dds_stream_t * is)
+{
+  const dds_topic_descriptor_t * desc = filter->m_desc;
+  const size_t start = is->m_index;
+  uint32_t i, k;
+
+  for (i = 0; i < filter->m_nterms; i++)
+  {
+    const struct dds_stream_filter_term * t = &filter->m_terms[i];
+    if (t->m_key == DDS_STREAM_FILTER_NOKEY)
+    {
+      continue;
+    }
+    is->m_index = start;
+    for (k = 0; k < t->m_key; k++)
+    {
+      if (!dds_stream_filter_skip (is, desc->m_ops + desc->m_keys[k].m_index))
+      {
+        return false;
+      }
+    }
+    if (!dds_stream_filter_eval (t, is))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool dds_stream_filter_accepts (const struct dds_stream_filter * filter, const struct serdata * sample)
+{
+  const uint32_t * op = filter->m_desc->m_ops;
+  dds_stream_t is;
+  size_t start;
+  uint32_t i;
+
+  dds_stream_from_serstate (&is, sample->v.st);
+  if (sample->v.st->kind == STK_KEY)
+  {
+    return dds_stream_filter_accepts_key (filter, &is);
+  }
+
+  start = is.m_index;
+  for (i = 0; i < filter->m_nterms; i++)
+  {
+    const struct dds_stream_filter_term * t = &filter->m_terms[i];
+    if (!filter->m_dynamic)
+    {
+      is.m_index = start + t->m_pos;
+    }
+    else
+    {
+      /* Terms are in op order, so the walk only ever moves forward; the
+         field itself is not consumed as several terms may refer to it */
+      while (op != t->m_op)
+      {
+        if (!dds_stream_filter_skip (&is, op))
+        {
+          return false;
+        }
+        op += dds_stream_filter_op_len (op);
+      }
+      start = is.m_index;
+    }
+    if (!dds_stream_filter_eval (t, &is))
+    {
+      return false;
+    }
+    is.m_index = start;
+  }
+  return true;
+}
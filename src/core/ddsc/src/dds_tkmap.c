@@ -30,6 +30,7 @@
 struct tkmap
 {
   struct ut_chh * m_hh;
+  struct ut_chh * m_iid_hh; /* same instances, indexed by m_iid */
   os_mutex m_lock;
   os_cond m_cond;
 };
@@ -141,10 +142,25 @@ static int dds_tk_equals_void (const void *a, const void *b)
   return dds_tk_equals (a, b);
 }
 
+static uint32_t dds_tk_iid_hash_void (const void * vinst)
+{
+  /* Instance handles are encrypted counters, folding the halves is good enough */
+  const struct tkmap_instance * inst = vinst;
+  return (uint32_t) (inst->m_iid ^ (inst->m_iid >> 32));
+}
+
+static int dds_tk_iid_equals_void (const void *va, const void *vb)
+{
+  const struct tkmap_instance * a = va;
+  const struct tkmap_instance * b = vb;
+  return a->m_iid == b->m_iid;
+}
+
 struct tkmap * dds_tkmap_new (void)
 {
   struct tkmap *tkmap = dds_alloc (sizeof (*tkmap));
   tkmap->m_hh = ut_chhNew (1, dds_tk_hash_void, dds_tk_equals_void, gc_buckets);
+  tkmap->m_iid_hh = ut_chhNew (1, dds_tk_iid_hash_void, dds_tk_iid_equals_void, gc_buckets);
   os_mutexInit (&tkmap->m_lock);
   os_condInit (&tkmap->m_cond, &tkmap->m_lock);
   return tkmap;
@@ -161,6 +177,7 @@ void dds_tkmap_free (_Inout_ _Post_invalid_ struct tkmap * map)
 {
   ut_chhEnumUnsafe (map->m_hh, free_tkmap_instance, NULL);
   ut_chhFree (map->m_hh);
+  ut_chhFree (map->m_iid_hh);
   os_condDestroy (&map->m_cond);
   os_mutexDestroy (&map->m_lock);
   dds_free (map);
@@ -175,58 +192,46 @@ uint64_t dds_tkmap_lookup (_In_ struct tkmap * map, _In_ const struct serdata *
   return (tk) ? tk->m_iid : DDS_HANDLE_NIL;
 }
 
-typedef struct
+static struct tkmap_instance * dds_tkmap_lookup_iid (_In_ struct tkmap * map, _In_ uint64_t iid)
 {
-  uint64_t m_iid;
-  void * m_sample;
-  bool m_ret;
-}
-tkmap_get_key_arg;
-
-static void dds_tkmap_get_key_fn (void * vtk, void * varg)
-{
-  struct tkmap_instance * tk = vtk;
-  tkmap_get_key_arg * arg = (tkmap_get_key_arg*) varg;
-  if (tk->m_iid == arg->m_iid)
-  {
-    deserialize_into (arg->m_sample, tk->m_sample);
-    arg->m_ret = true;
-  }
+  struct tkmap_instance dummy;
+  dummy.m_iid = iid;
+  return ut_chhLookup (map->m_iid_hh, &dummy);
 }
 
 _Check_return_
 bool dds_tkmap_get_key (_In_ struct tkmap * map, _In_ uint64_t iid, _Out_ void * sample)
 {
-  tkmap_get_key_arg arg = { iid, sample, false };
-  os_mutexLock (&map->m_lock);
-  ut_chhEnumUnsafe (map->m_hh, dds_tkmap_get_key_fn, &arg);
-  os_mutexUnlock (&map->m_lock);
-  return arg.m_ret;
-}
-
-typedef struct
-{
-  uint64_t m_iid;
-  struct tkmap_instance * m_inst;
-}
-tkmap_get_inst_arg;
+  struct thread_state1 * const thr = lookup_thread_state ();
+  const bool asleep = thr ? !vtime_awake_p (thr->vtime) : false;
+  struct tkmap_instance * tk;
+  bool ret = false;
 
-static void dds_tkmap_get_inst_fn (void * vtk, void * varg)
-{
-  struct tkmap_instance * tk = vtk;
-  tkmap_get_inst_arg * arg = (tkmap_get_inst_arg*) varg;
-  if (tk->m_iid == arg->m_iid)
+  /* Staying awake keeps the instance from being freed while deserializing its key */
+  if (asleep)
+    thread_state_awake (thr);
+  if ((tk = dds_tkmap_lookup_iid (map, iid)) != NULL)
   {
-    arg->m_inst = tk;
+    deserialize_into (sample, tk->m_sample);
+    ret = true;
   }
+  if (asleep)
+    thread_state_asleep (thr);
+  return ret;
 }
 
 _Check_return_
 struct tkmap_instance * dds_tkmap_find_by_id (_In_ struct tkmap * map, _In_ uint64_t iid)
 {
-  tkmap_get_inst_arg arg = { iid, NULL };
-  ut_chhEnumUnsafe (map->m_hh, dds_tkmap_get_inst_fn, &arg);
-  return arg.m_inst;
+  struct thread_state1 * const thr = lookup_thread_state ();
+  const bool asleep = thr ? !vtime_awake_p (thr->vtime) : false;
+  struct tkmap_instance * tk;
+  if (asleep)
+    thread_state_awake (thr);
+  tk = dds_tkmap_lookup_iid (map, iid);
+  if (asleep)
+    thread_state_asleep (thr);
+  return tk;
 }
 
 /* Debug keyhash generation for debug and coverage builds */
@@ -328,6 +333,9 @@ retry:
       dds_free (tk);
       goto retry;
     }
+    /* Handles are unique, and the reference held by the caller keeps it from
+       being removed before it has been added */
+    (void) ut_chhAdd (map->m_iid_hh, tk);
   }
 
   if (tk && rd)
@@ -378,8 +386,9 @@ void dds_tkmap_instance_unref (_In_ struct tkmap_instance * tk)
   {
     struct tkmap *map = tk->m_map;
 
-    /* Remove from hash table */
+    /* Remove from hash tables */
     (void)ut_chhRemove(map->m_hh, tk);
+    (void)ut_chhRemove(map->m_iid_hh, tk);
 
     /* Signal any threads blocked in their retry loops in lookup */
     os_mutexLock(&map->m_lock);
@@ -21,6 +21,8 @@
 #include "dds__err.h"
 #include "ddsi/q_entity.h"
 #include "ddsi/q_thread.h"
+#include "ddsi/q_gc.h"
+#include "ddsi/q_globals.h"
 #include "q__osplser.h"
 #include "ddsi/q_ddsi_discovery.h"
 #include "os/os_atomics.h"
@@ -529,6 +531,61 @@ dds_topic_get_filter_with_ctx(
   return (filter == dds_topic_chaining_filter) ? NULL : filter;
 }
 
+static void gc_field_filter_impl (struct gcreq *gcreq)
+{
+    dds_stream_filter_free (gcreq->arg);
+    gcreq_free (gcreq);
+}
+
+/* Readers evaluate the filter while storing samples without holding the
+   topic lock, so the old one may only be freed once no thread can still
+   be using it */
+static void gc_field_filter (struct dds_stream_filter *filter)
+{
+    struct gcreq *gcreq = gcreq_new (gv.gcreq_queue, gc_field_filter_impl);
+    gcreq->arg = filter;
+    gcreq_enqueue (gcreq);
+}
+
+_Pre_satisfies_((topic & DDS_ENTITY_KIND_MASK) == DDS_KIND_TOPIC)
+dds_return_t
+dds_topic_set_field_filter(
+        _In_ dds_entity_t topic,
+        _In_ uint32_t nterms,
+        _In_reads_opt_(nterms) const dds_field_filter_t *terms)
+{
+    struct dds_stream_filter *filter = NULL;
+    dds_topic *t;
+    dds_return_t ret;
+    dds__retcode_t rc;
+
+    DDS_REPORT_STACK();
+
+    if ((nterms > 0) && (terms == NULL)) {
+        ret = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Argument terms is NULL");
+        goto fail;
+    }
+    rc = dds_topic_lock(topic, &t);
+    if (rc != DDS_RETCODE_OK) {
+        ret = DDS_ERRNO(rc, "Error occurred on locking topic");
+        goto fail;
+    }
+    if ((nterms > 0) && (filter = dds_stream_filter_new(t->m_descriptor, nterms, terms)) == NULL) {
+        ret = DDS_ERRNO(DDS_RETCODE_BAD_PARAMETER, "Field filter does not match topic type");
+    } else {
+        struct dds_stream_filter *old = os_atomic_ldvoidp(&t->m_stopic->field_filter);
+        os_atomic_stvoidp(&t->m_stopic->field_filter, filter);
+        if (old) {
+            gc_field_filter(old);
+        }
+        ret = DDS_RETCODE_OK;
+    }
+    dds_topic_unlock(t);
+fail:
+    DDS_REPORT_FLUSH(ret != DDS_RETCODE_OK);
+    return ret;
+}
+
 _Pre_satisfies_((topic & DDS_ENTITY_KIND_MASK) == DDS_KIND_TOPIC)
 DDS_EXPORT dds_return_t
 dds_get_name(
@@ -23,6 +23,8 @@
 #include "ddsi/q_entity.h"
 #include "dds__report.h"
 #include "ddsi/q_radmin.h"
+#include "ddsi/q_globals.h"
+#include "ddsi/q_sampletrace.h"
 #include <string.h>
 
 
@@ -146,7 +148,7 @@ deliver_locally(
         _In_ struct tkmap_instance *tk)
 {
     dds_return_t ret = DDS_RETCODE_OK;
-    os_mutexLock (&wr->rdary.rdary_lock);
+    os_rwlockRead (&wr->rdary.rdary_lock);
     if (wr->rdary.fastpath_ok) {
         struct reader ** const rdary = wr->rdary.rdary;
         if (rdary[0]) {
@@ -173,7 +175,7 @@ deliver_locally(
                 } while ((!stored) && (ret == DDS_RETCODE_OK));
             }
         }
-        os_mutexUnlock (&wr->rdary.rdary_lock);
+        os_rwlockUnlock (&wr->rdary.rdary_lock);
     } else {
         /* When deleting, pwr is no longer accessible via the hash
            tables, and consequently, a reader may be deleted without
@@ -186,7 +188,7 @@ deliver_locally(
         ut_avlIter_t it;
         struct pwr_rd_match *m;
         struct nn_rsample_info sampleinfo;
-        os_mutexUnlock (&wr->rdary.rdary_lock);
+        os_rwlockUnlock (&wr->rdary.rdary_lock);
         init_sampleinfo(&sampleinfo, wr, seq, payload);
         os_mutexLock (&wr->e.lock);
         for (m = ut_avlIterFirst (&wr_local_readers_treedef, &wr->local_readers, &it); m != NULL; m = ut_avlIterNext (&it)) {
@@ -239,6 +241,10 @@ dds_write_impl(
         thread_state_awake (thr);
     }
 
+    if (gv.sampletrace) {
+        nn_sampletrace_mark (gv.sampletrace);
+    }
+
     /* Serialize and write data or key */
     if (writekey) {
         d = serialize_key (gv.serpool, ddsi_wr->topic, data);
@@ -315,6 +321,10 @@ dds_writecdr_impl(
         thread_state_awake (thr);
     }
 
+    if (gv.sampletrace) {
+        nn_sampletrace_mark (gv.sampletrace);
+    }
+
     /* Serialize and write data or key */
     if (writekey) {
         abort();
@@ -10,9 +10,11 @@
  * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
  */
 #include <assert.h>
+#include <string.h>
 #include "ddsc/dds.h"
 #include "ddsi/q_config.h"
 #include "ddsi/q_entity.h"
+#include "ddsi/q_whc.h"
 #include "ddsi/q_thread.h"
 #include "q__osplser.h"
 #include "dds__writer.h"
@@ -40,6 +42,28 @@ dds_writer_instance_hdl(
     return DDS_RETCODE_OK;
 }
 
+static dds_return_t
+dds_writer_statistics(
+        dds_entity *e,
+        dds_statistics_t *stats)
+{
+    struct writer *ddsi_wr = ((dds_writer*)e)->m_wr;
+    assert(stats);
+    memset(stats, 0, sizeof(*stats));
+    os_mutexLock(&ddsi_wr->e.lock);
+    stats->samples_written = (uint64_t)ddsi_wr->seq;
+    stats->bytes_written = ddsi_wr->num_bytes_written;
+    stats->acks_received = ddsi_wr->num_acks_received;
+    stats->nacks_received = ddsi_wr->num_nacks_received;
+    stats->rexmits = ddsi_wr->rexmit_count;
+    stats->rexmits_lost = ddsi_wr->rexmit_lost_count;
+    stats->throttle_count = ddsi_wr->throttle_count;
+    stats->throttle_time = ddsi_wr->throttle_time;
+    stats->whc_unacked_bytes = (uint64_t)whc_unacked_bytes(ddsi_wr->whc);
+    os_mutexUnlock(&ddsi_wr->e.lock);
+    return DDS_RETCODE_OK;
+}
+
 static dds_return_t
 dds_writer_status_validate(
         uint32_t mask)
@@ -425,6 +449,7 @@ dds_create_writer(
     wr->m_entity.m_deriver.set_qos = dds_writer_qos_set;
     wr->m_entity.m_deriver.validate_status = dds_writer_status_validate;
     wr->m_entity.m_deriver.get_instance_hdl = dds_writer_instance_hdl;
+    wr->m_entity.m_deriver.get_statistics = dds_writer_statistics;
 
     /* Extra claim of this writer to make sure that the delete waits until DDSI
      * has deleted its writer as well. This can be known through the callback. */
@@ -128,6 +128,7 @@ void serstate_init (serstate_t st, const struct sertopic * topic)
   st->data->v.hash_valid = (topic == NULL || topic->nkeys) ? 0 : 1;
   st->data->v.hash = 0;
   st->data->v.bswap = false;
+  st->data->v.trace_id = 0;
   memset (st->data->v.keyhash.m_hash, 0, sizeof (st->data->v.keyhash.m_hash));
   st->data->v.keyhash.m_key_len = 0;
   st->data->v.keyhash.m_flags = 0;
@@ -148,6 +149,7 @@ void sertopic_free (struct sertopic * tp)
     dds_free (tp->typename);
     dds_free (tp->name_typename);
     dds_sample_free (tp->filter_sample, (const struct dds_topic_descriptor *) tp->type, DDS_FREE_ALL);
+    dds_stream_filter_free (os_atomic_ldvoidp (&tp->field_filter));
     dds_free (tp);
   }
 }
@@ -0,0 +1,334 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <string.h>
+#include "ddsc/dds.h"
+#include "os/os.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+#include "Space.h"
+#include "RoundTrip.h"
+
+/**************************************************************************************************
+ *
+ * Test fixtures
+ *
+ *************************************************************************************************/
+#define MAX_SAMPLES                 20
+
+static dds_entity_t g_participant = 0;
+static dds_entity_t g_topic       = 0;
+static dds_entity_t g_writer      = 0;
+
+static void*             g_samples[MAX_SAMPLES];
+static Space_Type1       g_data[MAX_SAMPLES];
+static dds_sample_info_t g_info[MAX_SAMPLES];
+
+static char*
+create_topic_name(const char *prefix, char *name, size_t size)
+{
+    /* Get semi random g_topic name. */
+    os_procId pid = os_procIdSelf();
+    uintmax_t tid = os_threadIdToInteger(os_threadIdSelf());
+    (void) snprintf(name, size, "%s_pid%"PRIprocId"_tid%"PRIuMAX"", prefix, pid, tid);
+    return name;
+}
+
+static dds_entity_t
+create_entity(dds_entity_t topic, bool reader)
+{
+    dds_qos_t *qos = dds_qos_create ();
+    dds_entity_t e;
+    dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, 0);
+    dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_SECS(1));
+    e = reader ? dds_create_reader(g_participant, topic, qos, NULL) : dds_create_writer(g_participant, topic, qos, NULL);
+    cr_assert_gt(e, 0, "Failed to create prerequisite entity");
+    dds_qos_delete(qos);
+    return e;
+}
+
+static void
+fieldfilter_init(void)
+{
+    char name[100];
+
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+
+    g_topic = dds_create_topic(g_participant, &Space_Type1_desc, create_topic_name("ddsc_fieldfilter_test", name, sizeof name), NULL, NULL);
+    cr_assert_gt(g_topic, 0, "Failed to create prerequisite g_topic");
+
+    g_writer = create_entity(g_topic, false);
+
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        g_samples[i] = &g_data[i];
+    }
+}
+
+static void
+fieldfilter_fini(void)
+{
+    dds_delete(g_participant);
+}
+
+static void
+write_samples(void)
+{
+    for (int32_t i = 0; i < MAX_SAMPLES; i++) {
+        Space_Type1 sample = { i % 4, i, -i };
+        dds_return_t ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK, "Failed prerequisite write");
+    }
+}
+
+
+/**************************************************************************************************
+ *
+ * These will check the field filters on queryconditions and topics.
+ *
+ *************************************************************************************************/
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, querycondition, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    dds_entity_t reader = create_entity(g_topic, true);
+    dds_field_filter_t terms[3];
+    dds_entity_t cond;
+    dds_return_t ret;
+
+    /* long_2 >= 5 && long_3 > -15 && long_1 != 2 */
+    terms[0].m_offset = offsetof(Space_Type1, long_2);
+    terms[0].m_kind = DDS_FIELD_FILTER_UINT;
+    terms[0].m_op = DDS_FIELD_FILTER_GE;
+    terms[0].m_value.u = 5;
+    terms[1].m_offset = offsetof(Space_Type1, long_3);
+    terms[1].m_kind = DDS_FIELD_FILTER_INT;
+    terms[1].m_op = DDS_FIELD_FILTER_GT;
+    terms[1].m_value.i = -15;
+    terms[2].m_offset = offsetof(Space_Type1, long_1);
+    terms[2].m_kind = DDS_FIELD_FILTER_INT;
+    terms[2].m_op = DDS_FIELD_FILTER_NE;
+    terms[2].m_value.i = 2;
+    cond = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 3, terms);
+    cr_assert_gt(cond, 0);
+
+    write_samples();
+    ret = dds_read(cond, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 7);
+    for (int i = 0; i < ret; i++) {
+        Space_Type1 *s = (Space_Type1*)g_samples[i];
+        cr_assert(s->long_2 >= 5 && s->long_2 < 15 && s->long_1 != 2);
+    }
+
+    /* Taking through the condition leaves the other samples. */
+    ret = dds_take(cond, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 7);
+    ret = dds_take(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_SAMPLES - 7);
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, topic, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    dds_field_filter_t term;
+    dds_entity_t reader;
+    dds_return_t ret;
+
+    term.m_offset = offsetof(Space_Type1, long_1);
+    term.m_kind = DDS_FIELD_FILTER_INT;
+    term.m_op = DDS_FIELD_FILTER_EQ;
+    term.m_value.i = 1;
+    ret = dds_topic_set_field_filter(g_topic, 1, &term);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+
+    reader = create_entity(g_topic, true);
+    write_samples();
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_SAMPLES / 4);
+    for (int i = 0; i < ret; i++) {
+        cr_assert_eq(((Space_Type1*)g_samples[i])->long_1, 1);
+    }
+
+    ret = dds_topic_set_field_filter(g_topic, 0, NULL);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, string, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    static const char *ips[] = { "10.0.0.1", "10.0.0.2", "192.168.1.1" };
+    RoundTripModule_Address data[MAX_SAMPLES];
+    dds_field_filter_t terms[2];
+    dds_entity_t topic, writer, reader, cond;
+    dds_return_t ret;
+    char name[100];
+
+    topic = dds_create_topic(g_participant, &RoundTripModule_Address_desc, create_topic_name("ddsc_fieldfilter_string", name, sizeof name), NULL, NULL);
+    cr_assert_gt(topic, 0);
+    writer = create_entity(topic, false);
+    reader = create_entity(topic, true);
+
+    /* The port follows a string and is located while evaluating. */
+    terms[0].m_offset = offsetof(RoundTripModule_Address, port);
+    terms[0].m_kind = DDS_FIELD_FILTER_INT;
+    terms[0].m_op = DDS_FIELD_FILTER_LT;
+    terms[0].m_value.i = 3;
+    terms[1].m_offset = offsetof(RoundTripModule_Address, ip);
+    terms[1].m_kind = DDS_FIELD_FILTER_STRING;
+    terms[1].m_op = DDS_FIELD_FILTER_LE;
+    terms[1].m_value.s = "10.0.0.2";
+    cond = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 2, terms);
+    cr_assert_gt(cond, 0);
+
+    for (int32_t i = 0; i < 6; i++) {
+        RoundTripModule_Address sample = { (char *)ips[i % 3], i };
+        ret = dds_write(writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        data[i].ip = NULL;
+        g_samples[i] = &data[i];
+    }
+    ret = dds_take(cond, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 2);
+    for (int i = 0; i < ret; i++) {
+        cr_assert(data[i].port < 3);
+        cr_assert_str_neq(data[i].ip, "192.168.1.1");
+        dds_sample_free(&data[i], &RoundTripModule_Address_desc, DDS_FREE_CONTENTS);
+    }
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, bounded_string_array, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    static const char *names[] = { "a", "bcdefgh", "" };
+    Space_bstrarray data[MAX_SAMPLES];
+    dds_field_filter_t term;
+    dds_entity_t topic, writer, reader, cond;
+    dds_return_t ret;
+    char name[100];
+
+    topic = dds_create_topic(g_participant, &Space_bstrarray_desc, create_topic_name("ddsc_fieldfilter_bstrarray", name, sizeof name), NULL, NULL);
+    cr_assert_gt(topic, 0);
+    writer = create_entity(topic, false);
+    reader = create_entity(topic, true);
+
+    /* The value follows an array of bounded strings. */
+    term.m_offset = offsetof(Space_bstrarray, value);
+    term.m_kind = DDS_FIELD_FILTER_INT;
+    term.m_op = DDS_FIELD_FILTER_GE;
+    term.m_value.i = 4;
+    cond = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 1, &term);
+    cr_assert_gt(cond, 0);
+
+    for (int32_t i = 0; i < 6; i++) {
+        Space_bstrarray sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.id = i;
+        for (int j = 0; j < 3; j++) {
+            strcpy(sample.names[j], names[(i + j) % 3]);
+        }
+        sample.value = i;
+        ret = dds_write(writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        g_samples[i] = &data[i];
+    }
+    ret = dds_take(cond, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 2);
+    for (int i = 0; i < ret; i++) {
+        cr_assert_geq(data[i].value, 4);
+        cr_assert_str_eq(data[i].names[0], names[data[i].id % 3]);
+    }
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, invalid, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    dds_entity_t reader = create_entity(g_topic, true);
+    dds_field_filter_t term;
+    dds_entity_t cond;
+    dds_return_t ret;
+
+    /* Not the offset of a field. */
+    term.m_offset = offsetof(Space_Type1, long_2) + 1;
+    term.m_kind = DDS_FIELD_FILTER_INT;
+    term.m_op = DDS_FIELD_FILTER_EQ;
+    term.m_value.i = 0;
+    cond = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 1, &term);
+    cr_assert_eq(dds_err_nr(cond), DDS_RETCODE_BAD_PARAMETER);
+    ret = dds_topic_set_field_filter(g_topic, 1, &term);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+
+    /* Not a string field. */
+    term.m_offset = offsetof(Space_Type1, long_2);
+    term.m_kind = DDS_FIELD_FILTER_STRING;
+    term.m_value.s = "";
+    cond = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 1, &term);
+    cr_assert_eq(dds_err_nr(cond), DDS_RETCODE_BAD_PARAMETER);
+
+    ret = dds_topic_set_field_filter(g_topic, 1, NULL);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_fieldfilter, trigger, .init=fieldfilter_init, .fini=fieldfilter_fini)
+{
+    dds_entity_t reader = create_entity(g_topic, true);
+    dds_field_filter_t term;
+    dds_entity_t cond, late;
+    dds_return_t ret;
+
+    /* Only samples with long_1 == 3 match. */
+    term.m_offset = offsetof(Space_Type1, long_1);
+    term.m_kind = DDS_FIELD_FILTER_INT;
+    term.m_op = DDS_FIELD_FILTER_EQ;
+    term.m_value.i = 3;
+    cond = dds_create_querycondition_fields(reader, DDS_NOT_READ_SAMPLE_STATE, 1, &term);
+    cr_assert_gt(cond, 0);
+    cr_assert_eq(dds_triggered(cond), 0);
+
+    /* Non-matching samples must not trigger the condition. */
+    for (int32_t i = 0; i < 3; i++) {
+        Space_Type1 sample = { i, i, i };
+        ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+    cr_assert_eq(dds_triggered(cond), 0);
+
+    /* A matching sample does, until it has been read. */
+    {
+        Space_Type1 sample = { 3, 3, 3 };
+        ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+    cr_assert_eq(dds_triggered(cond), 1);
+    ret = dds_read(cond, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 1);
+    cr_assert_eq(dds_triggered(cond), 0);
+
+    /* Conditions created afterwards account for the existing history. */
+    late = dds_create_querycondition_fields(reader, DDS_ANY_STATE, 1, &term);
+    cr_assert_gt(late, 0);
+    cr_assert_eq(dds_triggered(late), 1);
+    ret = dds_take(late, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 1);
+    cr_assert_eq(dds_triggered(late), 0);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 3);
+}
+/*************************************************************************************************/
@@ -0,0 +1,218 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include "ddsc/dds.h"
+#include "os/os.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+#include "Space.h"
+
+/**************************************************************************************************
+ *
+ * Test fixtures
+ *
+ *************************************************************************************************/
+#define MAX_INSTANCES               10
+#define MAX_WRITES                  40
+#define MAX_SAMPLES                 (MAX_INSTANCES * MAX_WRITES)
+
+static dds_entity_t g_participant = 0;
+static dds_entity_t g_topic       = 0;
+static dds_entity_t g_writer      = 0;
+
+static void*             g_samples[MAX_SAMPLES];
+static Space_Type1       g_data[MAX_SAMPLES];
+static dds_sample_info_t g_info[MAX_SAMPLES];
+
+static char*
+create_topic_name(const char *prefix, char *name, size_t size)
+{
+    /* Get semi random g_topic name. */
+    os_procId pid = os_procIdSelf();
+    uintmax_t tid = os_threadIdToInteger(os_threadIdSelf());
+    (void) snprintf(name, size, "%s_pid%"PRIprocId"_tid%"PRIuMAX"", prefix, pid, tid);
+    return name;
+}
+
+static void
+history_init(void)
+{
+    dds_qos_t *qos = dds_qos_create ();
+    char name[100];
+
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+
+    g_topic = dds_create_topic(g_participant, &Space_Type1_desc, create_topic_name("ddsc_history_test", name, sizeof name), NULL, NULL);
+    cr_assert_gt(g_topic, 0, "Failed to create prerequisite g_topic");
+
+    dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, 0);
+    dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_SECS(1));
+    g_writer = dds_create_writer(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(g_writer, 0, "Failed to create prerequisite g_writer");
+    dds_qos_delete(qos);
+
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        g_samples[i] = &g_data[i];
+    }
+}
+
+static void
+history_fini(void)
+{
+    dds_delete(g_writer);
+    dds_delete(g_topic);
+    dds_delete(g_participant);
+}
+
+static dds_entity_t
+create_reader(dds_history_kind_t kind, int32_t depth)
+{
+    dds_qos_t *qos = dds_qos_create ();
+    dds_entity_t reader;
+    dds_qset_history(qos, kind, depth);
+    dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_SECS(1));
+    reader = dds_create_reader(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(reader, 0, "Failed to create prerequisite reader");
+    dds_qos_delete(qos);
+    return reader;
+}
+
+static void
+write_samples(int32_t first, int32_t nwrites)
+{
+    Space_Type1 sample;
+    dds_return_t ret;
+    for (int32_t w = first; w < first + nwrites; w++) {
+        for (int32_t i = 0; i < MAX_INSTANCES; i++) {
+            sample.long_1 = i;
+            sample.long_2 = w;
+            sample.long_3 = i * MAX_WRITES + w;
+            ret = dds_write(g_writer, &sample);
+            cr_assert_eq(ret, DDS_RETCODE_OK, "Failed prerequisite write");
+        }
+    }
+}
+
+static void
+check_history(int ret, int32_t nperinst, int32_t first)
+{
+    /* Per instance, samples are returned oldest first. */
+    cr_assert_eq(ret, MAX_INSTANCES * nperinst);
+    for (int i = 0; i < ret; i++) {
+        Space_Type1 *s = (Space_Type1*)g_samples[i];
+        cr_assert_eq(s->long_1, ((Space_Type1*)g_samples[i - (i % nperinst)])->long_1);
+        cr_assert_eq(s->long_2, first + (i % nperinst));
+        cr_assert(g_info[i].valid_data);
+    }
+}
+
+
+/**************************************************************************************************
+ *
+ * These will check the per-instance history for various depths.
+ *
+ *************************************************************************************************/
+/*************************************************************************************************/
+Test(ddsc_history, keep_last_shallow, .init=history_init, .fini=history_fini)
+{
+    dds_entity_t reader = create_reader(DDS_HISTORY_KEEP_LAST, 3);
+    dds_return_t ret;
+
+    write_samples(0, 10);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, 3, 7);
+    for (int i = 0; i < ret; i++) {
+        cr_assert_eq(g_info[i].sample_state, DDS_SST_NOT_READ);
+    }
+
+    /* Overwriting a partially read history retains the order. */
+    write_samples(10, 1);
+    ret = dds_read_mask(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES, DDS_NOT_READ_SAMPLE_STATE);
+    check_history(ret, 1, 10);
+    ret = dds_take(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, 3, 8);
+    ret = dds_take(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 0);
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_history, keep_last_deep, .init=history_init, .fini=history_fini)
+{
+    dds_entity_t reader = create_reader(DDS_HISTORY_KEEP_LAST, 13);
+    dds_return_t ret;
+
+    /* Partially filled, then wrapped around multiple times. */
+    write_samples(0, 5);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, 5, 0);
+    write_samples(5, 30);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, 13, 22);
+
+    /* Taking the unread samples leaves the read ones in order. */
+    write_samples(35, 4);
+    ret = dds_take_mask(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES, DDS_NOT_READ_SAMPLE_STATE);
+    check_history(ret, 4, 35);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, 9, 26);
+    for (int i = 0; i < ret; i++) {
+        cr_assert_eq(g_info[i].sample_state, DDS_SST_READ);
+    }
+
+    /* New samples go after the retained ones. */
+    write_samples(39, 1);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_INSTANCES * 10);
+    for (int i = 0; i < ret; i++) {
+        Space_Type1 *s = (Space_Type1*)g_samples[i];
+        cr_assert_eq(s->long_2, (i % 10 == 9) ? 39 : 26 + (i % 10));
+    }
+}
+/*************************************************************************************************/
+
+/*************************************************************************************************/
+Test(ddsc_history, keep_all, .init=history_init, .fini=history_fini)
+{
+    dds_entity_t reader = create_reader(DDS_HISTORY_KEEP_ALL, 0);
+    dds_instance_handle_t handle;
+    Space_Type1 key = { 0 };
+    dds_return_t ret;
+
+    write_samples(0, MAX_WRITES);
+    ret = dds_read(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    check_history(ret, MAX_WRITES, 0);
+
+    /* Take a few from the front of one instance, the remainder is unaffected. */
+    key.long_1 = 3;
+    handle = dds_instance_lookup(reader, &key);
+    cr_assert_neq(handle, DDS_HANDLE_NIL);
+    ret = dds_take_instance(reader, g_samples, g_info, MAX_SAMPLES, 7, handle);
+    cr_assert_eq(ret, 7);
+    for (int i = 0; i < ret; i++) {
+        Space_Type1 *s = (Space_Type1*)g_samples[i];
+        cr_assert_eq(s->long_1, 3);
+        cr_assert_eq(s->long_2, i);
+    }
+    ret = dds_read_instance(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES, handle);
+    cr_assert_eq(ret, MAX_WRITES - 7);
+    for (int i = 0; i < ret; i++) {
+        Space_Type1 *s = (Space_Type1*)g_samples[i];
+        cr_assert_eq(s->long_2, 7 + i);
+    }
+
+    ret = dds_take(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_SAMPLES - 7);
+    ret = dds_take(reader, g_samples, g_info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, 0);
+}
+/*************************************************************************************************/
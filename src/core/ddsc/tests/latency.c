@@ -0,0 +1,243 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+#include "ddsc/dds.h"
+#include "Space.h"
+#include "os/os.h"
+#include "ddsi/q_config.h"
+
+#define MAX_SAMPLES 10
+
+static dds_entity_t g_participant = 0;
+static dds_entity_t g_topic = 0;
+static dds_entity_t g_writer = 0;
+static dds_entity_t g_reader = 0;
+
+static char*
+create_topic_name(const char *prefix, char *name, size_t size)
+{
+    /* Get semi random g_topic name. */
+    os_procId pid = os_procIdSelf();
+    uintmax_t tid = os_threadIdToInteger(os_threadIdSelf());
+    (void) snprintf(name, size, "%s_pid%"PRIprocId"_tid%"PRIuMAX"", prefix, pid, tid);
+    return name;
+}
+
+static void
+latency_init(void)
+{
+    char name[100];
+    dds_qos_t *qos;
+
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+    /* The configuration is read when the participant is created; time
+       every sample unless a test says otherwise */
+    config.lat_histogram_interval = 1;
+
+    g_topic = dds_create_topic(g_participant, &Space_Type1_desc, create_topic_name("ddsc_latency", name, sizeof name), NULL, NULL);
+    cr_assert_gt(g_topic, 0, "Failed to create prerequisite g_topic");
+
+    qos = dds_qos_create();
+    dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_INFINITY);
+    dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, 0);
+    g_writer = dds_create_writer(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(g_writer, 0, "Failed to create prerequisite g_writer");
+    g_reader = dds_create_reader(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(g_reader, 0, "Failed to create prerequisite g_reader");
+    dds_qos_delete(qos);
+}
+
+static void
+latency_fini(void)
+{
+    dds_delete(g_participant);
+}
+
+static uint64_t
+sum_buckets(const dds_latency_histogram_t *hist)
+{
+    uint64_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < DDS_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        sum += hist->buckets[i];
+    }
+    return sum;
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, buckets)
+{
+    uint32_t i;
+    cr_assert_eq(dds_latency_histogram_bucket_lower(0), 0);
+    for (i = 1; i < DDS_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        dds_duration_t lo = dds_latency_histogram_bucket_lower(i - 1);
+        dds_duration_t hi = dds_latency_histogram_bucket_lower(i);
+        cr_assert_gt(hi, lo, "bucket %u not above bucket %u", i, i - 1);
+        /* relative bucket width is bounded by 1/8 */
+        cr_assert_leq((hi - lo) * 8, (lo < 8) ? 8 : lo, "bucket %u too wide", i - 1);
+    }
+    cr_assert_geq(dds_latency_histogram_bucket_lower(DDS_LATENCY_HISTOGRAM_BUCKETS - 1), DDS_SECS(900));
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, percentile)
+{
+    dds_latency_histogram_t hist;
+    memset(&hist, 0, sizeof(hist));
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 50.0), 0);
+
+    /* 90 samples in [lower(100),lower(101)), 10 in [lower(200),lower(201)) */
+    hist.buckets[100] = 90;
+    hist.buckets[200] = 10;
+    hist.count = 100;
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 0.0), dds_latency_histogram_bucket_lower(101) - 1);
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 50.0), dds_latency_histogram_bucket_lower(101) - 1);
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 90.0), dds_latency_histogram_bucket_lower(101) - 1);
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 95.0), dds_latency_histogram_bucket_lower(201) - 1);
+    cr_assert_eq(dds_latency_histogram_percentile(&hist, 100.0), dds_latency_histogram_bucket_lower(201) - 1);
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, write_take_reset, .init=latency_init, .fini=latency_fini)
+{
+    void *samples[MAX_SAMPLES];
+    Space_Type1 data[MAX_SAMPLES];
+    dds_sample_info_t info[MAX_SAMPLES];
+    dds_latency_histogram_t hist;
+    dds_return_t ret;
+    int i;
+
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        Space_Type1 sample = { i, i, i };
+        ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+        samples[i] = &data[i];
+    }
+
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_SOURCE_TO_STORE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, MAX_SAMPLES);
+    cr_assert_eq(sum_buckets(&hist), MAX_SAMPLES);
+    /* local delivery: anything beyond a few seconds means garbage */
+    cr_assert_lt(dds_latency_histogram_percentile(&hist, 100.0), DDS_SECS(5));
+
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_STORE_TO_TAKE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, 0);
+
+    /* reading doesn't count, taking does */
+    ret = dds_read(g_reader, samples, info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_SAMPLES);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_STORE_TO_TAKE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, 0);
+
+    ret = dds_take(g_reader, samples, info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, MAX_SAMPLES);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_STORE_TO_TAKE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, MAX_SAMPLES);
+    cr_assert_eq(sum_buckets(&hist), MAX_SAMPLES);
+
+    ret = dds_reset_latency_histograms(g_reader);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_SOURCE_TO_STORE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, 0);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_STORE_TO_TAKE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(hist.count, 0);
+}
+
+/*************************************************************************************************/
+static void
+write_take_count(int nwrite, uint64_t *nstore, uint64_t *ntake)
+{
+    void *samples[MAX_SAMPLES];
+    Space_Type1 data[MAX_SAMPLES];
+    dds_sample_info_t info[MAX_SAMPLES];
+    dds_latency_histogram_t hist;
+    dds_return_t ret;
+    int i;
+
+    cr_assert_leq(nwrite, MAX_SAMPLES);
+    for (i = 0; i < nwrite; i++) {
+        Space_Type1 sample = { i, i, i };
+        ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        samples[i] = &data[i];
+    }
+    ret = dds_take(g_reader, samples, info, MAX_SAMPLES, MAX_SAMPLES);
+    cr_assert_eq(ret, nwrite);
+
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_SOURCE_TO_STORE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(sum_buckets(&hist), hist.count);
+    *nstore = hist.count;
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_STORE_TO_TAKE, &hist);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(sum_buckets(&hist), hist.count);
+    *ntake = hist.count;
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, disabled, .init=latency_init, .fini=latency_fini)
+{
+    uint64_t nstore, ntake;
+    config.lat_histogram_interval = 0;
+    write_take_count(MAX_SAMPLES, &nstore, &ntake);
+    cr_assert_eq(nstore, 0);
+    cr_assert_eq(ntake, 0);
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, interval, .init=latency_init, .fini=latency_fini)
+{
+    uint64_t nstore, ntake;
+    /* every third sample: the 3rd, 6th and 9th */
+    config.lat_histogram_interval = 3;
+    write_take_count(9, &nstore, &ntake);
+    cr_assert_eq(nstore, 3);
+    cr_assert_eq(ntake, 3);
+}
+
+/*************************************************************************************************/
+Test(ddsc_latency, invalid_params, .init=latency_init, .fini=latency_fini)
+{
+    dds_latency_histogram_t hist;
+    dds_return_t ret;
+
+    /* Disable SAL warning on intentional misuse of the API */
+    OS_WARNING_MSVC_OFF(6387);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_SOURCE_TO_STORE, NULL);
+    OS_WARNING_MSVC_ON(6387);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+
+    ret = dds_get_latency_histogram(g_reader, (dds_latency_kind_t) 42, &hist);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+
+    ret = dds_get_latency_histogram(g_writer, DDS_LATENCY_SOURCE_TO_STORE, &hist);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ILLEGAL_OPERATION);
+
+    ret = dds_reset_latency_histograms(g_topic);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ILLEGAL_OPERATION);
+
+    dds_delete(g_reader);
+    ret = dds_get_latency_histogram(g_reader, DDS_LATENCY_SOURCE_TO_STORE, &hist);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ALREADY_DELETED);
+}
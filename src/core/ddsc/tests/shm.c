@@ -0,0 +1,466 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "ddsc/dds.h"
+#include "os/os.h"
+#include "ddsi/ddsi_tran.h"
+#include "ddsi/ddsi_shm.h"
+#include "ddsi/q_config.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#if OS_SOCKET_HAS_AF_UNIX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/**************************************************************************************************
+ *
+ * Test fixtures
+ *
+ *************************************************************************************************/
+#define RING_SIZE 4
+
+static dds_entity_t g_participant = 0;
+static ddsi_tran_conn_t g_conn = NULL;
+
+static ddsi_tran_conn_t
+create_conn(void)
+{
+    return ddsi_factory_create_conn(ddsi_factory_find("shm"), 0, NULL);
+}
+
+static void
+shm_init(void)
+{
+    /* The participant gets the DDSI core going, the ring is created
+       directly so that the test controls both ends of it */
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+    config.shm_ring_size = RING_SIZE;
+    cr_assert_eq(ddsi_shm_init(), 0);
+    g_conn = create_conn();
+    cr_assert_not_null(g_conn, "Failed to create prerequisite g_conn");
+}
+
+static void
+shm_fini(void)
+{
+    if (g_conn) {
+        ddsi_conn_free(g_conn);
+    }
+    dds_delete(g_participant);
+}
+
+static ssize_t
+send_msg(const nn_locator_t *loc, uint32_t seq, size_t len)
+{
+    os_sockaddr_storage dst;
+    unsigned char buf[256];
+    struct msghdr msg;
+    struct iovec iov[2];
+
+    cr_assert_leq(sizeof(seq) + len, sizeof(buf));
+    memset(buf, (int)(seq & 0xff), len);
+    ddsi_shm_loc_to_address(&dst, loc);
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = (void *)&seq;
+    iov[0].iov_len = sizeof(seq);
+    iov[1].iov_base = (void *)buf;
+    iov[1].iov_len = len;
+    msg.msg_name = &dst;
+    msg.msg_namelen = (socklen_t)sizeof(struct sockaddr_un);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    return ddsi_conn_write(g_conn, &msg, sizeof(seq) + len, 0);
+}
+
+static void
+check_msg(uint32_t seq, size_t len)
+{
+    unsigned char buf[256];
+    uint32_t rseq;
+    ssize_t n;
+    size_t i;
+
+    n = ddsi_conn_read(g_conn, buf, sizeof(buf));
+    cr_assert_eq(n, (ssize_t)(sizeof(seq) + len), "expected message %u of %u bytes, got %d bytes", seq, (unsigned)len, (int)n);
+    memcpy(&rseq, buf, sizeof(rseq));
+    cr_assert_eq(rseq, seq);
+    for (i = 0; i < len; i++) {
+        cr_assert_eq(buf[sizeof(seq) + i], (unsigned char)(seq & 0xff));
+    }
+}
+
+static void
+check_empty(void)
+{
+    unsigned char buf[256];
+    cr_assert_eq(ddsi_conn_read(g_conn, buf, sizeof(buf)), 0);
+}
+
+/**************************************************************************************************
+ *
+ * Tests
+ *
+ *************************************************************************************************/
+Test(ddsc_shm, wrap_around, .init=shm_init, .fini=shm_fini)
+{
+    nn_locator_t loc;
+    uint32_t seq = 0, i, j;
+
+    ddsi_conn_locator(g_conn, &loc);
+    cr_assert(ddsi_shm_reachable(&loc));
+    /* Batches of varying size make the sender and receiver go round
+       the ring at every possible offset */
+    for (i = 0; i < 10 * RING_SIZE; i++) {
+        const uint32_t batch = 1 + i % (RING_SIZE - 1);
+        for (j = 0; j < batch; j++) {
+            cr_assert_gt(send_msg(&loc, seq + j, (seq + j) % 200), 0);
+        }
+        for (j = 0; j < batch; j++) {
+            check_msg(seq + j, (seq + j) % 200);
+        }
+        check_empty();
+        seq += batch;
+    }
+}
+
+Test(ddsc_shm, full_ring_drops, .init=shm_init, .fini=shm_fini)
+{
+    nn_locator_t loc;
+    uint32_t i;
+
+    ddsi_conn_locator(g_conn, &loc);
+    /* A full ring drops messages like a full socket buffer, the sender
+       doesn't get to know */
+    for (i = 0; i < RING_SIZE + 3; i++) {
+        cr_assert_eq(send_msg(&loc, i, 16), (ssize_t)(sizeof(i) + 16));
+    }
+    for (i = 0; i < RING_SIZE; i++) {
+        check_msg(i, 16);
+    }
+    check_empty();
+
+    /* and once there is room again, messages get through */
+    cr_assert_gt(send_msg(&loc, 100, 8), 0);
+    check_msg(100, 8);
+    check_empty();
+}
+
+static struct ddsi_shm_ring *
+map_ring(const nn_locator_t *loc, size_t *size)
+{
+    os_sockaddr_storage addr;
+    struct ddsi_shm_ring *ring;
+    struct stat st;
+    int fd;
+
+    ddsi_shm_loc_to_address(&addr, loc);
+    fd = shm_open(((struct sockaddr_un *)&addr)->sun_path, O_RDWR, 0);
+    cr_assert_neq(fd, -1);
+    cr_assert_eq(fstat(fd, &st), 0);
+    *size = (size_t)st.st_size;
+    ring = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    cr_assert_neq(ring, MAP_FAILED);
+    return ring;
+}
+
+/* Claims the next slot like a sender does, but doesn't commit it */
+static uint32_t
+claim_slot(struct ddsi_shm_ring *ring, uint32_t pid, uint32_t nonce)
+{
+    const uint32_t pos = os_atomic_ld32(&ring->head);
+    struct ddsi_shm_slot *slot = &ring->slots[pos & (ring->nslots - 1)];
+    cr_assert_eq(os_atomic_ld32(&slot->seq), pos);
+    cr_assert(os_atomic_cas32(&ring->head, pos, pos + 1));
+    slot->claimer_nonce = nonce;
+    os_atomic_st32(&slot->claimer_pid, pid);
+    return pos;
+}
+
+static uint32_t
+loc_nonce(const nn_locator_t *loc)
+{
+    return ((uint32_t)loc->address[8] << 24) | ((uint32_t)loc->address[9] << 16) |
+        ((uint32_t)loc->address[10] << 8) | (uint32_t)loc->address[11];
+}
+
+static void
+wait_abandon_timeout(void)
+{
+    /* Once to see the slot isn't committed, once after the timeout */
+    const os_time delay = { 1, 100000000 };
+    check_empty();
+    os_nanoSleep(delay);
+}
+
+Test(ddsc_shm, skip_gone_claimer, .init=shm_init, .fini=shm_fini)
+{
+    struct ddsi_shm_ring *ring;
+    nn_locator_t loc;
+    size_t size;
+    pid_t pid;
+    uint32_t i;
+    int status;
+
+    /* A sender that died after claiming a slot */
+    pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0) {
+        _exit(0);
+    }
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+
+    ddsi_conn_locator(g_conn, &loc);
+    ring = map_ring(&loc, &size);
+    cr_assert_gt(send_msg(&loc, 1, 8), 0);
+    (void)claim_slot(ring, (uint32_t)pid, 0xdeadbeefu);
+    cr_assert_gt(send_msg(&loc, 2, 8), 0);
+    check_msg(1, 8);
+    wait_abandon_timeout();
+
+    /* The slot gets recycled, so the ring remains fully usable */
+    check_msg(2, 8);
+    check_empty();
+    for (i = 0; i < RING_SIZE; i++) {
+        cr_assert_gt(send_msg(&loc, 10 + i, 16), 0);
+    }
+    for (i = 0; i < RING_SIZE; i++) {
+        check_msg(10 + i, 16);
+    }
+    check_empty();
+    munmap(ring, size);
+}
+
+Test(ddsc_shm, quarantine_slow_claimer, .init=shm_init, .fini=shm_fini)
+{
+    struct ddsi_shm_ring *ring;
+    struct ddsi_shm_slot *slot;
+    nn_locator_t loc;
+    size_t size;
+    uint32_t pos, i;
+
+    /* A sender that is still around, but doesn't get to complete its
+       message: this process */
+    ddsi_conn_locator(g_conn, &loc);
+    ring = map_ring(&loc, &size);
+    pos = claim_slot(ring, loc.port, loc_nonce(&loc));
+    slot = &ring->slots[pos & (ring->nslots - 1)];
+    cr_assert_gt(send_msg(&loc, 1, 8), 0);
+    wait_abandon_timeout();
+
+    /* The message after it is delivered, but the slot isn't handed back
+       as the sender may yet write into it, so the ring fills up */
+    check_msg(1, 8);
+    check_empty();
+    for (i = 0; i < RING_SIZE; i++) {
+        cr_assert_gt(send_msg(&loc, 10 + i, 16), 0);
+    }
+    for (i = 0; i < RING_SIZE - 2; i++) {
+        check_msg(10 + i, 16);
+    }
+    check_empty();
+
+    /* The sender completes its message, which by now is out of order and
+       gets dropped, after which all slots can be used again */
+    memset(slot->data, 0xee, 100);
+    slot->len = 100;
+    os_atomic_fence();
+    os_atomic_st32(&slot->seq, pos + 1);
+    check_empty();
+    for (i = 0; i < RING_SIZE; i++) {
+        cr_assert_gt(send_msg(&loc, 20 + i, 16), 0);
+    }
+    for (i = 0; i < RING_SIZE; i++) {
+        check_msg(20 + i, 16);
+    }
+    check_empty();
+    munmap(ring, size);
+}
+
+/* A ring owned by this test, standing in for another process */
+struct fake_peer {
+    nn_locator_t loc;
+    char name[64], path[128];
+    struct ddsi_shm_ring *ring;
+    size_t size;
+    int fifo;
+    uint32_t tail;
+};
+
+static void
+fake_peer_create(struct fake_peer *fp, uint32_t nonce)
+{
+    os_sockaddr_storage addr;
+    uint32_t i;
+    int fd;
+
+    ddsi_conn_locator(g_conn, &fp->loc);
+    fp->loc.address[8] = (unsigned char)(nonce >> 24);
+    fp->loc.address[9] = (unsigned char)(nonce >> 16);
+    fp->loc.address[10] = (unsigned char)(nonce >> 8);
+    fp->loc.address[11] = (unsigned char)nonce;
+    ddsi_shm_loc_to_address(&addr, &fp->loc);
+    (void)snprintf(fp->name, sizeof(fp->name), "%s", ((struct sockaddr_un *)&addr)->sun_path);
+    ddsi_shm_fifo_path(fp->path, sizeof(fp->path), fp->name);
+    cr_assert_eq(mkfifo(fp->path, 0600), 0);
+    fp->fifo = open(fp->path, O_RDWR | O_NONBLOCK);
+    cr_assert_neq(fp->fifo, -1);
+    cr_assert_eq(flock(fp->fifo, LOCK_EX | LOCK_NB), 0);
+    fp->size = sizeof(struct ddsi_shm_ring) + RING_SIZE * sizeof(struct ddsi_shm_slot);
+    fd = shm_open(fp->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    cr_assert_neq(fd, -1);
+    cr_assert_eq(ftruncate(fd, (off_t)fp->size), 0);
+    fp->ring = mmap(NULL, fp->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    cr_assert_neq(fp->ring, MAP_FAILED);
+    fp->ring->nslots = RING_SIZE;
+    for (i = 0; i < RING_SIZE; i++) {
+        os_atomic_st32(&fp->ring->slots[i].seq, i);
+    }
+    fp->ring->version = DDSI_SHM_VERSION;
+    os_atomic_fence();
+    fp->ring->magic = DDSI_SHM_MAGIC;
+    fp->tail = 0;
+}
+
+static void
+fake_peer_destroy(struct fake_peer *fp)
+{
+    munmap(fp->ring, fp->size);
+    (void)shm_unlink(fp->name);
+    (void)unlink(fp->path);
+    close(fp->fifo);
+}
+
+static void
+fake_peer_check_msg(struct fake_peer *fp, uint32_t seq, size_t len)
+{
+    struct ddsi_shm_slot *slot = &fp->ring->slots[fp->tail % RING_SIZE];
+    uint32_t rseq;
+    cr_assert_eq(os_atomic_ld32(&slot->seq), fp->tail + 1, "expected message %u", seq);
+    cr_assert_eq(slot->len, sizeof(seq) + len);
+    memcpy(&rseq, slot->data, sizeof(rseq));
+    cr_assert_eq(rseq, seq);
+    os_atomic_st32(&slot->seq, fp->tail + RING_SIZE);
+    fp->tail++;
+}
+
+Test(ddsc_shm, peer_restart, .init=shm_init, .fini=shm_fini)
+{
+    struct fake_peer old, new;
+
+    fake_peer_create(&old, 0x01d01d01u);
+    cr_assert(ddsi_shm_reachable(&old.loc));
+    cr_assert_gt(send_msg(&old.loc, 1, 8), 0);
+    fake_peer_check_msg(&old, 1, 8);
+
+    /* A restarted process has a new ring with a new name */
+    fake_peer_destroy(&old);
+    fake_peer_create(&new, 0x0e0e0e0eu);
+
+    /* Until its proxy participant is deleted, the old ring remains mapped
+       and messages to it silently go nowhere */
+    cr_assert(ddsi_shm_reachable(&old.loc));
+    cr_assert_gt(send_msg(&old.loc, 2, 8), 0);
+
+    /* after that, it is no longer used, as it can't be mapped anymore */
+    ddsi_shm_forget_peer(&old.loc);
+    cr_assert(!ddsi_shm_reachable(&old.loc));
+    cr_assert_lt(send_msg(&old.loc, 3, 8), 0);
+
+    /* while the new one is reachable, also after forgetting it */
+    cr_assert(ddsi_shm_reachable(&new.loc));
+    cr_assert_gt(send_msg(&new.loc, 4, 8), 0);
+    fake_peer_check_msg(&new, 4, 8);
+    ddsi_shm_forget_peer(&new.loc);
+    cr_assert_gt(send_msg(&new.loc, 5, 8), 0);
+    fake_peer_check_msg(&new, 5, 8);
+    fake_peer_destroy(&new);
+    ddsi_shm_forget_peer(&new.loc);
+    check_empty();
+}
+
+static void
+make_ring(const char *name, char *path, size_t size)
+{
+    int fd;
+    ddsi_shm_fifo_path(path, size, name);
+    cr_assert_eq(mkfifo(path, 0600), 0, "mkfifo %s failed (errno %d)", path, errno);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    cr_assert_neq(fd, -1, "shm_open %s failed (errno %d)", name, errno);
+    close(fd);
+}
+
+static int
+ring_exists(const char *name, const char *path)
+{
+    int fd, shm_ok, fifo_ok;
+    if ((fd = shm_open(name, O_RDWR, 0)) != -1) {
+        close(fd);
+    }
+    shm_ok = (fd != -1);
+    fifo_ok = (access(path, F_OK) == 0);
+    cr_assert_eq(shm_ok, fifo_ok, "ring %s and its FIFO should come and go together", name);
+    return shm_ok;
+}
+
+Test(ddsc_shm, remove_stale, .init=shm_init, .fini=shm_fini)
+{
+    char name_dead[64], path_dead[128], name_live[64], path_live[128];
+    pid_t pid;
+    int fd, status;
+
+    /* A pid that doesn't exist in this namespace */
+    pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0) {
+        _exit(0);
+    }
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+
+    /* A crashed process leaves its ring behind without anyone holding the
+       lock on its FIFO. A process in another pid namespace may well have
+       a pid that doesn't exist here, but it does hold the lock. */
+    (void)snprintf(name_dead, sizeof(name_dead), "/dds-shm-%d-%08x", (int)pid, 0xdeadbeefu);
+    make_ring(name_dead, path_dead, sizeof(path_dead));
+    (void)snprintf(name_live, sizeof(name_live), "/dds-shm-%d-%08x", (int)pid, 0xa11feu);
+    make_ring(name_live, path_live, sizeof(path_live));
+    fd = open(path_live, O_RDWR | O_NONBLOCK);
+    cr_assert_neq(fd, -1);
+    cr_assert_eq(flock(fd, LOCK_EX | LOCK_NB), 0);
+
+    /* Creating a ring cleans up after processes that are gone */
+    ddsi_conn_free(g_conn);
+    g_conn = create_conn();
+    cr_assert_not_null(g_conn);
+    cr_assert(!ring_exists(name_dead, path_dead));
+    cr_assert(ring_exists(name_live, path_live));
+
+    /* and the other one once its owner has gone as well */
+    close(fd);
+    ddsi_conn_free(g_conn);
+    g_conn = create_conn();
+    cr_assert_not_null(g_conn);
+    cr_assert(!ring_exists(name_live, path_live));
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+#include "ddsc/dds.h"
+#include "Space.h"
+#include "os/os.h"
+
+#define MAX_SAMPLES 10
+
+static dds_entity_t g_participant = 0;
+static dds_entity_t g_topic = 0;
+static dds_entity_t g_writer = 0;
+static dds_entity_t g_reader = 0;
+
+static char*
+create_topic_name(const char *prefix, char *name, size_t size)
+{
+    /* Get semi random g_topic name. */
+    os_procId pid = os_procIdSelf();
+    uintmax_t tid = os_threadIdToInteger(os_threadIdSelf());
+    (void) snprintf(name, size, "%s_pid%"PRIprocId"_tid%"PRIuMAX"", prefix, pid, tid);
+    return name;
+}
+
+static void
+statistics_init(void)
+{
+    char name[100];
+    dds_qos_t *qos;
+
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+
+    g_topic = dds_create_topic(g_participant, &Space_Type1_desc, create_topic_name("ddsc_statistics", name, sizeof name), NULL, NULL);
+    cr_assert_gt(g_topic, 0, "Failed to create prerequisite g_topic");
+
+    qos = dds_qos_create();
+    dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_INFINITY);
+    dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, 0);
+    g_writer = dds_create_writer(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(g_writer, 0, "Failed to create prerequisite g_writer");
+
+    /* A best-effort reader that can hold only a single sample: all others
+     * written by the writer get rejected and are lost. */
+    dds_qset_reliability(qos, DDS_RELIABILITY_BEST_EFFORT, 0);
+    dds_qset_resource_limits(qos, 1, DDS_LENGTH_UNLIMITED, DDS_LENGTH_UNLIMITED);
+    g_reader = dds_create_reader(g_participant, g_topic, qos, NULL);
+    cr_assert_gt(g_reader, 0, "Failed to create prerequisite g_reader");
+    dds_qos_delete(qos);
+}
+
+static void
+statistics_fini(void)
+{
+    dds_delete(g_participant);
+}
+
+/*************************************************************************************************/
+Test(ddsc_statistics, initial, .init=statistics_init, .fini=statistics_fini)
+{
+    dds_statistics_t stats;
+    dds_return_t ret;
+
+    ret = dds_get_statistics(g_writer, &stats);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(stats.samples_written, 0);
+    cr_assert_eq(stats.bytes_written, 0);
+    cr_assert_eq(stats.whc_unacked_bytes, 0);
+    cr_assert_eq(stats.samples_received, 0);
+
+    ret = dds_get_statistics(g_reader, &stats);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(stats.samples_written, 0);
+    cr_assert_eq(stats.samples_received, 0);
+    cr_assert_eq(stats.samples_rejected, 0);
+    cr_assert_eq(stats.samples_dropped, 0);
+}
+
+/*************************************************************************************************/
+Test(ddsc_statistics, write, .init=statistics_init, .fini=statistics_fini)
+{
+    dds_statistics_t wrstats, rdstats;
+    dds_return_t ret;
+    int i;
+
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        Space_Type1 sample = { i, i, i };
+        ret = dds_write(g_writer, &sample);
+        cr_assert_eq(ret, DDS_RETCODE_OK);
+    }
+
+    ret = dds_get_statistics(g_writer, &wrstats);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(wrstats.samples_written, MAX_SAMPLES);
+    cr_assert_geq(wrstats.bytes_written, MAX_SAMPLES * sizeof(Space_Type1));
+    cr_assert_eq(wrstats.throttle_count, 0);
+    cr_assert_eq(wrstats.throttle_time, 0);
+
+    ret = dds_get_statistics(g_reader, &rdstats);
+    cr_assert_eq(ret, DDS_RETCODE_OK);
+    cr_assert_eq(rdstats.samples_received, 1);
+    cr_assert_eq(rdstats.samples_rejected, 0);
+    cr_assert_eq(rdstats.samples_dropped, MAX_SAMPLES - 1);
+}
+
+/*************************************************************************************************/
+Test(ddsc_statistics, invalid_params, .init=statistics_init, .fini=statistics_fini)
+{
+    dds_statistics_t stats;
+    dds_return_t ret;
+
+    /* Disable SAL warning on intentional misuse of the API */
+    OS_WARNING_MSVC_OFF(6387);
+    ret = dds_get_statistics(g_writer, NULL);
+    OS_WARNING_MSVC_ON(6387);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+
+    ret = dds_get_statistics(0, &stats);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_BAD_PARAMETER);
+
+    ret = dds_get_statistics(g_topic, &stats);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ILLEGAL_OPERATION);
+
+    ret = dds_get_statistics(g_participant, &stats);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ILLEGAL_OPERATION);
+}
+
+/*************************************************************************************************/
+Test(ddsc_statistics, deleted, .init=statistics_init, .fini=statistics_fini)
+{
+    dds_statistics_t stats;
+    dds_return_t ret;
+
+    dds_delete(g_writer);
+    ret = dds_get_statistics(g_writer, &stats);
+    cr_assert_eq(dds_err_nr(ret), DDS_RETCODE_ALREADY_DELETED);
+}
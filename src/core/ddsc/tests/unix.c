@@ -0,0 +1,258 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "ddsc/dds.h"
+#include "os/os.h"
+#include "ddsi/ddsi_tran.h"
+#include "ddsi/ddsi_unix.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#if OS_SOCKET_HAS_AF_UNIX
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**************************************************************************************************
+ *
+ * Test fixtures
+ *
+ *************************************************************************************************/
+static dds_entity_t g_participant = 0;
+static ddsi_tran_conn_t g_conn = NULL;
+
+/* The transport refuses to be used with a small net.unix.max_dgram_qlen */
+static int
+qlen_too_small(void)
+{
+#ifdef __linux__
+    FILE *fp;
+    unsigned qlen = 0;
+    if ((fp = fopen("/proc/sys/net/unix/max_dgram_qlen", "r")) == NULL) {
+        return 0;
+    }
+    if (fscanf(fp, "%u", &qlen) != 1) {
+        qlen = 0;
+    }
+    fclose(fp);
+    return qlen > 0 && qlen < 128;
+#else
+    return 0;
+#endif
+}
+
+static void
+unix_init(void)
+{
+    g_participant = dds_create_participant(DDS_DOMAIN_DEFAULT, NULL, NULL);
+    cr_assert_gt(g_participant, 0, "Failed to create prerequisite g_participant");
+    cr_assert_eq(ddsi_unix_init(), 0);
+    g_conn = ddsi_factory_create_conn(ddsi_factory_find("unix"), 0, NULL);
+    if (qlen_too_small()) {
+        /* then there is nothing else to test */
+        cr_assert_null(g_conn, "transport should not be used with a small net.unix.max_dgram_qlen");
+    } else {
+        cr_assert_not_null(g_conn, "Failed to create prerequisite g_conn");
+    }
+}
+
+static void
+unix_fini(void)
+{
+    if (g_conn) {
+        ddsi_conn_free(g_conn);
+        g_conn = NULL;
+    }
+    dds_delete(g_participant);
+}
+
+static ssize_t
+send_msg(const nn_locator_t *loc, uint32_t seq, size_t len)
+{
+    os_sockaddr_storage dst;
+    unsigned char buf[256];
+    struct msghdr msg;
+    struct iovec iov[2];
+
+    cr_assert_leq(len, sizeof(buf));
+    memset(buf, (int)(seq & 0xff), len);
+    ddsi_unix_loc_to_address(&dst, loc);
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = (void *)&seq;
+    iov[0].iov_len = sizeof(seq);
+    iov[1].iov_base = (void *)buf;
+    iov[1].iov_len = len;
+    msg.msg_name = &dst;
+    msg.msg_namelen = ddsi_unix_sockaddr_size(&dst);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    return ddsi_conn_write(g_conn, &msg, sizeof(seq) + len, 0);
+}
+
+/* Returns the sequence number of the next message, or -1 if there is none */
+static int64_t
+recv_msg(size_t len)
+{
+    unsigned char buf[256];
+    os_socket sock = (os_socket)ddsi_conn_handle(g_conn);
+    os_time timeout = { 0, 100000000 };
+    fd_set fds;
+    uint32_t seq;
+    ssize_t n;
+    size_t i;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    if (os_sockSelect((int32_t)sock + 1, &fds, NULL, NULL, &timeout) <= 0) {
+        return -1;
+    }
+    n = ddsi_conn_read(g_conn, buf, sizeof(buf));
+    cr_assert_eq(n, (ssize_t)(sizeof(seq) + len));
+    memcpy(&seq, buf, sizeof(seq));
+    for (i = 0; i < len; i++) {
+        cr_assert_eq(buf[sizeof(seq) + i], (unsigned char)(seq & 0xff));
+    }
+    return seq;
+}
+
+/**************************************************************************************************
+ *
+ * Tests
+ *
+ *************************************************************************************************/
+Test(ddsc_unix, bind, .init=unix_init, .fini=unix_fini)
+{
+    os_sockaddr_storage addr, bound;
+    socklen_t addrlen = sizeof(bound);
+    nn_locator_t loc;
+
+    if (g_conn == NULL) {
+        return;
+    }
+    ddsi_conn_locator(g_conn, &loc);
+    cr_assert_eq(loc.kind, NN_LOCATOR_KIND_UNIX);
+    cr_assert_eq(loc.port, (uint32_t)os_procIdSelf());
+    ddsi_unix_loc_to_address(&addr, &loc);
+    cr_assert_eq(getsockname((int)ddsi_conn_handle(g_conn), (struct sockaddr *)&bound, &addrlen), 0);
+    cr_assert_eq(addrlen, ddsi_unix_sockaddr_size(&addr));
+    cr_assert_eq(memcmp(&bound, &addr, addrlen), 0);
+
+    /* A process has only one */
+    cr_assert_null(ddsi_factory_create_conn(ddsi_factory_find("unix"), 0, NULL));
+}
+
+Test(ddsc_unix, address_size, .init=unix_init, .fini=unix_fini)
+{
+    const size_t off = offsetof(struct sockaddr_un, sun_path);
+    const struct sockaddr_un *x;
+    os_sockaddr_storage addr;
+    nn_locator_t loc;
+    int sock;
+
+    if (g_conn == NULL) {
+        return;
+    }
+    ddsi_conn_locator(g_conn, &loc);
+    ddsi_unix_loc_to_address(&addr, &loc);
+    x = (const struct sockaddr_un *)&addr;
+    cr_assert_eq(x->sun_family, AF_UNIX);
+    if (x->sun_path[0] == 0) {
+        /* An abstract name is exactly as long as the given length says,
+           trailing zeros would make it a different name */
+        cr_assert_gt(strlen(x->sun_path + 1), 0);
+        cr_assert_eq(ddsi_unix_sockaddr_size(&addr), (socklen_t)(off + 1 + strlen(x->sun_path + 1)));
+        sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        cr_assert_geq(sock, 0);
+        cr_assert_neq(connect(sock, (const struct sockaddr *)&addr, (socklen_t)sizeof(struct sockaddr_un)), 0);
+        cr_assert_eq(connect(sock, (const struct sockaddr *)&addr, ddsi_unix_sockaddr_size(&addr)), 0);
+        close(sock);
+    } else {
+        cr_assert_eq(ddsi_unix_sockaddr_size(&addr), (socklen_t)(off + strlen(x->sun_path) + 1));
+    }
+}
+
+Test(ddsc_unix, reachable, .init=unix_init, .fini=unix_fini)
+{
+    nn_locator_t loc, other;
+
+    if (g_conn == NULL) {
+        return;
+    }
+    ddsi_conn_locator(g_conn, &loc);
+    cr_assert(ddsi_unix_reachable(&loc));
+
+    /* No one is bound to a different nonce */
+    other = loc;
+    other.address[11] ^= 0xff;
+    cr_assert(!ddsi_unix_reachable(&other));
+
+    /* and a socket on another host is never reachable */
+    other = loc;
+    other.address[0] ^= 0xff;
+    cr_assert(!ddsi_unix_reachable(&other));
+}
+
+Test(ddsc_unix, send_recv, .init=unix_init, .fini=unix_fini)
+{
+    nn_locator_t loc, other;
+    uint32_t i;
+
+    if (g_conn == NULL) {
+        return;
+    }
+    ddsi_conn_locator(g_conn, &loc);
+    for (i = 0; i < 10; i++) {
+        cr_assert_eq(send_msg(&loc, i, 8 * i), (ssize_t)(sizeof(i) + 8 * i));
+    }
+    for (i = 0; i < 10; i++) {
+        cr_assert_eq(recv_msg(8 * i), (int64_t)i);
+    }
+    cr_assert_eq(recv_msg(0), -1);
+
+    /* Sending to a socket that doesn't exist fails */
+    other = loc;
+    other.address[11] ^= 0xff;
+    cr_assert_lt(send_msg(&other, 0, 8), 0);
+}
+
+Test(ddsc_unix, drop_on_full, .init=unix_init, .fini=unix_fini)
+{
+    const uint32_t nmsgs = 10000;
+    nn_locator_t loc;
+    int64_t seq, prev = -1;
+    uint32_t i, nrecv = 0;
+
+    if (g_conn == NULL) {
+        return;
+    }
+    /* Like a UDP socket, a full receive queue drops messages rather than
+       making the sender wait, and the sender doesn't get to know */
+    ddsi_conn_locator(g_conn, &loc);
+    for (i = 0; i < nmsgs; i++) {
+        cr_assert_eq(send_msg(&loc, i, 200), (ssize_t)(sizeof(i) + 200));
+    }
+    while ((seq = recv_msg(200)) >= 0) {
+        cr_assert_gt(seq, prev);
+        prev = seq;
+        nrecv++;
+    }
+    cr_assert_gt(nrecv, 0);
+    cr_assert_lt(nrecv, nmsgs);
+
+    /* and once there is room again, messages get through */
+    cr_assert_gt(send_msg(&loc, nmsgs, 8), 0);
+    cr_assert_eq(recv_msg(8), (int64_t)nmsgs);
+}
+
+#endif
@@ -103,6 +103,7 @@ struct serdata_base
   uint32_t hash;       /* cached serdata hash, valid only if hash_valid != 0 */
   dds_key_hash_t keyhash;
   bool bswap;           /* Whether state is native endian or requires swapping */
+  uint32_t trace_id;    /* non-zero if the sample is traced (see q_sampletrace.h) */
 };
 
 struct serdata
@@ -121,6 +122,7 @@ struct dds_key_descriptor;
 
 
 struct dds_topic;
+struct dds_stream_filter;
 typedef void (*topic_cb_t) (struct dds_topic * topic);
 #ifndef DDS_TOPIC_INTERN_FILTER_FN_DEFINED
 #define DDS_TOPIC_INTERN_FILTER_FN_DEFINED
@@ -145,6 +147,7 @@ struct sertopic
   dds_topic_intern_filter_fn filter_fn;
   void * filter_sample;
   void * filter_ctx;
+  os_atomic_voidp_t field_filter; /* struct dds_stream_filter *, replaced old one freed via gc */
   struct dds_topic * status_cb_entity;
   const struct dds_key_descriptor * keys;
 
@@ -0,0 +1,82 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef _DDSI_SHM_H_
+#define _DDSI_SHM_H_
+
+#include "os/os_atomics.h"
+#include "ddsi/ddsi_tran.h"
+
+/* Shared-memory transport for processes on the same host. Each process
+   owns a receive ring in a POSIX shared memory object, into which the
+   other processes copy their messages; a FIFO in a directory private to
+   the user is used to wake up the receive thread, and the lock its owner
+   holds on it tells other processes the ring is still in use. The locator (NN_LOCATOR_KIND_SHM) identifies the
+   host, so that peers elsewhere ignore it, and the ring. */
+
+/* Layout of a ring, which all processes using it must agree on */
+#define DDSI_SHM_MAGIC 0x4444534du /* "DDSM" */
+#define DDSI_SHM_VERSION 2u
+#define DDSI_SHM_MSGSIZE 65536u /* as with UDP, no message exceeds 64kB */
+
+/* Slot i of a ring with n slots is free for the sender that claimed
+   position p (p mod n = i) when seq = p, and holds that sender's message
+   once seq = p+1; the receiver hands it back for the next round by
+   setting seq to p+n. Any number of senders claim positions by
+   incrementing head, the one receiver keeps its position privately.
+
+   Right after claiming a slot, a sender stores the pid and nonce that
+   name its own ring in it, claimer_pid last; the receiver clears
+   claimer_pid when handing the slot back. A sender that dies between
+   claiming and committing would block the ring forever, so the receiver
+   recycles a slot that remains uncommitted for too long if its claimer
+   is known to be gone. If it isn't, the slot is quarantined: the
+   messages after it are delivered, but the slot itself is only handed
+   back once it has been committed (and its contents dropped) or its
+   claimer has gone, so that a slow sender can never overwrite the
+   message of the next sender to use the slot. */
+struct ddsi_shm_slot
+{
+  os_atomic_uint32_t seq;
+  os_atomic_uint32_t claimer_pid; /* 0 if not (yet) known */
+  uint32_t claimer_nonce;
+  uint32_t len;
+  unsigned char data[DDSI_SHM_MSGSIZE];
+};
+
+struct ddsi_shm_ring
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nslots;
+  uint32_t pad0[13];
+  os_atomic_uint32_t head;
+  uint32_t pad1[15];
+  os_atomic_uint32_t notify; /* set while a wake-up is pending in the FIFO */
+  uint32_t pad2[15];
+  struct ddsi_shm_slot slots[];
+};
+
+int ddsi_shm_init (void);
+
+/* Whether loc is the locator of a ring on this host that can be mapped */
+bool ddsi_shm_reachable (const nn_locator_t *loc);
+
+/* Releases the mapping of the ring of a peer that has gone */
+void ddsi_shm_forget_peer (const nn_locator_t *loc);
+
+/* Name of the ring (the path in dst, which is an AF_UNIX address) */
+void ddsi_shm_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc);
+
+/* Path of the FIFO belonging to the ring with the given name */
+void ddsi_shm_fifo_path (char *path, size_t size, const char *name);
+
+#endif
@@ -25,6 +25,7 @@
 /* Flags */
 
 #define DDSI_TRAN_ON_CONNECT 0x0001
+#define DDSI_TRAN_MORE 0x0002 /* more writes follow, may be deferred until ddsi_conn_flush */
 
 /* Core types */
 
@@ -38,6 +39,7 @@ typedef struct ddsi_tran_qos * ddsi_tran_qos_t;
 
 typedef ssize_t (*ddsi_tran_read_fn_t) (ddsi_tran_conn_t , unsigned char *, size_t);
 typedef ssize_t (*ddsi_tran_write_fn_t) (ddsi_tran_conn_t, const struct msghdr *, size_t, uint32_t);
+typedef void (*ddsi_tran_flush_fn_t) (ddsi_tran_conn_t);
 typedef int (*ddsi_tran_locator_fn_t) (ddsi_tran_base_t, nn_locator_t *);
 typedef bool (*ddsi_tran_supports_fn_t) (int32_t);
 typedef os_handle (*ddsi_tran_handle_fn_t) (ddsi_tran_base_t);
@@ -78,6 +80,7 @@ struct ddsi_tran_conn
 
   ddsi_tran_read_fn_t m_read_fn;
   ddsi_tran_write_fn_t m_write_fn;
+  ddsi_tran_flush_fn_t m_flush_fn; /* optional */
   ddsi_tran_peer_locator_fn_t m_peer_locator_fn;
 
   /* Data */
@@ -174,6 +177,7 @@ void ddsi_factory_conn_init (ddsi_tran_factory_t factory, ddsi_tran_conn_t conn)
 #define ddsi_conn_handle(c) (ddsi_tran_handle (&(c)->m_base))
 #define ddsi_conn_locator(c,l) (ddsi_tran_locator (&(c)->m_base,(l)))
 OSAPI_EXPORT ssize_t ddsi_conn_write (ddsi_tran_conn_t conn, const struct msghdr * msg, size_t len, uint32_t flags);
+void ddsi_conn_flush (ddsi_tran_conn_t conn);
 ssize_t ddsi_conn_read (ddsi_tran_conn_t conn, unsigned char * buf, size_t len);
 bool ddsi_conn_peer_locator (ddsi_tran_conn_t conn, nn_locator_t * loc);
 void ddsi_conn_add_ref (ddsi_tran_conn_t conn);
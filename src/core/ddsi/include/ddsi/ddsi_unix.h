@@ -0,0 +1,37 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef _DDSI_UNIX_H_
+#define _DDSI_UNIX_H_
+
+#include "ddsi/ddsi_tran.h"
+
+/* Unix domain datagram socket transport for processes on the same host.
+   The socket is bound to a name derived from the locator
+   (NN_LOCATOR_KIND_UNIX), which also identifies the host so that peers
+   elsewhere ignore it. On Linux the name lives in the abstract namespace,
+   elsewhere it is a file in the temporary directory. */
+
+int ddsi_unix_init (void);
+
+/* Whether loc is the locator of a socket on this host that is bound */
+bool ddsi_unix_reachable (const nn_locator_t *loc);
+
+/* Socket address corresponding to the locator */
+void ddsi_unix_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc);
+
+#if OS_SOCKET_HAS_AF_UNIX
+/* Length of a (possibly abstract) AF_UNIX address, which for an abstract
+   name must not include anything beyond the name */
+socklen_t ddsi_unix_sockaddr_size (const os_sockaddr_storage *a);
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef _DDSI_URING_H_
+#define _DDSI_URING_H_
+
+#include "ddsi/ddsi_tran.h"
+
+/* io_uring-based I/O for the UDP transport (Linux only). The sockets,
+   locators and multicast handling remain those of the UDP transport, but
+   once attached, writes to a connection go through an io_uring, and the
+   receive thread uses a uring waitset instead of the select()-based one:
+   attached connections then have a multishot receive outstanding that
+   takes its buffers from a ring provided to the kernel, other connections
+   get a poll request. */
+
+struct ddsi_uring_waitset;
+
+/* Returns < 0 if io_uring is not supported */
+int ddsi_uring_init (void);
+void ddsi_uring_fini (void);
+
+/* Switch writes (and, when in a uring waitset, reads) of a UDP connection
+   to io_uring */
+int ddsi_uring_attach (ddsi_tran_conn_t conn);
+
+/* Analogous to os_sockWaitset, but only a single one can exist, and
+   connections can be added only from the thread calling wait */
+struct ddsi_uring_waitset *ddsi_uring_waitset_new (void);
+void ddsi_uring_waitset_free (struct ddsi_uring_waitset *ws);
+void ddsi_uring_waitset_trigger (struct ddsi_uring_waitset *ws);
+void ddsi_uring_waitset_add (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t conn);
+bool ddsi_uring_waitset_wait (struct ddsi_uring_waitset *ws);
+int ddsi_uring_waitset_next_event (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t *conn);
+
+#endif
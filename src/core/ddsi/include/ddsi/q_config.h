@@ -202,6 +202,9 @@ struct config
   logcat_t enabled_logcats;
   char *servicename;
   char *pcap_file;
+  uint32_t pcap_bufsize;
+  char *sample_trace_file;
+  uint32_t sample_trace_interval;
 
   char *networkAddressString;
   char **networkRecvAddressStrings;
@@ -212,6 +215,7 @@ struct config
   int tracingTimestamps;
   int tracingRelativeTimestamps;
   int tracingAppendToFile;
+  uint32_t tracing_async_bufsize;
   unsigned allowMulticast;
   int useIpv6;
   int dontRoute;
@@ -268,6 +272,20 @@ struct config
   int64_t tcp_read_timeout;
   int64_t tcp_write_timeout;
 
+  /* Shared-memory transport configuration */
+
+  int shm_enable;
+  unsigned shm_ring_size;
+
+  /* Unix domain socket transport configuration */
+
+  int unix_enable;
+
+  /* io_uring configuration */
+
+  int uring_enable;
+  unsigned uring_rbufs;
+
 #ifdef DDSI_INCLUDE_SSL
 
   /* SSL support for TCP */
@@ -348,6 +366,8 @@ struct config
 #endif
   uint32_t max_queued_rexmit_bytes;
   unsigned max_queued_rexmit_msgs;
+  uint32_t max_discovery_rexmit_burst;
+  int rexmit_thread;
   unsigned ddsi2direct_max_threads;
   int late_ack_mode;
   int retry_on_reject_besteffort;
@@ -371,6 +391,7 @@ struct config
   int port_d3;
 
   int monitor_port;
+  uint32_t lat_histogram_interval;
 
   int enable_control_topic;
   int initial_deaf;
@@ -18,6 +18,7 @@
 #include "ddsi/q_protocol.h"
 #include "ddsi/q_lat_estim.h"
 #include "ddsi/q_ephash.h"
+#include "ddsi/q_qosmatch.h"
 #include "ddsi/q_hbcontrol.h"
 #include "ddsi/q_feature_check.h"
 
@@ -138,7 +139,7 @@ struct entity_common {
 };
 
 struct local_reader_ary {
-  os_mutex rdary_lock;
+  os_rwlock rdary_lock; /* delivery only reads rdary, so it takes the lock shared */
   unsigned valid: 1; /* always true until (proxy-)writer is being deleted; !valid => !fastpath_ok */
   unsigned fastpath_ok: 1; /* if not ok, fall back to using GUIDs (gives access to the reader-writer match data for handling readers that bumped into resource limits, hence can flip-flop, unlike "valid") */
   int n_readers;
@@ -153,6 +154,8 @@ struct participant
   unsigned prismtech_bes; /* prismtech-specific extension of built-in endpoints set */
   unsigned is_ddsi2_pp: 1; /* true for the "federation leader", the ddsi2 participant itself in OSPL; FIXME: probably should use this for broker mode as well ... */
   nn_plist_t *plist; /* settings/QoS for this participant */
+  void *spdp_payload; /* last SPDP payload fully processed, to skip unchanged ones */
+  uint32_t spdp_payload_size;
   struct xevent *spdp_xevent; /* timed event for periodically publishing SPDP */
   struct xevent *pmd_update_xevent; /* timed event for periodically publishing ParticipantMessageData */
   nn_locator_t m_locator;
@@ -219,6 +222,7 @@ struct writer
   int throttling; /* non-zero when some thread is waiting for the WHC to shrink */
   struct hbcontrol hbcontrol; /* controls heartbeat timing, piggybacking */
   struct nn_xqos *xqos;
+  struct nn_partition_set partitions; /* partition QoS preprocessed for matching */
   enum writer_state state;
   unsigned reliable: 1; /* iff 1, writer is reliable <=> heartbeat_xevent != NULL */
   unsigned handle_as_transient_local: 1; /* controls whether data is retained in WHC */
@@ -249,6 +253,8 @@ struct writer
   uint32_t num_nacks_received; /* cum received ACKNACKs that did request retransmission */
   uint32_t throttle_count; /* cum times transmitting was throttled (whc hitting high-level mark) */
   uint32_t throttle_tracing;
+  int64_t throttle_time; /* cum time spent blocked in throttle_writer (ns) */
+  uint64_t num_bytes_written; /* cum serialized payload bytes of samples accepted for transmission */
   uint32_t rexmit_count; /* cum samples retransmitted (counting events; 1 sample can be counted many times) */
   uint32_t rexmit_lost_count; /* cum samples lost but retransmit requested (also counting events) */
   struct xeventq *evq; /* timed event queue to be used by this writer */
@@ -263,6 +269,7 @@ struct reader
   void * status_cb_entity;
   struct rhc * rhc; /* reader history, tracks registrations and data */
   struct nn_xqos *xqos;
+  struct nn_partition_set partitions; /* partition QoS preprocessed for matching */
   unsigned reliable: 1; /* 1 iff reader is reliable */
   unsigned handle_as_transient_local: 1; /* 1 iff reader wants historical data from proxy writers */
 #ifdef DDSI_INCLUDE_SSM
@@ -288,6 +295,8 @@ struct proxy_participant
   unsigned prismtech_bes; /* prismtech-specific extension of built-in endpoints set */
   nn_guid_t privileged_pp_guid; /* if this PP depends on another PP for its SEDP writing */
   nn_plist_t *plist; /* settings/QoS for this participant */
+  void *spdp_payload; /* last SPDP payload fully processed, to skip unchanged ones */
+  uint32_t spdp_payload_size;
   os_atomic_voidp_t lease; /* lease object for this participant, for automatic leases */
   struct addrset *as_default; /* default address set to use for user data traffic */
   struct addrset *as_meta; /* default address set to use for discovery traffic */
@@ -324,6 +333,7 @@ struct proxy_endpoint_common
   struct proxy_endpoint_common *next_ep; /* next \ endpoint belonging to this proxy participant */
   struct proxy_endpoint_common *prev_ep; /* prev / -- this is in arbitrary ordering */
   struct nn_xqos *xqos; /* proxy endpoint QoS lives here; FIXME: local ones should have it moved to common as well */
+  struct nn_partition_set partitions; /* partition QoS preprocessed for matching */
   const struct sertopic * topic; /* topic may be NULL: for built-ins, but also for never-yet matched proxies (so we don't have to know the topic; when we match, we certainly do know) */
   struct addrset *as; /* address set to use for communicating with this endpoint */
   nn_guid_t group_guid; /* 0:0:0:0 if not available */
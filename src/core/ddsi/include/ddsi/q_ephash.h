@@ -27,6 +27,7 @@ struct proxy_participant;
 struct proxy_reader;
 struct proxy_writer;
 struct nn_guid;
+struct nn_xqos;
 
   enum entity_kind {
     EK_PARTICIPANT,
@@ -114,6 +115,20 @@ void ephash_enum_init (struct ephash_enum *st, enum entity_kind kind);
 void *ephash_enum_next (struct ephash_enum *st);
 void ephash_enum_fini (struct ephash_enum *st);
 
+/* Enumeration of the (non-built-in) readers & writers with the same
+   topic and type names as in xqos: visits exactly the endpoints of the
+   given kind that were present at the time of calling init; entries may
+   have been removed by the time "next" returns them. */
+struct ephash_enum_topic
+{
+  uint32_t i, n;
+  struct entity_common **eps;
+};
+
+void ephash_enum_topic_init (struct ephash_enum_topic *st, enum entity_kind kind, const struct nn_xqos *xqos);
+void *ephash_enum_topic_next (struct ephash_enum_topic *st);
+void ephash_enum_topic_fini (struct ephash_enum_topic *st);
+
 void ephash_enum_writer_init (struct ephash_enum_writer *st);
 void ephash_enum_reader_init (struct ephash_enum_reader *st);
 void ephash_enum_proxy_writer_init (struct ephash_enum_proxy_writer *st);
@@ -44,6 +44,7 @@ struct gcreq {
 
 struct gcreq_queue *gcreq_queue_new (void);
 void gcreq_queue_free (struct gcreq_queue *q);
+uint32_t gcreq_queue_count (struct gcreq_queue *q); /* requests not yet freed */
 
 struct gcreq *gcreq_new (struct gcreq_queue *gcreq_queue, gcreq_cb_t cb);
 void gcreq_free (struct gcreq *gcreq);
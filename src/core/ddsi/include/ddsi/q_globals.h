@@ -16,7 +16,7 @@
 
 #include "os/os.h"
 
-#include "util/ut_fibheap.h"
+#include "util/ut_timerwheel.h"
 
 
 #include "ddsi/q_plist.h"
@@ -34,6 +34,7 @@ extern "C" {
 
 struct nn_xmsgpool;
 struct serstatepool;
+struct nn_sampletrace;
 struct nn_dqueue;
 struct nn_reorder;
 struct nn_defrag;
@@ -45,6 +46,7 @@ struct lease;
 struct ddsi_tran_conn;
 struct ddsi_tran_listener;
 struct ddsi_tran_factory;
+struct ddsi_uring_waitset;
 struct ut_thread_pool_s;
 struct debug_monitor;
 struct tkmap;
@@ -62,6 +64,25 @@ enum recvips_mode {
   RECVIPS_MODE_SOME             /* explicit list of interfaces; only one requiring recvips */
 };
 
+/* Process-wide traffic counters, updated on the send and receive paths
+   without locking and exported by the debug monitor */
+#if OS_ATOMIC64_SUPPORT
+typedef os_atomic_uint64_t nn_stat_counter_t;
+#define NN_STAT_COUNTER_ADD(c, v) os_atomic_add64 (&(c), (uint64_t) (v))
+#define NN_STAT_COUNTER_LD(c) os_atomic_ld64 (&(c))
+#else
+typedef os_atomic_uint32_t nn_stat_counter_t;
+#define NN_STAT_COUNTER_ADD(c, v) os_atomic_add32 (&(c), (uint32_t) (v))
+#define NN_STAT_COUNTER_LD(c) ((uint64_t) os_atomic_ld32 (&(c)))
+#endif
+
+struct nn_net_stats {
+  nn_stat_counter_t packets_sent;
+  nn_stat_counter_t bytes_sent;
+  nn_stat_counter_t packets_received;
+  nn_stat_counter_t bytes_received;
+};
+
 #define N_LEASE_LOCKS_LG2 4
 #define N_LEASE_LOCKS ((int) (1 << N_LEASE_LOCKS_LG2))
 
@@ -81,6 +102,10 @@ struct q_globals {
   /* Timed events admin */
   struct xeventq *xevents;
 
+  /* Retransmits queued on xevents are diverted to this queue if
+     configured, NULL otherwise */
+  struct xeventq *rexmit_xevents;
+
   /* Queue for garbage collection requests */
   struct gcreq_queue *gcreq_queue;
   struct nn_servicelease *servicelease;
@@ -88,7 +113,7 @@ struct q_globals {
   /* Lease junk */
   os_mutex leaseheap_lock;
   os_mutex lease_locks[N_LEASE_LOCKS];
-  ut_fibheap_t leaseheap;
+  ut_timerwheel_t leaseheap;
 
   /* Transport factory */
 
@@ -105,6 +130,20 @@ struct q_globals {
   struct ddsi_tran_conn * disc_conn_uc;
   struct ddsi_tran_conn * data_conn_uc;
 
+  /* Shared-memory receive ring of this process, NULL if disabled; used
+     instead of UDP unicast for peers on this host that advertise one */
+
+  struct ddsi_tran_conn * shm_conn;
+
+  /* Unix domain datagram socket of this process, NULL if disabled; used
+     for peers on this host without a usable shared-memory ring */
+
+  struct ddsi_tran_conn * unix_conn;
+
+  /* io_uring-based replacement for waitset, NULL if not in use */
+
+  struct ddsi_uring_waitset * uring_waitset;
+
   /* TCP listener */
 
   struct ddsi_tran_listener * listener;
@@ -286,9 +325,14 @@ struct q_globals {
   q_securityDecoderSet recvSecurityCodec;
 #endif /* DDSI_INCLUDE_ENCRYPTION */
 
+  /* Cumulative over the lifetime of the process */
+  struct nn_net_stats net_stats;
+
   /* File for dumping captured packets, NULL if disabled */
-  FILE *pcap_fp;
-  os_mutex pcap_lock;
+  struct pcap_file *pcap_fp;
+
+  /* Sample tracing administration, NULL if disabled */
+  struct nn_sampletrace *sampletrace;
 
   /* Data structure to capture power events */
   os_timePowerEvents powerEvents;
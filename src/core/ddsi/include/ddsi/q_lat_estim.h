@@ -37,6 +37,26 @@ void nn_lat_estim_update (struct nn_lat_estim *le, int64_t est);
 double nn_lat_estim_current (const struct nn_lat_estim *le);
 int nn_lat_estim_log (logcat_t logcat, const char *tag, const struct nn_lat_estim *le);
 
+/* Log-bucketed latency histogram: each power of two is split into
+   2^NN_LAT_HISTOGRAM_SUB_BITS linear buckets, so the bucket width is
+   at most 1/8th of its lower bound. Latencies are in nanoseconds,
+   negative ones (clock skew) count as 0 and anything beyond 2^40ns
+   (~18 minutes) goes into the last bucket. Not thread-safe: the owner
+   is expected to serialise updates and reads. */
+#define NN_LAT_HISTOGRAM_SUB_BITS 3
+#define NN_LAT_HISTOGRAM_MAX_LG2 40
+#define NN_LAT_HISTOGRAM_NBUCKETS ((NN_LAT_HISTOGRAM_MAX_LG2 - NN_LAT_HISTOGRAM_SUB_BITS + 1) << NN_LAT_HISTOGRAM_SUB_BITS)
+
+struct nn_lat_histogram {
+  uint32_t count[NN_LAT_HISTOGRAM_NBUCKETS];
+};
+
+void nn_lat_histogram_init (struct nn_lat_histogram *lh);
+void nn_lat_histogram_record (struct nn_lat_histogram *lh, int64_t lat);
+uint64_t nn_lat_histogram_total (const uint32_t *count);
+int64_t nn_lat_histogram_bucket_lower (uint32_t idx);
+int64_t nn_lat_histogram_percentile (const uint32_t *count, double p);
+
 #if defined (__cplusplus)
 }
 #endif
@@ -57,6 +57,11 @@ OSAPI_EXPORT int nn_log (_In_ logcat_t cat, _In_z_ _Printf_format_string_ const
 OSAPI_EXPORT int nn_trace (_In_z_ _Printf_format_string_ const char *fmt, ...) __attribute_format__((printf,1,2));
 void nn_log_set_tstamp (nn_wctime_t tnow);
 
+/* Start/stop writing the trace file from a background thread, as
+   configured by Tracing/AsyncBufferSize */
+void nn_log_async_start (void);
+void nn_log_async_stop (void);
+
 #define TRACE(args) ((config.enabled_logcats & LC_TRACE) ? (nn_trace args) : 0)
 
 #define LOG_THREAD_CPUTIME(guard) do {                                  \
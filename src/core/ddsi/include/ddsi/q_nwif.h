@@ -50,6 +50,7 @@ int leave_mcgroups (struct nn_group_membership *mship, os_socket socket, const o
 void sockaddr_set_port (os_sockaddr_storage *addr, unsigned short port);
 unsigned short sockaddr_get_port (const os_sockaddr_storage *addr);
 unsigned sockaddr_to_hopefully_unique_uint32 (const os_sockaddr_storage *src);
+void get_host_id (unsigned char id[8]);
 
 #if defined (__cplusplus)
 }
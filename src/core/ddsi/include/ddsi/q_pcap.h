@@ -20,12 +20,15 @@ extern "C" {
 #endif
 
 struct msghdr;
+struct pcap_file;
 
-FILE * new_pcap_file (const char *name);
+struct pcap_file * new_pcap_file (const char *name, uint32_t bufsize);
+void free_pcap_file (struct pcap_file *pf);
+uint32_t pcap_file_dropped (const struct pcap_file *pf);
 
 void write_pcap_received
 (
-  FILE * fp,
+  struct pcap_file * pf,
   nn_wctime_t tstamp,
   const os_sockaddr_storage * src,
   const os_sockaddr_storage * dst,
@@ -35,7 +38,7 @@ void write_pcap_received
 
 void write_pcap_sent
 (
-  FILE * fp,
+  struct pcap_file * pf,
   nn_wctime_t tstamp,
   const os_sockaddr_storage * src,
   const struct msghdr * hdr,
@@ -209,6 +209,7 @@ void nn_plist_mergein_missing (nn_plist_t *a, const nn_plist_t *b);
 void nn_plist_copy (nn_plist_t *dst, const nn_plist_t *src);
 nn_plist_t *nn_plist_dup (const nn_plist_t *src);
 int nn_plist_init_frommsg (nn_plist_t *dest, char **nextafterplist, uint64_t pwanted, uint64_t qwanted, const nn_plist_src_t *src);
+int nn_plist_peek_guid (nn_guid_t *dest, nn_parameterid_t pid, const nn_plist_src_t *src);
 void nn_plist_fini (nn_plist_t *ps);
 void nn_plist_addtomsg (struct nn_xmsg *m, const nn_plist_t *ps, uint64_t pwanted, uint64_t qwanted);
 int nn_plist_init_default_participant (nn_plist_t *plist);
@@ -120,6 +120,8 @@ struct cdrstring {
 #define NN_LOCATOR_KIND_TCPv4 4
 #define NN_LOCATOR_KIND_TCPv6 8
 #define NN_LOCATOR_KIND_UDPv4MCGEN 0x4fff0000
+#define NN_LOCATOR_KIND_SHM 0x4fff0001 /* host id, nonce; port = pid */
+#define NN_LOCATOR_KIND_UNIX 0x4fff0002 /* host id, nonce; port = pid */
 #define NN_LOCATOR_PORT_INVALID 0
 
 #define NN_VENDORID_UNKNOWN                {{ 0x00, 0x00 }}
@@ -18,6 +18,22 @@ extern "C" {
 
 struct nn_xqos;
 
+/* Partition QoS of an endpoint, preprocessed for matching: the exact
+   partition names sorted and without duplicates, and the wildcard
+   expressions separately. An absent or empty partition QoS is stored
+   as the default partition "". The strings are aliased from the QoS,
+   which therefore must outlive the set. */
+struct nn_partition_set {
+  unsigned nexact;
+  unsigned nwild;
+  const char **exact;
+  const char **wild;
+};
+
+void nn_partition_set_init (struct nn_partition_set *ps, const struct nn_xqos *xqos);
+void nn_partition_set_fini (struct nn_partition_set *ps);
+int partition_sets_match_p (const struct nn_partition_set *a, const struct nn_partition_set *b);
+
 int partition_match_based_on_wildcard_in_left_operand (const struct nn_xqos *a, const struct nn_xqos *b, const char **realname);
 int partitions_match_p (const struct nn_xqos *a, const struct nn_xqos *b);
 int is_wildcard_partition (const char *str);
@@ -26,6 +42,10 @@ int is_wildcard_partition (const char *str);
 
 int32_t qos_match_p (const struct nn_xqos *rd, const struct nn_xqos *wr);
 
+/* Same as qos_match_p, but using the preprocessed partition sets of
+   reader and writer */
+int32_t qos_match_partition_sets_p (const struct nn_xqos *rd, const struct nn_partition_set *rdps, const struct nn_xqos *wr, const struct nn_partition_set *wrps);
+
 #if defined (__cplusplus)
 }
 #endif
@@ -207,6 +207,7 @@ typedef void (*nn_dqueue_callback_t) (void *arg);
 struct nn_rbufpool *nn_rbufpool_new (uint32_t rbuf_size, uint32_t max_rmsg_size);
 void nn_rbufpool_setowner (struct nn_rbufpool *rbp, os_threadId tid);
 void nn_rbufpool_free (struct nn_rbufpool *rbp);
+void nn_rbufpool_usage (struct nn_rbufpool *rbp, uint32_t *allocated, uint32_t *size);
 
 struct nn_rmsg *nn_rmsg_new (struct nn_rbufpool *rbufpool);
 void nn_rmsg_setsize (struct nn_rmsg *rmsg, uint32_t size);
@@ -242,6 +243,7 @@ void nn_dqueue_enqueue1 (struct nn_dqueue *q, const nn_guid_t *rdguid, struct nn
 void nn_dqueue_enqueue_callback (struct nn_dqueue *q, nn_dqueue_callback_t cb, void *arg);
 int  nn_dqueue_is_full (struct nn_dqueue *q);
 void nn_dqueue_wait_until_empty_if_full (struct nn_dqueue *q);
+uint32_t nn_dqueue_depth (struct nn_dqueue *q);
 
 #if defined (__cplusplus)
 }
@@ -0,0 +1,78 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef Q_SAMPLETRACE_H
+#define Q_SAMPLETRACE_H
+
+#include "ddsi/q_rtps.h"
+#include "ddsi/q_time.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* Sample tracing records the time at which a sample passes the stages
+   of the data path, from serialization in the writer to being taken
+   from the reader history. Only samples with a sequence number that is
+   a multiple of the configured interval are traced, so sender and
+   receiver trace the same samples without any coordination. Events go
+   into a ring buffer per thread and are written as a Chrome trace (JSON,
+   viewable in chrome://tracing or Perfetto) when DDSI terminates.
+
+   Stages past the creation of the serdata for the sample identify it
+   only by serdata::v.trace_id; the export maps these back to writer
+   GUID and sequence number. */
+
+enum nn_sampletrace_stage {
+  NN_SAMPLETRACE_SERIALIZE,   /* start of serialization (dds_write) */
+  NN_SAMPLETRACE_WHC_INSERT,  /* sequence number assigned, inserted in WHC */
+  NN_SAMPLETRACE_XPACK_ADD,   /* Data submessage added to a packet */
+  NN_SAMPLETRACE_SENDMSG,     /* packet containing it sent */
+  NN_SAMPLETRACE_RECVMSG,     /* packet containing it received */
+  NN_SAMPLETRACE_DEFRAG,      /* complete sample out of defragmenter */
+  NN_SAMPLETRACE_REORDER,     /* processed by reorder admin of proxy writer */
+  NN_SAMPLETRACE_DQUEUE,      /* dequeued (or synchronously) delivered */
+  NN_SAMPLETRACE_RHC_STORE,   /* stored in a reader history */
+  NN_SAMPLETRACE_TAKE,        /* taken by the application */
+  NN_SAMPLETRACE_NSTAGES
+};
+
+#define NN_SAMPLETRACE_RING_SIZE 4096 /* events per thread */
+
+struct nn_sampletrace;
+
+struct nn_sampletrace *nn_sampletrace_new (const char *name, uint32_t interval);
+void nn_sampletrace_free (struct nn_sampletrace *st);
+
+/* Whether to trace sample seq of the writer guid; gv.sampletrace is
+   NULL when tracing is disabled, and built-in writers are never traced */
+#define NN_SAMPLETRACE_SELECTED(guid, seq) \
+  (gv.sampletrace != NULL && \
+   ((guid).entityid.u & NN_ENTITYID_SOURCE_MASK) == NN_ENTITYID_SOURCE_USER && \
+   (seq) % (seqno_t) config.sample_trace_interval == 0)
+
+uint32_t nn_sampletrace_new_id (struct nn_sampletrace *st);
+
+/* Remember the current time as the start of serializing the next
+   sample written by this thread */
+void nn_sampletrace_mark (struct nn_sampletrace *st);
+
+/* Record that sample (wrguid, seq) or, if wrguid is NULL, the sample
+   with the given id passed stage at time t (now (), the remembered
+   time for the SERIALIZE stage) */
+void nn_sampletrace_record (struct nn_sampletrace *st, enum nn_sampletrace_stage stage, const nn_guid_t *wrguid, seqno_t seq, uint32_t id);
+void nn_sampletrace_record_at (struct nn_sampletrace *st, enum nn_sampletrace_stage stage, const nn_guid_t *wrguid, seqno_t seq, uint32_t id, nn_wctime_t t);
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif /* Q_SAMPLETRACE_H */
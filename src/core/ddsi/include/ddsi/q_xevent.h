@@ -45,6 +45,13 @@ void xeventq_free (struct xeventq *evq);
 int xeventq_start (struct xeventq *evq, const char *name); /* <0 => error, =0 => ok */
 void xeventq_stop (struct xeventq *evq);
 
+/* Retransmits queued on EVQ go to REXMIT_EVQ instead, so they don't
+   delay the protocol messages; must be set before starting EVQ */
+void xeventq_divert_rexmits (struct xeventq *evq, struct xeventq *rexmit_evq);
+
+/* Number of retransmit messages and bytes currently queued on EVQ */
+void xeventq_queued_rexmits (struct xeventq *evq, size_t *msgs, size_t *bytes);
+
 void qxev_msg (struct xeventq *evq, struct nn_xmsg *msg);
 void qxev_pwr_entityid (struct proxy_writer * pwr, nn_guid_prefix_t * id);
 void qxev_prd_entityid (struct proxy_reader * prd, nn_guid_prefix_t * id);
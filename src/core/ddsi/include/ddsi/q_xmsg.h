@@ -145,6 +145,7 @@ void nn_xpack_send (struct nn_xpack *xp, bool immediately /* unused */);
 int nn_xpack_addmsg (struct nn_xpack *xp, struct nn_xmsg *m, const uint32_t flags);
 int64_t nn_xpack_maxdelay (const struct nn_xpack *xp);
 unsigned nn_xpack_packetid (const struct nn_xpack *xp);
+void nn_xpack_note_traced (struct nn_xpack *xp, const nn_guid_t *wrguid, seqno_t seq, uint32_t trace_id);
 
 /* SENDQ */
 void nn_xpack_sendq_init (void);
@@ -58,6 +58,12 @@
 #define SYSDEPS_HAVE_CLOCK_THREAD_CPUTIME 1
 #endif
 
+#if defined (__linux) && defined (__has_include)
+#if __has_include (<linux/io_uring.h>)
+#define SYSDEPS_HAVE_IO_URING 1
+#endif
+#endif
+
 #if defined (INTEGRITY)
 #include <sys/uio.h>
 #include <limits.h>
@@ -0,0 +1,824 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <assert.h>
+#include <string.h>
+#include "os/os.h"
+#include "ddsi/ddsi_tran.h"
+#include "ddsi/ddsi_shm.h"
+#include "ddsi/q_config.h"
+#include "ddsi/q_log.h"
+#include "ddsi/q_nwif.h"
+#include "ddsi/q_time.h"
+#include "util/ut_avl.h"
+
+#if OS_SOCKET_HAS_AF_UNIX
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern void ddsi_factory_conn_init (ddsi_tran_factory_t factory, ddsi_tran_conn_t conn);
+
+#define DDSI_SHM_NAMESIZE 48
+#define DDSI_SHM_PATHSIZE 128
+#define DDSI_SHM_ABANDON_TIMEOUT T_SECOND /* claimed slot still not committed */
+#define DDSI_SHM_RETRY_INTERVAL T_SECOND /* for mapping the ring of a peer */
+#define DDSI_SHM_CREATE_TRIES 10
+#define DDSI_SHM_MAX_QUARANTINED 8
+
+/* Peers are looked up by name, which includes the pid and a nonce, so
+   the entry of a peer that restarted is never reused; entries get removed
+   when the proxy participant is deleted. Senders only need the read
+   lock, and hold it while copying into the peer's ring, so that the
+   mapping can't go away underneath them. */
+struct ddsi_shm_peer
+{
+  ut_avlNode_t avlnode;
+  char name[DDSI_SHM_NAMESIZE];
+  struct ddsi_shm_ring *ring; /* NULL if it couldn't be mapped */
+  nn_mtime_t t_retry; /* when to try mapping it again if ring = NULL */
+  size_t size;
+  int fifo;
+};
+
+struct ddsi_shm_quarantined
+{
+  uint32_t pos;
+  nn_mtime_t t_check; /* last time its claimer was found to be alive */
+};
+
+typedef struct ddsi_shm_conn
+{
+  struct ddsi_tran_conn m_base;
+  nn_locator_t m_loc;
+  uint32_t m_nonce;
+  char m_name[DDSI_SHM_NAMESIZE];
+  char m_fifopath[DDSI_SHM_PATHSIZE];
+  struct ddsi_shm_ring *m_ring;
+  size_t m_size;
+  int m_fifo;
+  uint32_t m_tail;
+  bool m_waiting; /* for the slot at m_tail to be committed since m_waiting_since */
+  nn_mtime_t m_waiting_since;
+  uint32_t m_nquarantined;
+  struct ddsi_shm_quarantined m_quarantined[DDSI_SHM_MAX_QUARANTINED];
+  os_rwlock m_peers_lock;
+  ut_avlTree_t m_peers;
+}
+* ddsi_shm_conn_t;
+
+static int ddsi_shm_peer_cmp (const void *va, const void *vb)
+{
+  return strcmp (va, vb);
+}
+
+static const ut_avlTreedef_t ddsi_shm_peers_td = UT_AVL_TREEDEF_INITIALIZER (offsetof (struct ddsi_shm_peer, avlnode), offsetof (struct ddsi_shm_peer, name), ddsi_shm_peer_cmp, 0);
+
+static struct ddsi_tran_factory ddsi_shm_factory_g;
+static os_atomic_uint32_t ddsi_shm_init_g = OS_ATOMIC_UINT32_INIT(0);
+static unsigned char ddsi_shm_hostid[8];
+static char ddsi_shm_fifodir[DDSI_SHM_PATHSIZE];
+static ddsi_shm_conn_t ddsi_shm_conn_g;
+
+static void ddsi_shm_name (char *name, size_t size, const nn_locator_t *loc)
+{
+  const uint32_t nonce =
+    ((uint32_t) loc->address[8] << 24) | ((uint32_t) loc->address[9] << 16) |
+    ((uint32_t) loc->address[10] << 8) | (uint32_t) loc->address[11];
+  (void) snprintf (name, size, "/dds-shm-%u-%08x", loc->port, nonce);
+}
+
+void ddsi_shm_fifo_path (char *path, size_t size, const char *name)
+{
+  (void) snprintf (path, size, "%s%s", ddsi_shm_fifodir, name);
+}
+
+void ddsi_shm_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc)
+{
+  struct sockaddr_un *x = (struct sockaddr_un *) dst;
+  memset (dst, 0, sizeof (*dst));
+  x->sun_family = AF_UNIX;
+  ddsi_shm_name (x->sun_path, sizeof (x->sun_path), loc);
+}
+
+static size_t ddsi_shm_ring_size (uint32_t nslots)
+{
+  return sizeof (struct ddsi_shm_ring) + nslots * sizeof (struct ddsi_shm_slot);
+}
+
+static void ddsi_shm_wakeup (int fd)
+{
+  const char c = 0;
+  ssize_t r;
+  do {
+    r = write (fd, &c, 1);
+  } while (r == -1 && errno == EINTR);
+}
+
+static void ddsi_shm_map_peer (struct ddsi_shm_peer *peer)
+{
+  char path[DDSI_SHM_PATHSIZE];
+  struct ddsi_shm_ring *ring;
+  struct stat st;
+  int fd;
+
+  peer->ring = NULL;
+  peer->size = 0;
+  peer->fifo = -1;
+  if ((fd = shm_open (peer->name, O_RDWR, 0)) == -1)
+  {
+    nn_log (LC_INFO, "shm: can't open %s (errno %d)\n", peer->name, errno);
+    return;
+  }
+  if (fstat (fd, &st) == -1 || (size_t) st.st_size < sizeof (struct ddsi_shm_ring))
+  {
+    nn_log (LC_INFO, "shm: %s is too small\n", peer->name);
+    close (fd);
+    return;
+  }
+  ring = mmap (NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (ring == MAP_FAILED)
+  {
+    nn_log (LC_INFO, "shm: can't map %s (errno %d)\n", peer->name, errno);
+    return;
+  }
+  if (ring->magic != DDSI_SHM_MAGIC || ring->version != DDSI_SHM_VERSION ||
+      ring->nslots == 0 || (ring->nslots & (ring->nslots - 1)) != 0 ||
+      ddsi_shm_ring_size (ring->nslots) > (size_t) st.st_size)
+  {
+    nn_log (LC_INFO, "shm: %s is not a valid ring\n", peer->name);
+    munmap (ring, (size_t) st.st_size);
+    return;
+  }
+
+  /* Opening the FIFO for reading as well means a write never raises
+     SIGPIPE, even if the owner has gone */
+  ddsi_shm_fifo_path (path, sizeof (path), peer->name);
+  if ((peer->fifo = open (path, O_RDWR | O_NONBLOCK)) == -1)
+  {
+    nn_log (LC_INFO, "shm: can't open %s (errno %d)\n", path, errno);
+    munmap (ring, (size_t) st.st_size);
+    return;
+  }
+  peer->ring = ring;
+  peer->size = (size_t) st.st_size;
+  nn_log (LC_INFO, "shm: mapped %s (%u slots)\n", peer->name, ring->nslots);
+}
+
+static void ddsi_shm_free_peer (void *vpeer)
+{
+  struct ddsi_shm_peer *peer = vpeer;
+  if (peer->ring)
+  {
+    munmap (peer->ring, peer->size);
+    close (peer->fifo);
+  }
+  os_free (peer);
+}
+
+static void ddsi_shm_add_peer (ddsi_shm_conn_t uc, const char *name)
+{
+  struct ddsi_shm_peer *peer;
+  ut_avlIPath_t ip;
+  nn_mtime_t tnow;
+
+  os_rwlockWrite (&uc->m_peers_lock);
+  tnow = now_mt ();
+  if ((peer = ut_avlLookupIPath (&ddsi_shm_peers_td, &uc->m_peers, name, &ip)) == NULL)
+  {
+    peer = os_malloc (sizeof (*peer));
+    (void) snprintf (peer->name, sizeof (peer->name), "%s", name);
+    ddsi_shm_map_peer (peer);
+    ut_avlInsertIPath (&ddsi_shm_peers_td, &uc->m_peers, peer, &ip);
+  }
+  else if (peer->ring == NULL && tnow.v >= peer->t_retry.v)
+  {
+    ddsi_shm_map_peer (peer);
+  }
+  if (peer->ring == NULL)
+  {
+    /* Failures are remembered for a while, so a peer that can't be
+       reached this way doesn't cost a system call for every message */
+    peer->t_retry = add_duration_to_mtime (tnow, DDSI_SHM_RETRY_INTERVAL);
+  }
+  os_rwlockUnlock (&uc->m_peers_lock);
+}
+
+/* Returns the peer with the read lock held, or NULL if its ring can't be
+   mapped. The common case of a known peer only costs a lookup under the
+   read lock. */
+static struct ddsi_shm_peer *ddsi_shm_lookup_peer (ddsi_shm_conn_t uc, const char *name)
+{
+  bool mapped = false;
+  for (;;)
+  {
+    struct ddsi_shm_peer *peer;
+    bool retry;
+    os_rwlockRead (&uc->m_peers_lock);
+    if ((peer = ut_avlLookup (&ddsi_shm_peers_td, &uc->m_peers, name)) != NULL && peer->ring != NULL)
+      return peer;
+    retry = !mapped && (peer == NULL || now_mt ().v >= peer->t_retry.v);
+    os_rwlockUnlock (&uc->m_peers_lock);
+    if (!retry)
+      return NULL;
+    ddsi_shm_add_peer (uc, name);
+    mapped = true;
+  }
+}
+
+void ddsi_shm_forget_peer (const nn_locator_t *loc)
+{
+  ddsi_shm_conn_t uc = ddsi_shm_conn_g;
+  char name[DDSI_SHM_NAMESIZE];
+  struct ddsi_shm_peer *peer;
+
+  assert (loc->kind == NN_LOCATOR_KIND_SHM);
+  if (uc == NULL)
+    return;
+  ddsi_shm_name (name, sizeof (name), loc);
+  os_rwlockWrite (&uc->m_peers_lock);
+  if ((peer = ut_avlLookup (&ddsi_shm_peers_td, &uc->m_peers, name)) != NULL)
+    ut_avlDelete (&ddsi_shm_peers_td, &uc->m_peers, peer);
+  os_rwlockUnlock (&uc->m_peers_lock);
+  if (peer)
+  {
+    nn_log (LC_INFO, "shm: forgetting %s\n", name);
+    ddsi_shm_free_peer (peer);
+  }
+}
+
+static int ddsi_shm_slot_ready (const struct ddsi_shm_ring *ring, uint32_t pos)
+{
+  return os_atomic_ld32 (&ring->slots[pos & (ring->nslots - 1)].seq) == pos + 1;
+}
+
+/* The owner of a ring holds an exclusive lock on its FIFO for as long as
+   the ring exists, so the ring has been abandoned if the FIFO is gone or
+   the lock can be taken. Unlike looking at the pid in the name, this also
+   works for processes in another pid namespace that share /dev/shm and
+   the FIFO directory. If REMOVE is set, an abandoned ring and its FIFO
+   are removed while still holding the lock. */
+static bool ddsi_shm_owner_gone (const char *name, bool remove)
+{
+  char path[DDSI_SHM_PATHSIZE];
+  int fd;
+  ddsi_shm_fifo_path (path, sizeof (path), name);
+  if ((fd = open (path, O_RDWR | O_NONBLOCK)) == -1)
+    return (errno == ENOENT);
+  if (flock (fd, LOCK_EX | LOCK_NB) == -1)
+  {
+    close (fd);
+    return false;
+  }
+  if (remove)
+  {
+    nn_log (LC_INFO, "shm: removing %s, its owner is gone\n", name);
+    (void) shm_unlink (name);
+    (void) unlink (path);
+  }
+  close (fd);
+  return true;
+}
+
+static bool ddsi_shm_claimer_gone (const struct ddsi_shm_slot *slot)
+{
+  char name[DDSI_SHM_NAMESIZE];
+  uint32_t pid;
+  if ((pid = os_atomic_ld32 (&slot->claimer_pid)) == 0)
+    return false;
+  os_atomic_fence_acq ();
+  (void) snprintf (name, sizeof (name), "/dds-shm-%u-%08x", pid, slot->claimer_nonce);
+  return ddsi_shm_owner_gone (name, false);
+}
+
+static void ddsi_shm_release_slot (struct ddsi_shm_ring *ring, uint32_t pos)
+{
+  struct ddsi_shm_slot *slot = &ring->slots[pos & (ring->nslots - 1)];
+  os_atomic_st32 (&slot->claimer_pid, 0);
+  os_atomic_fence ();
+  os_atomic_st32 (&slot->seq, pos + ring->nslots);
+}
+
+static bool ddsi_shm_recycle_slot (struct ddsi_shm_ring *ring, uint32_t pos)
+{
+  /* Only for a slot whose claimer is gone; it may have committed just
+     before going, in which case the message is there after all */
+  struct ddsi_shm_slot *slot = &ring->slots[pos & (ring->nslots - 1)];
+  os_atomic_st32 (&slot->claimer_pid, 0);
+  os_atomic_fence ();
+  return os_atomic_cas32 (&slot->seq, pos, pos + ring->nslots);
+}
+
+static void ddsi_shm_check_quarantined (ddsi_shm_conn_t uc)
+{
+  struct ddsi_shm_ring *ring = uc->m_ring;
+  const nn_mtime_t tnow = now_mt ();
+  uint32_t i = 0;
+  while (i < uc->m_nquarantined)
+  {
+    struct ddsi_shm_quarantined *q = &uc->m_quarantined[i];
+    struct ddsi_shm_slot *slot = &ring->slots[q->pos & (ring->nslots - 1)];
+    bool done = false;
+    if (ddsi_shm_slot_ready (ring, q->pos))
+    {
+      /* the messages after it have already been delivered */
+      NN_WARNING ("%s: dropping message that was completed late by its sender\n", uc->m_name);
+      ddsi_shm_release_slot (ring, q->pos);
+      done = true;
+    }
+    else if (tnow.v - q->t_check.v > DDSI_SHM_ABANDON_TIMEOUT)
+    {
+      q->t_check = tnow;
+      done = ddsi_shm_claimer_gone (slot) && ddsi_shm_recycle_slot (ring, q->pos);
+    }
+    if (done)
+      uc->m_quarantined[i] = uc->m_quarantined[--uc->m_nquarantined];
+    else
+      i++;
+  }
+}
+
+static void ddsi_shm_skip_abandoned (ddsi_shm_conn_t uc)
+{
+  struct ddsi_shm_ring *ring = uc->m_ring;
+  nn_mtime_t tnow;
+
+  if (os_atomic_ld32 (&ring->head) == uc->m_tail)
+  {
+    /* nothing claimed, so nothing to wait for */
+    uc->m_waiting = false;
+    return;
+  }
+  tnow = now_mt ();
+  if (!uc->m_waiting)
+  {
+    uc->m_waiting = true;
+    uc->m_waiting_since = tnow;
+  }
+  else if (tnow.v - uc->m_waiting_since.v > DDSI_SHM_ABANDON_TIMEOUT)
+  {
+    struct ddsi_shm_slot *slot = &ring->slots[uc->m_tail & (ring->nslots - 1)];
+    if (ddsi_shm_claimer_gone (slot))
+    {
+      if (ddsi_shm_recycle_slot (ring, uc->m_tail))
+      {
+        NN_WARNING ("%s: skipping message that was never completed by its sender\n", uc->m_name);
+        uc->m_tail++;
+      }
+    }
+    else if (uc->m_nquarantined < DDSI_SHM_MAX_QUARANTINED)
+    {
+      /* Still alive, or unknown because it didn't get around to storing
+         its identity: it may yet write into the slot */
+      NN_WARNING ("%s: skipping message that is taking its sender too long to complete\n", uc->m_name);
+      uc->m_quarantined[uc->m_nquarantined].pos = uc->m_tail;
+      uc->m_quarantined[uc->m_nquarantined].t_check = tnow;
+      uc->m_nquarantined++;
+      uc->m_tail++;
+    }
+    uc->m_waiting = false;
+  }
+}
+
+static ssize_t ddsi_shm_conn_read (ddsi_tran_conn_t conn, unsigned char * buf, size_t len)
+{
+  ddsi_shm_conn_t uc = (ddsi_shm_conn_t) conn;
+  struct ddsi_shm_ring *ring = uc->m_ring;
+  ssize_t ret = 0;
+
+  if (uc->m_nquarantined > 0)
+  {
+    ddsi_shm_check_quarantined (uc);
+  }
+  if (!ddsi_shm_slot_ready (ring, uc->m_tail))
+  {
+    ddsi_shm_skip_abandoned (uc);
+  }
+  if (ddsi_shm_slot_ready (ring, uc->m_tail))
+  {
+    struct ddsi_shm_slot *slot = &ring->slots[uc->m_tail & (ring->nslots - 1)];
+    size_t n;
+    os_atomic_fence_acq ();
+    n = slot->len;
+    if (n > len)
+    {
+      NN_WARNING ("%s => %d truncated to %d\n", uc->m_name, (int) n, (int) len);
+      n = len;
+    }
+    memcpy (buf, slot->data, n);
+    ddsi_shm_release_slot (ring, uc->m_tail);
+    uc->m_tail++;
+    uc->m_waiting = false;
+    ret = (ssize_t) n;
+  }
+
+  if (!ddsi_shm_slot_ready (ring, uc->m_tail))
+  {
+    /* Going idle: consume the wake-up and clear the flag, after which a
+       sender will write a new one; a message that was committed before
+       the flag got cleared would go unnoticed without another look. A
+       slot that is claimed but not yet committed gets a wake-up from its
+       sender, or if it never commits, from the next sender. */
+    char tmp[16];
+    (void) read (uc->m_fifo, tmp, sizeof (tmp));
+    os_atomic_st32 (&ring->notify, 0);
+    os_atomic_fence ();
+    if (ddsi_shm_slot_ready (ring, uc->m_tail) && os_atomic_or32_ov (&ring->notify, 1) == 0)
+      ddsi_shm_wakeup (uc->m_fifo);
+  }
+  return ret;
+}
+
+/* Copies the message into the peer's ring; like a full socket receive
+   buffer, a full ring means the message gets dropped */
+static void ddsi_shm_put (const ddsi_shm_conn_t uc, struct ddsi_shm_peer *peer, const struct msghdr * msg, size_t len)
+{
+  struct ddsi_shm_ring *ring = peer->ring;
+  struct ddsi_shm_slot *slot;
+  unsigned char *p;
+  uint32_t pos;
+  size_t i;
+
+  /* Claim a slot */
+  pos = os_atomic_ld32 (&ring->head);
+  for (;;)
+  {
+    int32_t d;
+    slot = &ring->slots[pos & (ring->nslots - 1)];
+    d = (int32_t) (os_atomic_ld32 (&slot->seq) - pos);
+    if (d == 0)
+    {
+      if (os_atomic_cas32 (&ring->head, pos, pos + 1))
+        break;
+      pos = os_atomic_ld32 (&ring->head);
+    }
+    else if (d < 0)
+    {
+      /* The receiver may be waiting for an abandoned slot, it needs a
+         wake-up to notice that it has waited long enough */
+      nn_log (LC_TRAFFIC, "shm: %s full, dropping message\n", peer->name);
+      if (os_atomic_or32_ov (&ring->notify, 1) == 0)
+        ddsi_shm_wakeup (peer->fifo);
+      return;
+    }
+    else
+    {
+      pos = os_atomic_ld32 (&ring->head);
+    }
+  }
+
+  slot->claimer_nonce = uc->m_nonce;
+  os_atomic_fence_rel ();
+  os_atomic_st32 (&slot->claimer_pid, uc->m_loc.port);
+
+  p = slot->data;
+  for (i = 0; i < (size_t) msg->msg_iovlen; i++)
+  {
+    memcpy (p, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+    p += msg->msg_iov[i].iov_len;
+  }
+  assert ((size_t) (p - slot->data) == len);
+  slot->len = (uint32_t) len;
+  os_atomic_fence_rel ();
+  if (!os_atomic_cas32 (&slot->seq, pos, pos + 1))
+  {
+    nn_log (LC_TRAFFIC, "shm: %s gave up waiting, message dropped\n", peer->name);
+    return;
+  }
+
+  /* or32 implies a full barrier, so the receiver either sees the flag
+     still set while going idle or sees the new message */
+  if (os_atomic_or32_ov (&ring->notify, 1) == 0)
+  {
+    ddsi_shm_wakeup (peer->fifo);
+  }
+}
+
+static ssize_t ddsi_shm_conn_write (ddsi_tran_conn_t conn, const struct msghdr * msg, size_t len, uint32_t flags)
+{
+  ddsi_shm_conn_t uc = (ddsi_shm_conn_t) conn;
+  const struct sockaddr_un *dst = msg->msg_name;
+  struct ddsi_shm_peer *peer;
+  (void) flags;
+
+  if (len > DDSI_SHM_MSGSIZE)
+  {
+    NN_ERROR ("ddsi_shm_conn_write: message of %u bytes is too large\n", (unsigned) len);
+    return -1;
+  }
+  if ((peer = ddsi_shm_lookup_peer (uc, dst->sun_path)) == NULL)
+  {
+    return -1;
+  }
+  ddsi_shm_put (uc, peer, msg, len);
+  os_rwlockUnlock (&uc->m_peers_lock);
+  return (ssize_t) len;
+}
+
+static os_handle ddsi_shm_conn_handle (ddsi_tran_base_t base)
+{
+  return ((ddsi_shm_conn_t) base)->m_fifo;
+}
+
+static bool ddsi_shm_supports (int32_t kind)
+{
+  return kind == NN_LOCATOR_KIND_SHM;
+}
+
+static int ddsi_shm_conn_locator (ddsi_tran_base_t base, nn_locator_t *loc)
+{
+  *loc = ((ddsi_shm_conn_t) base)->m_loc;
+  return 0;
+}
+
+/* A process that crashed leaves its ring and FIFO behind. The FIFO is
+   created first and removed last, so every ring has one. */
+static void ddsi_shm_remove_stale (void)
+{
+  DIR *d;
+  struct dirent *de;
+  if ((d = opendir (ddsi_shm_fifodir)) == NULL)
+    return;
+  while ((de = readdir (d)) != NULL)
+  {
+    char name[DDSI_SHM_NAMESIZE];
+    unsigned pid, nonce;
+    int pos = 0;
+    if (sscanf (de->d_name, "dds-shm-%u-%8x%n", &pid, &nonce, &pos) != 2 || de->d_name[pos] != 0)
+      continue;
+    (void) snprintf (name, sizeof (name), "/dds-shm-%u-%08x", pid, nonce);
+    (void) ddsi_shm_owner_gone (name, true);
+  }
+  closedir (d);
+}
+
+/* FIFOs live in a directory private to the user, as do the rings */
+static int ddsi_shm_init_fifodir (void)
+{
+  struct stat st;
+  (void) snprintf (ddsi_shm_fifodir, sizeof (ddsi_shm_fifodir), "%s/dds-shm-%u", P_tmpdir, (unsigned) getuid ());
+  if (mkdir (ddsi_shm_fifodir, 0700) == -1 && errno != EEXIST)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: can't create %s (errno %d)\n", ddsi_shm_fifodir, errno);
+    return -1;
+  }
+  if (lstat (ddsi_shm_fifodir, &st) == -1 || !S_ISDIR (st.st_mode) || st.st_uid != getuid () || (st.st_mode & 077) != 0)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: %s is not a private directory\n", ddsi_shm_fifodir);
+    return -1;
+  }
+  return 0;
+}
+
+/* Creates the FIFO and takes the lock that marks the ring as in use. A
+   process cleaning up may take the lock between creating and locking
+   the FIFO and then remove it, which shows as the path no longer
+   referring to the FIFO that was opened. */
+static int ddsi_shm_create_fifo (const char *path)
+{
+  struct stat st, fst;
+  int fd;
+  if (mkfifo (path, 0600) == -1)
+    return -1;
+  if ((fd = open (path, O_RDWR | O_NONBLOCK)) == -1)
+  {
+    (void) unlink (path);
+    return -1;
+  }
+  if (flock (fd, LOCK_EX | LOCK_NB) == -1 || fstat (fd, &fst) == -1 ||
+      stat (path, &st) == -1 || st.st_dev != fst.st_dev || st.st_ino != fst.st_ino)
+  {
+    close (fd);
+    return -1;
+  }
+  return fd;
+}
+
+static ddsi_tran_conn_t ddsi_shm_create_conn (uint32_t port, ddsi_tran_qos_t qos)
+{
+  ddsi_shm_conn_t uc;
+  struct ddsi_shm_ring *ring;
+  uint32_t nslots = 2, nonce, i;
+  nn_wctime_t tnow = now ();
+  size_t size;
+  int fd;
+#ifndef __APPLE__
+  int err;
+#endif
+  (void) port;
+  (void) qos;
+
+  if (ddsi_shm_conn_g != NULL)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: a process has only one receive ring\n");
+    return NULL;
+  }
+  if (ddsi_shm_init_fifodir () < 0)
+    return NULL;
+  ddsi_shm_remove_stale ();
+
+  while (nslots < config.shm_ring_size && nslots < (1u << 16))
+    nslots *= 2;
+  size = ddsi_shm_ring_size (nslots);
+
+  uc = os_malloc (sizeof (*uc));
+  memset (uc, 0, sizeof (*uc));
+  uc->m_loc.kind = NN_LOCATOR_KIND_SHM;
+  uc->m_loc.port = (unsigned) os_procIdSelf ();
+  memcpy (uc->m_loc.address, ddsi_shm_hostid, sizeof (ddsi_shm_hostid));
+  for (i = 0; ; i++)
+  {
+    nonce = (uint32_t) tnow.v ^ (uint32_t) (tnow.v >> 32) ^ i;
+    uc->m_loc.address[8] = (unsigned char) (nonce >> 24);
+    uc->m_loc.address[9] = (unsigned char) (nonce >> 16);
+    uc->m_loc.address[10] = (unsigned char) (nonce >> 8);
+    uc->m_loc.address[11] = (unsigned char) nonce;
+    ddsi_shm_name (uc->m_name, sizeof (uc->m_name), &uc->m_loc);
+    ddsi_shm_fifo_path (uc->m_fifopath, sizeof (uc->m_fifopath), uc->m_name);
+    if ((uc->m_fifo = ddsi_shm_create_fifo (uc->m_fifopath)) != -1)
+    {
+      uc->m_nonce = nonce;
+      break;
+    }
+    else if (i + 1 == DDSI_SHM_CREATE_TRIES)
+    {
+      NN_ERROR ("ddsi_shm_create_conn: can't create FIFO %s (errno %d)\n", uc->m_fifopath, errno);
+      os_free (uc);
+      return NULL;
+    }
+  }
+
+  if ((fd = shm_open (uc->m_name, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: shm_open %s failed (errno %d)\n", uc->m_name, errno);
+    goto err_open;
+  }
+  if (ftruncate (fd, (off_t) size) == -1)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: can't size %s to %u bytes (errno %d)\n", uc->m_name, (unsigned) size, errno);
+    close (fd);
+    goto err_map;
+  }
+#ifndef __APPLE__
+  /* Touching a page of a sparse object for which there is no space left
+     raises SIGBUS, so allocate it all now (there is no posix_fallocate on
+     macOS, but there shared memory objects aren't sparse) */
+  if ((err = posix_fallocate (fd, 0, (off_t) size)) != 0)
+  {
+    NN_WARNING ("ddsi_shm_create_conn: can't allocate %u bytes for %s (errno %d)\n", (unsigned) size, uc->m_name, err);
+    close (fd);
+    goto err_map;
+  }
+#endif
+  ring = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (ring == MAP_FAILED)
+  {
+    NN_ERROR ("ddsi_shm_create_conn: mmap %s failed (errno %d)\n", uc->m_name, errno);
+    goto err_map;
+  }
+  ring->nslots = nslots;
+  os_atomic_st32 (&ring->head, 0);
+  os_atomic_st32 (&ring->notify, 0);
+  for (i = 0; i < nslots; i++)
+    os_atomic_st32 (&ring->slots[i].seq, i);
+  ring->version = DDSI_SHM_VERSION;
+  os_atomic_fence_rel ();
+  ring->magic = DDSI_SHM_MAGIC;
+
+  uc->m_ring = ring;
+  uc->m_size = size;
+  uc->m_tail = 0;
+  os_rwlockInit (&uc->m_peers_lock);
+  ut_avlInit (&ddsi_shm_peers_td, &uc->m_peers);
+
+  ddsi_factory_conn_init (&ddsi_shm_factory_g, &uc->m_base);
+  uc->m_base.m_base.m_port = uc->m_loc.port;
+  uc->m_base.m_base.m_trantype = DDSI_TRAN_CONN;
+  uc->m_base.m_base.m_multicast = false;
+  uc->m_base.m_base.m_handle_fn = ddsi_shm_conn_handle;
+  uc->m_base.m_base.m_locator_fn = ddsi_shm_conn_locator;
+
+  uc->m_base.m_read_fn = ddsi_shm_conn_read;
+  uc->m_base.m_write_fn = ddsi_shm_conn_write;
+
+  ddsi_shm_conn_g = uc;
+  nn_log (LC_INFO, "ddsi_shm_create_conn %s (%u slots) fifo %s\n", uc->m_name, nslots, uc->m_fifopath);
+  return &uc->m_base;
+
+err_map:
+  (void) shm_unlink (uc->m_name);
+err_open:
+  (void) unlink (uc->m_fifopath);
+  close (uc->m_fifo);
+  os_free (uc);
+  return NULL;
+}
+
+static void ddsi_shm_release_conn (ddsi_tran_conn_t conn)
+{
+  ddsi_shm_conn_t uc = (ddsi_shm_conn_t) conn;
+  nn_log (LC_INFO, "ddsi_shm_release_conn %s\n", uc->m_name);
+  assert (uc == ddsi_shm_conn_g);
+  ddsi_shm_conn_g = NULL;
+  ut_avlFree (&ddsi_shm_peers_td, &uc->m_peers, ddsi_shm_free_peer);
+  os_rwlockDestroy (&uc->m_peers_lock);
+  munmap (uc->m_ring, uc->m_size);
+  (void) shm_unlink (uc->m_name);
+  (void) unlink (uc->m_fifopath);
+  close (uc->m_fifo);
+  os_free (uc);
+}
+
+bool ddsi_shm_reachable (const nn_locator_t *loc)
+{
+  char name[DDSI_SHM_NAMESIZE];
+  struct ddsi_shm_peer *peer;
+  assert (loc->kind == NN_LOCATOR_KIND_SHM);
+  if (ddsi_shm_conn_g == NULL || memcmp (loc->address, ddsi_shm_hostid, sizeof (ddsi_shm_hostid)) != 0)
+    return false;
+  ddsi_shm_name (name, sizeof (name), loc);
+  if ((peer = ddsi_shm_lookup_peer (ddsi_shm_conn_g, name)) == NULL)
+    return false;
+  os_rwlockUnlock (&ddsi_shm_conn_g->m_peers_lock);
+  return true;
+}
+
+static void ddsi_shm_fini (void)
+{
+  if (os_atomic_dec32_nv (&ddsi_shm_init_g) == 0)
+  {
+    memset (&ddsi_shm_factory_g, 0, sizeof (ddsi_shm_factory_g));
+    nn_log (LC_INFO | LC_CONFIG, "shm finalized\n");
+  }
+}
+
+int ddsi_shm_init (void)
+{
+  if (os_atomic_inc32_nv (&ddsi_shm_init_g) == 1)
+  {
+    get_host_id (ddsi_shm_hostid);
+    memset (&ddsi_shm_factory_g, 0, sizeof (ddsi_shm_factory_g));
+    ddsi_shm_factory_g.m_kind = NN_LOCATOR_KIND_SHM;
+    ddsi_shm_factory_g.m_typename = "shm";
+    ddsi_shm_factory_g.m_connless = true;
+    ddsi_shm_factory_g.m_supports_fn = ddsi_shm_supports;
+    ddsi_shm_factory_g.m_create_conn_fn = ddsi_shm_create_conn;
+    ddsi_shm_factory_g.m_release_conn_fn = ddsi_shm_release_conn;
+    ddsi_shm_factory_g.m_free_fn = ddsi_shm_fini;
+
+    ddsi_factory_add (&ddsi_shm_factory_g);
+
+    nn_log (LC_INFO | LC_CONFIG, "shm initialized\n");
+  }
+  return 0;
+}
+
+#else
+
+int ddsi_shm_init (void)
+{
+  NN_ERROR ("shared-memory transport not supported on this platform\n");
+  return -1;
+}
+
+bool ddsi_shm_reachable (const nn_locator_t *loc)
+{
+  (void) loc;
+  return false;
+}
+
+void ddsi_shm_forget_peer (const nn_locator_t *loc)
+{
+  (void) loc;
+}
+
+void ddsi_shm_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc)
+{
+  (void) loc;
+  memset (dst, 0, sizeof (*dst));
+}
+
+void ddsi_shm_fifo_path (char *path, size_t size, const char *name)
+{
+  (void) name;
+  if (size > 0)
+    path[0] = 0;
+}
+
+#endif
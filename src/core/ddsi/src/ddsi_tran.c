@@ -89,6 +89,7 @@ extern void ddsi_factory_conn_init (ddsi_tran_factory_t factory, ddsi_tran_conn_
   conn->m_connless = factory->m_connless;
   conn->m_stream = factory->m_stream;
   conn->m_factory = factory;
+  conn->m_flush_fn = NULL;
 }
 
 ssize_t ddsi_conn_read (ddsi_tran_conn_t conn, unsigned char * buf, size_t len)
@@ -110,6 +111,14 @@ ssize_t ddsi_conn_write (ddsi_tran_conn_t conn, const struct msghdr * msg, size_
   return ret;
 }
 
+void ddsi_conn_flush (ddsi_tran_conn_t conn)
+{
+  if (! conn->m_closed && conn->m_flush_fn)
+  {
+    (conn->m_flush_fn) (conn);
+  }
+}
+
 bool ddsi_conn_peer_locator (ddsi_tran_conn_t conn, nn_locator_t * loc)
 {
   if (conn->m_peer_locator_fn)
@@ -0,0 +1,342 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include "os/os.h"
+#include "ddsi/ddsi_tran.h"
+#include "ddsi/ddsi_unix.h"
+#include "ddsi/q_nwif.h"
+#include "ddsi/q_config.h"
+#include "ddsi/q_log.h"
+#include "ddsi/q_time.h"
+#include "ddsi/sysdeps.h"
+
+#if OS_SOCKET_HAS_AF_UNIX
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+extern void ddsi_factory_conn_init (ddsi_tran_factory_t factory, ddsi_tran_conn_t conn);
+
+#ifdef __linux__
+#define DDSI_UNIX_ABSTRACT 1
+#else
+#define DDSI_UNIX_ABSTRACT 0
+#endif
+
+/* Linux queues at most net.unix.max_dgram_qlen datagrams for a socket,
+   and as messages that don't fit get dropped, a small limit means so many
+   retransmits that UDP is far better */
+#define DDSI_UNIX_MIN_DGRAM_QLEN 128
+
+typedef struct ddsi_unix_conn
+{
+  struct ddsi_tran_conn m_base;
+  os_socket m_sock;
+  nn_locator_t m_loc;
+  os_sockaddr_storage m_addr;
+}
+* ddsi_unix_conn_t;
+
+static struct ddsi_tran_factory ddsi_unix_factory_g;
+static os_atomic_uint32_t ddsi_unix_init_g = OS_ATOMIC_UINT32_INIT(0);
+static unsigned char ddsi_unix_hostid[8];
+static ddsi_unix_conn_t ddsi_unix_conn_g;
+
+void ddsi_unix_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc)
+{
+  struct sockaddr_un *x = (struct sockaddr_un *) dst;
+  const uint32_t nonce =
+    ((uint32_t) loc->address[8] << 24) | ((uint32_t) loc->address[9] << 16) |
+    ((uint32_t) loc->address[10] << 8) | (uint32_t) loc->address[11];
+  memset (dst, 0, sizeof (*dst));
+  x->sun_family = AF_UNIX;
+#if DDSI_UNIX_ABSTRACT
+  (void) snprintf (x->sun_path + 1, sizeof (x->sun_path) - 1, "dds-unix-%u-%08x", loc->port, nonce);
+#else
+  (void) snprintf (x->sun_path, sizeof (x->sun_path), "%s/dds-unix-%u-%08x", P_tmpdir, loc->port, nonce);
+#endif
+}
+
+socklen_t ddsi_unix_sockaddr_size (const os_sockaddr_storage *a)
+{
+  const struct sockaddr_un *x = (const struct sockaddr_un *) a;
+  assert (a->ss_family == AF_UNIX);
+  if (x->sun_path[0] == 0)
+    return (socklen_t) (offsetof (struct sockaddr_un, sun_path) + 1 + strlen (x->sun_path + 1));
+  else
+    return (socklen_t) (offsetof (struct sockaddr_un, sun_path) + strlen (x->sun_path) + 1);
+}
+
+static ssize_t ddsi_unix_conn_read (ddsi_tran_conn_t conn, unsigned char * buf, size_t len)
+{
+  ddsi_unix_conn_t uc = (ddsi_unix_conn_t) conn;
+  int err;
+  ssize_t ret;
+  struct msghdr msghdr;
+  struct iovec msg_iov;
+
+  msg_iov.iov_base = (void *) buf;
+  msg_iov.iov_len = len;
+  memset (&msghdr, 0, sizeof (msghdr));
+  msghdr.msg_iov = &msg_iov;
+  msghdr.msg_iovlen = 1;
+
+  do {
+    ret = recvmsg (uc->m_sock, &msghdr, 0);
+    err = (ret == -1) ? os_getErrno () : 0;
+  } while (err == os_sockEINTR);
+
+  if (ret > 0)
+  {
+    if (msghdr.msg_flags & MSG_TRUNC)
+    {
+      char addrbuf[INET6_ADDRSTRLEN_EXTENDED];
+      sockaddr_to_string_with_port (addrbuf, &uc->m_addr);
+      NN_WARNING ("%s: message truncated to %d\n", addrbuf, (int) len);
+    }
+  }
+  else if (err != os_sockENOTSOCK)
+  {
+    NN_ERROR ("Unix recvmsg sock %d: ret %d errno %d\n", (int) uc->m_sock, (int) ret, err);
+  }
+  return ret;
+}
+
+static ssize_t ddsi_unix_conn_write (ddsi_tran_conn_t conn, const struct msghdr * msg, size_t len, uint32_t flags)
+{
+  ddsi_unix_conn_t uc = (ddsi_unix_conn_t) conn;
+  int err;
+  ssize_t ret;
+  int sendflags = 0;
+  (void) flags;
+#ifdef MSG_NOSIGNAL
+  sendflags |= MSG_NOSIGNAL;
+#endif
+  /* Unlike with UDP, a receiver that doesn't keep up makes a blocking
+     sender wait; the sender may well be the thread that has to process
+     the acknowledgements, so don't wait but drop the message like a UDP
+     socket would */
+#ifdef MSG_DONTWAIT
+  sendflags |= MSG_DONTWAIT;
+#endif
+  do {
+    ret = sendmsg (uc->m_sock, msg, sendflags);
+    err = (ret == -1) ? os_getErrno () : 0;
+  } while (err == os_sockEINTR);
+  if (ret == -1)
+  {
+    switch (err)
+    {
+      case os_sockEAGAIN:
+#if os_sockEWOULDBLOCK != os_sockEAGAIN
+      case os_sockEWOULDBLOCK:
+#endif
+        nn_log (LC_TRAFFIC, "unix: receiver busy, dropping message\n");
+        ret = (ssize_t) len;
+        break;
+      case ECONNREFUSED:
+      case os_sockENOENT:
+        /* peer is gone */
+        break;
+      default:
+        NN_ERROR ("ddsi_unix_conn_write failed with error code %d", err);
+    }
+  }
+  return ret;
+}
+
+static os_handle ddsi_unix_conn_handle (ddsi_tran_base_t base)
+{
+  return ((ddsi_unix_conn_t) base)->m_sock;
+}
+
+static bool ddsi_unix_supports (int32_t kind)
+{
+  return kind == NN_LOCATOR_KIND_UNIX;
+}
+
+static int ddsi_unix_conn_locator (ddsi_tran_base_t base, nn_locator_t *loc)
+{
+  *loc = ((ddsi_unix_conn_t) base)->m_loc;
+  return 0;
+}
+
+static int ddsi_unix_check_qlen (void)
+{
+#ifdef __linux__
+  FILE *fp;
+  unsigned qlen;
+  int ret = 0;
+  if ((fp = fopen ("/proc/sys/net/unix/max_dgram_qlen", "r")) == NULL)
+    return 0;
+  if (fscanf (fp, "%u", &qlen) == 1 && qlen < DDSI_UNIX_MIN_DGRAM_QLEN)
+  {
+    NN_WARNING ("ddsi_unix_create_conn: net.unix.max_dgram_qlen is %u, it must be at least %u for this transport to be used\n", qlen, DDSI_UNIX_MIN_DGRAM_QLEN);
+    ret = -1;
+  }
+  fclose (fp);
+  return ret;
+#else
+  return 0;
+#endif
+}
+
+static ddsi_tran_conn_t ddsi_unix_create_conn (uint32_t port, ddsi_tran_qos_t qos)
+{
+  ddsi_unix_conn_t uc;
+  nn_wctime_t tnow = now ();
+  uint32_t nonce;
+  char addrbuf[INET6_ADDRSTRLEN_EXTENDED];
+  (void) port;
+  (void) qos;
+
+  if (ddsi_unix_conn_g != NULL)
+  {
+    NN_ERROR ("ddsi_unix_create_conn: a process has only one Unix domain socket\n");
+    return NULL;
+  }
+  if (ddsi_unix_check_qlen () < 0)
+  {
+    return NULL;
+  }
+
+  uc = os_malloc (sizeof (*uc));
+  memset (uc, 0, sizeof (*uc));
+  nonce = (uint32_t) tnow.v ^ (uint32_t) (tnow.v >> 32);
+  uc->m_loc.kind = NN_LOCATOR_KIND_UNIX;
+  uc->m_loc.port = (unsigned) os_procIdSelf ();
+  memcpy (uc->m_loc.address, ddsi_unix_hostid, sizeof (ddsi_unix_hostid));
+  uc->m_loc.address[8] = (unsigned char) (nonce >> 24);
+  uc->m_loc.address[9] = (unsigned char) (nonce >> 16);
+  uc->m_loc.address[10] = (unsigned char) (nonce >> 8);
+  uc->m_loc.address[11] = (unsigned char) nonce;
+  ddsi_unix_loc_to_address (&uc->m_addr, &uc->m_loc);
+  sockaddr_to_string_with_port (addrbuf, &uc->m_addr);
+
+  if ((uc->m_sock = os_sockNew (AF_UNIX, SOCK_DGRAM)) == Q_INVALID_SOCKET)
+  {
+    print_sockerror ("socket");
+    goto err_sock;
+  }
+  if (os_sockBind (uc->m_sock, (const struct sockaddr *) &uc->m_addr, (uint32_t) ddsi_unix_sockaddr_size (&uc->m_addr)) != os_resultSuccess)
+  {
+    NN_ERROR ("ddsi_unix_create_conn: bind to %s failed (errno %d)\n", addrbuf, os_getErrno ());
+    goto err_bind;
+  }
+
+  ddsi_factory_conn_init (&ddsi_unix_factory_g, &uc->m_base);
+  uc->m_base.m_base.m_port = uc->m_loc.port;
+  uc->m_base.m_base.m_trantype = DDSI_TRAN_CONN;
+  uc->m_base.m_base.m_multicast = false;
+  uc->m_base.m_base.m_handle_fn = ddsi_unix_conn_handle;
+  uc->m_base.m_base.m_locator_fn = ddsi_unix_conn_locator;
+
+  uc->m_base.m_read_fn = ddsi_unix_conn_read;
+  uc->m_base.m_write_fn = ddsi_unix_conn_write;
+
+  ddsi_unix_conn_g = uc;
+  nn_log (LC_INFO, "ddsi_unix_create_conn socket %"PRIsock" bound to %s\n", uc->m_sock, addrbuf);
+  return &uc->m_base;
+
+err_bind:
+  os_sockFree (uc->m_sock);
+err_sock:
+  os_free (uc);
+  return NULL;
+}
+
+static void ddsi_unix_release_conn (ddsi_tran_conn_t conn)
+{
+  ddsi_unix_conn_t uc = (ddsi_unix_conn_t) conn;
+  nn_log (LC_INFO, "ddsi_unix_release_conn socket %"PRIsock"\n", uc->m_sock);
+  assert (uc == ddsi_unix_conn_g);
+  ddsi_unix_conn_g = NULL;
+  os_sockFree (uc->m_sock);
+#if ! DDSI_UNIX_ABSTRACT
+  (void) unlink (((struct sockaddr_un *) &uc->m_addr)->sun_path);
+#endif
+  os_free (uc);
+}
+
+bool ddsi_unix_reachable (const nn_locator_t *loc)
+{
+  /* Sockets in the abstract namespace are per network namespace, not per
+     host, so check someone is actually bound to the address */
+  os_sockaddr_storage addr;
+  os_socket sock;
+  bool ok;
+  assert (loc->kind == NN_LOCATOR_KIND_UNIX);
+  if (ddsi_unix_conn_g == NULL || memcmp (loc->address, ddsi_unix_hostid, sizeof (ddsi_unix_hostid)) != 0)
+    return false;
+  if ((sock = os_sockNew (AF_UNIX, SOCK_DGRAM)) == Q_INVALID_SOCKET)
+    return false;
+  ddsi_unix_loc_to_address (&addr, loc);
+  ok = (connect (sock, (const struct sockaddr *) &addr, ddsi_unix_sockaddr_size (&addr)) == 0);
+  os_sockFree (sock);
+  return ok;
+}
+
+static void ddsi_unix_fini (void)
+{
+  if (os_atomic_dec32_nv (&ddsi_unix_init_g) == 0)
+  {
+    memset (&ddsi_unix_factory_g, 0, sizeof (ddsi_unix_factory_g));
+    nn_log (LC_INFO | LC_CONFIG, "unix finalized\n");
+  }
+}
+
+int ddsi_unix_init (void)
+{
+  if (os_atomic_inc32_nv (&ddsi_unix_init_g) == 1)
+  {
+    get_host_id (ddsi_unix_hostid);
+
+    memset (&ddsi_unix_factory_g, 0, sizeof (ddsi_unix_factory_g));
+    ddsi_unix_factory_g.m_kind = NN_LOCATOR_KIND_UNIX;
+    ddsi_unix_factory_g.m_typename = "unix";
+    ddsi_unix_factory_g.m_connless = true;
+    ddsi_unix_factory_g.m_supports_fn = ddsi_unix_supports;
+    ddsi_unix_factory_g.m_create_conn_fn = ddsi_unix_create_conn;
+    ddsi_unix_factory_g.m_release_conn_fn = ddsi_unix_release_conn;
+    ddsi_unix_factory_g.m_free_fn = ddsi_unix_fini;
+
+    ddsi_factory_add (&ddsi_unix_factory_g);
+
+    nn_log (LC_INFO | LC_CONFIG, "unix initialized\n");
+  }
+  return 0;
+}
+
+#else
+
+int ddsi_unix_init (void)
+{
+  NN_ERROR ("Unix domain socket transport not supported on this platform\n");
+  return -1;
+}
+
+bool ddsi_unix_reachable (const nn_locator_t *loc)
+{
+  (void) loc;
+  return false;
+}
+
+void ddsi_unix_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *loc)
+{
+  (void) loc;
+  memset (dst, 0, sizeof (*dst));
+}
+
+#endif
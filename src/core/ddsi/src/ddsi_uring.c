@@ -0,0 +1,883 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <assert.h>
+#include <string.h>
+#include "os/os.h"
+#include "ddsi/ddsi_tran.h"
+#include "ddsi/ddsi_uring.h"
+#include "ddsi/q_nwif.h"
+#include "ddsi/q_config.h"
+#include "ddsi/q_globals.h"
+#include "ddsi/q_log.h"
+#include "ddsi/q_pcap.h"
+#include "ddsi/sysdeps.h"
+
+#if SYSDEPS_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+/* Multishot receive (and with it provided buffer rings) requires Linux 6.0 */
+#if SYSDEPS_HAVE_IO_URING && defined (IORING_RECV_MULTISHOT)
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define DDSI_URING_MAX_CONNS 16 /* size of the registered file tables */
+#define DDSI_URING_MAX_IOV 64 /* writes with more can't be deferred */
+#define DDSI_URING_SEND_ENTRIES 64
+#define DDSI_URING_SUBMIT_TRIES 10 /* 1ms apart */
+#define DDSI_URING_WAIT_TRIES 1000 /* 1ms apart */
+#define DDSI_URING_RECV_ENTRIES 64
+#define DDSI_URING_BUFSIZE (65536 + 256) /* max UDP payload + recvmsg_out + address */
+#define DDSI_URING_BGID 0
+#define DDSI_URING_UD_TRIGGER (~(uint64_t) 0)
+
+struct ddsi_uring_ring
+{
+  int fd;
+  unsigned sq_entries;
+  unsigned sq_mask;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_local_tail;
+  unsigned to_submit;
+  unsigned cq_mask;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *ring_ptr;
+  size_t ring_size;
+  size_t sqes_size;
+};
+
+/* A deferred write (one with DDSI_TRAN_MORE); its copy of the message
+   header remains valid until the write has completed, the data itself
+   belongs to the caller, who must keep it valid until ddsi_conn_flush */
+struct ddsi_uring_sendslot
+{
+  ddsi_tran_conn_t conn;
+  int fileidx;
+  struct msghdr mhdr;
+  os_sockaddr_storage addr;
+  struct iovec iov[DDSI_URING_MAX_IOV];
+  unsigned retries; /* for EPERM, as ddsi_udp_conn_write does */
+  bool done;
+};
+
+/* All writes go through a single ring. Every write gets a ticket, the
+   slot it uses is the ticket modulo the number of slots, and the slot
+   can be reused once all writes up to and including it have completed.
+   Writes are prepared with the lock held, but nobody holds it while in
+   the kernel: one thread at a time submits the prepared writes and waits
+   for completions in a single io_uring_enter ("reaping"), the others wait
+   on the condition variable. */
+struct ddsi_uring_sendq
+{
+  os_mutex lock;
+  os_cond cond;
+  struct ddsi_uring_ring ring;
+  bool reaping;
+  uint32_t next; /* ticket of the next write */
+  uint32_t done; /* all writes with a ticket before this one have completed */
+  struct ddsi_uring_sendslot slots[DDSI_URING_SEND_ENTRIES];
+  uint64_t nsent;
+  uint64_t nsubmits;
+};
+
+struct ddsi_uring_attached
+{
+  ddsi_tran_conn_t conn;
+  ddsi_tran_read_fn_t read_fn; /* of the UDP transport */
+  ddsi_tran_write_fn_t write_fn;
+};
+
+struct ddsi_uring_waitset
+{
+  struct ddsi_uring_ring ring;
+  int evfd;
+  uint64_t evbuf;
+  bool trigger_armed;
+
+  /* buffers provided to the kernel for multishot receive */
+  struct io_uring_buf_ring *br;
+  size_t br_size;
+  unsigned nbufs;
+  unsigned br_tail;
+  unsigned char *bufs;
+  struct msghdr recv_mhdr; /* only lengths of name and control data matter */
+
+  unsigned n;
+  ddsi_tran_conn_t conns[DDSI_URING_MAX_CONNS];
+  bool multishot[DDSI_URING_MAX_CONNS];
+  bool armed[DDSI_URING_MAX_CONNS];
+
+  /* event being processed: connection and (if multishot) buffer */
+  int cur_idx;
+  bool cur_has_buf;
+  unsigned cur_bid;
+  unsigned cur_len;
+
+  uint64_t npackets;
+  uint64_t nwaits;
+};
+
+static os_atomic_uint32_t ddsi_uring_init_g = OS_ATOMIC_UINT32_INIT(0);
+static struct ddsi_uring_sendq ddsi_uring_sendq_g;
+static struct ddsi_uring_attached ddsi_uring_attached_g[DDSI_URING_MAX_CONNS];
+static unsigned ddsi_uring_nattached_g;
+static struct ddsi_uring_waitset *ddsi_uring_waitset_g;
+
+static int ddsi_uring_sys_setup (unsigned entries, struct io_uring_params *p)
+{
+  return (int) syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int ddsi_uring_sys_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int ddsi_uring_sys_register (int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+  return (int) syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int ddsi_uring_ring_init (struct ddsi_uring_ring *r, unsigned entries)
+{
+  struct io_uring_params p;
+  unsigned *sq_array;
+  int files[DDSI_URING_MAX_CONNS];
+  unsigned i;
+
+  memset (&p, 0, sizeof (p));
+  memset (r, 0, sizeof (*r));
+  if ((r->fd = ddsi_uring_sys_setup (entries, &p)) < 0)
+  {
+    nn_log (LC_CONFIG, "uring: io_uring_setup failed (errno %d)\n", os_getErrno ());
+    return -1;
+  }
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+  {
+    nn_log (LC_CONFIG, "uring: kernel too old\n");
+    goto err;
+  }
+  r->ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  if (p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe) > r->ring_size)
+    r->ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  if ((r->ring_ptr = mmap (NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+    goto err;
+  r->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  if ((r->sqes = mmap (NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES)) == MAP_FAILED)
+  {
+    munmap (r->ring_ptr, r->ring_size);
+    goto err;
+  }
+  r->sq_entries = p.sq_entries;
+  r->sq_mask = *(unsigned *) ((char *) r->ring_ptr + p.sq_off.ring_mask);
+  r->sq_head = (unsigned *) ((char *) r->ring_ptr + p.sq_off.head);
+  r->sq_tail = (unsigned *) ((char *) r->ring_ptr + p.sq_off.tail);
+  r->sq_local_tail = *r->sq_tail;
+  r->cq_mask = *(unsigned *) ((char *) r->ring_ptr + p.cq_off.ring_mask);
+  r->cq_head = (unsigned *) ((char *) r->ring_ptr + p.cq_off.head);
+  r->cq_tail = (unsigned *) ((char *) r->ring_ptr + p.cq_off.tail);
+  r->cqes = (struct io_uring_cqe *) ((char *) r->ring_ptr + p.cq_off.cqes);
+  sq_array = (unsigned *) ((char *) r->ring_ptr + p.sq_off.array);
+  for (i = 0; i < p.sq_entries; i++)
+    sq_array[i] = i;
+
+  /* sockets get registered as they are attached */
+  for (i = 0; i < DDSI_URING_MAX_CONNS; i++)
+    files[i] = -1;
+  if (ddsi_uring_sys_register (r->fd, IORING_REGISTER_FILES, files, DDSI_URING_MAX_CONNS) < 0)
+  {
+    nn_log (LC_CONFIG, "uring: can't register files (errno %d)\n", os_getErrno ());
+    munmap (r->sqes, r->sqes_size);
+    munmap (r->ring_ptr, r->ring_size);
+    goto err;
+  }
+  return 0;
+
+err:
+  close (r->fd);
+  return -1;
+}
+
+static void ddsi_uring_ring_fini (struct ddsi_uring_ring *r)
+{
+  munmap (r->sqes, r->sqes_size);
+  munmap (r->ring_ptr, r->ring_size);
+  close (r->fd);
+}
+
+static int ddsi_uring_ring_register_file (struct ddsi_uring_ring *r, unsigned idx, int fd)
+{
+  struct io_uring_files_update up;
+  memset (&up, 0, sizeof (up));
+  up.offset = idx;
+  up.fds = (uint64_t) (uintptr_t) &fd;
+  return (ddsi_uring_sys_register (r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) == 1) ? 0 : -1;
+}
+
+static struct io_uring_sqe *ddsi_uring_ring_get_sqe (struct ddsi_uring_ring *r)
+{
+  struct io_uring_sqe *sqe;
+  const unsigned head = *(volatile unsigned *) r->sq_head;
+  os_atomic_fence_acq ();
+  if (r->sq_local_tail - head >= r->sq_entries)
+    return NULL;
+  sqe = &r->sqes[r->sq_local_tail & r->sq_mask];
+  r->sq_local_tail++;
+  r->to_submit++;
+  memset (sqe, 0, sizeof (*sqe));
+  return sqe;
+}
+
+static void ddsi_uring_ring_publish (struct ddsi_uring_ring *r)
+{
+  os_atomic_fence_rel ();
+  *(volatile unsigned *) r->sq_tail = r->sq_local_tail;
+}
+
+/* Publishes the prepared entries and enters the kernel to submit them and
+   wait for min_complete completions */
+static int ddsi_uring_ring_enter (struct ddsi_uring_ring *r, unsigned min_complete)
+{
+  int ret;
+  ddsi_uring_ring_publish (r);
+  do {
+    ret = ddsi_uring_sys_enter (r->fd, r->to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+  } while (ret < 0 && os_getErrno () == EINTR && min_complete == 0);
+  if (ret >= 0)
+    r->to_submit -= (unsigned) ret;
+  return ret;
+}
+
+static struct io_uring_cqe *ddsi_uring_ring_peek_cqe (struct ddsi_uring_ring *r)
+{
+  const unsigned head = *r->cq_head;
+  const unsigned tail = *(volatile unsigned *) r->cq_tail;
+  os_atomic_fence_acq ();
+  return (head == tail) ? NULL : &r->cqes[head & r->cq_mask];
+}
+
+static void ddsi_uring_ring_cqe_seen (struct ddsi_uring_ring *r)
+{
+  os_atomic_fence_rel ();
+  *(volatile unsigned *) r->cq_head = *r->cq_head + 1;
+}
+
+static int ddsi_uring_find_attached (ddsi_tran_conn_t conn)
+{
+  unsigned i;
+  for (i = 0; i < ddsi_uring_nattached_g; i++)
+    if (ddsi_uring_attached_g[i].conn == conn)
+      return (int) i;
+  return -1;
+}
+
+static void ddsi_uring_sendq_prep (struct ddsi_uring_sendq *q, uint32_t ticket)
+{
+  struct ddsi_uring_sendslot *s = &q->slots[ticket % DDSI_URING_SEND_ENTRIES];
+  struct io_uring_sqe *sqe;
+  /* the ring has as many entries as there are slots */
+  sqe = ddsi_uring_ring_get_sqe (&q->ring);
+  assert (sqe != NULL);
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->fd = s->fileidx;
+  sqe->addr = (uint64_t) (uintptr_t) &s->mhdr;
+  sqe->len = 1;
+#ifdef MSG_NOSIGNAL
+  sqe->msg_flags = MSG_NOSIGNAL;
+#endif
+  sqe->user_data = ticket;
+}
+
+static void ddsi_uring_sendq_complete (struct ddsi_uring_sendq *q, uint32_t ticket, int res)
+{
+  struct ddsi_uring_sendslot *s = &q->slots[ticket % DDSI_URING_SEND_ENTRIES];
+  if (res > 0 && gv.pcap_fp)
+  {
+    os_sockaddr_storage sa;
+    socklen_t alen = sizeof (sa);
+    if (getsockname (ddsi_conn_handle (s->conn), (struct sockaddr *) &sa, &alen) == -1)
+      memset (&sa, 0, sizeof (sa));
+    write_pcap_sent (gv.pcap_fp, now (), &sa, &s->mhdr, (size_t) res);
+  }
+  else if (res < 0)
+  {
+    switch (-res)
+    {
+      case os_sockEPERM:
+      case os_sockECONNRESET:
+#ifdef os_sockENETUNREACH
+      case os_sockENETUNREACH:
+#endif
+#ifdef os_sockEHOSTUNREACH
+      case os_sockEHOSTUNREACH:
+#endif
+        break;
+      default:
+        NN_ERROR ("ddsi_uring_conn_write failed with error code %d", -res);
+    }
+  }
+  s->done = true;
+  while (q->done != q->next && q->slots[q->done % DDSI_URING_SEND_ENTRIES].done)
+  {
+    q->slots[q->done % DDSI_URING_SEND_ENTRIES].done = false;
+    q->done++;
+    q->nsent++;
+  }
+}
+
+/* Takes back the writes the kernel hasn't consumed and fails them; the
+   kernel only looks at the submission queue when asked, so this is safe
+   as long as no thread is in io_uring_enter */
+static void ddsi_uring_sendq_drop_locked (struct ddsi_uring_sendq *q, int err)
+{
+  const unsigned head = *(volatile unsigned *) q->ring.sq_head;
+  unsigned i;
+  assert (!q->reaping);
+  NN_ERROR ("ddsi_uring: io_uring_enter failed with error code %d, dropping %u messages\n", err, q->ring.to_submit);
+  for (i = head; i != q->ring.sq_local_tail; i++)
+    ddsi_uring_sendq_complete (q, (uint32_t) q->ring.sqes[i & q->ring.sq_mask].user_data, -err);
+  q->ring.sq_local_tail = head;
+  *(volatile unsigned *) q->ring.sq_tail = head;
+  q->ring.to_submit = 0;
+}
+
+/* Consumes the completions the kernel has posted, without a system call;
+   writes failing with EPERM are prepared again */
+static void ddsi_uring_sendq_reap_locked (struct ddsi_uring_sendq *q)
+{
+  struct io_uring_cqe *cqe;
+  while ((cqe = ddsi_uring_ring_peek_cqe (&q->ring)) != NULL)
+  {
+    const uint32_t ticket = (uint32_t) cqe->user_data;
+    const int res = cqe->res;
+    struct ddsi_uring_sendslot *s = &q->slots[ticket % DDSI_URING_SEND_ENTRIES];
+    ddsi_uring_ring_cqe_seen (&q->ring);
+    if (res == -os_sockEPERM && s->retries++ < 2)
+      ddsi_uring_sendq_prep (q, ticket);
+    else
+      ddsi_uring_sendq_complete (q, ticket, res);
+  }
+  os_condBroadcast (&q->cond);
+}
+
+/* Waits until all writes with a ticket before upto have completed; sendq
+   lock must be held, but is released while in the kernel. Completions that
+   have already been posted are consumed first, and the prepared writes are
+   submitted by the same system call that waits for completions. */
+static void ddsi_uring_sendq_wait_locked (struct ddsi_uring_sendq *q, uint32_t upto)
+{
+  unsigned nfails = 0;
+  ddsi_uring_sendq_reap_locked (q);
+  while ((int32_t) (upto - q->done) > 0)
+  {
+    if (q->reaping)
+    {
+      os_condWait (&q->cond, &q->lock);
+    }
+    else
+    {
+      const unsigned to_submit = q->ring.to_submit;
+      int ret, err;
+      q->reaping = true;
+      if (to_submit > 0)
+      {
+        ddsi_uring_ring_publish (&q->ring);
+        q->nsubmits++;
+      }
+      os_mutexUnlock (&q->lock);
+      ret = ddsi_uring_sys_enter (q->ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+      /* the kernel doesn't wait if it couldn't submit everything, which
+         only happens when it is short of resources */
+      if (ret < 0)
+        err = os_getErrno ();
+      else
+        err = ((unsigned) ret < to_submit) ? EAGAIN : 0;
+      if (err != 0 && err != EINTR)
+      {
+        const os_time delay = { 0, 1000000 };
+        os_nanoSleep (delay);
+      }
+      os_mutexLock (&q->lock);
+      q->reaping = false;
+      if (ret > 0)
+        q->ring.to_submit -= (unsigned) ret;
+      if (err == 0 || err == EINTR)
+        nfails = 0;
+      else if (q->ring.to_submit > 0)
+      {
+        /* give up on the writes the kernel hasn't taken */
+        if (++nfails >= DDSI_URING_SUBMIT_TRIES)
+        {
+          ddsi_uring_sendq_drop_locked (q, err);
+          nfails = 0;
+        }
+      }
+      else if (++nfails >= DDSI_URING_WAIT_TRIES)
+      {
+        /* the kernel still has the writes, so there is no way to give up
+           on them */
+        NN_FATAL ("ddsi_uring: io_uring_enter failed with error code %d\n", err);
+      }
+      ddsi_uring_sendq_reap_locked (q);
+    }
+  }
+}
+
+static ssize_t ddsi_uring_conn_write (ddsi_tran_conn_t conn, const struct msghdr * msg, size_t len, uint32_t flags)
+{
+  struct ddsi_uring_sendq * const q = &ddsi_uring_sendq_g;
+  struct ddsi_uring_sendslot *s;
+  const int fileidx = ddsi_uring_find_attached (conn);
+  uint32_t ticket;
+  size_t i;
+
+  assert (fileidx >= 0);
+  if (!(flags & DDSI_TRAN_MORE) || msg->msg_iovlen > DDSI_URING_MAX_IOV || msg->msg_namelen > sizeof (s->addr) || msg->msg_controllen > 0)
+  {
+    /* a single write costs one system call either way, and sendmsg
+       doesn't serialise it with all other writes on the sendq lock; the
+       others don't fit in a slot, which can't happen with the current
+       message packing */
+    return ddsi_uring_attached_g[fileidx].write_fn (conn, msg, len, flags);
+  }
+
+  os_mutexLock (&q->lock);
+  if (q->next - q->done == DDSI_URING_SEND_ENTRIES)
+    ddsi_uring_sendq_wait_locked (q, q->next - DDSI_URING_SEND_ENTRIES + 1);
+  ticket = q->next++;
+  s = &q->slots[ticket % DDSI_URING_SEND_ENTRIES];
+  s->conn = conn;
+  s->fileidx = fileidx;
+  s->retries = 0;
+  s->done = false;
+  memcpy (&s->addr, msg->msg_name, msg->msg_namelen);
+  for (i = 0; i < (size_t) msg->msg_iovlen; i++)
+    s->iov[i] = msg->msg_iov[i];
+  memset (&s->mhdr, 0, sizeof (s->mhdr));
+  s->mhdr.msg_name = &s->addr;
+  s->mhdr.msg_namelen = msg->msg_namelen;
+  s->mhdr.msg_iov = s->iov;
+  s->mhdr.msg_iovlen = msg->msg_iovlen;
+  ddsi_uring_sendq_prep (q, ticket);
+  os_mutexUnlock (&q->lock);
+  /* errors get reported on completion, just like a full socket buffer
+     would drop the message silently */
+  return (ssize_t) len;
+}
+
+static void ddsi_uring_conn_flush (ddsi_tran_conn_t conn)
+{
+  struct ddsi_uring_sendq * const q = &ddsi_uring_sendq_g;
+  (void) conn;
+  /* this includes writes of other threads, but those will complete soon
+     enough anyway */
+  os_mutexLock (&q->lock);
+  ddsi_uring_sendq_wait_locked (q, q->next);
+  os_mutexUnlock (&q->lock);
+}
+
+static void ddsi_uring_recycle_buffer (struct ddsi_uring_waitset *ws, unsigned bid)
+{
+  struct io_uring_buf *b = &ws->br->bufs[ws->br_tail & (ws->nbufs - 1)];
+  b->addr = (uint64_t) (uintptr_t) (ws->bufs + (size_t) bid * DDSI_URING_BUFSIZE);
+  b->len = DDSI_URING_BUFSIZE;
+  b->bid = (uint16_t) bid;
+  ws->br_tail++;
+  os_atomic_fence_rel ();
+  *(volatile uint16_t *) &ws->br->tail = (uint16_t) ws->br_tail;
+}
+
+static ssize_t ddsi_uring_conn_read (ddsi_tran_conn_t conn, unsigned char * buf, size_t len)
+{
+  struct ddsi_uring_waitset * const ws = ddsi_uring_waitset_g;
+  const struct io_uring_recvmsg_out *out;
+  const unsigned char *p;
+  size_t hdrlen, n;
+
+  if (ws == NULL || !ws->cur_has_buf || ws->conns[ws->cur_idx] != conn)
+  {
+    /* not from a multishot receive, so just read from the socket */
+    const int idx = ddsi_uring_find_attached (conn);
+    assert (idx >= 0);
+    return ddsi_uring_attached_g[idx].read_fn (conn, buf, len);
+  }
+
+  p = ws->bufs + (size_t) ws->cur_bid * DDSI_URING_BUFSIZE;
+  out = (const struct io_uring_recvmsg_out *) p;
+  hdrlen = sizeof (*out) + ws->recv_mhdr.msg_namelen + ws->recv_mhdr.msg_controllen;
+  assert (ws->cur_len >= hdrlen);
+  n = ws->cur_len - hdrlen;
+  if (n > len || (out->flags & MSG_TRUNC))
+  {
+    char addrbuf[INET6_ADDRSTRLEN_EXTENDED];
+    os_sockaddr_storage src;
+    memset (&src, 0, sizeof (src));
+    memcpy (&src, p + sizeof (*out), out->namelen < sizeof (src) ? out->namelen : sizeof (src));
+    sockaddr_to_string_with_port (addrbuf, &src);
+    NN_WARNING ("%s => %d truncated to %d\n", addrbuf, (int) out->payloadlen, (int) (n < len ? n : len));
+    if (n > len)
+      n = len;
+  }
+  memcpy (buf, p + hdrlen, n);
+  ddsi_uring_recycle_buffer (ws, ws->cur_bid);
+  ws->cur_has_buf = false;
+  return (ssize_t) n;
+}
+
+int ddsi_uring_attach (ddsi_tran_conn_t conn)
+{
+  struct ddsi_uring_attached *a;
+  int fd;
+  assert (os_atomic_ld32 (&ddsi_uring_init_g) > 0);
+  if (ddsi_uring_find_attached (conn) >= 0)
+    return 0;
+  if (ddsi_uring_nattached_g == DDSI_URING_MAX_CONNS)
+    return -1;
+  fd = (int) ddsi_conn_handle (conn);
+  if (ddsi_uring_ring_register_file (&ddsi_uring_sendq_g.ring, ddsi_uring_nattached_g, fd) < 0)
+  {
+    NN_WARNING ("ddsi_uring_attach: can't register socket %d (errno %d)\n", fd, os_getErrno ());
+    return -1;
+  }
+  a = &ddsi_uring_attached_g[ddsi_uring_nattached_g++];
+  a->conn = conn;
+  a->read_fn = conn->m_read_fn;
+  a->write_fn = conn->m_write_fn;
+  conn->m_read_fn = ddsi_uring_conn_read;
+  conn->m_write_fn = ddsi_uring_conn_write;
+  conn->m_flush_fn = ddsi_uring_conn_flush;
+  nn_log (LC_INFO, "ddsi_uring_attach socket %d\n", fd);
+  return 0;
+}
+
+static void ddsi_uring_arm_trigger (struct ddsi_uring_waitset *ws)
+{
+  struct io_uring_sqe *sqe;
+  if ((sqe = ddsi_uring_ring_get_sqe (&ws->ring)) == NULL)
+    return;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = ws->evfd;
+  sqe->addr = (uint64_t) (uintptr_t) &ws->evbuf;
+  sqe->len = sizeof (ws->evbuf);
+  sqe->user_data = DDSI_URING_UD_TRIGGER;
+  ws->trigger_armed = true;
+}
+
+static void ddsi_uring_arm_conn (struct ddsi_uring_waitset *ws, unsigned idx)
+{
+  struct io_uring_sqe *sqe;
+  if ((sqe = ddsi_uring_ring_get_sqe (&ws->ring)) == NULL)
+    return;
+  if (ws->multishot[idx])
+  {
+    /* one request keeps on receiving datagrams until it runs out of
+       buffers; the socket is a registered file at the same index */
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->fd = (int) idx;
+    sqe->addr = (uint64_t) (uintptr_t) &ws->recv_mhdr;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = DDSI_URING_BGID;
+  }
+  else
+  {
+    /* one-shot poll, re-armed after handling each event, so that it is
+       level-triggered like select() */
+    uint32_t mask = POLLIN;
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = (int) ddsi_conn_handle (ws->conns[idx]);
+    sqe->poll32_events = mask;
+  }
+  sqe->user_data = idx;
+  ws->armed[idx] = true;
+}
+
+struct ddsi_uring_waitset *ddsi_uring_waitset_new (void)
+{
+  struct ddsi_uring_waitset *ws;
+  struct io_uring_buf_reg reg;
+  unsigned i;
+
+  assert (ddsi_uring_waitset_g == NULL);
+  ws = os_malloc (sizeof (*ws));
+  memset (ws, 0, sizeof (*ws));
+  ws->cur_idx = -1;
+  if (ddsi_uring_ring_init (&ws->ring, DDSI_URING_RECV_ENTRIES) < 0)
+    goto err_ring;
+  if ((ws->evfd = eventfd (0, EFD_CLOEXEC)) == -1)
+    goto err_evfd;
+
+  ws->nbufs = 1;
+  while (ws->nbufs < config.uring_rbufs && ws->nbufs < 32768)
+    ws->nbufs *= 2;
+  ws->br_size = ws->nbufs * sizeof (struct io_uring_buf);
+  if ((ws->br = mmap (NULL, ws->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+    goto err_br;
+  ws->bufs = os_malloc ((size_t) ws->nbufs * DDSI_URING_BUFSIZE);
+  memset (&reg, 0, sizeof (reg));
+  reg.ring_addr = (uint64_t) (uintptr_t) ws->br;
+  reg.ring_entries = ws->nbufs;
+  reg.bgid = DDSI_URING_BGID;
+  if (ddsi_uring_sys_register (ws->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+  {
+    nn_log (LC_CONFIG, "uring: can't register buffer ring (errno %d)\n", os_getErrno ());
+    goto err_reg;
+  }
+  for (i = 0; i < ws->nbufs; i++)
+    ddsi_uring_recycle_buffer (ws, i);
+  memset (&ws->recv_mhdr, 0, sizeof (ws->recv_mhdr));
+  ws->recv_mhdr.msg_namelen = sizeof (os_sockaddr_storage);
+  ddsi_uring_arm_trigger (ws);
+
+  ddsi_uring_waitset_g = ws;
+  nn_log (LC_INFO, "uring: waitset with %u receive buffers\n", ws->nbufs);
+  return ws;
+
+err_reg:
+  os_free (ws->bufs);
+  munmap (ws->br, ws->br_size);
+err_br:
+  close (ws->evfd);
+err_evfd:
+  ddsi_uring_ring_fini (&ws->ring);
+err_ring:
+  os_free (ws);
+  return NULL;
+}
+
+void ddsi_uring_waitset_free (struct ddsi_uring_waitset *ws)
+{
+  if (ws == NULL)
+    return;
+  assert (ws == ddsi_uring_waitset_g);
+  nn_log (LC_INFO, "uring: received %llu packets in %llu waits\n", (unsigned long long) ws->npackets, (unsigned long long) ws->nwaits);
+  ddsi_uring_waitset_g = NULL;
+  /* closing the ring cancels the outstanding requests before the buffers
+     are freed */
+  ddsi_uring_ring_fini (&ws->ring);
+  close (ws->evfd);
+  munmap (ws->br, ws->br_size);
+  os_free (ws->bufs);
+  os_free (ws);
+}
+
+void ddsi_uring_waitset_trigger (struct ddsi_uring_waitset *ws)
+{
+  const uint64_t one = 1;
+  if (write (ws->evfd, &one, sizeof (one)) != (ssize_t) sizeof (one))
+    NN_ERROR ("ddsi_uring_waitset_trigger: write failed on eventfd (errno %d)\n", os_getErrno ());
+}
+
+void ddsi_uring_waitset_add (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t conn)
+{
+  unsigned idx;
+  for (idx = 0; idx < ws->n; idx++)
+    if (ws->conns[idx] == conn)
+      return;
+  if (ws->n == DDSI_URING_MAX_CONNS)
+  {
+    NN_ERROR ("ddsi_uring_waitset_add: too many connections\n");
+    return;
+  }
+  ws->conns[idx] = conn;
+  ws->multishot[idx] = false;
+  if (ddsi_uring_find_attached (conn) >= 0)
+  {
+    if (ddsi_uring_ring_register_file (&ws->ring, idx, (int) ddsi_conn_handle (conn)) == 0)
+      ws->multishot[idx] = true;
+    else
+      NN_WARNING ("ddsi_uring_waitset_add: can't register socket (errno %d), polling it instead\n", os_getErrno ());
+  }
+  ws->n++;
+  ddsi_uring_arm_conn (ws, idx);
+}
+
+bool ddsi_uring_waitset_wait (struct ddsi_uring_waitset *ws)
+{
+  unsigned idx;
+  assert (!ws->cur_has_buf);
+  if (!ws->trigger_armed)
+    ddsi_uring_arm_trigger (ws);
+  for (idx = 0; idx < ws->n; idx++)
+    if (!ws->armed[idx])
+      ddsi_uring_arm_conn (ws, idx);
+  ws->nwaits++;
+  if (ddsi_uring_ring_enter (&ws->ring, 1) < 0 && os_getErrno () != EINTR)
+  {
+    NN_ERROR ("ddsi_uring_waitset_wait: io_uring_enter failed with error code %d\n", os_getErrno ());
+    return false;
+  }
+  return ddsi_uring_ring_peek_cqe (&ws->ring) != NULL;
+}
+
+int ddsi_uring_waitset_next_event (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t *conn)
+{
+  struct io_uring_cqe *cqe;
+
+  /* the buffer of the previous event may not have been read */
+  if (ws->cur_has_buf)
+  {
+    ddsi_uring_recycle_buffer (ws, ws->cur_bid);
+    ws->cur_has_buf = false;
+  }
+  ws->cur_idx = -1;
+
+  while ((cqe = ddsi_uring_ring_peek_cqe (&ws->ring)) != NULL)
+  {
+    const uint64_t ud = cqe->user_data;
+    const int32_t res = cqe->res;
+    const uint32_t flags = cqe->flags;
+    unsigned idx;
+    ddsi_uring_ring_cqe_seen (&ws->ring);
+
+    if (ud == DDSI_URING_UD_TRIGGER)
+    {
+      ws->trigger_armed = false;
+      continue;
+    }
+    assert (ud < ws->n);
+    idx = (unsigned) ud;
+    if (!(flags & IORING_CQE_F_MORE))
+      ws->armed[idx] = false;
+    if (res < 0)
+    {
+      if (res == -EINVAL && ws->multishot[idx])
+      {
+        NN_WARNING ("ddsi_uring: multishot receive not supported, polling instead\n");
+        ws->multishot[idx] = false;
+      }
+      else if (res != -ENOBUFS && res != -ECANCELED)
+      {
+        NN_ERROR ("ddsi_uring: receive failed with error code %d\n", -res);
+      }
+      continue;
+    }
+    if (ws->multishot[idx])
+    {
+      if (!(flags & IORING_CQE_F_BUFFER))
+        continue;
+      ws->cur_has_buf = true;
+      ws->cur_bid = flags >> IORING_CQE_BUFFER_SHIFT;
+      ws->cur_len = (unsigned) res;
+    }
+    ws->cur_idx = (int) idx;
+    ws->npackets++;
+    *conn = ws->conns[idx];
+    return (int) idx;
+  }
+  return -1;
+}
+
+void ddsi_uring_fini (void)
+{
+  if (os_atomic_dec32_nv (&ddsi_uring_init_g) == 0)
+  {
+    struct ddsi_uring_sendq * const q = &ddsi_uring_sendq_g;
+    assert (q->next == q->done);
+    assert (ddsi_uring_waitset_g == NULL);
+    nn_log (LC_INFO, "uring: sent %llu packets in %llu submissions\n", (unsigned long long) q->nsent, (unsigned long long) q->nsubmits);
+    /* the connections have been freed by now */
+    ddsi_uring_nattached_g = 0;
+    ddsi_uring_ring_fini (&q->ring);
+    os_condDestroy (&q->cond);
+    os_mutexDestroy (&q->lock);
+    nn_log (LC_INFO | LC_CONFIG, "uring finalized\n");
+  }
+}
+
+int ddsi_uring_init (void)
+{
+  if (os_atomic_inc32_nv (&ddsi_uring_init_g) == 1)
+  {
+    struct ddsi_uring_sendq * const q = &ddsi_uring_sendq_g;
+    memset (q, 0, sizeof (*q));
+    if (ddsi_uring_ring_init (&q->ring, DDSI_URING_SEND_ENTRIES) < 0)
+    {
+      os_atomic_dec32 (&ddsi_uring_init_g);
+      return -1;
+    }
+    assert (q->ring.sq_entries >= DDSI_URING_SEND_ENTRIES);
+    os_mutexInit (&q->lock);
+    os_condInit (&q->cond, &q->lock);
+    ddsi_uring_nattached_g = 0;
+    nn_log (LC_INFO | LC_CONFIG, "uring initialized\n");
+  }
+  return 0;
+}
+
+#else
+
+int ddsi_uring_init (void)
+{
+  nn_log (LC_CONFIG, "uring: not supported on this platform\n");
+  return -1;
+}
+
+void ddsi_uring_fini (void)
+{
+}
+
+int ddsi_uring_attach (ddsi_tran_conn_t conn)
+{
+  (void) conn;
+  return -1;
+}
+
+struct ddsi_uring_waitset *ddsi_uring_waitset_new (void)
+{
+  return NULL;
+}
+
+void ddsi_uring_waitset_free (struct ddsi_uring_waitset *ws)
+{
+  (void) ws;
+}
+
+void ddsi_uring_waitset_trigger (struct ddsi_uring_waitset *ws)
+{
+  (void) ws;
+}
+
+void ddsi_uring_waitset_add (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t conn)
+{
+  (void) ws;
+  (void) conn;
+}
+
+bool ddsi_uring_waitset_wait (struct ddsi_uring_waitset *ws)
+{
+  (void) ws;
+  return false;
+}
+
+int ddsi_uring_waitset_next_event (struct ddsi_uring_waitset *ws, ddsi_tran_conn_t *conn)
+{
+  (void) ws;
+  (void) conn;
+  return -1;
+}
+
+#endif
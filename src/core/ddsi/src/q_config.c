@@ -530,6 +530,10 @@ static const struct cfgelem unsupp_cfgelems[] = {
 "<p>This setting limits the maximum number of bytes queued for retransmission. The default value of 0 is unlimited unless an AuxiliaryBandwidthLimit has been set, in which case it becomes NackDelay * AuxiliaryBandwidthLimit. It must be large enough to contain the largest sample that may need to be retransmitted.</p>" },
 { LEAF("MaxQueuedRexmitMessages"), 1, "200", ABSOFF(max_queued_rexmit_msgs), 0, uf_uint, 0, pf_uint,
 "<p>This settings limits the maximum number of samples queued for retransmission.</p>" },
+{ LEAF("MaxDiscoveryRexmitBurst"), 1, "16 kB", ABSOFF(max_discovery_rexmit_burst), 0, uf_memsize, 0, pf_memsize,
+"<p>This setting limits the number of bytes of historical discovery data retransmitted to a remote participant in response to a single NACK while it is still catching up. The remainder follows in response to its next NACK, so that a mass (re)start of participants does not result in bursts that overflow the network and socket buffers. The value 0 means no limit other than Internal/MaxQueuedRexmitBytes.</p>" },
+{ LEAF("RetransmitThread"), 1, "false", ABSOFF(rexmit_thread), 0, uf_boolean, 0, pf_boolean,
+"<p>This element controls whether sample retransmissions queued on the global event queue are handled by a separate thread (\"tev.rexmit\") with its own queue. This prevents heartbeats, acknowledgements and discovery messages from being delayed by the recovery of lost data when many retransmits are pending.</p>" },
 { LEAF("LeaseDuration"), 1, "10 s", ABSOFF(lease_duration), 0, uf_duration_ms_1hr, 0, pf_duration,
 "<p>This setting controls the default participant lease duration. <p>" },
 { LEAF("WriterLingerDuration"), 1, "1 s", ABSOFF(writer_linger_duration), 0, uf_duration_ms_1hr, 0, pf_duration,
@@ -574,7 +578,9 @@ static const struct cfgelem unsupp_cfgelems[] = {
 { LEAF("LogStackTraces"), 1, "true", ABSOFF(noprogress_log_stacktraces), 0, uf_boolean, 0, pf_boolean,
 "<p>This element controls whether or not to write stack traces to the DDSI2 trace when a thread fails to make progress (on select platforms only).</p>" },
 { LEAF("MonitorPort"), 1, "-1", ABSOFF(monitor_port), 0, uf_int, 0, pf_int,
-"<p>This element allows configuring a service that dumps a text description of part the internal state to TCP clients. By default (-1), this is disabled; specifying 0 means a kernel-allocated port is used; a positive number is used as the TCP port number.</p>" },
+"<p>This element allows configuring a service that dumps a text description of part the internal state to TCP clients. HTTP clients requesting /metrics instead get process-wide and per-topic counters in the Prometheus text format. By default (-1), this is disabled; specifying 0 means a kernel-allocated port is used; a positive number is used as the TCP port number.</p>" },
+{ LEAF("LatencyHistogramInterval"), 1, "0", ABSOFF(lat_histogram_interval), 0, uf_uint, 0, pf_uint,
+"<p>This element specifies which samples are timed for the per-reader latency histograms (see dds_get_latency_histogram): one in every so many samples stored in each reader history. Timing costs two clock readings when a sample is stored and one per take operation that takes a timed sample. 0 disables the histograms.</p>" },
 { LEAF("AssumeMulticastCapable"), 1, "", ABSOFF(assumeMulticastCapable), 0, uf_string, ff_free, pf_string,
 "<p>This element controls which network interfaces are assumed to be capable of multicasting even when the interface flags returned by the operating system state it is not (this provides a workaround for some platforms). It is a comma-separated lists of patterns (with ? and * wildcards) against which the interface names are matched.</p>" },
 { LEAF("PrioritizeRetransmit"), 1, "true", ABSOFF(prioritize_retransmit), 0, uf_boolean, 0, pf_boolean,
@@ -621,6 +627,29 @@ static const struct cfgelem discovery_ports_cfgelems[] = {
     END_MARKER
 };
 
+static const struct cfgelem shm_cfgelems[] = {
+    { LEAF("Enable"), 1, "false", ABSOFF(shm_enable), 0, uf_boolean, 0, pf_boolean,
+    "<p>This element enables the shared-memory transport for communicating with other processes on the same host. Each process then advertises a receive ring in shared memory, and peers on the same host that can map it write their messages directly into it instead of sending them over UDP. It is ignored when TCP or multiple-socket mode is used.</p>" },
+    { LEAF("RingSize"), 1, "256", ABSOFF(shm_ring_size), 0, uf_uint, 0, pf_uint,
+    "<p>This element specifies the number of messages of up to 64kB the receive ring can hold; it is rounded up to a power of two. Messages arriving while the ring is full are dropped, as they would be by a full socket receive buffer. The ring is allocated in full when the transport is created, so each process takes 64kB of shared memory (/dev/shm on Linux) per slot, 16MB with the default setting. If that much is not available, the process uses UDP instead.</p>" },
+    END_MARKER
+};
+
+static const struct cfgelem unix_cfgelems[] = {
+    { LEAF("Enable"), 1, "false", ABSOFF(unix_enable), 0, uf_boolean, 0, pf_boolean,
+    "<p>This element enables the Unix domain socket transport for communicating with other processes on the same host. Each process then advertises a datagram socket (in the abstract namespace on Linux), and peers on the same host that can reach it send their messages to it instead of over UDP. If the shared-memory transport is enabled as well, that one is preferred. It is ignored when TCP or multiple-socket mode is used.</p>\n\
+<p>As with UDP, messages that the receiving process has no room for are dropped rather than waited for. Linux allows only net.unix.max_dgram_qlen messages to be queued per socket, 10 by default on many systems, which makes for so many retransmits that UDP performs far better. The transport is therefore not used if it is less than 128, and it should be raised to several hundred for this transport to perform well.</p>" },
+    END_MARKER
+};
+
+static const struct cfgelem uring_cfgelems[] = {
+    { LEAF("Enable"), 1, "false", ABSOFF(uring_enable), 0, uf_boolean, 0, pf_boolean,
+    "<p>This element enables the use of io_uring for the UDP sockets on Linux: the receive thread then receives from all sockets through a single io_uring instance instead of select() and recvmsg(), and messages that go to multiple addresses are sent with a single system call. If io_uring is not available, the regular implementation is used. It is ignored when TCP or multiple-socket mode is used.</p>" },
+    { LEAF("ReceiveBuffers"), 1, "32", ABSOFF(uring_rbufs), 0, uf_uint, 0, pf_uint,
+    "<p>This element specifies the number of 64kB buffers the kernel can receive messages into before the receive thread processes them; it is rounded up to a power of two.</p>" },
+    END_MARKER
+};
+
 static const struct cfgelem tcp_cfgelems[] = {
     { LEAF("Enable"), 1, "false", ABSOFF(tcp_enable), 0, uf_boolean, 0, pf_boolean,
     "<p>This element enables the optional TCP transport.</p>" },
@@ -754,8 +783,16 @@ static const struct cfgelem tracing_cfgelems[] = {
 "<p>This option has no effect.</p>" },
 { LEAF("AppendToFile"), 1, "false", ABSOFF(tracingAppendToFile), 0, uf_boolean, 0, pf_boolean,
 "<p>This option specifies whether the output is to be appended to an existing log file. The default is to create a new log file each time, which is generally the best option if a detailed log is generated.</p>" },
+{ LEAF("AsyncBufferSize"), 1, "0 B", ABSOFF(tracing_async_bufsize), 0, uf_memsize, 0, pf_memsize,
+"<p>This option specifies the size of the buffer, per thread producing trace output, in which trace lines are queued for writing to the log file by a background thread. Each line takes about 2kB, irrespective of its length. With the default of 0, every line is written (and flushed) by the thread producing it, which makes detailed tracing very expensive. With a buffer, only formatting the output remains in the producing thread, but lines that are still buffered are lost if the process crashes.</p>" },
 { LEAF("PacketCaptureFile"), 1, "", ABSOFF(pcap_file), 0, uf_string, ff_free, pf_string,
 "<p>This option specifies the file to which received and sent packets will be logged in the \"pcap\" format suitable for analysis using common networking tools, such as WireShark. IP and UDP headers are ficitious, in particular the destination address of received packets. The TTL may be used to distinguish between sent and received packets: it is 255 for sent packets and 128 for received ones. Currently IPv4 only.</p>" },
+{ LEAF("PacketCaptureBufferSize"), 1, "1 MB", ABSOFF(pcap_bufsize), 0, uf_memsize, 0, pf_memsize,
+"<p>This option specifies the size of the buffer in which captured packets are collected for writing to the Tracing/PacketCaptureFile by a background thread. Packets that do not fit in the buffer are not captured; the number of such packets is reported when the file is closed. The size is rounded up to a power of 2 of at least 256 kB.</p>" },
+{ LEAF("SampleTraceFile"), 1, "", ABSOFF(sample_trace_file), 0, uf_string, ff_free, pf_string,
+"<p>This option specifies the file to which the times at which a selection of the samples pass the stages of the data path (serialization, insertion in the writer history, packing, sending, receiving, defragmenting, reordering, delivery, storing in the reader history and being taken) are written in the Chrome trace event format when the domain is deleted. Events are kept in a fixed-size buffer per thread, so only the most recent ones are retained. Tracing is disabled if the file name is empty.</p>" },
+{ LEAF("SampleTraceInterval"), 1, "100", ABSOFF(sample_trace_interval), 0, uf_uint, 0, pf_uint,
+"<p>This option specifies which samples are traced when Tracing/SampleTraceFile is set: only those with a sequence number that is a multiple of this value. As this is based on the sequence number only, the sending and receiving processes trace the same samples when configured identically. 0 disables sample tracing.</p>" },
 END_MARKER
 };
 
@@ -810,6 +847,12 @@ static const struct cfgelem ddsi2_cfgelems[] = {
     "<p>This element specifies the type of OS scheduling class will be used by the thread that announces its liveliness periodically.</p>" },
     { GROUP("TCP", tcp_cfgelems),
     "<p>The TCP element allows specifying various parameters related to running DDSI over TCP.</p>" },
+    { GROUP("SharedMemory", shm_cfgelems),
+    "<p>The SharedMemory element allows specifying various parameters related to the shared-memory transport between processes on the same host.</p>" },
+    { GROUP("Unix", unix_cfgelems),
+    "<p>The Unix element allows specifying various parameters related to the Unix domain socket transport between processes on the same host.</p>" },
+    { GROUP("IoUring", uring_cfgelems),
+    "<p>The IoUring element allows specifying various parameters related to the use of io_uring for network I/O.</p>" },
     { GROUP("ThreadPool", tp_cfgelems),
     "<p>The ThreadPool element allows specifying various parameters related to using a thread pool to send DDSI messages to multiple unicast addresses (TCP or UDP).</p>" },
 #ifdef DDSI_INCLUDE_SSL
@@ -2749,6 +2792,7 @@ void config_fini(_In_ struct cfgst *cfgst)
 
     free_all_elements(cfgst, cfgst->cfg, root_cfgelems);
     if ( config.tracingOutputFile ) {
+        nn_log_async_stop();
         fclose(config.tracingOutputFile);
     }
     memset(&config, 0, sizeof(config));
@@ -42,6 +42,8 @@
 #include "q__osplser.h"
 #include "ddsi/q_md5.h"
 #include "ddsi/q_feature_check.h"
+#include "ddsi/ddsi_shm.h"
+#include "ddsi/ddsi_unix.h"
 
 #include "ddsi/sysdeps.h"
 
@@ -68,6 +70,31 @@ static int get_locator (nn_locator_t *loc, const nn_locators_t *locs, int uc_sam
     }
   }
 
+  /* A peer on this host that advertises a shared-memory ring we can map
+     is best reached that way, failing that, via its Unix domain socket */
+  if (gv.shm_conn)
+  {
+    for (l = locs->first; l != NULL; l = l->next)
+    {
+      if (l->loc.kind == NN_LOCATOR_KIND_SHM && ddsi_shm_reachable (&l->loc))
+      {
+        *loc = l->loc;
+        return 1;
+      }
+    }
+  }
+  if (gv.unix_conn)
+  {
+    for (l = locs->first; l != NULL; l = l->next)
+    {
+      if (l->loc.kind == NN_LOCATOR_KIND_UNIX && ddsi_unix_reachable (&l->loc))
+      {
+        *loc = l->loc;
+        return 1;
+      }
+    }
+  }
+
   /* Preferably an (the first) address that matches a network we are
      on; if none does, pick the first. No multicast locator ever will
      match, so the first one will be used. */
@@ -185,6 +212,9 @@ int spdp_write (struct participant *pp)
   size_t payload_sz;
   char *payload_blob;
   struct nn_locators_one def_uni_loc_one, def_multi_loc_one, meta_uni_loc_one, meta_multi_loc_one;
+  struct nn_locators_one def_uni_loc_local[2], meta_uni_loc_local[2];
+  ddsi_tran_conn_t local_conns[2];
+  int i, nlocal = 0;
   nn_plist_t ps;
   nn_guid_t kh;
   struct writer *wr;
@@ -248,6 +278,27 @@ int spdp_write (struct participant *pp)
     meta_uni_loc_one.loc = gv.loc_meta_uc;
   }
 
+  /* Peers on this host can write into our shared-memory ring or send to
+     our Unix domain socket, those on other hosts (and other
+     implementations) ignore them */
+  if (gv.shm_conn)
+    local_conns[nlocal++] = gv.shm_conn;
+  if (gv.unix_conn)
+    local_conns[nlocal++] = gv.unix_conn;
+  for (i = 0; i < nlocal; i++)
+  {
+    ddsi_conn_locator (local_conns[i], &def_uni_loc_local[i].loc);
+    meta_uni_loc_local[i].loc = def_uni_loc_local[i].loc;
+    def_uni_loc_local[i].next = NULL;
+    meta_uni_loc_local[i].next = NULL;
+    ps.default_unicast_locators.last->next = &def_uni_loc_local[i];
+    ps.metatraffic_unicast_locators.last->next = &meta_uni_loc_local[i];
+    ps.default_unicast_locators.last = &def_uni_loc_local[i];
+    ps.metatraffic_unicast_locators.last = &meta_uni_loc_local[i];
+    ps.default_unicast_locators.n++;
+    ps.metatraffic_unicast_locators.n++;
+  }
+
   if (config.publish_uc_locators)
   {
     ps.present |= PP_DEFAULT_UNICAST_LOCATOR | PP_METATRAFFIC_UNICAST_LOCATOR;
@@ -801,6 +852,51 @@ static int handle_SPDP_alive (const struct receiver_state *rst, nn_wctime_t time
   return 1;
 }
 
+static int handle_SPDP_unchanged (const nn_plist_src_t *src, const void *vdata, unsigned len)
+{
+  /* Periodic SPDP messages of a participant almost never change: if it
+     is identical to the last one that was processed in full for a known
+     proxy participant, all that needs doing is renewing its lease. */
+  struct proxy_participant *proxypp;
+  nn_guid_t ppguid;
+  int unchanged;
+  if (nn_plist_peek_guid (&ppguid, PID_PARTICIPANT_GUID, src) < 0 || ppguid.entityid.u != NN_ENTITYID_PARTICIPANT)
+    return 0;
+  if ((proxypp = ephash_lookup_proxy_participant_guid (&ppguid)) == NULL)
+    return 0;
+  os_mutexLock (&proxypp->e.lock);
+  unchanged = (!proxypp->implicitly_created && proxypp->spdp_payload != NULL &&
+               proxypp->spdp_payload_size == len && memcmp (proxypp->spdp_payload, vdata, len) == 0);
+  os_mutexUnlock (&proxypp->e.lock);
+  if (unchanged)
+  {
+    TRACE ((" %x:%x:%x:%x (known, unchanged)", PGUID (ppguid)));
+    lease_renew (os_atomic_ldvoidp (&proxypp->lease), now_et ());
+  }
+  return unchanged;
+}
+
+static void remember_SPDP (const nn_plist_t *datap, const void *vdata, unsigned len)
+{
+  struct proxy_participant *proxypp;
+  if (!(datap->present & PP_PARTICIPANT_GUID))
+    return;
+  if ((proxypp = ephash_lookup_proxy_participant_guid (&datap->participant_guid)) == NULL)
+    return;
+  os_mutexLock (&proxypp->e.lock);
+  if (!proxypp->implicitly_created)
+  {
+    if (proxypp->spdp_payload_size != len)
+    {
+      os_free (proxypp->spdp_payload);
+      proxypp->spdp_payload = os_malloc (len);
+      proxypp->spdp_payload_size = len;
+    }
+    memcpy (proxypp->spdp_payload, vdata, len);
+  }
+  os_mutexUnlock (&proxypp->e.lock);
+}
+
 static void handle_SPDP (const struct receiver_state *rst, nn_wctime_t timestamp, unsigned statusinfo, const void *vdata, unsigned len)
 {
   const struct CDRHeader *data = vdata; /* built-ins not deserialized (yet) */
@@ -820,6 +916,11 @@ static void handle_SPDP (const struct receiver_state *rst, nn_wctime_t timestamp
     src.encoding = data->identifier;
     src.buf = (unsigned char *) data + 4;
     src.bufsz = len - 4;
+    if ((statusinfo & (NN_STATUSINFO_DISPOSE | NN_STATUSINFO_UNREGISTER)) == 0 && handle_SPDP_unchanged (&src, vdata, len))
+    {
+      TRACE (("\n"));
+      return;
+    }
     if (nn_plist_init_frommsg (&decoded_data, NULL, ~(uint64_t)0, ~(uint64_t)0, &src) < 0)
     {
       NN_WARNING ("SPDP (vendor %u.%u): invalid qos/parameters\n", src.vendorid.id[0], src.vendorid.id[1]);
@@ -830,6 +931,7 @@ static void handle_SPDP (const struct receiver_state *rst, nn_wctime_t timestamp
     {
       case 0:
         interesting = handle_SPDP_alive (rst, timestamp, &decoded_data);
+        remember_SPDP (&decoded_data, vdata, len);
         break;
 
       case NN_STATUSINFO_DISPOSE:
@@ -1346,6 +1448,26 @@ static void handle_SEDP_dead (nn_plist_t *datap, nn_wctime_t timestamp)
   nn_log (LC_DISCOVERY, " %s\n", (res < 0) ? " unknown" : " delete");
 }
 
+static int handle_SEDP_known (const nn_plist_src_t *src)
+{
+  /* Rediscovery of a known endpoint changes nothing (except for the
+     Cloud discovery service, see handle_SEDP_alive), so there is no
+     need to interpret the rest of the data once the endpoint is found */
+  nn_guid_t epguid;
+  int known;
+  if (vendor_is_cloud (src->vendorid) || nn_plist_peek_guid (&epguid, PID_ENDPOINT_GUID, src) < 0)
+    return 0;
+  if (is_writer_entityid (epguid.entityid))
+    known = (ephash_lookup_proxy_writer_guid (&epguid) != NULL);
+  else if (is_reader_entityid (epguid.entityid))
+    known = (ephash_lookup_proxy_reader_guid (&epguid) != NULL);
+  else
+    known = 0;
+  if (known)
+    nn_log (LC_DISCOVERY, " %x:%x:%x:%x known\n", PGUID (epguid));
+  return known;
+}
+
 static void handle_SEDP (const struct receiver_state *rst, nn_wctime_t timestamp, unsigned statusinfo, const void *vdata, unsigned len)
 {
   const struct CDRHeader *data = vdata; /* built-ins not deserialized (yet) */
@@ -1364,6 +1486,8 @@ static void handle_SEDP (const struct receiver_state *rst, nn_wctime_t timestamp
     src.encoding = data->identifier;
     src.buf = (unsigned char *) data + 4;
     src.bufsz = len - 4;
+    if ((statusinfo & (NN_STATUSINFO_DISPOSE | NN_STATUSINFO_UNREGISTER)) == 0 && handle_SEDP_known (&src))
+      return;
     if (nn_plist_init_frommsg (&decoded_data, NULL, ~(uint64_t)0, ~(uint64_t)0, &src) < 0)
     {
       NN_WARNING ("SEDP (vendor %u.%u): invalid qos/parameters\n", src.vendorid.id[0], src.vendorid.id[1]);
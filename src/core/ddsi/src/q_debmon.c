@@ -34,6 +34,9 @@
 #include "ddsi/q_unused.h"
 #include "ddsi/q_error.h"
 #include "ddsi/q_debmon.h"
+#include "ddsi/q_gc.h"
+#include "ddsi/q_pcap.h"
+#include "ddsi/q_xevent.h"
 #include "ddsi/ddsi_ser.h"
 #include "ddsi/ddsi_tran.h"
 #include "ddsi/ddsi_tcp.h"
@@ -57,7 +60,7 @@ struct debug_monitor {
   int stop;
 };
 
-static int cpf (ddsi_tran_conn_t conn, const char *fmt, ...)
+static int conn_write (ddsi_tran_conn_t conn, const char *buf, size_t n)
 {
   nn_locator_t loc;
   if (!ddsi_conn_peer_locator (conn, &loc))
@@ -65,17 +68,11 @@ static int cpf (ddsi_tran_conn_t conn, const char *fmt, ...)
   else
   {
     os_sockaddr_storage addr;
-    va_list ap;
     struct msghdr msg;
     struct iovec iov;
-    char buf[4096];
-    int n;
     nn_loc_to_address(&addr, &loc);
-    va_start (ap, fmt);
-    n = os_vsnprintf (buf, sizeof (buf), fmt, ap);
-    va_end (ap);
-    iov.iov_base = buf;
-    iov.iov_len = (size_t) n;
+    iov.iov_base = (void *) buf;
+    iov.iov_len = n;
     memset (&msg, 0, sizeof (msg));
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
@@ -85,6 +82,19 @@ static int cpf (ddsi_tran_conn_t conn, const char *fmt, ...)
   }
 }
 
+static int cpf (ddsi_tran_conn_t conn, const char *fmt, ...)
+{
+  va_list ap;
+  char buf[4096];
+  int n;
+  va_start (ap, fmt);
+  n = os_vsnprintf (buf, sizeof (buf), fmt, ap);
+  va_end (ap);
+  if (n < 0)
+    return -1;
+  return conn_write (conn, buf, ((size_t) n < sizeof (buf)) ? (size_t) n : sizeof (buf) - 1);
+}
+
 struct print_address_arg {
   ddsi_tran_conn_t conn;
   int count;
@@ -308,6 +318,315 @@ static int print_proxy_participants (struct thread_state1 *self, ddsi_tran_conn_
   return x;
 }
 
+/* Metrics in the Prometheus text exposition format, for HTTP clients
+   requesting /metrics. Everything is first copied into a memory buffer,
+   holding each lock only for as long as it takes to copy a handful of
+   counters, and only then written to the socket. */
+
+struct mbuf {
+  char *buf;
+  size_t pos, size;
+};
+
+static void mpf (struct mbuf *mb, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+  va_start (ap, fmt);
+  n = os_vsnprintf (mb->buf + mb->pos, mb->size - mb->pos, fmt, ap);
+  va_end (ap);
+  if (n < 0)
+    return;
+  if ((size_t) n >= mb->size - mb->pos)
+  {
+    while ((size_t) n >= mb->size - mb->pos)
+      mb->size *= 2;
+    mb->buf = os_realloc (mb->buf, mb->size);
+    va_start (ap, fmt);
+    n = os_vsnprintf (mb->buf + mb->pos, mb->size - mb->pos, fmt, ap);
+    va_end (ap);
+  }
+  mb->pos += (size_t) n;
+}
+
+static void mpf_escaped (struct mbuf *mb, const char *str)
+{
+  for (; *str; str++)
+  {
+    switch (*str)
+    {
+      case '\\': mpf (mb, "\\\\"); break;
+      case '"': mpf (mb, "\\\""); break;
+      case '\n': mpf (mb, "\\n"); break;
+      default: mpf (mb, "%c", *str); break;
+    }
+  }
+}
+
+static void mpf_header (struct mbuf *mb, const char *name, const char *type, const char *help)
+{
+  mpf (mb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+struct topic_metrics {
+  ut_avlNode_t avlnode;
+  char *name;
+  uint64_t nwriters;
+  uint64_t nreaders;
+  uint64_t samples_written;
+  uint64_t bytes_written;
+  uint64_t rexmits;
+  uint64_t nacks_received;
+  uint64_t whc_unacked_bytes;
+  int64_t throttle_time;
+};
+
+static int compare_topic_name (const void *va, const void *vb)
+{
+  return strcmp (va, vb);
+}
+
+static const ut_avlTreedef_t topic_metrics_treedef =
+  UT_AVL_TREEDEF_INITIALIZER_INDKEY (offsetof (struct topic_metrics, avlnode), offsetof (struct topic_metrics, name), compare_topic_name, 0);
+
+static void free_topic_metrics (void *vtm)
+{
+  struct topic_metrics *tm = vtm;
+  os_free (tm->name);
+  os_free (tm);
+}
+
+static struct topic_metrics *lookup_topic_metrics (ut_avlTree_t *topics, const struct sertopic *topic)
+{
+  struct topic_metrics *tm;
+  ut_avlIPath_t path;
+  if ((tm = ut_avlLookupIPath (&topic_metrics_treedef, topics, topic->name, &path)) == NULL)
+  {
+    tm = os_malloc (sizeof (*tm));
+    memset (tm, 0, sizeof (*tm));
+    tm->name = os_strdup (topic->name);
+    ut_avlInsertIPath (&topic_metrics_treedef, topics, tm, &path);
+  }
+  return tm;
+}
+
+static void collect_topic_metrics (struct thread_state1 *self, ut_avlTree_t *topics)
+{
+  struct ephash_enum_writer ew;
+  struct ephash_enum_reader er;
+  struct writer *w;
+  struct reader *r;
+  thread_state_awake (self);
+  ephash_enum_writer_init (&ew);
+  while ((w = ephash_enum_writer_next (&ew)) != NULL)
+  {
+    struct topic_metrics *tm;
+    seqno_t seq;
+    uint64_t bytes_written;
+    uint32_t rexmits, nacks;
+    size_t unacked;
+    int64_t throttle_time;
+    if (w->topic == NULL)
+      continue;
+    os_mutexLock (&w->e.lock);
+    seq = w->seq;
+    bytes_written = w->num_bytes_written;
+    rexmits = w->rexmit_count;
+    nacks = w->num_nacks_received;
+    unacked = whc_unacked_bytes (w->whc);
+    throttle_time = w->throttle_time;
+    os_mutexUnlock (&w->e.lock);
+
+    tm = lookup_topic_metrics (topics, w->topic);
+    tm->nwriters++;
+    tm->samples_written += (uint64_t) seq;
+    tm->bytes_written += bytes_written;
+    tm->rexmits += rexmits;
+    tm->nacks_received += nacks;
+    tm->whc_unacked_bytes += unacked;
+    tm->throttle_time += throttle_time;
+  }
+  ephash_enum_writer_fini (&ew);
+  ephash_enum_reader_init (&er);
+  while ((r = ephash_enum_reader_next (&er)) != NULL)
+  {
+    if (r->topic != NULL)
+      lookup_topic_metrics (topics, r->topic)->nreaders++;
+  }
+  ephash_enum_reader_fini (&er);
+  thread_state_asleep (self);
+}
+
+/* The per-topic figures are summed over the writers that exist at the
+   time, and so go down when a writer is deleted: they are gauges, not
+   counters. */
+static void print_topic_metrics (struct mbuf *mb, ut_avlTree_t *topics)
+{
+  static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t off;
+  } fields[] = {
+    { "cyclonedds_topic_writers", "gauge", "Number of local writers", offsetof (struct topic_metrics, nwriters) },
+    { "cyclonedds_topic_readers", "gauge", "Number of local readers", offsetof (struct topic_metrics, nreaders) },
+    { "cyclonedds_topic_samples_written", "gauge", "Samples written by the existing local writers", offsetof (struct topic_metrics, samples_written) },
+    { "cyclonedds_topic_bytes_written", "gauge", "Serialized payload bytes written by the existing local writers", offsetof (struct topic_metrics, bytes_written) },
+    { "cyclonedds_topic_retransmits", "gauge", "Samples retransmitted by the existing local writers", offsetof (struct topic_metrics, rexmits) },
+    { "cyclonedds_topic_nacks_received", "gauge", "Retransmit requests received by the existing local writers", offsetof (struct topic_metrics, nacks_received) },
+    { "cyclonedds_topic_whc_unacked_bytes", "gauge", "Unacknowledged data in the writer history caches", offsetof (struct topic_metrics, whc_unacked_bytes) }
+  };
+  const struct topic_metrics *tm;
+  ut_avlIter_t it;
+  size_t i;
+  if (ut_avlIsEmpty (topics))
+    return;
+  for (i = 0; i < sizeof (fields) / sizeof (fields[0]); i++)
+  {
+    mpf_header (mb, fields[i].name, fields[i].type, fields[i].help);
+    for (tm = ut_avlIterFirst (&topic_metrics_treedef, topics, &it); tm; tm = ut_avlIterNext (&it))
+    {
+      mpf (mb, "%s{topic=\"", fields[i].name);
+      mpf_escaped (mb, tm->name);
+      mpf (mb, "\"} %"PRIu64"\n", *((const uint64_t *) ((const char *) tm + fields[i].off)));
+    }
+  }
+  mpf_header (mb, "cyclonedds_topic_throttle_seconds", "gauge", "Time the existing local writers spent blocked on a full writer history cache");
+  for (tm = ut_avlIterFirst (&topic_metrics_treedef, topics, &it); tm; tm = ut_avlIterNext (&it))
+  {
+    mpf (mb, "cyclonedds_topic_throttle_seconds{topic=\"");
+    mpf_escaped (mb, tm->name);
+    mpf (mb, "\"} %.9f\n", (double) tm->throttle_time / 1e9);
+  }
+}
+
+static void print_process_metrics (struct mbuf *mb)
+{
+  size_t msgs, bytes;
+  uint32_t allocated, size;
+
+  mpf_header (mb, "cyclonedds_packets_sent_total", "counter", "Packets sent");
+  mpf (mb, "cyclonedds_packets_sent_total %"PRIu64"\n", NN_STAT_COUNTER_LD (gv.net_stats.packets_sent));
+  mpf_header (mb, "cyclonedds_bytes_sent_total", "counter", "Bytes sent");
+  mpf (mb, "cyclonedds_bytes_sent_total %"PRIu64"\n", NN_STAT_COUNTER_LD (gv.net_stats.bytes_sent));
+  mpf_header (mb, "cyclonedds_packets_received_total", "counter", "Packets received");
+  mpf (mb, "cyclonedds_packets_received_total %"PRIu64"\n", NN_STAT_COUNTER_LD (gv.net_stats.packets_received));
+  mpf_header (mb, "cyclonedds_bytes_received_total", "counter", "Bytes received");
+  mpf (mb, "cyclonedds_bytes_received_total %"PRIu64"\n", NN_STAT_COUNTER_LD (gv.net_stats.bytes_received));
+
+  mpf_header (mb, "cyclonedds_dqueue_samples", "gauge", "Samples waiting in a delivery queue");
+  mpf (mb, "cyclonedds_dqueue_samples{queue=\"builtins\"} %"PRIu32"\n", nn_dqueue_depth (gv.builtins_dqueue));
+#ifdef DDSI_INCLUDE_NETWORK_CHANNELS
+  {
+    struct config_channel_listelem *chptr;
+    for (chptr = config.channels; chptr; chptr = chptr->next)
+    {
+      mpf (mb, "cyclonedds_dqueue_samples{queue=\"");
+      mpf_escaped (mb, chptr->name);
+      mpf (mb, "\"} %"PRIu32"\n", nn_dqueue_depth (chptr->dqueue));
+    }
+  }
+#else
+  mpf (mb, "cyclonedds_dqueue_samples{queue=\"user\"} %"PRIu32"\n", nn_dqueue_depth (gv.user_dqueue));
+#endif
+
+  nn_rbufpool_usage (gv.rbufpool, &allocated, &size);
+  mpf_header (mb, "cyclonedds_rbuf_allocated_bytes", "gauge", "Bytes allocated in the current receive buffer");
+  mpf (mb, "cyclonedds_rbuf_allocated_bytes %"PRIu32"\n", allocated);
+  mpf_header (mb, "cyclonedds_rbuf_size_bytes", "gauge", "Size of the current receive buffer");
+  mpf (mb, "cyclonedds_rbuf_size_bytes %"PRIu32"\n", size);
+
+  mpf_header (mb, "cyclonedds_xevent_queued_rexmits", "gauge", "Retransmits waiting in an event queue");
+  xeventq_queued_rexmits (gv.xevents, &msgs, &bytes);
+  mpf (mb, "cyclonedds_xevent_queued_rexmits{queue=\"tev\"} %"PRIuSIZE"\n", msgs);
+  if (gv.rexmit_xevents)
+  {
+    size_t rmsgs, rbytes;
+    xeventq_queued_rexmits (gv.rexmit_xevents, &rmsgs, &rbytes);
+    mpf (mb, "cyclonedds_xevent_queued_rexmits{queue=\"tev.rexmit\"} %"PRIuSIZE"\n", rmsgs);
+    mpf_header (mb, "cyclonedds_xevent_queued_rexmit_bytes", "gauge", "Bytes of retransmits waiting in an event queue");
+    mpf (mb, "cyclonedds_xevent_queued_rexmit_bytes{queue=\"tev\"} %"PRIuSIZE"\n", bytes);
+    mpf (mb, "cyclonedds_xevent_queued_rexmit_bytes{queue=\"tev.rexmit\"} %"PRIuSIZE"\n", rbytes);
+  }
+  else
+  {
+    mpf_header (mb, "cyclonedds_xevent_queued_rexmit_bytes", "gauge", "Bytes of retransmits waiting in an event queue");
+    mpf (mb, "cyclonedds_xevent_queued_rexmit_bytes{queue=\"tev\"} %"PRIuSIZE"\n", bytes);
+  }
+
+  mpf_header (mb, "cyclonedds_gc_requests", "gauge", "Garbage collection requests not yet completed");
+  mpf (mb, "cyclonedds_gc_requests %"PRIu32"\n", gcreq_queue_count (gv.gcreq_queue));
+
+  if (gv.pcap_fp)
+  {
+    mpf_header (mb, "cyclonedds_pcap_dropped_packets_total", "counter", "Packets missing from the packet capture because its buffer was full");
+    mpf (mb, "cyclonedds_pcap_dropped_packets_total %"PRIu32"\n", pcap_file_dropped (gv.pcap_fp));
+  }
+}
+
+static int print_metrics (struct thread_state1 *self, ddsi_tran_conn_t conn)
+{
+  static const char hdr_fmt[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Content-Length: %"PRIuSIZE"\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+  struct mbuf mb;
+  ut_avlTree_t topics;
+  char hdr[sizeof (hdr_fmt) + 20];
+  int n, r;
+
+  mb.size = 4096;
+  mb.pos = 0;
+  mb.buf = os_malloc (mb.size);
+  ut_avlInit (&topic_metrics_treedef, &topics);
+  print_process_metrics (&mb);
+  collect_topic_metrics (self, &topics);
+  print_topic_metrics (&mb, &topics);
+  ut_avlFree (&topic_metrics_treedef, &topics, free_topic_metrics);
+
+  n = snprintf (hdr, sizeof (hdr), hdr_fmt, mb.pos);
+  if ((r = conn_write (conn, hdr, (size_t) n)) == 0)
+    r = conn_write (conn, mb.buf, mb.pos);
+  os_free (mb.buf);
+  return r;
+}
+
+/* Clients of the original text dump just connect and read, HTTP
+   clients send a request first. Give them a moment to do so, reading
+   until the end of the request header or until the buffer is full. */
+static int read_request (ddsi_tran_conn_t conn, char *buf, size_t size)
+{
+  os_socket sock = (os_socket) ddsi_conn_handle (conn);
+  const os_time maxwait = { 0, 100000000 };
+  os_time tend, timeout;
+  fd_set fds;
+  size_t pos = 0;
+  ssize_t n;
+  int ret;
+  tend = os_timeAdd (os_timeGetMonotonic (), maxwait);
+  buf[0] = 0;
+  while (pos < size - 1 && strstr (buf, "\r\n\r\n") == NULL)
+  {
+    timeout = os_timeSub (tend, os_timeGetMonotonic ());
+    if (timeout.tv_sec < 0)
+      break;
+    FD_ZERO (&fds);
+    FD_SET (sock, &fds);
+    do
+      ret = os_sockSelect ((int32_t) sock + 1, &fds, NULL, NULL, &timeout);
+    while (ret == -1 && os_getErrno () == os_sockEINTR);
+    if (ret <= 0)
+      break;
+    if ((n = recv (sock, buf + pos, size - 1 - pos, 0)) <= 0)
+      break;
+    pos += (size_t) n;
+    buf[pos] = 0;
+  }
+  return pos > 0;
+}
+
 static uint32_t debmon_main (void *vdm)
 {
   struct debug_monitor *dm = vdm;
@@ -318,23 +637,32 @@ static uint32_t debmon_main (void *vdm)
     os_mutexUnlock (&dm->lock);
     if ((conn = ddsi_listener_accept (dm->servsock)) != NULL)
     {
-      struct plugin *p;
-      int r = 0;
-      r += print_participants (dm->servts, conn);
-      if (r == 0)
-        r += print_proxy_participants (dm->servts, conn);
-
-      /* Note: can only add plugins (at the tail) */
-      os_mutexLock (&dm->lock);
-      p = dm->plugins;
-      while (r == 0 && p != NULL)
+      char req[256];
+      const int is_http = read_request (conn, req, sizeof (req)) && strncmp (req, "GET ", 4) == 0;
+      if (is_http && strncmp (req + 4, "/metrics", 8) == 0 && (req[12] == ' ' || req[12] == '?'))
+        (void) print_metrics (dm->servts, conn);
+      else
       {
-        os_mutexUnlock (&dm->lock);
-        r += p->fn (conn, cpf, p->arg);
+        struct plugin *p;
+        int r = 0;
+        if (is_http)
+          r += cpf (conn, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+        r += print_participants (dm->servts, conn);
+        if (r == 0)
+          r += print_proxy_participants (dm->servts, conn);
+
+        /* Note: can only add plugins (at the tail) */
         os_mutexLock (&dm->lock);
-        p = p->next;
+        p = dm->plugins;
+        while (r == 0 && p != NULL)
+        {
+          os_mutexUnlock (&dm->lock);
+          r += p->fn (conn, cpf, p->arg);
+          os_mutexLock (&dm->lock);
+          p = p->next;
+        }
+        os_mutexUnlock (&dm->lock);
       }
-      os_mutexUnlock (&dm->lock);
 
       ddsi_conn_free (conn);
     }
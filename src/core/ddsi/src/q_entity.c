@@ -39,6 +39,7 @@
 #include "ddsi/q_error.h"
 #include "ddsi/q_builtin_topic.h"
 #include "ddsi/ddsi_ser.h"
+#include "ddsi/ddsi_shm.h"
 
 #include "ddsi/sysdeps.h"
 
@@ -189,7 +190,7 @@ static void entity_common_fini (struct entity_common *e)
 
 void local_reader_ary_init (struct local_reader_ary *x)
 {
-  os_mutexInit (&x->rdary_lock);
+  os_rwlockInit (&x->rdary_lock);
   x->valid = 1;
   x->fastpath_ok = 1;
   x->n_readers = 0;
@@ -200,23 +201,23 @@ void local_reader_ary_init (struct local_reader_ary *x)
 void local_reader_ary_fini (struct local_reader_ary *x)
 {
   os_free (x->rdary);
-  os_mutexDestroy (&x->rdary_lock);
+  os_rwlockDestroy (&x->rdary_lock);
 }
 
 void local_reader_ary_insert (struct local_reader_ary *x, struct reader *rd)
 {
-  os_mutexLock (&x->rdary_lock);
+  os_rwlockWrite (&x->rdary_lock);
   x->n_readers++;
   x->rdary = os_realloc (x->rdary, (x->n_readers + 1) * sizeof (*x->rdary));
   x->rdary[x->n_readers - 1] = rd;
   x->rdary[x->n_readers] = NULL;
-  os_mutexUnlock (&x->rdary_lock);
+  os_rwlockUnlock (&x->rdary_lock);
 }
 
 void local_reader_ary_remove (struct local_reader_ary *x, struct reader *rd)
 {
   int i;
-  os_mutexLock (&x->rdary_lock);
+  os_rwlockWrite (&x->rdary_lock);
   for (i = 0; i < x->n_readers; i++)
   {
     if (x->rdary[i] == rd)
@@ -228,15 +229,15 @@ void local_reader_ary_remove (struct local_reader_ary *x, struct reader *rd)
   x->n_readers--;
   x->rdary[x->n_readers] = NULL;
   x->rdary = os_realloc (x->rdary, (x->n_readers + 1) * sizeof (*x->rdary));
-  os_mutexUnlock (&x->rdary_lock);
+  os_rwlockUnlock (&x->rdary_lock);
 }
 
 void local_reader_ary_setinvalid (struct local_reader_ary *x)
 {
-  os_mutexLock (&x->rdary_lock);
+  os_rwlockWrite (&x->rdary_lock);
   x->valid = 0;
   x->fastpath_ok = 0;
-  os_mutexUnlock (&x->rdary_lock);
+  os_rwlockUnlock (&x->rdary_lock);
 }
 
 /* DELETED PARTICIPANTS --------------------------------------------- */
@@ -1983,7 +1984,7 @@ static void connect_writer_with_proxy_reader (struct writer *wr, struct proxy_re
     return;
   if (wr->e.onlylocal)
     return;
-  if (!isb0 && (reason = qos_match_p (prd->c.xqos, wr->xqos)) >= 0)
+  if (!isb0 && (reason = qos_match_partition_sets_p (prd->c.xqos, &prd->c.partitions, wr->xqos, &wr->partitions)) >= 0)
   {
     writer_qos_mismatch (wr, reason);
     return;
@@ -2002,7 +2003,7 @@ static void connect_proxy_writer_with_reader (struct proxy_writer *pwr, struct r
     return;
   if (rd->e.onlylocal)
     return;
-  if (!isb0 && (reason = qos_match_p (rd->xqos, pwr->c.xqos)) >= 0)
+  if (!isb0 && (reason = qos_match_partition_sets_p (rd->xqos, &rd->partitions, pwr->c.xqos, &pwr->c.partitions)) >= 0)
   {
     reader_qos_mismatch (rd, reason);
     return;
@@ -2016,7 +2017,7 @@ static void connect_writer_with_reader (struct writer *wr, struct reader *rd, nn
   int32_t reason;
   if (is_builtin_entityid (wr->e.guid.entityid, ownvendorid) || is_builtin_entityid (rd->e.guid.entityid, ownvendorid))
     return;
-  if ((reason = qos_match_p (rd->xqos, wr->xqos)) >= 0)
+  if ((reason = qos_match_partition_sets_p (rd->xqos, &rd->partitions, wr->xqos, &wr->partitions)) >= 0)
   {
     writer_qos_mismatch (wr, reason);
     reader_qos_mismatch (rd, reason);
@@ -2137,6 +2138,22 @@ static int generic_do_match_isproxy (const struct entity_common *e)
   return e->kind == EK_PROXY_WRITER || e->kind == EK_PROXY_READER || e->kind == EK_PROXY_PARTICIPANT;
 }
 
+static const nn_xqos_t *generic_do_match_xqos (const struct entity_common *e)
+{
+  switch (e->kind)
+  {
+    case EK_WRITER: return ((const struct writer *) e)->xqos;
+    case EK_READER: return ((const struct reader *) e)->xqos;
+    case EK_PROXY_WRITER: return ((const struct proxy_writer *) e)->c.xqos;
+    case EK_PROXY_READER: return ((const struct proxy_reader *) e)->c.xqos;
+    case EK_PARTICIPANT:
+    case EK_PROXY_PARTICIPANT:
+      assert(0);
+  }
+  assert(0);
+  return NULL;
+}
+
 static void generic_do_match_connect (struct entity_common *e, struct entity_common *em, nn_mtime_t tnow)
 {
   switch (e->kind)
@@ -2184,21 +2201,22 @@ static void generic_do_match (struct entity_common *e, nn_mtime_t tnow)
   enum entity_kind mkind = generic_do_match_mkind(e->kind);
   if (!is_builtin_entityid (e->guid.entityid, ownvendorid))
   {
-    nn_log(LC_DISCOVERY, "match_%s_with_%ss(%s %x:%x:%x:%x) scanning all %ss\n",
+    struct ephash_enum_topic est_tp;
+    nn_log(LC_DISCOVERY, "match_%s_with_%ss(%s %x:%x:%x:%x) scanning %ss on same topic\n",
             generic_do_match_kindstr_us (e->kind), generic_do_match_kindstr_us (mkind),
             generic_do_match_kindabbrev (e->kind), PGUID (e->guid),
             generic_do_match_kindstr(mkind));
-    /* Note: we visit at least all proxies that existed when we called
-     init (with the -- possible -- exception of ones that were
-     deleted between our calling init and our reaching it while
-     enumerating), but we may visit a single proxy reader multiple
-     times. */
-    ephash_enum_init (&est, mkind);
+    /* Note: we visit all proxies with the same topic and type name
+     that existed when we called init (with the -- possible --
+     exception of ones that were deleted between our calling init and
+     our reaching it while enumerating); endpoints on other topics
+     can never match. */
+    ephash_enum_topic_init (&est_tp, mkind, generic_do_match_xqos (e));
     os_rwlockRead (&gv.qoslock);
-    while ((em = ephash_enum_next (&est)) != NULL)
+    while ((em = ephash_enum_topic_next (&est_tp)) != NULL)
       generic_do_match_connect(e, em, tnow);
     os_rwlockUnlock (&gv.qoslock);
-    ephash_enum_fini (&est);
+    ephash_enum_topic_fini (&est_tp);
   }
   else
   {
@@ -2229,28 +2247,27 @@ static void generic_do_match (struct entity_common *e, nn_mtime_t tnow)
 
 static void generic_do_local_match (struct entity_common *e, nn_mtime_t tnow)
 {
-  struct ephash_enum est;
+  struct ephash_enum_topic est;
   struct entity_common *em;
   enum entity_kind mkind;
   if (is_builtin_entityid (e->guid.entityid, ownvendorid))
     /* never a need for local matches on discovery endpoints */
     return;
   mkind = generic_do_local_match_mkind(e->kind);
-  nn_log(LC_DISCOVERY, "match_%s_with_%ss(%s %x:%x:%x:%x) scanning all %ss\n",
+  nn_log(LC_DISCOVERY, "match_%s_with_%ss(%s %x:%x:%x:%x) scanning %ss on same topic\n",
           generic_do_match_kindstr_us (e->kind), generic_do_match_kindstr_us (mkind),
           generic_do_match_kindabbrev (e->kind), PGUID (e->guid),
           generic_do_match_kindstr(mkind));
-  /* Note: we visit at least all proxies that existed when we called
-     init (with the -- possible -- exception of ones that were
-     deleted between our calling init and our reaching it while
-     enumerating), but we may visit a single proxy reader multiple
-     times. */
-  ephash_enum_init (&est, mkind);
+  /* Note: we visit all endpoints with the same topic and type name
+     that existed when we called init (with the -- possible --
+     exception of ones that were deleted between our calling init and
+     our reaching it while enumerating). */
+  ephash_enum_topic_init (&est, mkind, generic_do_match_xqos (e));
   os_rwlockRead (&gv.qoslock);
-  while ((em = ephash_enum_next (&est)) != NULL)
+  while ((em = ephash_enum_topic_next (&est)) != NULL)
     generic_do_local_match_connect(e, em, tnow);
   os_rwlockUnlock (&gv.qoslock);
-  ephash_enum_fini (&est);
+  ephash_enum_topic_fini (&est);
 }
 
 static void match_writer_with_proxy_readers (struct writer *wr, nn_mtime_t tnow)
@@ -2597,6 +2614,8 @@ static struct writer * new_writer_guid
   wr->num_nacks_received = 0;
   wr->throttle_count = 0;
   wr->throttle_tracing = 0;
+  wr->throttle_time = 0;
+  wr->num_bytes_written = 0;
   wr->rexmit_count = 0;
   wr->rexmit_lost_count = 0;
 
@@ -2610,6 +2629,7 @@ static struct writer * new_writer_guid
   nn_xqos_mergein_missing (wr->xqos, &gv.default_xqos_wr);
   assert (wr->xqos->aliased == 0);
   set_topic_type_name (wr->xqos, topic);
+  nn_partition_set_init (&wr->partitions, wr->xqos);
 
   if (config.enabled_logcats & LC_DISCOVERY)
   {
@@ -2907,6 +2927,7 @@ static void gc_delete_writer (struct gcreq *gcreq)
     unref_addrset (wr->ssm_as);
 #endif
   unref_addrset (wr->as); /* must remain until readers gone (rebuilding of addrset) */
+  nn_partition_set_fini (&wr->partitions);
   nn_xqos_fini (wr->xqos);
   os_free (wr->xqos);
   local_reader_ary_fini (&wr->rdary);
@@ -3184,6 +3205,7 @@ static struct reader * new_reader_guid
   nn_xqos_mergein_missing (rd->xqos, &gv.default_xqos_rd);
   assert (rd->xqos->aliased == 0);
   set_topic_type_name (rd->xqos, topic);
+  nn_partition_set_init (&rd->partitions, rd->xqos);
 
   if (config.enabled_logcats & LC_DISCOVERY)
   {
@@ -3354,6 +3376,7 @@ static void gc_delete_reader (struct gcreq *gcreq)
   }
   sertopic_free ((struct sertopic *) rd->topic);
 
+  nn_partition_set_fini (&rd->partitions);
   nn_xqos_fini (rd->xqos);
   os_free (rd->xqos);
 #ifdef DDSI_INCLUDE_NETWORK_PARTITIONS
@@ -3508,6 +3531,8 @@ void new_proxy_participant
   proxypp->as_meta = as_meta;
   proxypp->endpoints = NULL;
   proxypp->plist = nn_plist_dup (plist);
+  proxypp->spdp_payload = NULL;
+  proxypp->spdp_payload_size = 0;
   ut_avlInit (&proxypp_groups_treedef, &proxypp->groups);
 
 
@@ -3700,6 +3725,13 @@ static void ref_proxy_participant (struct proxy_participant *proxypp, struct pro
   os_mutexUnlock (&proxypp->e.lock);
 }
 
+static void forget_shm_peer (const nn_locator_t *loc, void *varg)
+{
+  (void) varg;
+  if (loc->kind == NN_LOCATOR_KIND_SHM)
+    ddsi_shm_forget_peer (loc);
+}
+
 static void unref_proxy_participant (struct proxy_participant *proxypp, struct proxy_endpoint_common *c)
 {
   uint32_t refc;
@@ -3724,11 +3756,18 @@ static void unref_proxy_participant (struct proxy_participant *proxypp, struct p
     os_mutexUnlock (&proxypp->e.lock);
     nn_log (LC_DISCOVERY, "unref_proxy_participant(%x:%x:%x:%x): refc=0, freeing\n", PGUID (proxypp->e.guid));
 
-
+    /* Unmap its shared-memory ring; should another participant in the
+       same process still use it, it simply gets mapped again */
+    if (gv.shm_conn)
+    {
+      addrset_forall (proxypp->as_default, forget_shm_peer, NULL);
+      addrset_forall (proxypp->as_meta, forget_shm_peer, NULL);
+    }
     unref_addrset (proxypp->as_default);
     unref_addrset (proxypp->as_meta);
     nn_plist_fini (proxypp->plist);
     os_free (proxypp->plist);
+    os_free (proxypp->spdp_payload);
     if (proxypp->owns_lease)
       lease_free (os_atomic_ldvoidp (&proxypp->lease));
     entity_common_fini (&proxypp->e);
@@ -4041,6 +4080,7 @@ static void proxy_endpoint_common_init
   name = (plist->present & PP_ENTITY_NAME) ? plist->entity_name : "";
   entity_common_init (e, guid, name, kind, false);
   c->xqos = nn_xqos_dup (&plist->qos);
+  nn_partition_set_init (&c->partitions, c->xqos);
   c->as = ref_addrset (as);
   c->topic = NULL; /* set from first matching reader/writer */
   c->vendor = proxypp->vendor;
@@ -4058,6 +4098,7 @@ static void proxy_endpoint_common_fini (struct entity_common *e, struct proxy_en
 {
   unref_proxy_participant (c->proxypp, c);
 
+  nn_partition_set_fini (&c->partitions);
   nn_xqos_fini (c->xqos);
   os_free (c->xqos);
   unref_addrset (c->as);
@@ -10,24 +10,57 @@
  * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
  */
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include "os/os.h"
 #include "ddsi/sysdeps.h"
 
 #include "util/ut_hopscotch.h"
+#include "util/ut_avl.h"
 #include "ddsi/q_ephash.h"
 #include "ddsi/q_config.h"
 #include "ddsi/q_globals.h"
 #include "ddsi/q_entity.h"
+#include "ddsi/q_xqos.h"
 #include "ddsi/q_gc.h"
 #include "ddsi/q_rtps.h" /* guid_t */
 #include "ddsi/q_thread.h" /* for assert(thread is awake) */
 
+/* Endpoints are also indexed on topic and type name, so that matching
+   a new endpoint only needs to consider endpoints that can possibly
+   match it. The index is small and only touched when endpoints come
+   and go, so a mutex-protected tree suffices. */
+struct ephash_topic_key {
+  const char *topic_name;
+  const char *type_name;
+};
+
+struct ephash_topic {
+  ut_avlNode_t avlnode;
+  struct ephash_topic_key key;
+  uint32_t n, size;
+  struct entity_common **eps;
+};
+
 struct ephash {
   struct ut_chh *hash;
+  os_mutex topics_lock;
+  ut_avlTree_t topics;
 };
 
+static int compare_topic_key (const void *va, const void *vb)
+{
+  const struct ephash_topic_key *a = va;
+  const struct ephash_topic_key *b = vb;
+  int c;
+  if ((c = strcmp (a->topic_name, b->topic_name)) != 0)
+    return c;
+  return strcmp (a->type_name, b->type_name);
+}
+
+static const ut_avlTreedef_t ephash_topics_td = UT_AVL_TREEDEF_INITIALIZER (offsetof (struct ephash_topic, avlnode), offsetof (struct ephash_topic, key), compare_topic_key, 0);
+
 static const uint64_t unihashconsts[] = {
   UINT64_C (16292676669999574021),
   UINT64_C (10242350189706880077),
@@ -85,17 +118,92 @@ struct ephash *ephash_new (void)
     os_free (ephash);
     return NULL;
   } else {
+    os_mutexInit (&ephash->topics_lock);
+    ut_avlInit (&ephash_topics_td, &ephash->topics);
     return ephash;
   }
 }
 
+static void free_topic (void *vtp)
+{
+  struct ephash_topic *tp = vtp;
+  os_free ((char *) tp->key.topic_name);
+  os_free ((char *) tp->key.type_name);
+  os_free (tp->eps);
+  os_free (tp);
+}
+
 void ephash_free (struct ephash *ephash)
 {
+  ut_avlFree (&ephash_topics_td, &ephash->topics, free_topic);
+  os_mutexDestroy (&ephash->topics_lock);
   ut_chhFree (ephash->hash);
   ephash->hash = NULL;
   os_free (ephash);
 }
 
+static int ephash_topic_key_init (struct ephash_topic_key *key, const nn_xqos_t *xqos)
+{
+  /* Built-in endpoints have no topic & type name, they are matched via
+     the participants instead */
+  if ((xqos->present & (QP_TOPIC_NAME | QP_TYPE_NAME)) != (QP_TOPIC_NAME | QP_TYPE_NAME))
+    return 0;
+  key->topic_name = xqos->topic_name;
+  key->type_name = xqos->type_name;
+  return 1;
+}
+
+static void ephash_topic_insert (struct entity_common *e, const nn_xqos_t *xqos)
+{
+  struct ephash *ephash = gv.guid_hash;
+  struct ephash_topic_key key;
+  struct ephash_topic *tp;
+  ut_avlIPath_t path;
+  if (!ephash_topic_key_init (&key, xqos))
+    return;
+  os_mutexLock (&ephash->topics_lock);
+  if ((tp = ut_avlLookupIPath (&ephash_topics_td, &ephash->topics, &key, &path)) == NULL)
+  {
+    tp = os_malloc (sizeof (*tp));
+    tp->key.topic_name = os_strdup (key.topic_name);
+    tp->key.type_name = os_strdup (key.type_name);
+    tp->n = 0;
+    tp->size = 4;
+    tp->eps = os_malloc (tp->size * sizeof (*tp->eps));
+    ut_avlInsertIPath (&ephash_topics_td, &ephash->topics, tp, &path);
+  }
+  if (tp->n == tp->size)
+  {
+    tp->size *= 2;
+    tp->eps = os_realloc (tp->eps, tp->size * sizeof (*tp->eps));
+  }
+  tp->eps[tp->n++] = e;
+  os_mutexUnlock (&ephash->topics_lock);
+}
+
+static void ephash_topic_remove (struct entity_common *e, const nn_xqos_t *xqos)
+{
+  struct ephash *ephash = gv.guid_hash;
+  struct ephash_topic_key key;
+  struct ephash_topic *tp;
+  uint32_t i;
+  if (!ephash_topic_key_init (&key, xqos))
+    return;
+  os_mutexLock (&ephash->topics_lock);
+  tp = ut_avlLookup (&ephash_topics_td, &ephash->topics, &key);
+  assert (tp != NULL);
+  for (i = 0; i < tp->n && tp->eps[i] != e; i++)
+    ;
+  assert (i < tp->n);
+  tp->eps[i] = tp->eps[--tp->n];
+  if (tp->n == 0)
+  {
+    ut_avlDelete (&ephash_topics_td, &ephash->topics, tp);
+    free_topic (tp);
+  }
+  os_mutexUnlock (&ephash->topics_lock);
+}
+
 static void ephash_guid_insert (struct entity_common *e)
 {
   int x;
@@ -147,21 +255,25 @@ void ephash_insert_proxy_participant_guid (struct proxy_participant *proxypp)
 void ephash_insert_writer_guid (struct writer *wr)
 {
   ephash_guid_insert (&wr->e);
+  ephash_topic_insert (&wr->e, wr->xqos);
 }
 
 void ephash_insert_reader_guid (struct reader *rd)
 {
   ephash_guid_insert (&rd->e);
+  ephash_topic_insert (&rd->e, rd->xqos);
 }
 
 void ephash_insert_proxy_writer_guid (struct proxy_writer *pwr)
 {
   ephash_guid_insert (&pwr->e);
+  ephash_topic_insert (&pwr->e, pwr->c.xqos);
 }
 
 void ephash_insert_proxy_reader_guid (struct proxy_reader *prd)
 {
   ephash_guid_insert (&prd->e);
+  ephash_topic_insert (&prd->e, prd->c.xqos);
 }
 
 void ephash_remove_participant_guid (struct participant *pp)
@@ -176,21 +288,25 @@ void ephash_remove_proxy_participant_guid (struct proxy_participant *proxypp)
 
 void ephash_remove_writer_guid (struct writer *wr)
 {
+  ephash_topic_remove (&wr->e, wr->xqos);
   ephash_guid_remove (&wr->e);
 }
 
 void ephash_remove_reader_guid (struct reader *rd)
 {
+  ephash_topic_remove (&rd->e, rd->xqos);
   ephash_guid_remove (&rd->e);
 }
 
 void ephash_remove_proxy_writer_guid (struct proxy_writer *pwr)
 {
+  ephash_topic_remove (&pwr->e, pwr->c.xqos);
   ephash_guid_remove (&pwr->e);
 }
 
 void ephash_remove_proxy_reader_guid (struct proxy_reader *prd)
 {
+  ephash_topic_remove (&prd->e, prd->c.xqos);
   ephash_guid_remove (&prd->e);
 }
 
@@ -334,6 +450,40 @@ void ephash_enum_fini (struct ephash_enum *st)
   OS_UNUSED_ARG(st);
 }
 
+void ephash_enum_topic_init (struct ephash_enum_topic *st, enum entity_kind kind, const nn_xqos_t *xqos)
+{
+  struct ephash *ephash = gv.guid_hash;
+  struct ephash_topic_key key;
+  struct ephash_topic *tp;
+  st->n = st->i = 0;
+  st->eps = NULL;
+  if (!ephash_topic_key_init (&key, xqos))
+    return;
+  /* Copy the candidates so that matching can proceed without holding
+     the lock; entities deleted in the meantime remain valid for as long
+     as the caller is awake, just like with the GUID hash iterator */
+  os_mutexLock (&ephash->topics_lock);
+  if ((tp = ut_avlLookup (&ephash_topics_td, &ephash->topics, &key)) != NULL)
+  {
+    uint32_t i;
+    st->eps = os_malloc (tp->n * sizeof (*st->eps));
+    for (i = 0; i < tp->n; i++)
+      if (tp->eps[i]->kind == kind)
+        st->eps[st->n++] = tp->eps[i];
+  }
+  os_mutexUnlock (&ephash->topics_lock);
+}
+
+void *ephash_enum_topic_next (struct ephash_enum_topic *st)
+{
+  return (st->i < st->n) ? st->eps[st->i++] : NULL;
+}
+
+void ephash_enum_topic_fini (struct ephash_enum_topic *st)
+{
+  os_free (st->eps);
+}
+
 void ephash_enum_writer_fini (struct ephash_enum_writer *st)
 {
   ephash_enum_fini (&st->st);
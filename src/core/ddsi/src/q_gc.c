@@ -76,31 +76,60 @@ static int threads_vtime_check (unsigned *nivs, struct idx_vtime *ivs)
   return *nivs == 0;
 }
 
+static struct gcreq *run_ready_gcreqs (struct thread_state1 *self, struct gcreq *batch)
+{
+  /* Runs the requests in BATCH in order until it encounters one that
+     is not ready yet, returning the remainder.  A request only waits
+     for the threads that were awake when it was created, and only
+     until they made progress, so if a request is not ready, none of
+     the requests created after it can be ready either. Requests are
+     nearly always enqueued right after creating them, so there is
+     little point in looking further, and stopping keeps the order in
+     which the callbacks are invoked the same as the queue order. */
+  thread_state_awake (self);
+  while (batch && threads_vtime_check (&batch->nvtimes, batch->vtimes))
+  {
+    /* Sufficent progress has been made: may now continue deleting
+       it; the callback is responsible for requeueing (if complex
+       multi-phase delete) or freeing the delete request. */
+    struct gcreq *gcreq = batch;
+    batch = batch->next;
+    TRACE (("gc %p: deleting\n", (void*)gcreq));
+    gcreq->cb (gcreq);
+  }
+  thread_state_asleep (self);
+  return batch;
+}
+
 static uint32_t gcreq_queue_thread (struct gcreq_queue *q)
 {
   struct thread_state1 *self = lookup_thread_state ();
   nn_mtime_t next_thread_cputime = { 0 };
   struct os_time to = { 0, 100 * T_MILLISECOND };
-  struct os_time shortsleep = { 0, 1 * T_MILLISECOND };
-  struct gcreq *gcreq = NULL;
+  const int64_t shortsleep_min = 1 * T_MILLISECOND;
+  const int64_t shortsleep_max = 16 * T_MILLISECOND;
+  int64_t shortsleep = shortsleep_min;
+  struct gcreq *batch = NULL, *batch_last = NULL, *head;
   int trace_shortsleep = 1;
   os_mutexLock (&q->lock);
   while (!(q->terminate && q->count == 0))
   {
     LOG_THREAD_CPUTIME (next_thread_cputime);
-    /* If we are waiting for a gcreq to become ready, don't bother
-       looking at the queue; if we aren't, wait for a request to come
+    /* If we are waiting for requests to become ready, don't bother
+       waiting for new ones; if we aren't, wait for a request to come
        in.  We can't really wait until something came in because we're
-       also checking lease expirations. */
-    if (gcreq == NULL)
+       also checking lease expirations.  Everything that has been
+       queued is then handled as a single batch. */
+    if (batch == NULL && q->first == NULL)
+      os_condTimedWait (&q->cond, &q->lock, &to);
+    if (q->first)
     {
-      if (q->first == NULL)
-        os_condTimedWait (&q->cond, &q->lock, &to);
-      if (q->first)
-      {
-        gcreq = q->first;
-        q->first = q->first->next;
-      }
+      if (batch == NULL)
+        batch = q->first;
+      else
+        batch_last->next = q->first;
+      batch_last = q->last;
+      q->first = q->last = NULL;
     }
     os_mutexUnlock (&q->lock);
 
@@ -115,40 +144,45 @@ static uint32_t gcreq_queue_thread (struct gcreq_queue *q)
     check_and_handle_lease_expiration (self, now_et ());
     thread_state_asleep (self);
 
-    if (gcreq)
+    if (batch)
     {
-      if (!threads_vtime_check (&gcreq->nvtimes, gcreq->vtimes))
+      head = batch;
+      if ((batch = run_ready_gcreqs (self, batch)) == NULL)
+      {
+        batch_last = NULL;
+        shortsleep = shortsleep_min;
+        trace_shortsleep = 1;
+      }
+      else
       {
-        /* Not all threads made enough progress => gcreq is not ready
-           yet => sleep for a bit and rety.  Note that we can't even
-           terminate while this gcreq is waiting and that there is no
-           condition on which to wait, so a plain sleep is quite
-           reasonable. */
+        /* Not all threads made enough progress => the remaining
+           requests are not ready yet => sleep for a bit and rety.
+           Note that we can't even terminate while requests are
+           waiting and that there is no condition on which to wait, so
+           a plain sleep is quite reasonable.  The sleep doubles for as
+           long as nothing could be done, so that a thread that stays
+           awake for a long time doesn't keep this one spinning at 1kHz,
+           and is back at its minimum once a request went through. */
+        struct os_time delay;
+        if (batch != head)
+          shortsleep = shortsleep_min;
         if (trace_shortsleep)
         {
-          TRACE (("gc %p: not yet, shortsleep\n", (void*)gcreq));
+          TRACE (("gc %p: not yet, shortsleep\n", (void*)batch));
           trace_shortsleep = 0;
         }
-        os_nanoSleep (shortsleep);
-      }
-      else
-      {
-        /* Sufficent progress has been made: may now continue deleting
-           it; the callback is responsible for requeueing (if complex
-           multi-phase delete) or freeing the delete request.  Reset
-           the current gcreq as this one obviously is no more.  */
-        TRACE (("gc %p: deleting\n", (void*)gcreq));
-        thread_state_awake (self);
-        gcreq->cb (gcreq);
-        thread_state_asleep (self);
-        gcreq = NULL;
-        trace_shortsleep = 1;
+        delay.tv_sec = 0;
+        delay.tv_nsec = (int32_t) shortsleep;
+        os_nanoSleep (delay);
+        if (shortsleep < shortsleep_max)
+          shortsleep *= 2;
       }
     }
 
     os_mutexLock (&q->lock);
   }
   os_mutexUnlock (&q->lock);
+  assert (batch == NULL);
   return 0;
 }
 
@@ -195,6 +229,15 @@ void gcreq_queue_free (struct gcreq_queue *q)
   os_free (q);
 }
 
+uint32_t gcreq_queue_count (struct gcreq_queue *q)
+{
+  int32_t count;
+  os_mutexLock (&q->lock);
+  count = q->count;
+  os_mutexUnlock (&q->lock);
+  return (uint32_t) count;
+}
+
 struct gcreq *gcreq_new (struct gcreq_queue *q, gcreq_cb_t cb)
 {
   struct gcreq *gcreq;
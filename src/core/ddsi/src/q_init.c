@@ -45,6 +45,7 @@
 #include "ddsi/q_xmsg.h"
 #include "ddsi/q_receive.h"
 #include "ddsi/q_pcap.h"
+#include "ddsi/q_sampletrace.h"
 #include "ddsi/q_feature_check.h"
 #include "ddsi/q_debmon.h"
 
@@ -54,6 +55,9 @@
 #include "ddsi/ddsi_tran.h"
 #include "ddsi/ddsi_udp.h"
 #include "ddsi/ddsi_tcp.h"
+#include "ddsi/ddsi_shm.h"
+#include "ddsi/ddsi_unix.h"
+#include "ddsi/ddsi_uring.h"
 
 #include "dds__tkmap.h"
 
@@ -447,6 +451,10 @@ int rtps_config_open (void)
     {
         status = 1;
     }
+    if (status)
+    {
+        nn_log_async_start ();
+    }
 
     return status;
 }
@@ -602,9 +610,9 @@ int rtps_config_prep (struct cfgst *cfgst)
 #define USER_MAX_THREADS 50
 
 #ifdef DDSI_INCLUDE_NETWORK_CHANNELS
-    const unsigned max_threads = 7 + USER_MAX_THREADS + num_channel_threads + config.ddsi2direct_max_threads;
+    const unsigned max_threads = 7 + USER_MAX_THREADS + num_channel_threads + config.ddsi2direct_max_threads + (config.rexmit_thread ? 1 : 0);
 #else
-    const unsigned max_threads = 9 + USER_MAX_THREADS + config.ddsi2direct_max_threads;
+    const unsigned max_threads = 9 + USER_MAX_THREADS + config.ddsi2direct_max_threads + (config.rexmit_thread ? 1 : 0);
 #endif
     thread_states_init (max_threads);
   }
@@ -699,6 +707,9 @@ int rtps_init (void)
   gv.data_conn_uc = NULL;
   gv.disc_conn_mc = NULL;
   gv.data_conn_mc = NULL;
+  gv.shm_conn = NULL;
+  gv.unix_conn = NULL;
+  gv.uring_waitset = NULL;
   gv.tev_conn = NULL;
   gv.listener = NULL;
   gv.thread_pool = NULL;
@@ -890,17 +901,22 @@ int rtps_init (void)
 
   if (config.pcap_file && *config.pcap_file)
   {
-    gv.pcap_fp = new_pcap_file (config.pcap_file);
-    if (gv.pcap_fp)
-    {
-      os_mutexInit (&gv.pcap_lock);
-    }
+    gv.pcap_fp = new_pcap_file (config.pcap_file, config.pcap_bufsize);
   }
   else
   {
     gv.pcap_fp = NULL;
   }
 
+  if (config.sample_trace_file && *config.sample_trace_file && config.sample_trace_interval > 0)
+  {
+    gv.sampletrace = nn_sampletrace_new (config.sample_trace_file, config.sample_trace_interval);
+  }
+  else
+  {
+    gv.sampletrace = NULL;
+  }
+
   if (gv.m_factory->m_connless)
   {
     uint32_t port;
@@ -939,6 +955,45 @@ int rtps_init (void)
       if (joinleave_spdp_defmcip (1) < 0)
         goto err_mc_conn;
     }
+
+    /* Without a ring or socket, peers on this host simply continue to use UDP */
+    if (config.shm_enable)
+    {
+      if (config.many_sockets_mode)
+        NN_WARNING ("rtps_init: shared-memory transport not supported in multiple-socket mode\n");
+      else if (ddsi_shm_init () < 0 || (gv.shm_conn = ddsi_factory_create_conn (ddsi_factory_find ("shm"), 0, NULL)) == NULL)
+        NN_WARNING ("rtps_init: failed to create shared-memory receive ring\n");
+    }
+    if (config.unix_enable)
+    {
+      if (config.many_sockets_mode)
+        NN_WARNING ("rtps_init: Unix domain socket transport not supported in multiple-socket mode\n");
+      else if (ddsi_unix_init () < 0 || (gv.unix_conn = ddsi_factory_create_conn (ddsi_factory_find ("unix"), 0, NULL)) == NULL)
+        NN_WARNING ("rtps_init: failed to create Unix domain socket\n");
+    }
+    /* Without io_uring, the regular socket I/O is used */
+    if (config.uring_enable)
+    {
+      if (config.many_sockets_mode)
+        NN_WARNING ("rtps_init: io_uring not supported in multiple-socket mode\n");
+      else if (ddsi_uring_init () < 0)
+        NN_WARNING ("rtps_init: io_uring not available\n");
+      else if ((gv.uring_waitset = ddsi_uring_waitset_new ()) == NULL)
+      {
+        NN_WARNING ("rtps_init: failed to create io_uring waitset\n");
+        ddsi_uring_fini ();
+      }
+      else
+      {
+        ddsi_uring_attach (gv.disc_conn_uc);
+        ddsi_uring_attach (gv.data_conn_uc);
+        if (config.allowMulticast)
+        {
+          ddsi_uring_attach (gv.disc_conn_mc);
+          ddsi_uring_attach (gv.data_conn_mc);
+        }
+      }
+    }
   }
   else
   {
@@ -1041,6 +1096,23 @@ int rtps_init (void)
     0
 #endif
   );
+  if (!config.rexmit_thread)
+    gv.rexmit_xevents = NULL;
+  else
+  {
+    gv.rexmit_xevents = xeventq_new
+    (
+      gv.tev_conn,
+      config.max_queued_rexmit_bytes,
+      config.max_queued_rexmit_msgs,
+#ifdef DDSI_INCLUDE_BANDWIDTH_LIMITING
+      config.auxiliary_bandwidth_limit
+#else
+      0
+#endif
+    );
+    xeventq_divert_rexmits (gv.xevents, gv.rexmit_xevents);
+  }
 
   gv.as_disc = new_addrset ();
   add_to_addrset (gv.as_disc, &gv.loc_spdp_mc);
@@ -1076,6 +1148,10 @@ int rtps_init (void)
     {
       NN_FATAL ("failed to start global event processing thread (%d)\n", r);
     }
+    if (gv.rexmit_xevents && (r = xeventq_start (gv.rexmit_xevents, "rexmit")) < 0)
+    {
+      NN_FATAL ("failed to start retransmit event processing thread (%d)\n", r);
+    }
   }
 
   nn_xpack_sendq_init();
@@ -1124,8 +1200,14 @@ err_mc_conn:
     ddsi_conn_free (gv.disc_conn_mc);
   if (gv.data_conn_mc)
     ddsi_conn_free (gv.data_conn_mc);
+  if (gv.shm_conn)
+    ddsi_conn_free (gv.shm_conn);
+  if (gv.unix_conn)
+    ddsi_conn_free (gv.unix_conn);
   if (gv.pcap_fp)
-    os_mutexDestroy (&gv.pcap_lock);
+    free_pcap_file (gv.pcap_fp);
+  if (gv.sampletrace)
+    nn_sampletrace_free (gv.sampletrace);
   os_sockWaitsetFree (gv.waitset);
   if (gv.disc_conn_uc == gv.data_conn_uc)
     ddsi_conn_free (gv.data_conn_uc);
@@ -1210,6 +1292,8 @@ void rtps_term_prep (void)
     os_atomic_fence ();
     /* can't wake up throttle_writer, currently, but it'll check every few seconds */
     os_sockWaitsetTrigger (gv.waitset);
+    if (gv.uring_waitset)
+      ddsi_uring_waitset_trigger (gv.uring_waitset);
   }
   os_mutexUnlock (&gv.lock);
 }
@@ -1239,6 +1323,8 @@ void rtps_term (void)
   }
 
   xeventq_stop (gv.xevents);
+  if (gv.rexmit_xevents)
+    xeventq_stop (gv.rexmit_xevents);
 #ifdef DDSI_INCLUDE_NETWORK_CHANNELS
   for (chptr = config.channels; chptr; chptr = chptr->next)
   {
@@ -1364,6 +1450,8 @@ void rtps_term (void)
 #endif
 
   xeventq_free (gv.xevents);
+  if (gv.rexmit_xevents)
+    xeventq_free (gv.rexmit_xevents);
 
   nn_xpack_sendq_stop();
   nn_xpack_sendq_fini();
@@ -1392,6 +1480,8 @@ void rtps_term (void)
 
   ddsi_conn_free (gv.disc_conn_mc);
   ddsi_conn_free (gv.data_conn_mc);
+  ddsi_conn_free (gv.shm_conn);
+  ddsi_conn_free (gv.unix_conn);
   if (gv.disc_conn_uc == gv.data_conn_uc)
   {
     ddsi_conn_free (gv.data_conn_uc);
@@ -1404,13 +1494,17 @@ void rtps_term (void)
 
   /* Not freeing gv.tev_conn: it aliases data_conn_uc */
 
+  if (gv.uring_waitset)
+  {
+    ddsi_uring_waitset_free (gv.uring_waitset);
+    ddsi_uring_fini ();
+  }
   ddsi_tran_factories_fini ();
 
   if (gv.pcap_fp)
-  {
-    os_mutexDestroy (&gv.pcap_lock);
-    fclose (gv.pcap_fp);
-  }
+    free_pcap_file (gv.pcap_fp);
+  if (gv.sampletrace)
+    nn_sampletrace_free (gv.sampletrace);
 
   unref_addrset (gv.as_disc);
   unref_addrset (gv.as_disc_group);
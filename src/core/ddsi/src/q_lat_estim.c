@@ -9,6 +9,7 @@
  *
  * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
  */
+#include <assert.h>
 #include <ctype.h>
 #include <stddef.h>
 
@@ -77,6 +78,82 @@ int nn_lat_estim_log (logcat_t logcat, const char *tag, const struct nn_lat_esti
   }
 }
 
+void nn_lat_histogram_init (struct nn_lat_histogram *lh)
+{
+  memset (lh, 0, sizeof (*lh));
+}
+
+static uint32_t lat_histogram_index (int64_t lat)
+{
+  const int sb = NN_LAT_HISTOGRAM_SUB_BITS;
+  uint64_t v;
+  int lg2 = 0;
+  if (lat <= 0)
+    return 0;
+  if (lat >= ((int64_t) 1 << NN_LAT_HISTOGRAM_MAX_LG2))
+    return NN_LAT_HISTOGRAM_NBUCKETS - 1;
+  v = (uint64_t) lat;
+  if (v < (1u << sb))
+    return (uint32_t) v;
+  while ((v >> lg2) > 1)
+    lg2++;
+  /* lg2 >= sb: bucket group (lg2 - sb + 1), the sb bits below the
+     leading one select the bucket within the group */
+  return ((uint32_t) (lg2 - sb + 1) << sb) | (uint32_t) ((v >> (lg2 - sb)) & ((1u << sb) - 1));
+}
+
+void nn_lat_histogram_record (struct nn_lat_histogram *lh, int64_t lat)
+{
+  lh->count[lat_histogram_index (lat)]++;
+}
+
+int64_t nn_lat_histogram_bucket_lower (uint32_t idx)
+{
+  const int sb = NN_LAT_HISTOGRAM_SUB_BITS;
+  const uint32_t group = idx >> sb, sub = idx & ((1u << sb) - 1);
+  assert (idx < NN_LAT_HISTOGRAM_NBUCKETS);
+  if (group == 0)
+    return (int64_t) sub;
+  else
+    return (int64_t) ((1u << sb) + sub) << (group - 1);
+}
+
+uint64_t nn_lat_histogram_total (const uint32_t *count)
+{
+  uint64_t total = 0;
+  uint32_t i;
+  for (i = 0; i < NN_LAT_HISTOGRAM_NBUCKETS; i++)
+    total += count[i];
+  return total;
+}
+
+int64_t nn_lat_histogram_percentile (const uint32_t *count, double p)
+{
+  /* Returns the upper bound of the bucket containing the p-th
+     percentile, or 0 if the histogram is empty */
+  const uint64_t total = nn_lat_histogram_total (count);
+  uint64_t rank, cum = 0;
+  uint32_t i;
+  if (total == 0)
+    return 0;
+  if (p <= 0.0)
+    rank = 1;
+  else if (p >= 100.0)
+    rank = total;
+  else
+  {
+    rank = (uint64_t) ((p / 100.0) * (double) total + 0.5);
+    if (rank == 0)
+      rank = 1;
+  }
+  for (i = 0; i < NN_LAT_HISTOGRAM_NBUCKETS - 1; i++)
+  {
+    if ((cum += count[i]) >= rank)
+      return nn_lat_histogram_bucket_lower (i + 1) - 1;
+  }
+  return nn_lat_histogram_bucket_lower (NN_LAT_HISTOGRAM_NBUCKETS - 1);
+}
+
 #if 0 /* not implemented yet */
 double nn_lat_estim_current (const struct nn_lat_estim *le)
 {
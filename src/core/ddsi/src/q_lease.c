@@ -15,7 +15,7 @@
 
 #include "os/os.h"
 
-#include "util/ut_fibheap.h"
+#include "util/ut_timerwheel.h"
 
 #include "ddsi/ddsi_ser.h"
 #include "ddsi/q_protocol.h"
@@ -44,23 +44,16 @@
 #define TSCHED_NOT_ON_HEAP INT64_MIN
 
 struct lease {
-  ut_fibheapNode_t heapnode;
+  ut_timerwheelNode_t heapnode;
   nn_etime_t tsched;  /* access guarded by leaseheap_lock */
   nn_etime_t tend;    /* access guarded by lock_lease/unlock_lease */
   int64_t tdur;      /* constant (renew depends on it) */
   struct entity_common *entity; /* constant */
 };
 
-static int compare_lease_tsched (const void *va, const void *vb);
-
-static const ut_fibheapDef_t lease_fhdef = UT_FIBHEAPDEF_INITIALIZER(offsetof (struct lease, heapnode), compare_lease_tsched);
-
-static int compare_lease_tsched (const void *va, const void *vb)
-{
-  const struct lease *a = va;
-  const struct lease *b = vb;
-  return (a->tsched.v == b->tsched.v) ? 0 : (a->tsched.v < b->tsched.v) ? -1 : 1;
-}
+/* Leases are only checked by the gc thread, so coarse ticks of ~17ms
+   are more than good enough */
+static const ut_timerwheelDef_t lease_twdef = UT_TIMERWHEELDEF_INITIALIZER(offsetof (struct lease, heapnode), 24);
 
 void lease_management_init (void)
 {
@@ -68,13 +61,13 @@ void lease_management_init (void)
   os_mutexInit (&gv.leaseheap_lock);
   for (i = 0; i < N_LEASE_LOCKS; i++)
     os_mutexInit (&gv.lease_locks[i]);
-  ut_fibheapInit (&lease_fhdef, &gv.leaseheap);
+  ut_timerwheelInit (&lease_twdef, &gv.leaseheap);
 }
 
 void lease_management_term (void)
 {
   int i;
-  assert (ut_fibheapMin (&lease_fhdef, &gv.leaseheap) == NULL);
+  assert (ut_timerwheelIsEmpty (&gv.leaseheap));
   for (i = 0; i < N_LEASE_LOCKS; i++)
     os_mutexDestroy (&gv.lease_locks[i]);
   os_mutexDestroy (&gv.leaseheap_lock);
@@ -120,7 +113,7 @@ void lease_register (struct lease *l)
   if (l->tend.v != T_NEVER)
   {
     l->tsched = l->tend;
-    ut_fibheapInsert (&lease_fhdef, &gv.leaseheap, l);
+    ut_timerwheelInsert (&lease_twdef, &gv.leaseheap, l, l->tsched.v);
   }
   unlock_lease (l);
   os_mutexUnlock (&gv.leaseheap_lock);
@@ -131,7 +124,7 @@ void lease_free (struct lease *l)
   TRACE (("lease_free(l %p guid %x:%x:%x:%x)\n", (void *) l, PGUID (l->entity->guid)));
   os_mutexLock (&gv.leaseheap_lock);
   if (l->tsched.v != TSCHED_NOT_ON_HEAP)
-    ut_fibheapDelete (&lease_fhdef, &gv.leaseheap, l);
+    ut_timerwheelDelete (&lease_twdef, &gv.leaseheap, l);
   os_mutexUnlock (&gv.leaseheap_lock);
   os_free (l);
 }
@@ -175,13 +168,13 @@ void lease_set_expiry (struct lease *l, nn_etime_t when)
     /* moved forward and currently scheduled (by virtue of
        TSCHED_NOT_ON_HEAP == INT64_MIN) */
     l->tsched = l->tend;
-    ut_fibheapDecreaseKey (&lease_fhdef, &gv.leaseheap, l);
+    ut_timerwheelReschedule (&lease_twdef, &gv.leaseheap, l, l->tsched.v);
   }
   else if (l->tsched.v == TSCHED_NOT_ON_HEAP && l->tend.v < T_NEVER)
   {
     /* not currently scheduled, with a finite new expiry time */
     l->tsched = l->tend;
-    ut_fibheapInsert (&lease_fhdef, &gv.leaseheap, l);
+    ut_timerwheelInsert (&lease_twdef, &gv.leaseheap, l, l->tsched.v);
   }
   unlock_lease (l);
   os_mutexUnlock (&gv.leaseheap_lock);
@@ -192,13 +185,12 @@ void check_and_handle_lease_expiration (UNUSED_ARG (struct thread_state1 *self),
   struct lease *l;
   const nn_wctime_t tnow = now();
   os_mutexLock (&gv.leaseheap_lock);
-  while ((l = ut_fibheapMin (&lease_fhdef, &gv.leaseheap)) != NULL && l->tsched.v <= tnowE.v)
+  while ((l = ut_timerwheelExtractExpired (&lease_twdef, &gv.leaseheap, tnowE.v)) != NULL)
   {
     nn_guid_t g = l->entity->guid;
     enum entity_kind k = l->entity->kind;
 
     assert (l->tsched.v != TSCHED_NOT_ON_HEAP);
-    ut_fibheapExtractMin (&lease_fhdef, &gv.leaseheap);
 
     lock_lease (l);
     if (tnowE.v < l->tend.v)
@@ -210,7 +202,7 @@ void check_and_handle_lease_expiration (UNUSED_ARG (struct thread_state1 *self),
       } else {
         l->tsched = l->tend;
         unlock_lease (l);
-        ut_fibheapInsert (&lease_fhdef, &gv.leaseheap, l);
+        ut_timerwheelInsert (&lease_twdef, &gv.leaseheap, l, l->tsched.v);
       }
       continue;
     }
@@ -252,7 +244,7 @@ void check_and_handle_lease_expiration (UNUSED_ARG (struct thread_state1 *self),
                 PGUID (proxypp->privileged_pp_guid));
         l->tsched = l->tend = add_duration_to_etime (tnowE, 200 * T_MILLISECOND);
         unlock_lease (l);
-        ut_fibheapInsert (&lease_fhdef, &gv.leaseheap, l);
+        ut_timerwheelInsert (&lease_twdef, &gv.leaseheap, l, l->tsched.v);
         continue;
       }
     }
@@ -30,6 +30,316 @@
 
 #define BUF_OFFSET MAX_HDR_LENGTH
 
+#define NAME_HDR_LENGTH (1 + MAX_TID_LENGTH + 2)
+
+/* Asynchronous output: every thread that logs gets its own queue of line
+   buffers. The thread formats a line directly in the buffer at the tail
+   of its queue and hands the whole buffer to the background "logwriter"
+   thread by advancing the tail; the writer adds the timestamp, writes the
+   line to the file and advances the head. Lines are never copied, and
+   producers only take a lock to wake up the writer when it is asleep and
+   their queue is half full, or to wait for it when their queue is full.
+   Only active while the trace file is open and Tracing/AsyncBufferSize is
+   non-zero. */
+struct logq {
+  struct logq *next;   /* protected by logwriter lock */
+  os_atomic_uint32_t wr; /* advanced by the owner once a buffer is filled */
+  os_atomic_uint32_t rd; /* advanced by the writer once a buffer is written */
+  os_atomic_uint32_t gone; /* set by the owner when it exits */
+  const char *name;    /* owner only: thread name in name_hdr */
+  char name_hdr[NAME_HDR_LENGTH + 1];
+  struct logbuf bufs[];
+};
+
+struct logwriter {
+  os_mutex lock;
+  os_cond cond;       /* wakes up the writer */
+  os_cond space_cond; /* a queue has space again */
+  struct logq *qs;
+  uint32_t depth;     /* buffers per queue, a power of 2 */
+  uint32_t nwaiting;  /* producers waiting for space */
+  os_atomic_uint32_t asleep;
+  int terminate;
+  os_threadId tid;
+};
+
+static struct logwriter *logwriter;
+
+/* A thread's queue is only valid for the writer that existed when it was
+   created: stopping the writer frees all queues, including those of
+   threads that are still alive */
+static uint32_t logwriter_gen;
+static os_threadLocal struct logq *logq_self;
+static os_threadLocal uint32_t logq_self_gen;
+static os_threadLocal int logq_cleanup_pushed;
+
+static logbuf_t logq_tail (struct logq *q, const struct logwriter *w)
+{
+  return &q->bufs[os_atomic_ld32 (&q->wr) & (w->depth - 1)];
+}
+
+static uint32_t logwriter_write_queues (struct logwriter *w)
+{
+  struct logq *q;
+  uint32_t n = 0;
+  os_mutexLock (&w->lock);
+  q = w->qs;
+  os_mutexUnlock (&w->lock);
+  /* new queues get inserted at the front, and only the writer removes
+     them, so the list can be traversed without holding the lock */
+  for (; q; q = q->next)
+  {
+    const uint32_t wr = os_atomic_ld32 (&q->wr);
+    uint32_t rd = os_atomic_ld32 (&q->rd);
+    os_atomic_fence_acq ();
+    for (; rd != wr; rd++)
+    {
+      logbuf_t lb = &q->bufs[rd & (w->depth - 1)];
+      char ts[MAX_TIMESTAMP_LENGTH + 1];
+      size_t off;
+      int tsn, tsec, tusec;
+      wctime_to_sec_usec (&tsec, &tusec, lb->tstamp);
+      tsn = snprintf (ts, sizeof (ts), "%d.%06d", tsec, tusec);
+      assert (0 < tsn && tsn <= MAX_TIMESTAMP_LENGTH);
+      off = BUF_OFFSET - NAME_HDR_LENGTH - (size_t) tsn;
+      memcpy (lb->buf + off, ts, (size_t) tsn);
+      fwrite (lb->buf + off, 1, lb->pos - off, config.tracingOutputFile);
+      n++;
+    }
+    os_atomic_fence_rel ();
+    os_atomic_st32 (&q->rd, rd);
+  }
+  return n;
+}
+
+static void logwriter_free_gone_locked (struct logwriter *w)
+{
+  struct logq **pq = &w->qs, *q;
+  while ((q = *pq) != NULL)
+  {
+    if (os_atomic_ld32 (&q->gone) && os_atomic_ld32 (&q->rd) == os_atomic_ld32 (&q->wr))
+    {
+      *pq = q->next;
+      os_free (q);
+    }
+    else
+    {
+      pq = &q->next;
+    }
+  }
+}
+
+static uint32_t logwriter_thread (void *varg)
+{
+  /* lines wait at most this long for the writer to wake up on its own */
+  const os_time timeout = { 0, 10000000 };
+  struct logwriter *w = varg;
+  int dirty = 0;
+  for (;;)
+  {
+    if (logwriter_write_queues (w) > 0)
+    {
+      dirty = 1;
+      os_mutexLock (&w->lock);
+      if (w->nwaiting > 0)
+        os_condBroadcast (&w->space_cond);
+      os_mutexUnlock (&w->lock);
+      continue;
+    }
+    if (dirty)
+    {
+      fflush (config.tracingOutputFile);
+      dirty = 0;
+    }
+    os_mutexLock (&w->lock);
+    logwriter_free_gone_locked (w);
+    if (w->terminate)
+    {
+      os_mutexUnlock (&w->lock);
+      break;
+    }
+    os_atomic_st32 (&w->asleep, 1);
+    (void) os_condTimedWait (&w->cond, &w->lock, &timeout);
+    os_atomic_st32 (&w->asleep, 0);
+    os_mutexUnlock (&w->lock);
+  }
+  return 0;
+}
+
+static int logwriter_idle (struct logwriter *w)
+{
+  struct logq *q;
+  int idle = 1;
+  os_mutexLock (&w->lock);
+  for (q = w->qs; q && idle; q = q->next)
+    idle = (os_atomic_ld32 (&q->rd) == os_atomic_ld32 (&q->wr));
+  os_mutexUnlock (&w->lock);
+  return idle;
+}
+
+static void logwriter_drain (struct logwriter *w)
+{
+  /* bounded wait: used on the way to abort() as well */
+  const os_time delay = { 0, 1000000 };
+  int i;
+  for (i = 0; i < 1000 && !logwriter_idle (w); i++)
+  {
+    os_mutexLock (&w->lock);
+    os_condSignal (&w->cond);
+    os_mutexUnlock (&w->lock);
+    os_nanoSleep (delay);
+  }
+  fflush (config.tracingOutputFile);
+}
+
+static void logq_handoff (struct logwriter *w, struct logq *q, struct thread_state1 *self)
+{
+  const char *name = self ? self->name : "(anon)";
+  logbuf_t lb = logq_tail (q, w);
+  uint32_t wr;
+  if (name != q->name)
+  {
+    (void) snprintf (q->name_hdr, sizeof (q->name_hdr), "/%*.*s: ", MAX_TID_LENGTH, MAX_TID_LENGTH, name);
+    q->name = name;
+  }
+  memcpy (lb->buf + BUF_OFFSET - NAME_HDR_LENGTH, q->name_hdr, NAME_HDR_LENGTH);
+  if (lb->tstamp.v < 0)
+    lb->tstamp = now ();
+  wr = os_atomic_ld32 (&q->wr) + 1;
+  os_atomic_fence_rel ();
+  os_atomic_st32 (&q->wr, wr);
+
+  /* only a hint: the writer wakes up periodically anyway, and waking it
+     before the queue is full merely avoids having to wait for it */
+  if (wr - os_atomic_ld32 (&q->rd) >= w->depth / 2 && os_atomic_ld32 (&w->asleep))
+  {
+    os_mutexLock (&w->lock);
+    os_condSignal (&w->cond);
+    os_mutexUnlock (&w->lock);
+  }
+  if (wr - os_atomic_ld32 (&q->rd) == w->depth)
+  {
+    os_mutexLock (&w->lock);
+    w->nwaiting++;
+    os_condSignal (&w->cond);
+    while (wr - os_atomic_ld32 (&q->rd) == w->depth)
+      os_condWait (&w->space_cond, &w->lock);
+    w->nwaiting--;
+    os_mutexUnlock (&w->lock);
+  }
+  /* the writer must be done with the next buffer before it is reused */
+  os_atomic_fence_acq ();
+  logbuf_init (logq_tail (q, w));
+}
+
+static void logq_cleanup (void *varg)
+{
+  /* terminates an incomplete line, as logbuf_free does */
+  struct logwriter * const w = logwriter;
+  struct logq * const q = logq_self;
+  (void) varg;
+  if (w == NULL || q == NULL || logq_self_gen != logwriter_gen)
+    return;
+  if (logq_tail (q, w)->pos > BUF_OFFSET)
+  {
+    logbuf_t lb = logq_tail (q, w);
+    if (lb->pos < sizeof (lb->buf))
+      lb->buf[lb->pos++] = '\n';
+    else
+      lb->buf[sizeof (lb->buf) - 1] = '\n';
+    logq_handoff (w, q, lookup_thread_state_real ());
+  }
+  os_atomic_fence_rel ();
+  os_atomic_st32 (&q->gone, 1);
+  logq_self = NULL;
+}
+
+static struct logq *logq_lookup (struct logwriter *w)
+{
+  struct logq *q;
+  if (logq_self != NULL && logq_self_gen == logwriter_gen)
+    return logq_self;
+  q = os_malloc (sizeof (*q) + w->depth * sizeof (q->bufs[0]));
+  os_atomic_st32 (&q->wr, 0);
+  os_atomic_st32 (&q->rd, 0);
+  os_atomic_st32 (&q->gone, 0);
+  q->name = NULL;
+  logbuf_init (logq_tail (q, w));
+  os_mutexLock (&w->lock);
+  q->next = w->qs;
+  w->qs = q;
+  os_mutexUnlock (&w->lock);
+  logq_self = q;
+  logq_self_gen = logwriter_gen;
+  if (!logq_cleanup_pushed)
+  {
+    os_threadCleanupPush (logq_cleanup, NULL);
+    logq_cleanup_pushed = 1;
+  }
+  return q;
+}
+
+void nn_log_async_start (void)
+{
+  struct logwriter *w;
+  os_threadAttr tattr;
+  uint32_t depth;
+  assert (logwriter == NULL);
+  if (config.tracingOutputFile == NULL || config.tracing_async_bufsize == 0)
+    return;
+  w = os_malloc (sizeof (*w));
+  /* the largest power of 2 that fits, but at least 4 */
+  for (depth = 4; 2 * depth * sizeof (struct logbuf) <= config.tracing_async_bufsize; depth *= 2)
+    ;
+  w->depth = depth;
+  w->qs = NULL;
+  w->nwaiting = 0;
+  os_atomic_st32 (&w->asleep, 0);
+  w->terminate = 0;
+  os_mutexInit (&w->lock);
+  os_condInit (&w->cond, &w->lock);
+  os_condInit (&w->space_cond, &w->lock);
+  os_threadAttrInit (&tattr);
+  if (os_threadCreate (&w->tid, "logwriter", &tattr, logwriter_thread, w) != os_resultSuccess)
+  {
+    NN_WARNING ("failed to start trace writer thread, using synchronous output\n");
+    os_condDestroy (&w->space_cond);
+    os_condDestroy (&w->cond);
+    os_mutexDestroy (&w->lock);
+    os_free (w);
+    return;
+  }
+  logwriter_gen++;
+  logwriter = w;
+}
+
+void nn_log_async_stop (void)
+{
+  /* all threads other than this one are supposed to have stopped logging */
+  struct logwriter *w = logwriter;
+  struct logq *q;
+  if (w == NULL)
+    return;
+  if (logq_self != NULL && logq_self_gen == logwriter_gen && logq_tail (logq_self, w)->pos > BUF_OFFSET)
+    logq_cleanup (NULL);
+  os_mutexLock (&w->lock);
+  w->terminate = 1;
+  os_condSignal (&w->cond);
+  os_mutexUnlock (&w->lock);
+  os_threadWaitExit (w->tid, NULL);
+  logwriter = NULL;
+  logwriter_gen++;
+  while ((q = w->qs) != NULL)
+  {
+    w->qs = q->next;
+    os_free (q);
+  }
+  os_condDestroy (&w->space_cond);
+  os_condDestroy (&w->cond);
+  os_mutexDestroy (&w->lock);
+  os_free (w);
+}
+
 static void logbuf_flush_real (struct thread_state1 *self, logbuf_t lb)
 {
   if (config.tracingOutputFile != NULL)
@@ -88,12 +398,16 @@ void logbuf_free (logbuf_t lb)
 
 static void nn_vlogb (struct thread_state1 *self, const char *fmt, va_list ap)
 {
+  struct logwriter * const w = logwriter;
+  struct logq *q = NULL;
   int n, trunc = 0;
   size_t nrem;
   logbuf_t lb;
   if (*fmt == 0)
     return;
-  if (self && self->lb)
+  if (w)
+    lb = logq_tail ((q = logq_lookup (w)), w);
+  else if (self && self->lb)
     lb = self->lb;
   else
   {
@@ -128,7 +442,10 @@ static void nn_vlogb (struct thread_state1 *self, const char *fmt, va_list ap)
   }
   if (fmt[strlen (fmt) - 1] == '\n')
   {
-    logbuf_flush_real (self, lb);
+    if (q)
+      logq_handoff (w, q, self);
+    else
+      logbuf_flush_real (self, lb);
   }
 
   if (lb == &gv.static_logbuf && gv.static_logbuf_lock_inited)
@@ -159,6 +476,8 @@ int nn_log (_In_ logcat_t cat, _In_z_ _Printf_format_string_ const char *fmt, ..
   }
   if (cat == LC_FATAL)
   {
+    if (logwriter)
+      logwriter_drain (logwriter);
     abort ();
   }
   return 0;
@@ -180,6 +499,8 @@ int nn_trace (_In_z_ _Printf_format_string_ const char *fmt, ...)
 void nn_log_set_tstamp (nn_wctime_t tnow)
 {
   struct thread_state1 *self = lookup_thread_state ();
-  if (self && self->lb)
+  if (logwriter)
+    logq_tail (logq_lookup (logwriter), logwriter)->tstamp = tnow;
+  else if (self && self->lb)
     self->lb->tstamp = tnow;
 }
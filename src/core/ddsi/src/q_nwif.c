@@ -30,6 +30,8 @@
 #include "ddsi/q_misc.h"
 #include "ddsi/q_addrset.h" /* unspec locator */
 #include "ddsi/q_feature_check.h"
+#include "ddsi/ddsi_shm.h"
+#include "ddsi/ddsi_unix.h"
 #include "util/ut_avl.h"
 
 
@@ -204,6 +206,12 @@ void nn_loc_to_address (os_sockaddr_storage *dst, const nn_locator_t *src)
     case NN_LOCATOR_KIND_UDPv4MCGEN:
       NN_ERROR ("nn_address_to_loc: kind %x unsupported\n", src->kind);
       break;
+    case NN_LOCATOR_KIND_SHM:
+      ddsi_shm_loc_to_address (dst, src);
+      break;
+    case NN_LOCATOR_KIND_UNIX:
+      ddsi_unix_loc_to_address (dst, src);
+      break;
     default:
       break;
   }
@@ -298,6 +306,18 @@ char *sockaddr_to_string_with_port (char addrbuf[INET6_ADDRSTRLEN_EXTENDED], con
       assert (n < INET6_ADDRSTRLEN_EXTENDED);
       (void)n;
       break;
+#endif
+#if OS_SOCKET_HAS_AF_UNIX
+    case AF_UNIX:
+    {
+      /* names in the abstract namespace start with a NUL, shown as '@' */
+      const char *path = ((const struct sockaddr_un *) src)->sun_path;
+      if (path[0] == 0)
+        (void) snprintf (addrbuf, INET6_ADDRSTRLEN_EXTENDED, "@%.*s", INET6_ADDRSTRLEN_EXTENDED - 2, path + 1);
+      else
+        (void) snprintf (addrbuf, INET6_ADDRSTRLEN_EXTENDED, "%.*s", INET6_ADDRSTRLEN_EXTENDED - 1, path);
+      break;
+    }
 #endif
     default:
       NN_WARNING ("sockaddr_to_string_with_port: unknown address family\n");
@@ -309,6 +329,10 @@ char *sockaddr_to_string_with_port (char addrbuf[INET6_ADDRSTRLEN_EXTENDED], con
 
 char *sockaddr_to_string_no_port (char addrbuf[INET6_ADDRSTRLEN_EXTENDED], const os_sockaddr_storage *src)
 {
+#if OS_SOCKET_HAS_AF_UNIX
+  if (src->ss_family == AF_UNIX)
+    return sockaddr_to_string_with_port (addrbuf, src);
+#endif
   return os_sockaddrAddressToString ((const os_sockaddr *) src, addrbuf, INET6_ADDRSTRLEN);
 }
 
@@ -367,6 +391,22 @@ unsigned sockaddr_to_hopefully_unique_uint32 (const os_sockaddr_storage *src)
   }
 }
 
+void get_host_id (unsigned char id[8])
+{
+  /* Locators for same-host transports must not be mistaken for their own
+     by peers on other hosts: the host is identified by (a hash of) its
+     name */
+  char hostname[256];
+  md5_state_t st;
+  md5_byte_t digest[16];
+  if (os_gethostname (hostname, sizeof (hostname)) != os_resultSuccess)
+    hostname[0] = 0;
+  md5_init (&st);
+  md5_append (&st, (const md5_byte_t *) hostname, (unsigned) strlen (hostname));
+  md5_finish (&st, digest);
+  memcpy (id, digest, 8);
+}
+
 unsigned short get_socket_port (os_socket socket)
 {
   os_sockaddr_storage addr;
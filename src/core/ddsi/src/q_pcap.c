@@ -10,9 +10,11 @@
  * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
  */
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include "os/os.h"
+#include "os/os_atomics.h"
 
 #include "ddsi/q_log.h"
 #include "ddsi/q_time.h"
@@ -79,10 +81,179 @@ static const ipv4_hdr_t ipv4_hdr_template = {
 #define IPV4_HDR_SIZE 20
 #define UDP_HDR_SIZE 8
 
-FILE *new_pcap_file (const char *name)
-{
+/* Packets are copied into a ring buffer by the sending/receiving
+   threads and written to the file by a separate thread, so capturing
+   doesn't slow down the data path. Producers reserve space by
+   advancing "head" with a CAS and mark the record as complete by
+   setting the READY flag in its header once they have filled it in.
+   The writer thread consumes records in order, zeroes them and then
+   advances "tail". If there is no space, the packet is dropped (and
+   counted) rather than waiting for the writer. Positions are free
+   running 32-bit counters, the buffer size is a power of 2.
+
+   An idle writer thread sleeps on a condition variable after setting
+   "sleeping"; producers only take the lock to signal it when they see
+   that flag after committing a record. Both sides have a full barrier
+   between the store and the load, so either the writer sees the record
+   or the producer sees the flag. */
+
+#define REC_READY 0x80000000u
+#define REC_PAD   0x40000000u
+#define REC_LENMASK 0x3fffffffu
+
+struct pcap_rec {
+  os_atomic_uint32_t state; /* length incl header | flags */
+  uint32_t pad;
+  pcaprec_hdr_t pcap_hdr;
+  union {
+    ipv4_hdr_t ipv4_hdr;
+    uint16_t x[10];
+  } u;
+  udp_hdr_t udp_hdr;
+  /* followed by the payload */
+};
+
+#define PCAP_REC_HDR_SIZE (offsetof (struct pcap_rec, udp_hdr) + UDP_HDR_SIZE)
+
+struct pcap_file {
   FILE *fp;
+  char *buf;
+  uint32_t size;
+  os_atomic_uint32_t head;
+  os_atomic_uint32_t tail;
+  os_atomic_uint32_t dropped;
+  os_atomic_uint32_t terminate;
+  os_atomic_uint32_t sleeping;
+  os_mutex lock;
+  os_cond cond;
+  os_threadId tid;
+};
+
+static uint16_t calc_ipv4_checksum (const uint16_t *x)
+{
+  uint32_t s = 0;
+  int i;
+  for (i = 0; i < 10; i++)
+  {
+    s += x[i];
+  }
+  s = (s & 0xffff) + (s >> 16);
+  return (uint16_t) ~s;
+}
+
+static int pcap_drain (struct pcap_file *pf)
+{
+  /* Writes all consecutive complete records; returns whether it
+     wrote anything */
+  uint32_t tail = os_atomic_ld32 (&pf->tail);
+  const uint32_t tail0 = tail;
+  while (tail != os_atomic_ld32 (&pf->head))
+  {
+    struct pcap_rec *rec = (struct pcap_rec *) (pf->buf + (tail & (pf->size - 1)));
+    const uint32_t state = os_atomic_ld32 (&rec->state);
+    const uint32_t len = state & REC_LENMASK;
+    if (!(state & REC_READY))
+      break;
+    os_atomic_fence_acq ();
+    if (!(state & REC_PAD))
+    {
+      rec->u.ipv4_hdr.checksum = calc_ipv4_checksum (rec->u.x);
+      fwrite (&rec->pcap_hdr, rec->pcap_hdr.incl_len + sizeof (rec->pcap_hdr), 1, pf->fp);
+    }
+    /* stale READY flags anywhere in the buffer would confuse us once
+       the producers wrap around */
+    memset (rec, 0, len);
+    tail += len;
+    os_atomic_fence_rel ();
+    os_atomic_st32 (&pf->tail, tail);
+  }
+  return tail != tail0;
+}
+
+static int pcap_ready (const struct pcap_file *pf)
+{
+  const uint32_t tail = os_atomic_ld32 (&pf->tail);
+  const struct pcap_rec *rec = (const struct pcap_rec *) (pf->buf + (tail & (pf->size - 1)));
+  return tail != os_atomic_ld32 (&pf->head) && (os_atomic_ld32 (&rec->state) & REC_READY);
+}
+
+static uint32_t pcap_writer_thread (void *varg)
+{
+  struct pcap_file *pf = varg;
+  while (!os_atomic_ld32 (&pf->terminate))
+  {
+    if (pcap_drain (pf))
+      fflush (pf->fp);
+    else
+    {
+      os_mutexLock (&pf->lock);
+      os_atomic_st32 (&pf->sleeping, 1);
+      os_atomic_fence ();
+      if (!pcap_ready (pf) && !os_atomic_ld32 (&pf->terminate))
+        os_condWait (&pf->cond, &pf->lock);
+      os_atomic_st32 (&pf->sleeping, 0);
+      os_mutexUnlock (&pf->lock);
+    }
+  }
+  return 0;
+}
+
+static void pcap_wakeup (struct pcap_file *pf)
+{
+  os_mutexLock (&pf->lock);
+  os_condSignal (&pf->cond);
+  os_mutexUnlock (&pf->lock);
+}
+
+static struct pcap_rec *pcap_reserve (struct pcap_file *pf, size_t sz)
+{
+  const uint32_t need = (uint32_t) ((PCAP_REC_HDR_SIZE + sz + 7) & ~(size_t) 7);
+  uint32_t head, off, pad, total;
+  struct pcap_rec *rec;
+  if (need > pf->size / 2)
+  {
+    os_atomic_inc32 (&pf->dropped);
+    return NULL;
+  }
+  do {
+    head = os_atomic_ld32 (&pf->head);
+    off = head & (pf->size - 1);
+    /* records are contiguous: skip the remainder of the buffer if it
+       won't fit */
+    pad = (off + need <= pf->size) ? 0 : pf->size - off;
+    total = pad + need;
+    if (head + total - os_atomic_ld32 (&pf->tail) > pf->size)
+    {
+      os_atomic_inc32 (&pf->dropped);
+      return NULL;
+    }
+  } while (!os_atomic_cas32 (&pf->head, head, head + total));
+  if (pad)
+  {
+    struct pcap_rec *padrec = (struct pcap_rec *) (pf->buf + off);
+    os_atomic_st32 (&padrec->state, pad | REC_PAD | REC_READY);
+  }
+  rec = (struct pcap_rec *) (pf->buf + ((head + pad) & (pf->size - 1)));
+  rec->state.v = need;
+  return rec;
+}
+
+static void pcap_commit (struct pcap_file *pf, struct pcap_rec *rec)
+{
+  const uint32_t len = rec->state.v;
+  os_atomic_fence_rel ();
+  os_atomic_st32 (&rec->state, len | REC_READY);
+  os_atomic_fence ();
+  if (os_atomic_ld32 (&pf->sleeping))
+    pcap_wakeup (pf);
+}
+
+struct pcap_file *new_pcap_file (const char *name, uint32_t bufsize)
+{
+  struct pcap_file *pf;
   pcap_hdr_t hdr;
+  os_threadAttr tattr;
+  FILE *fp;
 
   if ((fp = fopen (name, "wb")) == NULL)
   {
@@ -99,37 +270,83 @@ FILE *new_pcap_file (const char *name)
   hdr.network = LINKTYPE_RAW;
   fwrite (&hdr, sizeof (hdr), 1, fp);
 
-  return fp;
+  pf = os_malloc (sizeof (*pf));
+  pf->fp = fp;
+  /* large enough for the largest UDP datagram; power of 2 up to 1GB */
+  pf->size = 256 * 1024;
+  while (pf->size < bufsize && pf->size < (1u << 30))
+    pf->size *= 2;
+  pf->buf = os_malloc (pf->size);
+  memset (pf->buf, 0, pf->size);
+  os_atomic_st32 (&pf->head, 0);
+  os_atomic_st32 (&pf->tail, 0);
+  os_atomic_st32 (&pf->dropped, 0);
+  os_atomic_st32 (&pf->terminate, 0);
+  os_atomic_st32 (&pf->sleeping, 0);
+  os_mutexInit (&pf->lock);
+  os_condInit (&pf->cond, &pf->lock);
+  os_threadAttrInit (&tattr);
+  if (os_threadCreate (&pf->tid, "pcap", &tattr, pcap_writer_thread, pf) != os_resultSuccess)
+  {
+    NN_WARNING ("packet capture disabled: failed to start writer thread\n");
+    os_condDestroy (&pf->cond);
+    os_mutexDestroy (&pf->lock);
+    fclose (fp);
+    os_free (pf->buf);
+    os_free (pf);
+    return NULL;
+  }
+  return pf;
+}
+
+void free_pcap_file (struct pcap_file *pf)
+{
+  uint32_t dropped;
+  os_atomic_st32 (&pf->terminate, 1);
+  pcap_wakeup (pf);
+  os_threadWaitExit (pf->tid, NULL);
+  (void) pcap_drain (pf);
+  if ((dropped = os_atomic_ld32 (&pf->dropped)) > 0)
+    NN_WARNING ("packet capture: %"PRIu32" packets dropped because the capture buffer was full\n", dropped);
+  else
+    nn_log (LC_INFO, "packet capture: no packets dropped\n");
+  os_condDestroy (&pf->cond);
+  os_mutexDestroy (&pf->lock);
+  fclose (pf->fp);
+  os_free (pf->buf);
+  os_free (pf);
 }
 
-static void write_data (FILE *fp, const struct msghdr *msghdr, size_t sz)
+uint32_t pcap_file_dropped (const struct pcap_file *pf)
 {
-  size_t i, n = 0;
-  for (i = 0; i < (size_t) msghdr->msg_iovlen && n < sz; i++)
-  {
-    size_t m1 = msghdr->msg_iov[i].iov_len;
-    size_t m = (n + m1 <= sz) ? m1 : sz - n;
-    fwrite (msghdr->msg_iov[i].iov_base, m, 1, fp);
-    n += m;
-  }
-  assert (n == sz);
+  return os_atomic_ld32 (&pf->dropped);
 }
 
-static uint16_t calc_ipv4_checksum (const uint16_t *x)
+static struct pcap_rec *pcap_rec_new (struct pcap_file *pf, nn_wctime_t tstamp, unsigned char ttl, const os_sockaddr_storage *src, const os_sockaddr_storage *dst, size_t sz)
 {
-  uint32_t s = 0;
-  int i;
-  for (i = 0; i < 10; i++)
-  {
-    s += x[i];
-  }
-  s = (s & 0xffff) + (s >> 16);
-  return (uint16_t) ~s;
+  struct pcap_rec *rec;
+  const size_t sz_ud = sz + UDP_HDR_SIZE;
+  const size_t sz_iud = sz_ud + IPV4_HDR_SIZE;
+  if ((rec = pcap_reserve (pf, sz)) == NULL)
+    return NULL;
+  wctime_to_sec_usec (&rec->pcap_hdr.ts_sec, &rec->pcap_hdr.ts_usec, tstamp);
+  rec->pcap_hdr.incl_len = rec->pcap_hdr.orig_len = (uint32_t) sz_iud;
+  rec->u.ipv4_hdr = ipv4_hdr_template;
+  rec->u.ipv4_hdr.totallength = toBE2u ((unsigned short) sz_iud);
+  rec->u.ipv4_hdr.ttl = ttl;
+  rec->u.ipv4_hdr.srcip = ((const os_sockaddr_in*) src)->sin_addr.s_addr;
+  rec->u.ipv4_hdr.dstip = ((const os_sockaddr_in*) dst)->sin_addr.s_addr;
+  /* checksum is computed by the writer thread */
+  rec->udp_hdr.srcport = ((const os_sockaddr_in*) src)->sin_port;
+  rec->udp_hdr.dstport = ((const os_sockaddr_in*) dst)->sin_port;
+  rec->udp_hdr.length = toBE2u ((unsigned short) sz_ud);
+  rec->udp_hdr.checksum = 0; /* don't have to compute a checksum for UDPv4 */
+  return rec;
 }
 
 void write_pcap_received
 (
-  FILE * fp,
+  struct pcap_file * pf,
   nn_wctime_t tstamp,
   const os_sockaddr_storage * src,
   const os_sockaddr_storage * dst,
@@ -139,38 +356,18 @@ void write_pcap_received
 {
   if (!config.useIpv6)
   {
-    pcaprec_hdr_t pcap_hdr;
-    union {
-      ipv4_hdr_t ipv4_hdr;
-      uint16_t x[10];
-    } u;
-    udp_hdr_t udp_hdr;
-    size_t sz_ud = sz + UDP_HDR_SIZE;
-    size_t sz_iud = sz_ud + IPV4_HDR_SIZE;
-    os_mutexLock (&gv.pcap_lock);
-    wctime_to_sec_usec (&pcap_hdr.ts_sec, &pcap_hdr.ts_usec, tstamp);
-    pcap_hdr.incl_len = pcap_hdr.orig_len = (uint32_t) sz_iud;
-    fwrite (&pcap_hdr, sizeof (pcap_hdr), 1, fp);
-    u.ipv4_hdr = ipv4_hdr_template;
-    u.ipv4_hdr.totallength = toBE2u ((unsigned short) sz_iud);
-    u.ipv4_hdr.ttl = 128;
-    u.ipv4_hdr.srcip = ((os_sockaddr_in*) src)->sin_addr.s_addr;
-    u.ipv4_hdr.dstip = ((os_sockaddr_in*) dst)->sin_addr.s_addr;
-    u.ipv4_hdr.checksum = calc_ipv4_checksum (u.x);
-    fwrite (&u.ipv4_hdr, sizeof (u.ipv4_hdr), 1, fp);
-    udp_hdr.srcport = ((os_sockaddr_in*) src)->sin_port;
-    udp_hdr.dstport = ((os_sockaddr_in*) dst)->sin_port;
-    udp_hdr.length = toBE2u ((unsigned short) sz_ud);
-    udp_hdr.checksum = 0; /* don't have to compute a checksum for UDPv4 */
-    fwrite (&udp_hdr, sizeof (udp_hdr), 1, fp);
-    fwrite (buf, sz, 1, fp);
-    os_mutexUnlock (&gv.pcap_lock);
+    struct pcap_rec *rec;
+    if ((rec = pcap_rec_new (pf, tstamp, 128, src, dst, sz)) != NULL)
+    {
+      memcpy ((char *) rec + PCAP_REC_HDR_SIZE, buf, sz);
+      pcap_commit (pf, rec);
+    }
   }
 }
 
 void write_pcap_sent
 (
-  FILE * fp,
+  struct pcap_file * pf,
   nn_wctime_t tstamp,
   const os_sockaddr_storage * src,
   const struct msghdr * hdr,
@@ -179,31 +376,20 @@ void write_pcap_sent
 {
   if (!config.useIpv6)
   {
-    pcaprec_hdr_t pcap_hdr;
-    union {
-      ipv4_hdr_t ipv4_hdr;
-      uint16_t x[10];
-    } u;
-    udp_hdr_t udp_hdr;
-    size_t sz_ud = sz + UDP_HDR_SIZE;
-    size_t sz_iud = sz_ud + IPV4_HDR_SIZE;
-    os_mutexLock (&gv.pcap_lock);
-    wctime_to_sec_usec (&pcap_hdr.ts_sec, &pcap_hdr.ts_usec, tstamp);
-    pcap_hdr.incl_len = pcap_hdr.orig_len = (uint32_t) sz_iud;
-    fwrite (&pcap_hdr, sizeof (pcap_hdr), 1, fp);
-    u.ipv4_hdr = ipv4_hdr_template;
-    u.ipv4_hdr.totallength = toBE2u ((unsigned short) sz_iud);
-    u.ipv4_hdr.ttl = 255;
-    u.ipv4_hdr.srcip = ((os_sockaddr_in*) src)->sin_addr.s_addr;
-    u.ipv4_hdr.dstip = ((os_sockaddr_in*) hdr->msg_name)->sin_addr.s_addr;
-    u.ipv4_hdr.checksum = calc_ipv4_checksum (u.x);
-    fwrite (&u.ipv4_hdr, sizeof (u.ipv4_hdr), 1, fp);
-    udp_hdr.srcport = ((os_sockaddr_in*) src)->sin_port;
-    udp_hdr.dstport = ((os_sockaddr_in*) hdr->msg_name)->sin_port;
-    udp_hdr.length = toBE2u ((unsigned short) sz_ud);
-    udp_hdr.checksum = 0; /* don't have to compute a checksum for UDPv4 */
-    fwrite (&udp_hdr, sizeof (udp_hdr), 1, fp);
-    write_data (fp, hdr, sz);
-    os_mutexUnlock (&gv.pcap_lock);
+    struct pcap_rec *rec;
+    if ((rec = pcap_rec_new (pf, tstamp, 255, src, hdr->msg_name, sz)) != NULL)
+    {
+      char *dst = (char *) rec + PCAP_REC_HDR_SIZE;
+      size_t i, n = 0;
+      for (i = 0; i < (size_t) hdr->msg_iovlen && n < sz; i++)
+      {
+        size_t m1 = hdr->msg_iov[i].iov_len;
+        size_t m = (n + m1 <= sz) ? m1 : sz - n;
+        memcpy (dst + n, hdr->msg_iov[i].iov_base, m);
+        n += m;
+      }
+      assert (n == sz);
+      pcap_commit (pf, rec);
+    }
   }
 }
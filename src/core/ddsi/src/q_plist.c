@@ -1560,6 +1560,14 @@ static int do_locator
       }
       break;
     }
+    case NN_LOCATOR_KIND_SHM:
+    case NN_LOCATOR_KIND_UNIX:
+      if (loc.port == 0)
+      {
+        TRACE (("plist/do_locator[kind=%s]: invalid port (%d)\n", loc.kind == NN_LOCATOR_KIND_SHM ? "SHM" : "UNIX", (int) loc.port));
+        return ERR_INVALID;
+      }
+      break;
     case NN_LOCATOR_KIND_INVALID:
       if (!locator_address_zero (&loc))
       {
@@ -3064,6 +3072,54 @@ int nn_plist_init_frommsg
   return ERR_INVALID;
 }
 
+int nn_plist_peek_guid (nn_guid_t *dest, nn_parameterid_t pid, const nn_plist_src_t *src)
+{
+  /* Extracts the GUID in parameter pid without interpreting or
+     validating any of the other parameters; returns ERR_INVALID if it
+     is not there. Intended for quickly finding the key of discovery
+     data, nn_plist_init_frommsg() must still be used for the rest. */
+  const unsigned char *pl;
+  int bswap;
+  switch (src->encoding)
+  {
+    case PL_CDR_LE:
+#if OS_ENDIANNESS == OS_LITTLE_ENDIAN
+      bswap = 0;
+#else
+      bswap = 1;
+#endif
+      break;
+    case PL_CDR_BE:
+#if OS_ENDIANNESS == OS_LITTLE_ENDIAN
+      bswap = 1;
+#else
+      bswap = 0;
+#endif
+      break;
+    default:
+      return ERR_INVALID;
+  }
+  pl = src->buf;
+  while (pl + sizeof (nn_parameter_t) <= src->buf + src->bufsz)
+  {
+    const nn_parameter_t *par = (const nn_parameter_t *) pl;
+    const nn_parameterid_t curpid = (nn_parameterid_t) (bswap ? bswap2u (par->parameterid) : par->parameterid);
+    const unsigned short length = (unsigned short) (bswap ? bswap2u (par->length) : par->length);
+    if (curpid == PID_SENTINEL || length > src->bufsz - sizeof (*par) - (size_t) (pl - src->buf))
+      return ERR_INVALID;
+    if (curpid == pid)
+    {
+      if (length < sizeof (*dest))
+        return ERR_INVALID;
+      memcpy (dest, par + 1, sizeof (*dest));
+      *dest = nn_ntoh_guid (*dest);
+      return 0;
+    }
+    pl += sizeof (*par) + length;
+  }
+  return ERR_INVALID;
+}
+
 unsigned char *nn_plist_quickscan (struct nn_rsample_info *dest, const struct nn_rmsg *rmsg, const nn_plist_src_t *src)
 {
   /* Sets a few fields in dest, returns address of first byte
@@ -10,8 +10,10 @@
  * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
  */
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 
+#include "os/os.h"
 #include "ddsi/q_time.h"
 #include "ddsi/q_xqos.h"
 #include "ddsi/q_misc.h"
@@ -66,6 +68,82 @@ int partitions_match_p (const nn_xqos_t *a, const nn_xqos_t *b)
   }
 }
 
+static int compare_partition_name (const void *va, const void *vb)
+{
+  const char * const *a = va;
+  const char * const *b = vb;
+  return strcmp (*a, *b);
+}
+
+void nn_partition_set_init (struct nn_partition_set *ps, const nn_xqos_t *xqos)
+{
+  static const char *default_partition = "";
+  unsigned i, n;
+  ps->nexact = ps->nwild = 0;
+  if (!(xqos->present & QP_PARTITION) || xqos->partition.n == 0)
+  {
+    ps->exact = os_malloc (sizeof (*ps->exact));
+    ps->wild = NULL;
+    ps->exact[ps->nexact++] = default_partition;
+    return;
+  }
+  n = xqos->partition.n;
+  ps->exact = os_malloc (n * sizeof (*ps->exact));
+  ps->wild = os_malloc (n * sizeof (*ps->wild));
+  for (i = 0; i < n; i++)
+  {
+    const char *str = xqos->partition.strs[i];
+    if (is_wildcard_partition (str))
+      ps->wild[ps->nwild++] = str;
+    else
+      ps->exact[ps->nexact++] = str;
+  }
+  if (ps->nexact > 1)
+  {
+    unsigned j;
+    qsort (ps->exact, ps->nexact, sizeof (*ps->exact), compare_partition_name);
+    for (i = 1, j = 0; i < ps->nexact; i++)
+      if (strcmp (ps->exact[i], ps->exact[j]) != 0)
+        ps->exact[++j] = ps->exact[i];
+    ps->nexact = j + 1;
+  }
+}
+
+void nn_partition_set_fini (struct nn_partition_set *ps)
+{
+  os_free (ps->exact);
+  os_free (ps->wild);
+}
+
+static int partition_set_wild_matches_exact (const struct nn_partition_set *a, const struct nn_partition_set *b)
+{
+  unsigned i, j;
+  for (i = 0; i < a->nwild; i++)
+    for (j = 0; j < b->nexact; j++)
+      if (ddsi2_patmatch (a->wild[i], b->exact[j]))
+        return 1;
+  return 0;
+}
+
+int partition_sets_match_p (const struct nn_partition_set *a, const struct nn_partition_set *b)
+{
+  /* Exact names match if they are equal, which for two sorted sets is
+     a merge; wildcards only match exact names of the other side, never
+     wildcards. */
+  unsigned i = 0, j = 0;
+  while (i < a->nexact && j < b->nexact)
+  {
+    const int c = strcmp (a->exact[i], b->exact[j]);
+    if (c == 0)
+      return 1;
+    else if (c < 0)
+      i++;
+    else
+      j++;
+  }
+  return partition_set_wild_matches_exact (a, b) || partition_set_wild_matches_exact (b, a);
+}
+
 int partition_match_based_on_wildcard_in_left_operand (const nn_xqos_t *a, const nn_xqos_t *b, const char **realname)
 {
   assert (partitions_match_p (a, b));
@@ -145,7 +223,7 @@ static int ddsi_duration_is_lt (nn_duration_t a0, nn_duration_t b0)
 #define Q_LIFESPAN_QOS_POLICY_ID 21
 #define Q_DURABILITYSERVICE_QOS_POLICY_ID 22
 
-int32_t qos_match_p (const nn_xqos_t *rd, const nn_xqos_t *wr)
+static int32_t qos_match_except_partition_p (const nn_xqos_t *rd, const nn_xqos_t *wr)
 {
 #ifndef NDEBUG
   unsigned musthave = (QP_RXO_MASK | QP_PARTITION | QP_TOPIC_NAME | QP_TYPE_NAME);
@@ -214,9 +292,33 @@ int32_t qos_match_p (const nn_xqos_t *rd, const nn_xqos_t *wr)
       return Q_DESTINATIONORDER_QOS_POLICY_ID;
     }
   }
+  return -1;
+}
+
+int32_t qos_match_p (const nn_xqos_t *rd, const nn_xqos_t *wr)
+{
+  int32_t reason;
+  if ((reason = qos_match_except_partition_p (rd, wr)) >= 0)
+  {
+    return reason;
+  }
   if (!partitions_match_p (rd, wr))
   {
     return Q_PARTITION_QOS_POLICY_ID;
   }
   return -1;
 }
+
+int32_t qos_match_partition_sets_p (const nn_xqos_t *rd, const struct nn_partition_set *rdps, const nn_xqos_t *wr, const struct nn_partition_set *wrps)
+{
+  int32_t reason;
+  if ((reason = qos_match_except_partition_p (rd, wr)) >= 0)
+  {
+    return reason;
+  }
+  if (!partition_sets_match_p (rdps, wrps))
+  {
+    return Q_PARTITION_QOS_POLICY_ID;
+  }
+  return -1;
+}
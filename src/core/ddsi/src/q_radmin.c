@@ -443,6 +443,16 @@ static struct nn_rbuf *nn_rbuf_alloc_new (struct nn_rbufpool *rbufpool)
   return rb;
 }
 
+void nn_rbufpool_usage (struct nn_rbufpool *rbp, uint32_t *allocated, uint32_t *size)
+{
+  /* Approximate: the owner advances freeptr without holding the lock,
+     the lock only guarantees that "current" isn't freed meanwhile */
+  os_mutexLock (&rbp->lock);
+  *allocated = (uint32_t) (rbp->current->freeptr - rbp->current->u.raw);
+  *size = rbp->current->size;
+  os_mutexUnlock (&rbp->lock);
+}
+
 static struct nn_rbuf *nn_rbuf_new (struct nn_rbufpool *rbufpool)
 {
   struct nn_rbuf *rb;
@@ -2660,6 +2670,11 @@ void nn_dqueue_wait_until_empty_if_full (struct nn_dqueue *q)
   }
 }
 
+uint32_t nn_dqueue_depth (struct nn_dqueue *q)
+{
+  return os_atomic_ld32 (&q->nof_samples);
+}
+
 void nn_dqueue_free (struct nn_dqueue *q)
 {
   /* There must not be any thread enqueueing things anymore at this
@@ -47,9 +47,13 @@
 #include "ddsi/q_transmit.h"
 #include "ddsi/q_globals.h"
 #include "ddsi/q_static_assert.h"
+#include "ddsi/q_sampletrace.h"
+#include "ddsi/ddsi_uring.h"
 
 #include "ddsi/sysdeps.h"
 
+static const nn_vendorid_t ownvendorid = MY_VENDOR_ID;
+
 /*
 Notes:
 
@@ -721,6 +725,7 @@ static int handle_AckNack (struct receiver_state *rst, nn_etime_t tnow, const Ac
   struct whc_node *deferred_free_list = NULL;
   unsigned i;
   int hb_sent_in_response = 0;
+  uint32_t rexmit_budget, rexmit_bytes = 0;
   memset (gapbits, 0, sizeof (gapbits));
   countp = (nn_count_t *) ((char *) msg + offsetof (AckNack_t, readerSNState) +
                            NN_SEQUENCE_NUMBER_SET_SIZE (msg->readerSNState.numbits));
@@ -935,7 +940,17 @@ static int handle_AckNack (struct receiver_state *rst, nn_etime_t tnow, const Ac
      a future request'll fix it. */
   enqueued = 1;
   seq_xmit = READ_SEQ_XMIT(wr);
-  for (i = 0; i < numbits && seqbase + i <= seq_xmit && enqueued; i++)
+  /* Historical discovery data for a remote participant that is still
+     catching up is paced: at most a limited amount is sent in response
+     to each NACK, with the heartbeat sent below causing the reader to
+     request the next batch. When many participants start at the same
+     time, this spreads out the SEDP traffic instead of everyone sending
+     all at once and losing much of it. */
+  if (config.max_discovery_rexmit_burst > 0 && !rn->assumed_in_sync && is_builtin_entityid (wr->e.guid.entityid, ownvendorid))
+    rexmit_budget = config.max_discovery_rexmit_burst;
+  else
+    rexmit_budget = UINT32_MAX;
+  for (i = 0; i < numbits && seqbase + i <= seq_xmit && enqueued && rexmit_bytes < rexmit_budget; i++)
   {
     /* Accelerated schedule may run ahead of sequence number set
        contained in the acknack, and assumes all messages beyond the
@@ -980,6 +995,7 @@ static int handle_AckNack (struct receiver_state *rst, nn_etime_t tnow, const Ac
             max_seq_in_reply = seqbase + i;
             msgs_sent++;
             whcn->rexmit_count++;
+            rexmit_bytes += ddsi_serdata_size (whcn->serdata);
           }
         }
       }
@@ -1008,6 +1024,8 @@ static int handle_AckNack (struct receiver_state *rst, nn_etime_t tnow, const Ac
   }
   if (!enqueued)
     TRACE ((" rexmit-limit-hit"));
+  else if (rexmit_bytes >= rexmit_budget)
+    TRACE ((" rexmit-burst-limit-hit"));
   /* Generate a Gap message if some of the sequence is missing */
   if (gapstart > 0)
   {
@@ -2026,6 +2044,11 @@ static int deliver_user_data (const struct nn_rsample_info *sampleinfo, const st
   {
     goto no_payload;
   }
+  if (NN_SAMPLETRACE_SELECTED (pwr->e.guid, sampleinfo->seq))
+  {
+    payload->v.trace_id = nn_sampletrace_new_id (gv.sampletrace);
+    nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_DQUEUE, &pwr->e.guid, sampleinfo->seq, payload->v.trace_id);
+  }
 
 
   /* Generate the DDS_SampleInfo (which is faked to some extent
@@ -2059,7 +2082,7 @@ static int deliver_user_data (const struct nn_rsample_info *sampleinfo, const st
           (with late acknowledgement of sample and nack). */
 retry:
 
-        os_mutexLock (&pwr->rdary.rdary_lock);
+        os_rwlockRead (&pwr->rdary.rdary_lock);
         if (pwr->rdary.fastpath_ok)
         {
           struct reader ** const rdary = pwr->rdary.rdary;
@@ -2070,13 +2093,13 @@ retry:
             if (! (ddsi_plugin.rhc_store_fn) (rdary[i]->rhc, sampleinfo, payload, tk))
             {
               if (pwr_locked) os_mutexUnlock (&pwr->e.lock);
-              os_mutexUnlock (&pwr->rdary.rdary_lock);
+              os_rwlockUnlock (&pwr->rdary.rdary_lock);
               dds_sleepfor (DDS_MSECS (10));
               if (pwr_locked) os_mutexLock (&pwr->e.lock);
               goto retry;
             }
           }
-          os_mutexUnlock (&pwr->rdary.rdary_lock);
+          os_rwlockUnlock (&pwr->rdary.rdary_lock);
         }
         else
         {
@@ -2090,7 +2113,7 @@ retry:
              reliable samples that are rejected are simply discarded. */
           ut_avlIter_t it;
           struct pwr_rd_match *m;
-          os_mutexUnlock (&pwr->rdary.rdary_lock);
+          os_rwlockUnlock (&pwr->rdary.rdary_lock);
           if (!pwr_locked) os_mutexLock (&pwr->e.lock);
           for (m = ut_avlIterFirst (&pwr_readers_treedef, &pwr->readers, &it); m != NULL; m = ut_avlIterNext (&it))
           {
@@ -2226,8 +2249,17 @@ static void handle_regular (struct receiver_state *rst, nn_etime_t tnow, struct
     struct nn_rsample_chain sc;
     struct nn_rdata *fragchain = nn_rsample_fragchain (rsample);
     nn_reorder_result_t rres;
+    const int traced = NN_SAMPLETRACE_SELECTED (pwr->e.guid, sampleinfo->seq);
+
+    if (traced)
+    {
+      nn_sampletrace_record_at (gv.sampletrace, NN_SAMPLETRACE_RECVMSG, &pwr->e.guid, sampleinfo->seq, 0, sampleinfo->reception_timestamp);
+      nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_DEFRAG, &pwr->e.guid, sampleinfo->seq, 0);
+    }
 
     rres = nn_reorder_rsample (&sc, pwr->reorder, rsample, &refc_adjust, 0); // nn_dqueue_is_full (pwr->dqueue));
+    if (traced)
+      nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_REORDER, &pwr->e.guid, sampleinfo->seq, 0);
 
     if (rres == NN_REORDER_ACCEPT && pwr->n_reliable_readers == 0)
     {
@@ -3041,6 +3073,8 @@ static bool do_packet
 
   if (sz > 0 && !gv.deaf)
   {
+    NN_STAT_COUNTER_ADD (gv.net_stats.packets_received, 1);
+    NN_STAT_COUNTER_ADD (gv.net_stats.bytes_received, sz);
     nn_rmsg_setsize (rmsg, (uint32_t) sz);
     assert (vtime_asleep_p (self->vtime));
 
@@ -3225,6 +3259,37 @@ uint32_t listen_thread (struct ddsi_tran_listener * listener)
   return 0;
 }
 
+static void recv_thread_uring (struct thread_state1 *self, struct nn_rbufpool * rbpool)
+{
+  /* Only used for connectionless transports without per-participant
+     sockets, so the set of sockets is fixed */
+  struct ddsi_uring_waitset * const ws = gv.uring_waitset;
+  nn_mtime_t next_thread_cputime = { 0 };
+
+  ddsi_uring_waitset_add (ws, gv.disc_conn_uc);
+  ddsi_uring_waitset_add (ws, gv.data_conn_uc);
+  if (config.allowMulticast)
+  {
+    ddsi_uring_waitset_add (ws, gv.disc_conn_mc);
+    ddsi_uring_waitset_add (ws, gv.data_conn_mc);
+  }
+  if (gv.shm_conn)
+    ddsi_uring_waitset_add (ws, gv.shm_conn);
+  if (gv.unix_conn)
+    ddsi_uring_waitset_add (ws, gv.unix_conn);
+
+  while (gv.rtps_keepgoing)
+  {
+    LOG_THREAD_CPUTIME (next_thread_cputime);
+    if (ddsi_uring_waitset_wait (ws))
+    {
+      ddsi_tran_conn_t conn;
+      while (ddsi_uring_waitset_next_event (ws, &conn) >= 0)
+        (void) do_packet (self, conn, NULL, rbpool);
+    }
+  }
+}
+
 uint32_t recv_thread (struct nn_rbufpool * rbpool)
 {
   struct thread_state1 *self = lookup_thread_state ();
@@ -3234,8 +3299,14 @@ uint32_t recv_thread (struct nn_rbufpool * rbpool)
   os_sockWaitsetCtx ctx;
   unsigned i;
 
-  local_participant_set_init (&lps);
   nn_rbufpool_setowner (rbpool, os_threadIdSelf ());
+  if (gv.uring_waitset)
+  {
+    recv_thread_uring (self, rbpool);
+    return 0;
+  }
+
+  local_participant_set_init (&lps);
 
   if (gv.m_factory->m_connless)
   {
@@ -3248,6 +3319,16 @@ uint32_t recv_thread (struct nn_rbufpool * rbpool)
       os_sockWaitsetAdd (gv.waitset, gv.data_conn_mc);
       num_fixed += 2;
     }
+    if (gv.shm_conn)
+    {
+      os_sockWaitsetAdd (gv.waitset, gv.shm_conn);
+      num_fixed++;
+    }
+    if (gv.unix_conn)
+    {
+      os_sockWaitsetAdd (gv.waitset, gv.unix_conn);
+      num_fixed++;
+    }
   }
 
   while (gv.rtps_keepgoing)
@@ -0,0 +1,338 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "os/os.h"
+#include "os/os_atomics.h"
+
+#include "ddsi/q_log.h"
+#include "ddsi/q_time.h"
+#include "ddsi/q_thread.h"
+#include "ddsi/q_sampletrace.h"
+
+struct nn_sampletrace_event {
+  int64_t t;
+  nn_guid_t wrguid;           /* all 0 if identified by id only */
+  seqno_t seq;
+  uint32_t id;                /* 0 if identified by wrguid, seq only */
+  uint32_t stage;
+};
+
+struct nn_sampletrace_ring {
+  char *thread_name;          /* copy: the thread may be gone by the time the trace is written */
+  nn_wctime_t tmark;          /* start of serialization, 0 if none */
+  uint32_t n;                 /* number of events recorded, ev[n % size] is next */
+  struct nn_sampletrace_event ev[NN_SAMPLETRACE_RING_SIZE];
+};
+
+struct nn_sampletrace {
+  char *name;
+  os_atomic_uint32_t next_id;
+  unsigned nrings;
+  /* one ring per thread state slot, allocated and written only by the
+     thread occupying the slot */
+  struct nn_sampletrace_ring **rings;
+};
+
+static const char *stage_names[NN_SAMPLETRACE_NSTAGES] = {
+  "serialize", "whc_insert", "xpack_addmsg", "sendmsg", "recvmsg",
+  "defrag", "reorder", "dqueue", "rhc_store", "take"
+};
+
+struct nn_sampletrace *nn_sampletrace_new (const char *name, uint32_t interval)
+{
+  struct nn_sampletrace *st;
+  FILE *fp;
+  assert (interval > 0);
+  /* Better to find out that the file can't be written to now rather than
+     after running for a long time */
+  if ((fp = fopen (name, "w")) == NULL)
+  {
+    NN_WARNING ("sample trace: %s: cannot open for writing\n", name);
+    return NULL;
+  }
+  fclose (fp);
+  st = os_malloc (sizeof (*st));
+  st->name = os_strdup (name);
+  os_atomic_st32 (&st->next_id, 0);
+  st->nrings = thread_states.nthreads;
+  st->rings = os_malloc (st->nrings * sizeof (*st->rings));
+  memset (st->rings, 0, st->nrings * sizeof (*st->rings));
+  nn_log (LC_CONFIG, "sample trace: tracing 1 in %u samples to %s\n", interval, name);
+  return st;
+}
+
+static struct nn_sampletrace_ring *get_ring (struct nn_sampletrace *st)
+{
+  const struct thread_state1 *self = lookup_thread_state ();
+  const unsigned idx = (unsigned) (self - thread_states.ts);
+  const char *name = self->name ? self->name : "(anon)";
+  struct nn_sampletrace_ring *r;
+  assert (idx < st->nrings);
+  if ((r = st->rings[idx]) == NULL)
+  {
+    r = os_malloc (sizeof (*r));
+    r->thread_name = os_strdup (name);
+    r->tmark.v = 0;
+    r->n = 0;
+    st->rings[idx] = r;
+  }
+  else if (strcmp (r->thread_name, name) != 0)
+  {
+    /* the slot has been taken over by another thread since the ring was
+       created: the trace should show the current occupant, and a mark
+       left by the previous one must not be attributed to this one */
+    os_free (r->thread_name);
+    r->thread_name = os_strdup (name);
+    r->tmark.v = 0;
+  }
+  return r;
+}
+
+uint32_t nn_sampletrace_new_id (struct nn_sampletrace *st)
+{
+  uint32_t id;
+  while ((id = os_atomic_inc32_nv (&st->next_id)) == 0)
+    ;
+  return id;
+}
+
+void nn_sampletrace_mark (struct nn_sampletrace *st)
+{
+  get_ring (st)->tmark = now ();
+}
+
+static void record (struct nn_sampletrace_ring *r, enum nn_sampletrace_stage stage, const nn_guid_t *wrguid, seqno_t seq, uint32_t id, nn_wctime_t t)
+{
+  struct nn_sampletrace_event *ev = &r->ev[r->n++ % NN_SAMPLETRACE_RING_SIZE];
+  ev->t = t.v;
+  if (wrguid)
+  {
+    ev->wrguid = *wrguid;
+    ev->seq = seq;
+  }
+  else
+  {
+    memset (&ev->wrguid, 0, sizeof (ev->wrguid));
+    ev->seq = 0;
+  }
+  ev->id = id;
+  ev->stage = (uint32_t) stage;
+}
+
+void nn_sampletrace_record_at (struct nn_sampletrace *st, enum nn_sampletrace_stage stage, const nn_guid_t *wrguid, seqno_t seq, uint32_t id, nn_wctime_t t)
+{
+  record (get_ring (st), stage, wrguid, seq, id, t);
+}
+
+void nn_sampletrace_record (struct nn_sampletrace *st, enum nn_sampletrace_stage stage, const nn_guid_t *wrguid, seqno_t seq, uint32_t id)
+{
+  struct nn_sampletrace_ring * const r = get_ring (st);
+  if (stage != NN_SAMPLETRACE_SERIALIZE)
+    record (r, stage, wrguid, seq, id, now ());
+  else if (r->tmark.v != 0)
+  {
+    record (r, stage, wrguid, seq, id, r->tmark);
+    r->tmark.v = 0;
+  }
+}
+
+/* EXPORT -------------------------------------------------------------- */
+
+struct strace_event {
+  struct nn_sampletrace_event ev;
+  unsigned thread;
+};
+
+static int guid_known (const nn_guid_t *g)
+{
+  return g->prefix.u[0] != 0 || g->prefix.u[1] != 0 || g->prefix.u[2] != 0 || g->entityid.u != 0;
+}
+
+static int cmp_u32 (uint32_t a, uint32_t b)
+{
+  return (a == b) ? 0 : (a < b) ? -1 : 1;
+}
+
+static int cmp_by_id (const void *va, const void *vb)
+{
+  /* events with a known writer guid first within each id */
+  const struct strace_event *a = va, *b = vb;
+  int c;
+  if ((c = cmp_u32 (a->ev.id, b->ev.id)) != 0)
+    return c;
+  return guid_known (&b->ev.wrguid) - guid_known (&a->ev.wrguid);
+}
+
+static int cmp_by_sample (const void *va, const void *vb)
+{
+  const struct strace_event *a = va, *b = vb;
+  int c, i;
+  for (i = 0; i < 3; i++)
+    if ((c = cmp_u32 (a->ev.wrguid.prefix.u[i], b->ev.wrguid.prefix.u[i])) != 0)
+      return c;
+  if ((c = cmp_u32 (a->ev.wrguid.entityid.u, b->ev.wrguid.entityid.u)) != 0)
+    return c;
+  if (a->ev.seq != b->ev.seq)
+    return (a->ev.seq < b->ev.seq) ? -1 : 1;
+  if (a->ev.t != b->ev.t)
+    return (a->ev.t < b->ev.t) ? -1 : 1;
+  return cmp_u32 (a->ev.stage, b->ev.stage);
+}
+
+static size_t collect_events (const struct nn_sampletrace *st, struct strace_event **xs)
+{
+  size_t n = 0, i, j;
+  unsigned k;
+  for (k = 0; k < st->nrings; k++)
+    if (st->rings[k])
+      n += (st->rings[k]->n < NN_SAMPLETRACE_RING_SIZE) ? st->rings[k]->n : NN_SAMPLETRACE_RING_SIZE;
+  *xs = os_malloc ((n > 0 ? n : 1) * sizeof (**xs));
+  for (k = 0, i = 0; k < st->nrings; k++)
+  {
+    const struct nn_sampletrace_ring *r = st->rings[k];
+    uint32_t m, cnt;
+    if (r == NULL)
+      continue;
+    cnt = (r->n < NN_SAMPLETRACE_RING_SIZE) ? r->n : NN_SAMPLETRACE_RING_SIZE;
+    for (m = r->n - cnt; m != r->n; m++, i++)
+    {
+      (*xs)[i].ev = r->ev[m % NN_SAMPLETRACE_RING_SIZE];
+      (*xs)[i].thread = k;
+    }
+  }
+  assert (i == n);
+
+  /* Events identified only by id get the writer guid and sequence number
+     of an event with the same id that has both; those for which that
+     event was overwritten are dropped */
+  qsort (*xs, n, sizeof (**xs), cmp_by_id);
+  for (i = 0, j = 0; i < n; )
+  {
+    const uint32_t id = (*xs)[i].ev.id;
+    const int known = guid_known (&(*xs)[i].ev.wrguid);
+    const nn_guid_t g = (*xs)[i].ev.wrguid;
+    const seqno_t seq = (*xs)[i].ev.seq;
+    do {
+      if (id != 0 && known && !guid_known (&(*xs)[i].ev.wrguid))
+      {
+        (*xs)[i].ev.wrguid = g;
+        (*xs)[i].ev.seq = seq;
+      }
+      if (guid_known (&(*xs)[i].ev.wrguid))
+        (*xs)[j++] = (*xs)[i];
+      i++;
+    } while (i < n && id != 0 && (*xs)[i].ev.id == id);
+  }
+  qsort (*xs, j, sizeof (**xs), cmp_by_sample);
+  return j;
+}
+
+static void write_json_string (FILE *fp, const char *s)
+{
+  fputc ('"', fp);
+  for (; *s; s++)
+  {
+    if (*s == '"' || *s == '\\')
+      fprintf (fp, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20)
+      fprintf (fp, "\\u%04x", (unsigned) (unsigned char) *s);
+    else
+      fputc (*s, fp);
+  }
+  fputc ('"', fp);
+}
+
+static void write_ts (FILE *fp, int64_t t)
+{
+  /* Chrome traces are in microseconds */
+  fprintf (fp, "%"PRId64".%03d", t / 1000, (int) (t % 1000));
+}
+
+static void write_trace (const struct nn_sampletrace *st, FILE *fp, const struct strace_event *xs, size_t n)
+{
+  const int pid = (int) os_procIdSelf ();
+  const char *sep = "";
+  size_t i;
+  unsigned k;
+
+  fprintf (fp, "{\"traceEvents\":[");
+  for (k = 0; k < st->nrings; k++)
+  {
+    if (st->rings[k] == NULL || st->rings[k]->n == 0)
+      continue;
+    fprintf (fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", sep, pid, k);
+    write_json_string (fp, st->rings[k]->thread_name);
+    fprintf (fp, "}}");
+    sep = ",";
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    const struct nn_sampletrace_event *ev = &xs[i].ev;
+    char sid[64];
+    (void) snprintf (sid, sizeof (sid), "%x:%x:%x:%x#%"PRId64, PGUID (ev->wrguid), ev->seq);
+
+    /* an instant event on the thread that handled the stage ... */
+    fprintf (fp, "%s\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":", sep, stage_names[ev->stage], pid, xs[i].thread);
+    write_ts (fp, ev->t);
+    fprintf (fp, ",\"args\":{\"sample\":\"%s\"}}", sid);
+    sep = ",";
+
+    /* ... and a slice on the sample's own track covering the time until
+       the next stage, so the stage that takes the time stands out */
+    if (i + 1 < n && memcmp (&ev->wrguid, &xs[i+1].ev.wrguid, sizeof (ev->wrguid)) == 0 && ev->seq == xs[i+1].ev.seq)
+    {
+      const char *next = stage_names[xs[i+1].ev.stage];
+      fprintf (fp, ",\n{\"name\":\"%s -> %s\",\"cat\":\"sample\",\"ph\":\"b\",\"id\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":", stage_names[ev->stage], next, sid, pid, xs[i].thread);
+      write_ts (fp, ev->t);
+      fprintf (fp, "},\n{\"name\":\"%s -> %s\",\"cat\":\"sample\",\"ph\":\"e\",\"id\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":", stage_names[ev->stage], next, sid, pid, xs[i].thread);
+      write_ts (fp, xs[i+1].ev.t);
+      fprintf (fp, "}");
+    }
+  }
+  fprintf (fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+void nn_sampletrace_free (struct nn_sampletrace *st)
+{
+  struct strace_event *xs;
+  size_t n;
+  unsigned k;
+  FILE *fp;
+
+  n = collect_events (st, &xs);
+  if ((fp = fopen (st->name, "w")) == NULL)
+    NN_WARNING ("sample trace: %s: cannot open for writing\n", st->name);
+  else
+  {
+    write_trace (st, fp, xs, n);
+    fclose (fp);
+    nn_log (LC_INFO, "sample trace: wrote %lu events to %s\n", (unsigned long) n, st->name);
+  }
+  os_free (xs);
+
+  for (k = 0; k < st->nrings; k++)
+  {
+    if (st->rings[k])
+    {
+      os_free (st->rings[k]->thread_name);
+      os_free (st->rings[k]);
+    }
+  }
+  os_free (st->rings);
+  os_free (st->name);
+  os_free (st);
+}
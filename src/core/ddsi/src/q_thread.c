@@ -150,7 +150,8 @@ struct thread_state1 *lookup_thread_state_real (void)
     os_threadId tid = os_threadIdSelf ();
     unsigned i;
     for (i = 0; i < thread_states.nthreads; i++) {
-      if (os_threadEqual (thread_states.ts[i].tid, tid)) {
+      /* thread ids get reused, slots of threads that have gone are not theirs */
+      if (thread_states.ts[i].state == THREAD_STATE_ALIVE && os_threadEqual (thread_states.ts[i].tid, tid)) {
         return &thread_states.ts[i];
       }
     }
@@ -195,13 +196,25 @@ void upgrade_main_thread (void)
   int cand;
   struct thread_state1 *ts1;
   os_mutexLock (&thread_states.lock);
-  if ((cand = find_free_slot ("name")) < 0)
-    abort ();
-  ts1 = &thread_states.ts[cand];
-  if (ts1->state == THREAD_STATE_ZERO)
-    assert (vtime_asleep_p (ts1->vtime));
-  ts1->state = THREAD_STATE_ALIVE;
-  ts1->tid = os_threadIdSelf ();
+  if ((ts1 = lookup_thread_state_real ()) != NULL)
+  {
+    /* registered as an application thread because it logged something
+       (e.g., the configuration) before; taking another slot would leave
+       this one alive forever */
+    assert (ts1->lb == NULL);
+    if (ts1->name != main_thread_name)
+      os_free (ts1->name);
+  }
+  else
+  {
+    if ((cand = find_free_slot ("name")) < 0)
+      abort ();
+    ts1 = &thread_states.ts[cand];
+    if (ts1->state == THREAD_STATE_ZERO)
+      assert (vtime_asleep_p (ts1->vtime));
+    ts1->state = THREAD_STATE_ALIVE;
+    ts1->tid = os_threadIdSelf ();
+  }
   ts1->lb = logbuf_new ();
   ts1->name = main_thread_name;
   os_mutexUnlock (&thread_states.lock);
@@ -334,7 +347,7 @@ struct thread_state1 *get_thread_state (_In_ os_threadId id)
 
   for (i = 0; i < thread_states.nthreads; i++)
   {
-    if (os_threadEqual (thread_states.ts[i].extTid, id))
+    if (thread_states.ts[i].state == THREAD_STATE_ALIVE && os_threadEqual (thread_states.ts[i].extTid, id))
     {
       ts = &thread_states.ts[i];
       break;
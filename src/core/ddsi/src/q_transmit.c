@@ -32,6 +32,7 @@
 #include "ddsi/q_unused.h"
 #include "ddsi/q_hbcontrol.h"
 #include "ddsi/q_static_assert.h"
+#include "ddsi/q_sampletrace.h"
 
 #include "ddsi/ddsi_ser.h"
 
@@ -700,6 +701,8 @@ static void transmit_sample_lgmsg_unlocked (struct nn_xpack *xp, struct writer *
     os_mutexUnlock (&wr->e.lock);
 
     if(fmsg) nn_xpack_addmsg (xp, fmsg, 0);
+    if(fmsg && isnew && i + 1 == nfrags && serdata->v.trace_id)
+      nn_xpack_note_traced (xp, &wr->e.guid, seq, serdata->v.trace_id);
     if(hmsg) nn_xpack_addmsg (xp, hmsg, 0);
 
 #if MULTIPLE_FRAGS_IN_SUBMSG /* ugly hack for testing only */
@@ -760,6 +763,8 @@ static void transmit_sample_unlocks_wr (struct nn_xpack *xp, struct writer *wr,
 
     os_mutexUnlock (&wr->e.lock);
     nn_xpack_addmsg (xp, fmsg, 0);
+    if (serdata->v.trace_id)
+      nn_xpack_note_traced (xp, &wr->e.guid, seq, serdata->v.trace_id);
     if(hmsg)
       nn_xpack_addmsg (xp, hmsg, 0);
     if (hbansreq >= 2)
@@ -914,6 +919,7 @@ static os_result throttle_writer (struct nn_xpack *xp, struct writer *wr)
 
   os_result result = os_resultSuccess;
   nn_mtime_t tnow = now_mt ();
+  const nn_mtime_t tstart = tnow;
   const nn_mtime_t abstimeout = add_duration_to_mtime (tnow, nn_from_ddsi_duration (wr->xqos->reliability.max_blocking_time));
   size_t n_unacked = whc_unacked_bytes (wr->whc);
 
@@ -966,6 +972,7 @@ static os_result throttle_writer (struct nn_xpack *xp, struct writer *wr)
   }
 
   wr->throttling = 0;
+  wr->throttle_time += now_mt ().v - tstart.v;
   if (wr->state != WRST_OPERATIONAL)
   {
     /* gc_delete_writer may be waiting */
@@ -1057,6 +1064,7 @@ static int write_sample_eot (struct nn_xpack *xp, struct writer *wr, struct nn_p
   ddsi_serdata_set_twrite (serdata, tnow);
 
   seq = ++wr->seq;
+  wr->num_bytes_written += ddsi_serdata_size (serdata);
   if (wr->cs_seq != 0)
   {
     if (plist == NULL)
@@ -1069,7 +1077,14 @@ static int write_sample_eot (struct nn_xpack *xp, struct writer *wr, struct nn_p
     plist->coherent_set_seqno = toSN (wr->cs_seq);
   }
 
-  if ((r = insert_sample_in_whc (wr, seq, plist, serdata, tk)) < 0)
+  if ((r = insert_sample_in_whc (wr, seq, plist, serdata, tk)) >= 0 && NN_SAMPLETRACE_SELECTED (wr->e.guid, seq))
+  {
+    serdata->v.trace_id = nn_sampletrace_new_id (gv.sampletrace);
+    nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_SERIALIZE, &wr->e.guid, seq, serdata->v.trace_id);
+    nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_WHC_INSERT, &wr->e.guid, seq, serdata->v.trace_id);
+  }
+
+  if (r < 0)
   {
     /* Failure of some kind */
     os_mutexUnlock (&wr->e.lock);
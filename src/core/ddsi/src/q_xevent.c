@@ -15,7 +15,7 @@
 #include "os/os.h"
 
 #include "util/ut_avl.h"
-#include "util/ut_fibheap.h"
+#include "util/ut_timerwheel.h"
 
 #include "ddsi/q_time.h"
 #include "ddsi/q_log.h"
@@ -67,7 +67,7 @@ enum xeventkind
 
 struct xevent
 {
-  ut_fibheapNode_t heapnode;
+  ut_timerwheelNode_t heapnode;
   struct xeventq *evq;
   nn_mtime_t tsched;
   enum xeventkind kind;
@@ -140,7 +140,8 @@ struct xevent_nt
 };
 
 struct xeventq {
-  ut_fibheap_t xevents;
+  struct xeventq *rexmit_evq; /* constant; retransmits go here if non-NULL */
+  ut_timerwheel_t xevents;
   ut_avlTree_t msg_xevents;
   struct xevent_nt *non_timed_xmit_list_oldest;
   struct xevent_nt *non_timed_xmit_list_newest; /* undefined if ..._oldest == NULL */
@@ -159,18 +160,11 @@ struct xeventq {
 static uint32_t xevent_thread (struct xeventq *xevq);
 static nn_mtime_t earliest_in_xeventq (struct xeventq *evq);
 static int msg_xevents_cmp (const void *a, const void *b);
-static int compare_xevent_tsched (const void *va, const void *vb);
 
 static const ut_avlTreedef_t msg_xevents_treedef = UT_AVL_TREEDEF_INITIALIZER_INDKEY (offsetof (struct xevent_nt, u.msg_rexmit.msg_avlnode), offsetof (struct xevent_nt, u.msg_rexmit.msg), msg_xevents_cmp, 0);
 
-static const ut_fibheapDef_t evq_xevents_fhdef = UT_FIBHEAPDEF_INITIALIZER(offsetof (struct xevent, heapnode), compare_xevent_tsched);
-
-static int compare_xevent_tsched (const void *va, const void *vb)
-{
-  const struct xevent *a = va;
-  const struct xevent *b = vb;
-  return (a->tsched.v == b->tsched.v) ? 0 : (a->tsched.v < b->tsched.v) ? -1 : 1;
-}
+/* ~1ms ticks: events due within the same tick are handled in one go */
+static const ut_timerwheelDef_t evq_xevents_twdef = UT_TIMERWHEELDEF_INITIALIZER(offsetof (struct xevent, heapnode), 20);
 
 static void update_rexmit_counts (struct xeventq *evq, struct xevent_nt *ev)
 {
@@ -348,12 +342,12 @@ void delete_xevent (struct xevent *ev)
   if (ev->tsched.v != T_NEVER)
   {
     ev->tsched.v = TSCHED_DELETE;
-    ut_fibheapDecreaseKey (&evq_xevents_fhdef, &evq->xevents, ev);
+    ut_timerwheelReschedule (&evq_xevents_twdef, &evq->xevents, ev, ev->tsched.v);
   }
   else
   {
     ev->tsched.v = TSCHED_DELETE;
-    ut_fibheapInsert (&evq_xevents_fhdef, &evq->xevents, ev);
+    ut_timerwheelInsert (&evq_xevents_twdef, &evq->xevents, ev, ev->tsched.v);
   }
   /* TSCHED_DELETE is absolute minimum time, so chances are we need to
      wake up the thread.  The superfluous signal is harmless. */
@@ -381,12 +375,12 @@ int resched_xevent_if_earlier (struct xevent *ev, nn_mtime_t tsched)
     if (ev->tsched.v != T_NEVER)
     {
       ev->tsched = tsched;
-      ut_fibheapDecreaseKey (&evq_xevents_fhdef, &evq->xevents, ev);
+      ut_timerwheelReschedule (&evq_xevents_twdef, &evq->xevents, ev, ev->tsched.v);
     }
     else
     {
       ev->tsched = tsched;
-      ut_fibheapInsert (&evq_xevents_fhdef, &evq->xevents, ev);
+      ut_timerwheelInsert (&evq_xevents_twdef, &evq->xevents, ev, ev->tsched.v);
     }
     is_resched = 1;
     if (tsched.v < tbefore.v)
@@ -430,15 +424,12 @@ static struct xevent_nt *qxev_common_nt (struct xeventq *evq, enum xeventkind_nt
 
 static nn_mtime_t earliest_in_xeventq (struct xeventq *evq)
 {
-  struct xevent *min;
+  /* May be earlier than the first event (but never later), which at
+     worst causes a spurious wakeup of the event thread */
+  nn_mtime_t r;
   ASSERT_MUTEX_HELD (&evq->lock);
-  if ((min = ut_fibheapMin (&evq_xevents_fhdef, &evq->xevents)) != NULL)
-    return min->tsched;
-  else
-  {
-    nn_mtime_t r = { T_NEVER };
-    return r;
-  }
+  r.v = ut_timerwheelEarliest (&evq_xevents_twdef, &evq->xevents);
+  return r;
 }
 
 static void qxev_insert (struct xevent *ev)
@@ -450,7 +441,7 @@ static void qxev_insert (struct xevent *ev)
   if (ev->tsched.v != T_NEVER)
   {
     nn_mtime_t tbefore = earliest_in_xeventq (evq);
-    ut_fibheapInsert (&evq_xevents_fhdef, &evq->xevents, ev);
+    ut_timerwheelInsert (&evq_xevents_twdef, &evq->xevents, ev, ev->tsched.v);
     if (ev->tsched.v < tbefore.v)
       os_condSignal (&evq->cond);
   }
@@ -482,7 +473,8 @@ struct xeventq * xeventq_new
   /* limit to 2GB to prevent overflow (4GB - 64kB should be ok, too) */
   if (max_queued_rexmit_bytes > 2147483648u)
     max_queued_rexmit_bytes = 2147483648u;
-  ut_fibheapInit (&evq_xevents_fhdef, &evq->xevents);
+  evq->rexmit_evq = NULL;
+  ut_timerwheelInit (&evq_xevents_twdef, &evq->xevents);
   ut_avlInit (&msg_xevents_treedef, &evq->msg_xevents);
   evq->non_timed_xmit_list_oldest = NULL;
   evq->non_timed_xmit_list_newest = NULL;
@@ -521,6 +513,21 @@ int xeventq_start (struct xeventq *evq, const char *name)
   return (evq->ts == NULL) ? ERR_UNSPECIFIED : 0;
 }
 
+void xeventq_divert_rexmits (struct xeventq *evq, struct xeventq *rexmit_evq)
+{
+  assert (evq->ts == NULL);
+  assert (rexmit_evq != evq && rexmit_evq->rexmit_evq == NULL);
+  evq->rexmit_evq = rexmit_evq;
+}
+
+void xeventq_queued_rexmits (struct xeventq *evq, size_t *msgs, size_t *bytes)
+{
+  os_mutexLock (&evq->lock);
+  *msgs = evq->queued_rexmit_msgs;
+  *bytes = evq->queued_rexmit_bytes;
+  os_mutexUnlock (&evq->lock);
+}
+
 void xeventq_stop (struct xeventq *evq)
 {
   assert (evq->ts != NULL);
@@ -536,7 +543,7 @@ void xeventq_free (struct xeventq *evq)
 {
   struct xevent *ev;
   assert (evq->ts == NULL);
-  while ((ev = ut_fibheapExtractMin (&evq_xevents_fhdef, &evq->xevents)) != NULL)
+  while ((ev = ut_timerwheelExtractExpired (&evq_xevents_twdef, &evq->xevents, T_NEVER)) != NULL)
   {
     if (ev->tsched.v == TSCHED_DELETE || ev->kind != XEVK_CALLBACK)
       free_xevent (evq, ev);
@@ -1295,9 +1302,9 @@ static void handle_xevents (struct thread_state1 *self, struct xeventq *xevq, st
 
   while (xeventsToProcess)
   {
-    while (earliest_in_xeventq(xevq).v <= tnow.v)
+    struct xevent *xev;
+    while ((xev = ut_timerwheelExtractExpired (&evq_xevents_twdef, &xevq->xevents, tnow.v)) != NULL)
     {
-      struct xevent *xev = ut_fibheapExtractMin (&evq_xevents_fhdef, &xevq->xevents);
       if (xev->tsched.v == TSCHED_DELETE)
       {
         free_xevent (xevq, xev);
@@ -1319,8 +1326,8 @@ static void handle_xevents (struct thread_state1 *self, struct xeventq *xevq, st
 
     if (!non_timed_xmit_list_is_empty (xevq))
     {
-      struct xevent_nt *xev = getnext_from_non_timed_xmit_list (xevq);
-      handle_nontimed_xevent (self, xev, xp);
+      struct xevent_nt *xev_nt = getnext_from_non_timed_xmit_list (xevq);
+      handle_nontimed_xevent (self, xev_nt, xp);
       tnow = now_mt ();
     }
     else
@@ -1466,6 +1473,8 @@ int qxev_msg_rexmit_wrlock_held (struct xeventq *evq, struct nn_xmsg *msg, int f
 
   assert (evq);
   assert (nn_xmsg_kind (msg) == NN_XMSG_KIND_DATA_REXMIT);
+  if (evq->rexmit_evq)
+    evq = evq->rexmit_evq;
   os_mutexLock (&evq->lock);
   if ((ev = lookup_msg (evq, msg)) != NULL && nn_xmsg_merge_rexmit_destinations_wrlock_held (ev->u.msg_rexmit.msg, msg))
   {
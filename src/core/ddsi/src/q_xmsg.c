@@ -41,6 +41,8 @@
 #include "ddsi/q_globals.h"
 #include "ddsi/q_ephash.h"
 #include "ddsi/q_freelist.h"
+#include "ddsi/q_sampletrace.h"
+#include "ddsi/ddsi_unix.h"
 #include "q__osplser.h"
 
 #include "ddsi/sysdeps.h"
@@ -184,6 +186,8 @@ static os_result os_sem_wait (os_sem_t *sem)
 }
 ///////////////////////////
 
+#define NN_XPACK_MAX_TRACED 8
+
 struct nn_xpack
 {
   struct nn_xpack *sendq_next;
@@ -214,6 +218,14 @@ struct nn_xpack
 
   struct nn_xmsg_chain included_msgs;
 
+  /* traced samples in the packet, for recording the time it is sent */
+  unsigned ntraced;
+  struct {
+    nn_guid_t wrguid;
+    seqno_t seq;
+    uint32_t id;
+  } traced[NN_XPACK_MAX_TRACED];
+
 #ifdef DDSI_INCLUDE_BANDWIDTH_LIMITING
   struct nn_bw_limiter limiter;
 #endif
@@ -1224,6 +1236,7 @@ static void nn_xpack_reinit (struct nn_xpack *xp)
   xp->call_flags = 0;
   xp->msg_len.length = 0;
   xp->included_msgs.latest = NULL;
+  xp->ntraced = 0;
   xp->maxdelay = T_NEVER;
 #ifdef DDSI_INCLUDE_NETWORK_PARTITIONS
   xp->encoderId = 0;
@@ -1302,6 +1315,9 @@ static socklen_t sockaddr_size (const os_sockaddr_storage *a)
     case AF_INET: return sizeof (os_sockaddr_in);
 #if OS_SOCKET_HAS_IPV6
     case AF_INET6: return sizeof (os_sockaddr_in6);
+#endif
+#if OS_SOCKET_HAS_AF_UNIX
+    case AF_UNIX: return ddsi_unix_sockaddr_size (a);
 #endif
     default: assert (0); return 0;
   }
@@ -1324,6 +1340,20 @@ static ssize_t nn_xpack_send1 (const nn_locator_t *loc, void * varg)
   struct msghdr mhdr;
   ssize_t nbytes = 0;
   os_sockaddr_storage addr;
+  ddsi_tran_conn_t conn = xp->conn;
+
+  /* Peers on this host may be reached via shared memory or a Unix domain
+     socket instead */
+  if (loc->kind == NN_LOCATOR_KIND_SHM)
+  {
+    assert (gv.shm_conn != NULL);
+    conn = gv.shm_conn;
+  }
+  else if (loc->kind == NN_LOCATOR_KIND_UNIX)
+  {
+    assert (gv.unix_conn != NULL);
+    conn = gv.unix_conn;
+  }
 
   nn_loc_to_address(&addr, loc);
   if (config.enabled_logcats & LC_TRACE)
@@ -1355,13 +1385,14 @@ static ssize_t nn_xpack_send1 (const nn_locator_t *loc, void * varg)
 #ifdef DDSI_INCLUDE_ENCRYPTION
   if (q_security_plugin.send_encoded && xp->encoderId != 0 && (q_security_plugin.encoder_type) (xp->codec, xp->encoderId) != Q_CIPHER_NONE)
   {
-    nbytes = (q_security_plugin.send_encoded) (xp->conn, &mhdr, &xp->codec, xp->encoderId, xp->call_flags);
+    /* encoded data lives only for the duration of the call */
+    nbytes = (q_security_plugin.send_encoded) (conn, &mhdr, &xp->codec, xp->encoderId, xp->call_flags & ~DDSI_TRAN_MORE);
   }
   else
 #endif
   {
     if (!gv.mute)
-      nbytes = ddsi_conn_write (xp->conn, &mhdr, xp->msg_len.length, xp->call_flags);
+      nbytes = ddsi_conn_write (conn, &mhdr, xp->msg_len.length, xp->call_flags);
     else
     {
       TRACE (("(dropped)"));
@@ -1373,6 +1404,12 @@ static ssize_t nn_xpack_send1 (const nn_locator_t *loc, void * varg)
 
   xp->call_flags = 0;
 
+  if (nbytes > 0)
+  {
+    NN_STAT_COUNTER_ADD (gv.net_stats.packets_sent, 1);
+    NN_STAT_COUNTER_ADD (gv.net_stats.bytes_sent, nbytes);
+  }
+
 #ifdef DDSI_INCLUDE_BANDWIDTH_LIMITING
   if (nbytes > 0)
   {
@@ -1383,9 +1420,13 @@ static ssize_t nn_xpack_send1 (const nn_locator_t *loc, void * varg)
   return nbytes;
 }
 
-static void nn_xpack_send1v (const nn_locator_t *loc, void * varg)
+static void nn_xpack_send1v_more (const nn_locator_t *loc, void * varg)
 {
-  (void) nn_xpack_send1 (loc, varg);
+  /* the transport may defer the write until ddsi_conn_flush, the data
+     remains valid until then */
+  struct nn_xpack *xp = varg;
+  xp->call_flags |= DDSI_TRAN_MORE;
+  (void) nn_xpack_send1 (loc, xp);
 }
 
 typedef struct nn_xpack_send1_thread_arg {
@@ -1452,7 +1493,8 @@ static void nn_xpack_send_real (struct nn_xpack * xp)
     {
       if (gv.thread_pool == NULL)
       {
-        calls = addrset_forall_count (xp->dstaddr.all.as, nn_xpack_send1v, xp);
+        calls = addrset_forall_count (xp->dstaddr.all.as, nn_xpack_send1v_more, xp);
+        ddsi_conn_flush (xp->conn);
       }
       else
       {
@@ -1484,6 +1526,12 @@ static void nn_xpack_send_real (struct nn_xpack * xp)
   {
     nn_log (LC_TRAFFIC, "traffic-xmit (%lu) %u\n", (unsigned long) calls, xp->msg_len.length);
   }
+  if (xp->ntraced > 0 && gv.sampletrace)
+  {
+    unsigned i;
+    for (i = 0; i < xp->ntraced; i++)
+      nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_SENDMSG, &xp->traced[i].wrguid, xp->traced[i].seq, xp->traced[i].id);
+  }
   nn_xmsg_chain_release (&xp->included_msgs);
   nn_xpack_reinit (xp);
 }
@@ -1880,3 +1928,18 @@ unsigned nn_xpack_packetid (const struct nn_xpack *xp)
 {
   return xp->packetid;
 }
+
+void nn_xpack_note_traced (struct nn_xpack *xp, const nn_guid_t *wrguid, seqno_t seq, uint32_t trace_id)
+{
+  /* Called after adding the (last fragment of) traced sample to xp; if
+     there are too many traced samples in the packet, the sending of the
+     excess ones simply doesn't get recorded */
+  nn_sampletrace_record (gv.sampletrace, NN_SAMPLETRACE_XPACK_ADD, wrguid, seq, trace_id);
+  if (xp->ntraced < NN_XPACK_MAX_TRACED)
+  {
+    xp->traced[xp->ntraced].wrguid = *wrguid;
+    xp->traced[xp->ntraced].seq = seq;
+    xp->traced[xp->ntraced].id = trace_id;
+    xp->ntraced++;
+  }
+}
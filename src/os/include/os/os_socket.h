@@ -30,6 +30,9 @@
 #ifndef OS_SOCKET_HAS_SSM
 #error "OS_SOCKET_HAS_SSM should have been defined by os_platform_socket.h"
 #endif
+#ifndef OS_SOCKET_HAS_AF_UNIX
+#error "OS_SOCKET_HAS_AF_UNIX should have been defined by os_platform_socket.h"
+#endif
 
 #if defined (__cplusplus)
 extern "C" {
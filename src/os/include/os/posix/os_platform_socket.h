@@ -33,6 +33,10 @@
 
 #include <ifaddrs.h>
 
+#ifndef __VXWORKS__
+#include <sys/un.h>
+#endif
+
 #if defined (__cplusplus)
 extern "C" {
 #endif
@@ -44,6 +48,11 @@ extern "C" {
 #define OS_NO_SIOCGIFINDEX      1
 #define OS_NO_NETLINK           1
 #define OS_SOCKET_HAS_SSM       1
+#ifdef __VXWORKS__
+#define OS_SOCKET_HAS_AF_UNIX   0
+#else
+#define OS_SOCKET_HAS_AF_UNIX   1
+#endif
 
 #define os_sockEAGAIN       EAGAIN      /* Operation would block, or a timeout expired before operation succeeded */
 #define os_sockEWOULDBLOCK  EWOULDBLOCK /* Operation would block */
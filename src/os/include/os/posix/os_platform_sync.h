@@ -43,7 +43,7 @@ extern "C" {
     } os_mutex;
 
     typedef struct os_rwlock {
-        os_mutex mutex;
+        pthread_rwlock_t rwlock;
     } os_rwlock;
 
     typedef pthread_once_t os_once_t;
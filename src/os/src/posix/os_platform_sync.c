@@ -319,38 +319,65 @@ void os_condBroadcast (os_cond *cond)
 
 void os_rwlockInit (os_rwlock *rwlock)
 {
-  os_mutexInit (&rwlock->mutex);
+  pthread_rwlockattr_t attr;
+  assert (rwlock != NULL);
+  pthread_rwlockattr_init (&attr);
+#if defined __GLIBC__
+  /* glibc prefers readers by default, which lets a steady stream of readers
+     starve a writer indefinitely */
+  pthread_rwlockattr_setkind_np (&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  if (pthread_rwlock_init (&rwlock->rwlock, &attr) != 0)
+    abort();
+  pthread_rwlockattr_destroy (&attr);
 }
 
 void os_rwlockDestroy (os_rwlock *rwlock)
 {
   assert (rwlock != NULL);
-  os_mutexDestroy (&rwlock->mutex);
+  if (pthread_rwlock_destroy (&rwlock->rwlock) != 0)
+    abort();
 }
 
 void os_rwlockRead (os_rwlock *rwlock)
 {
-  os_mutexLock (&rwlock->mutex);
+  assert (rwlock != NULL);
+  if (pthread_rwlock_rdlock (&rwlock->rwlock) != 0)
+    abort();
 }
 
 void os_rwlockWrite (os_rwlock *rwlock)
 {
-  os_mutexLock (&rwlock->mutex);
+  assert (rwlock != NULL);
+  if (pthread_rwlock_wrlock (&rwlock->rwlock) != 0)
+    abort();
 }
 
 os_result os_rwlockTryRead (os_rwlock *rwlock)
 {
-  return os_mutexTryLock (&rwlock->mutex);
+  int result;
+  assert (rwlock != NULL);
+  result = pthread_rwlock_tryrdlock (&rwlock->rwlock);
+  if (result != 0 && result != EBUSY)
+    abort();
+  return (result == 0) ? os_resultSuccess : os_resultBusy;
 }
 
 os_result os_rwlockTryWrite (os_rwlock *rwlock)
 {
-  return os_mutexTryLock (&rwlock->mutex);
+  int result;
+  assert (rwlock != NULL);
+  result = pthread_rwlock_trywrlock (&rwlock->rwlock);
+  if (result != 0 && result != EBUSY)
+    abort();
+  return (result == 0) ? os_resultSuccess : os_resultBusy;
 }
 
 void os_rwlockUnlock (os_rwlock *rwlock)
 {
-  os_mutexUnlock (&rwlock->mutex);
+  assert (rwlock != NULL);
+  if (pthread_rwlock_unlock (&rwlock->rwlock) != 0)
+    abort();
 }
 
 void
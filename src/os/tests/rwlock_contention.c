@@ -0,0 +1,207 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include "CUnit/Runner.h"
+#include "os/os.h"
+
+#define CONTENTION_THREADS  (8)
+#define CONTENTION_DATA     (64)
+
+typedef struct {
+    os_rwlock rwlock;
+    uint32_t data[CONTENTION_DATA];
+    os_atomic_uint32_t holders;
+    os_atomic_uint32_t stop;
+} contention_data;
+
+typedef struct {
+    contention_data *cd;
+    uint64_t count;
+    int result;
+} contention_par;
+
+static contention_data cd;
+
+static double
+elapsed(os_time start)
+{
+    return os_timeToReal(os_timeSub(os_timeGetMonotonic(), start));
+}
+
+static void
+run_threads(
+    uint32_t (*fn)(void *),
+    contention_par *par,
+    int nthreads)
+{
+    os_threadId tid[CONTENTION_THREADS];
+    os_threadAttr attr;
+    os_result res;
+    int i;
+
+    os_threadAttrInit(&attr);
+    for (i = 0; i < nthreads; i++) {
+        par[i].cd = &cd;
+        par[i].count = 0;
+        par[i].result = 0;
+        res = os_threadCreate(&tid[i], "rwlock_contention", &attr, fn, &par[i]);
+        CU_ASSERT_FATAL(res == os_resultSuccess);
+    }
+    for (i = 0; i < nthreads; i++) {
+        res = os_threadWaitExit(tid[i], NULL);
+        CU_ASSERT(res == os_resultSuccess);
+    }
+}
+
+/* All readers hold the lock at the same time: each waits with the lock held
+ * until it has seen all others do the same. */
+static uint32_t
+shared_reader_thread(void *arg)
+{
+    contention_par *par = arg;
+    const os_time start = os_timeGetMonotonic();
+    const os_time delay = { 0, 1000000 };
+
+    os_rwlockRead(&par->cd->rwlock);
+    os_atomic_inc32(&par->cd->holders);
+    while (os_atomic_ld32(&par->cd->holders) < CONTENTION_THREADS && elapsed(start) < 10.0) {
+        os_nanoSleep(delay);
+    }
+    par->result = (os_atomic_ld32(&par->cd->holders) == CONTENTION_THREADS);
+    os_rwlockUnlock(&par->cd->rwlock);
+    return 0;
+}
+
+/* Readers looping over a small critical section until told to stop. */
+static uint32_t
+looping_reader_thread(void *arg)
+{
+    contention_par *par = arg;
+    uint32_t sum = 0;
+    int i;
+
+    while (!os_atomic_ld32(&par->cd->stop)) {
+        os_rwlockRead(&par->cd->rwlock);
+        for (i = 0; i < CONTENTION_DATA; i++) {
+            sum += par->cd->data[i];
+        }
+        os_rwlockUnlock(&par->cd->rwlock);
+        par->count++;
+    }
+    /* Keeps the reads in the critical section from being optimised away. */
+    par->result = (int)sum;
+    return 0;
+}
+
+static uint64_t
+measure_readers(contention_par *par, int nthreads, double duration)
+{
+    os_time delay;
+    os_threadId tid[CONTENTION_THREADS];
+    os_threadAttr attr;
+    uint64_t total = 0;
+    int i;
+
+    delay = os_realToTime(duration);
+    os_atomic_st32(&cd.stop, 0);
+    os_threadAttrInit(&attr);
+    for (i = 0; i < nthreads; i++) {
+        par[i].cd = &cd;
+        par[i].count = 0;
+        CU_ASSERT_FATAL(os_threadCreate(&tid[i], "rwlock_reader", &attr, looping_reader_thread, &par[i]) == os_resultSuccess);
+    }
+    os_nanoSleep(delay);
+    os_atomic_st32(&cd.stop, 1);
+    for (i = 0; i < nthreads; i++) {
+        CU_ASSERT(os_threadWaitExit(tid[i], NULL) == os_resultSuccess);
+        total += par[i].count;
+    }
+    return total;
+}
+
+CUnit_Suite_Initialize(os_rwlock_contention)
+{
+    os_osInit();
+    memset(&cd, 0, sizeof(cd));
+    os_rwlockInit(&cd.rwlock);
+    return 0;
+}
+
+CUnit_Suite_Cleanup(os_rwlock_contention)
+{
+    os_rwlockDestroy(&cd.rwlock);
+    os_osExit();
+    return 0;
+}
+
+CUnit_Test(os_rwlock_contention, shared)
+{
+    contention_par par[CONTENTION_THREADS];
+    int i;
+
+    os_atomic_st32(&cd.holders, 0);
+    run_threads(shared_reader_thread, par, CONTENTION_THREADS);
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        CU_ASSERT(par[i].result);
+    }
+}
+
+CUnit_Test(os_rwlock_contention, writer_not_starved)
+{
+    contention_par par[CONTENTION_THREADS];
+    os_threadId tid[CONTENTION_THREADS];
+    os_threadAttr attr;
+    const os_time settle = { 0, 50000000 };
+    os_time start;
+    double wait;
+    int i;
+
+    /* A writer must get the lock while readers continuously hold it. */
+    os_atomic_st32(&cd.stop, 0);
+    os_threadAttrInit(&attr);
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        par[i].cd = &cd;
+        par[i].count = 0;
+        CU_ASSERT_FATAL(os_threadCreate(&tid[i], "rwlock_reader", &attr, looping_reader_thread, &par[i]) == os_resultSuccess);
+    }
+    os_nanoSleep(settle);
+    start = os_timeGetMonotonic();
+    for (i = 0; i < 100; i++) {
+        os_rwlockWrite(&cd.rwlock);
+        cd.data[i % CONTENTION_DATA]++;
+        os_rwlockUnlock(&cd.rwlock);
+    }
+    wait = elapsed(start);
+    os_atomic_st32(&cd.stop, 1);
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        CU_ASSERT(os_threadWaitExit(tid[i], NULL) == os_resultSuccess);
+    }
+    printf("100 write locks with %d busy readers took %.3fs\n", CONTENTION_THREADS, wait);
+    CU_ASSERT(wait < 5.0);
+}
+
+CUnit_Test(os_rwlock_contention, reader_scaling)
+{
+    contention_par par[CONTENTION_THREADS];
+    uint64_t single, multi;
+    int n;
+
+    /* Reports read lock throughput for increasing numbers of readers. The
+     * numbers depend on the machine, only a total collapse is an error. */
+    single = measure_readers(par, 1, 0.2);
+    printf("read locks/s with 1 reader: %.0f\n", (double)single / 0.2);
+    for (n = 2, multi = single; n <= CONTENTION_THREADS; n *= 2) {
+        multi = measure_readers(par, n, 0.2);
+        printf("read locks/s with %d readers: %.0f\n", n, (double)multi / 0.2);
+    }
+    CU_ASSERT(single > 0);
+    CU_ASSERT(multi > single / 4);
+}
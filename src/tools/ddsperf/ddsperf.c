@@ -0,0 +1,697 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "os/os.h"
+#include "ddsc/dds.h"
+#include "ddsperf_types.h"
+
+/* ddsperf runs a matrix of publish/subscribe benchmarks: for every
+   combination of type (keyed/keyless), reliability, payload size and
+   number of writers and readers it writes as fast as possible (or at a
+   fixed rate) for a while and reports throughput, CPU time per sample
+   and the distribution of the write-to-take latency as CSV or JSON.
+
+   Publishers and subscribers either live in one process ("all"), or in
+   separate processes ("pub" and "sub") started with the same sweep
+   parameters: every run uses its own topic, and each side waits for the
+   other to show up before starting. */
+
+#define MAX_LIST 32
+#define MAX_TAKE 100
+#define LAT_RESERVOIR 100000
+
+enum mode { MODE_ALL, MODE_PUB, MODE_SUB };
+static const char *mode_names[] = { "all", "pub", "sub" };
+
+struct list {
+    unsigned n;
+    uint32_t v[MAX_LIST];
+};
+
+static struct {
+    enum mode mode;
+    struct list sizes, nwriters, nreaders, keyed, reliable;
+    uint32_t nkeys;
+    uint32_t rate;               /* samples/s per writer, 0 = unlimited */
+    dds_duration_t duration;
+    dds_duration_t match_timeout;
+    const char *prefix;
+    int json;
+    FILE *out;
+} opt;
+
+struct run {
+    bool keyed;
+    bool reliable;
+    uint32_t size;
+    uint32_t nwr, nrd;
+};
+
+struct writer_state {
+    dds_entity_t wr;
+    const struct run *run;
+    uint64_t count;
+    os_threadId tid;
+};
+
+struct latencies {
+    uint64_t seen;
+    uint32_t n;
+    uint64_t prng;
+    dds_duration_t *v;           /* reservoir sample of LAT_RESERVOIR latencies */
+};
+
+struct reader_state {
+    dds_entity_t rd;
+    const struct run *run;
+    uint64_t count;
+    uint64_t bytes;
+    dds_time_t tfirst, tlast;
+    struct latencies lat;
+    os_threadId tid;
+};
+
+static os_atomic_uint32_t stop_writers = OS_ATOMIC_UINT32_INIT(0);
+static os_atomic_uint32_t stop_readers = OS_ATOMIC_UINT32_INIT(0);
+static unsigned nrecords = 0;
+
+/*************************************************************************************************/
+
+static double cputime (void)
+{
+#ifdef _WIN32
+    FILETIME ct, et, kt, ut;
+    ULARGE_INTEGER k, u;
+    if (!GetProcessTimes (GetCurrentProcess (), &ct, &et, &kt, &ut))
+        return 0.0;
+    k.LowPart = kt.dwLowDateTime; k.HighPart = kt.dwHighDateTime;
+    u.LowPart = ut.dwLowDateTime; u.HighPart = ut.dwHighDateTime;
+    return (double) (k.QuadPart + u.QuadPart) / 1e7;
+#else
+    struct rusage u;
+    if (getrusage (RUSAGE_SELF, &u) != 0)
+        return 0.0;
+    return (double) (u.ru_utime.tv_sec + u.ru_stime.tv_sec) + (double) (u.ru_utime.tv_usec + u.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+static uint64_t xorshift (uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void lat_init (struct latencies *lat, uint64_t seed)
+{
+    lat->seen = 0;
+    lat->n = 0;
+    lat->prng = seed | 1;
+    lat->v = os_malloc (LAT_RESERVOIR * sizeof (*lat->v));
+}
+
+static void lat_add (struct latencies *lat, dds_duration_t d)
+{
+    lat->seen++;
+    if (lat->n < LAT_RESERVOIR) {
+        lat->v[lat->n++] = d;
+    } else {
+        const uint64_t i = xorshift (&lat->prng) % lat->seen;
+        if (i < LAT_RESERVOIR)
+            lat->v[i] = d;
+    }
+}
+
+static int cmp_duration (const void *va, const void *vb)
+{
+    const dds_duration_t *a = va, *b = vb;
+    return (*a == *b) ? 0 : (*a < *b) ? -1 : 1;
+}
+
+static double percentile_us (const dds_duration_t *v, uint32_t n, double p)
+{
+    uint32_t i;
+    if (n == 0)
+        return 0.0;
+    i = (uint32_t) (p / 100.0 * (double) (n - 1) + 0.5);
+    return (double) v[i] / 1e3;
+}
+
+/*************************************************************************************************/
+
+static uint32_t writer_thread (void *varg)
+{
+    struct writer_state * const ws = varg;
+    const struct run * const run = ws->run;
+    DDSPerf_KeyedSeq ks;
+    DDSPerf_UnkeyedSeq us;
+    dds_sequence_t baggage;
+    dds_time_t tstart = dds_time ();
+    uint32_t seq = 0;
+
+    baggage._maximum = baggage._length = run->size;
+    baggage._buffer = run->size ? os_malloc (run->size) : NULL;
+    baggage._release = false;
+    if (run->size)
+        memset (baggage._buffer, 0xa5, run->size);
+    memset (&ks, 0, sizeof (ks));
+    memset (&us, 0, sizeof (us));
+    ks.baggage = baggage;
+    us.baggage = baggage;
+
+    while (!os_atomic_ld32 (&stop_writers)) {
+        dds_return_t ret;
+        seq++;
+        if (run->keyed) {
+            ks.seq = seq;
+            ks.keyval = seq % opt.nkeys;
+            ks.tsend = dds_time ();
+            ret = dds_write (ws->wr, &ks);
+        } else {
+            us.seq = seq;
+            us.tsend = dds_time ();
+            ret = dds_write (ws->wr, &us);
+        }
+        if (ret == DDS_RETCODE_OK) {
+            ws->count++;
+        }
+        if (opt.rate > 0) {
+            /* sleep only once ahead of schedule by more than a millisecond,
+               otherwise the sleep granularity limits the rate */
+            const dds_time_t tnext = tstart + (dds_time_t) ((double) seq * 1e9 / opt.rate);
+            const dds_time_t tnow = dds_time ();
+            if (tnext - tnow > DDS_MSECS (1))
+                dds_sleepfor (tnext - tnow);
+        }
+    }
+    os_free (baggage._buffer);
+    return 0;
+}
+
+static void handle_sample (struct reader_state *rs, const void *sample, dds_time_t tnow)
+{
+    dds_time_t tsend;
+    uint32_t len;
+    if (rs->run->keyed) {
+        const DDSPerf_KeyedSeq *s = sample;
+        tsend = s->tsend;
+        len = s->baggage._length;
+    } else {
+        const DDSPerf_UnkeyedSeq *s = sample;
+        tsend = s->tsend;
+        len = s->baggage._length;
+    }
+    if (rs->count++ == 0)
+        rs->tfirst = tnow;
+    rs->tlast = tnow;
+    rs->bytes += len;
+    lat_add (&rs->lat, tnow - tsend);
+}
+
+static uint32_t reader_thread (void *varg)
+{
+    struct reader_state * const rs = varg;
+    const dds_topic_descriptor_t *desc = rs->run->keyed ? &DDSPerf_KeyedSeq_desc : &DDSPerf_UnkeyedSeq_desc;
+    void *samples[MAX_TAKE];
+    dds_sample_info_t info[MAX_TAKE];
+    dds_entity_t ws, rdcond;
+    int i, n;
+
+    for (i = 0; i < MAX_TAKE; i++)
+        samples[i] = dds_alloc (desc->m_size);
+    ws = dds_create_waitset (dds_get_participant (rs->rd));
+    rdcond = dds_create_readcondition (rs->rd, DDS_ANY_STATE);
+    (void) dds_waitset_attach (ws, rdcond, rs->rd);
+
+    while (!os_atomic_ld32 (&stop_readers)) {
+        (void) dds_waitset_wait (ws, NULL, 0, DDS_MSECS (100));
+        while ((n = dds_take (rs->rd, samples, info, MAX_TAKE, MAX_TAKE)) > 0) {
+            const dds_time_t tnow = dds_time ();
+            for (i = 0; i < n; i++) {
+                if (info[i].valid_data)
+                    handle_sample (rs, samples[i], tnow);
+            }
+        }
+    }
+
+    (void) dds_waitset_detach (ws, rdcond);
+    (void) dds_delete (rdcond);
+    (void) dds_delete (ws);
+    for (i = 0; i < MAX_TAKE; i++)
+        dds_sample_free (samples[i], desc, DDS_FREE_ALL);
+    return 0;
+}
+
+/*************************************************************************************************/
+
+static bool wait_for_matches (const dds_entity_t *es, uint32_t nes, uint32_t expected, bool writers)
+{
+    const dds_time_t tend = dds_time () + opt.match_timeout;
+    uint32_t i;
+    for (i = 0; i < nes; ) {
+        uint32_t count;
+        if (writers) {
+            dds_publication_matched_status_t st;
+            (void) dds_get_publication_matched_status (es[i], &st);
+            count = st.current_count;
+        } else {
+            dds_subscription_matched_status_t st;
+            (void) dds_get_subscription_matched_status (es[i], &st);
+            count = st.current_count;
+        }
+        if (count >= expected)
+            i++;
+        else if (dds_time () > tend)
+            return false;
+        else
+            dds_sleepfor (DDS_MSECS (10));
+    }
+    return true;
+}
+
+static void wait_for_unmatched (const dds_entity_t *rds, uint32_t nrds, dds_time_t tend)
+{
+    /* the remote writers get deleted at the end of the run */
+    uint32_t i;
+    for (i = 0; i < nrds && dds_time () < tend; ) {
+        dds_subscription_matched_status_t st;
+        (void) dds_get_subscription_matched_status (rds[i], &st);
+        if (st.current_count == 0)
+            i++;
+        else
+            dds_sleepfor (DDS_MSECS (10));
+    }
+}
+
+static void wait_for_drain (const struct reader_state *rs, uint32_t nrs)
+{
+    /* all in one process: done once nothing arrives for a while */
+    const dds_time_t tend = dds_time () + DDS_SECS (5);
+    uint64_t prev = UINT64_MAX, cur;
+    uint32_t i;
+    do {
+        dds_sleepfor (DDS_MSECS (200));
+        for (i = 0, cur = 0; i < nrs; i++)
+            cur += rs[i].count;
+        if (cur == prev)
+            break;
+        prev = cur;
+    } while (dds_time () < tend);
+}
+
+static void start_thread (os_threadId *tid, const char *name, os_threadRoutine f, void *arg)
+{
+    os_threadAttr attr;
+    os_threadAttrInit (&attr);
+    if (os_threadCreate (tid, name, &attr, f, arg) != os_resultSuccess) {
+        fprintf (stderr, "ddsperf: failed to create thread %s\n", name);
+        exit (2);
+    }
+}
+
+static dds_qos_t *make_qos (const struct run *run, bool for_reader)
+{
+    dds_qos_t *qos = dds_qos_create ();
+    if (run->reliable) {
+        dds_qset_reliability (qos, DDS_RELIABILITY_RELIABLE, DDS_SECS (1));
+        dds_qset_history (qos, DDS_HISTORY_KEEP_ALL, 0);
+    } else {
+        dds_qset_reliability (qos, DDS_RELIABILITY_BEST_EFFORT, 0);
+        dds_qset_history (qos, DDS_HISTORY_KEEP_LAST, for_reader ? 1000 : 1);
+    }
+    return qos;
+}
+
+/*************************************************************************************************/
+
+struct result {
+    double duration;
+    uint64_t sent, received, bytes;
+    uint64_t dropped, rexmits;
+    dds_duration_t throttle_time;
+    double cpu;
+    dds_duration_t *lat;
+    uint32_t nlat;
+};
+
+static void print_header (void)
+{
+    if (opt.json)
+        fprintf (opt.out, "[");
+    else
+        fprintf (opt.out, "mode,keyed,reliable,size,writers,readers,duration_s,sent,send_rate,received,recv_rate,recv_mbps,dropped,rexmits,throttle_ms,cpu_us_per_sample,lat_count,lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us\n");
+}
+
+static void print_trailer (void)
+{
+    if (opt.json)
+        fprintf (opt.out, "%s]\n", nrecords ? "\n" : "");
+}
+
+static void print_result (const struct run *run, const struct result *res)
+{
+    const double send_rate = res->duration > 0 ? (double) res->sent / res->duration : 0.0;
+    const double recv_rate = res->duration > 0 ? (double) res->received / res->duration : 0.0;
+    const double recv_mbps = res->duration > 0 ? (double) res->bytes * 8.0 / res->duration / 1e6 : 0.0;
+    const uint64_t nmsgs = res->sent + res->received;
+    const double cpu_us = nmsgs ? res->cpu * 1e6 / (double) nmsgs : 0.0;
+    const double p50 = percentile_us (res->lat, res->nlat, 50.0);
+    const double p90 = percentile_us (res->lat, res->nlat, 90.0);
+    const double p99 = percentile_us (res->lat, res->nlat, 99.0);
+    const double p999 = percentile_us (res->lat, res->nlat, 99.9);
+    const double pmax = percentile_us (res->lat, res->nlat, 100.0);
+
+    if (opt.json) {
+        fprintf (opt.out, "%s\n{\"mode\":\"%s\",\"keyed\":%s,\"reliable\":%s,\"size\":%u,\"writers\":%u,\"readers\":%u,"
+                 "\"duration_s\":%.3f,\"sent\":%"PRIu64",\"send_rate\":%.1f,\"received\":%"PRIu64",\"recv_rate\":%.1f,\"recv_mbps\":%.3f,"
+                 "\"dropped\":%"PRIu64",\"rexmits\":%"PRIu64",\"throttle_ms\":%.3f,\"cpu_us_per_sample\":%.3f,"
+                 "\"latency_us\":{\"count\":%u,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}}",
+                 nrecords ? "," : "", mode_names[opt.mode], run->keyed ? "true" : "false", run->reliable ? "true" : "false",
+                 run->size, run->nwr, run->nrd, res->duration, res->sent, send_rate, res->received, recv_rate, recv_mbps,
+                 res->dropped, res->rexmits, (double) res->throttle_time / 1e6, cpu_us,
+                 res->nlat, p50, p90, p99, p999, pmax);
+    } else {
+        fprintf (opt.out, "%s,%s,%s,%u,%u,%u,%.3f,%"PRIu64",%.1f,%"PRIu64",%.1f,%.3f,%"PRIu64",%"PRIu64",%.3f,%.3f,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                 mode_names[opt.mode], run->keyed ? "keyed" : "keyless", run->reliable ? "reliable" : "besteffort",
+                 run->size, run->nwr, run->nrd, res->duration, res->sent, send_rate, res->received, recv_rate, recv_mbps,
+                 res->dropped, res->rexmits, (double) res->throttle_time / 1e6, cpu_us,
+                 res->nlat, p50, p90, p99, p999, pmax);
+    }
+    fflush (opt.out);
+    nrecords++;
+}
+
+static void do_run (dds_entity_t pp, const struct run *run)
+{
+    const bool pub = (opt.mode != MODE_SUB), sub = (opt.mode != MODE_PUB);
+    const dds_topic_descriptor_t *desc = run->keyed ? &DDSPerf_KeyedSeq_desc : &DDSPerf_UnkeyedSeq_desc;
+    struct writer_state *wrs = NULL;
+    struct reader_state *rds = NULL;
+    dds_entity_t *wrents = NULL, *rdents = NULL;
+    dds_entity_t tp;
+    dds_qos_t *qos;
+    struct result res;
+    dds_time_t t0, t1;
+    double cpu0;
+    char name[128];
+    uint32_t i;
+
+    memset (&res, 0, sizeof (res));
+    (void) snprintf (name, sizeof (name), "%s_%c%c_%u_%ux%u", opt.prefix, run->keyed ? 'K' : 'U', run->reliable ? 'R' : 'B', run->size, run->nwr, run->nrd);
+    if ((tp = dds_create_topic (pp, desc, name, NULL, NULL)) < 0) {
+        fprintf (stderr, "ddsperf: %s: failed to create topic\n", name);
+        exit (2);
+    }
+
+    os_atomic_st32 (&stop_writers, 0);
+    os_atomic_st32 (&stop_readers, 0);
+    if (sub) {
+        qos = make_qos (run, true);
+        rds = os_malloc (run->nrd * sizeof (*rds));
+        rdents = os_malloc (run->nrd * sizeof (*rdents));
+        for (i = 0; i < run->nrd; i++) {
+            memset (&rds[i], 0, sizeof (rds[i]));
+            rds[i].run = run;
+            lat_init (&rds[i].lat, (uint64_t) dds_time () + i);
+            if ((rds[i].rd = rdents[i] = dds_create_reader (pp, tp, qos, NULL)) < 0) {
+                fprintf (stderr, "ddsperf: %s: failed to create reader\n", name);
+                exit (2);
+            }
+            start_thread (&rds[i].tid, "reader", reader_thread, &rds[i]);
+        }
+        dds_qos_delete (qos);
+    }
+    if (pub) {
+        qos = make_qos (run, false);
+        wrs = os_malloc (run->nwr * sizeof (*wrs));
+        wrents = os_malloc (run->nwr * sizeof (*wrents));
+        for (i = 0; i < run->nwr; i++) {
+            memset (&wrs[i], 0, sizeof (wrs[i]));
+            wrs[i].run = run;
+            if ((wrs[i].wr = wrents[i] = dds_create_writer (pp, tp, qos, NULL)) < 0) {
+                fprintf (stderr, "ddsperf: %s: failed to create writer\n", name);
+                exit (2);
+            }
+        }
+        dds_qos_delete (qos);
+    }
+
+    if ((pub && !wait_for_matches (wrents, run->nwr, run->nrd, true)) ||
+        (!pub && !wait_for_matches (rdents, run->nrd, run->nwr, false))) {
+        fprintf (stderr, "ddsperf: %s: timed out waiting for %s\n", name, pub ? "readers" : "writers");
+    }
+
+    cpu0 = cputime ();
+    t0 = dds_time ();
+    if (pub) {
+        for (i = 0; i < run->nwr; i++)
+            start_thread (&wrs[i].tid, "writer", writer_thread, &wrs[i]);
+        dds_sleepfor (opt.duration);
+        os_atomic_st32 (&stop_writers, 1);
+        for (i = 0; i < run->nwr; i++)
+            (void) os_threadWaitExit (wrs[i].tid, NULL);
+        t1 = dds_time ();
+        if (sub)
+            wait_for_drain (rds, run->nrd);
+    } else {
+        wait_for_unmatched (rdents, run->nrd, t0 + opt.match_timeout + 2 * opt.duration);
+        t1 = dds_time ();
+    }
+    if (sub) {
+        os_atomic_st32 (&stop_readers, 1);
+        for (i = 0; i < run->nrd; i++)
+            (void) os_threadWaitExit (rds[i].tid, NULL);
+    }
+    res.cpu = cputime () - cpu0;
+
+    if (pub) {
+        for (i = 0; i < run->nwr; i++) {
+            dds_statistics_t st;
+            res.sent += wrs[i].count;
+            if (dds_get_statistics (wrs[i].wr, &st) == DDS_RETCODE_OK) {
+                res.rexmits += st.rexmits;
+                res.throttle_time += st.throttle_time;
+            }
+        }
+        res.duration = (double) (t1 - t0) / 1e9;
+    }
+    if (sub) {
+        dds_time_t tfirst = INT64_MAX, tlast = 0;
+        for (i = 0; i < run->nrd; i++) {
+            dds_statistics_t st;
+            res.received += rds[i].count;
+            res.bytes += rds[i].bytes;
+            if (rds[i].count > 0) {
+                if (rds[i].tfirst < tfirst)
+                    tfirst = rds[i].tfirst;
+                if (rds[i].tlast > tlast)
+                    tlast = rds[i].tlast;
+            }
+            if (dds_get_statistics (rds[i].rd, &st) == DDS_RETCODE_OK)
+                res.dropped += st.samples_dropped;
+        }
+        /* subscriber-only: the rate is over the time data was arriving */
+        if (!pub)
+            res.duration = (tlast > tfirst) ? (double) (tlast - tfirst) / 1e9 : 0.0;
+
+        /* merging the reservoirs this way over-represents the readers
+           that received fewer samples; that's fine for a benchmark */
+        res.lat = os_malloc ((run->nrd * LAT_RESERVOIR + 1) * sizeof (*res.lat));
+        for (i = 0; i < run->nrd; i++) {
+            memcpy (res.lat + res.nlat, rds[i].lat.v, rds[i].lat.n * sizeof (*res.lat));
+            res.nlat += rds[i].lat.n;
+        }
+        qsort (res.lat, res.nlat, sizeof (*res.lat), cmp_duration);
+    }
+
+    print_result (run, &res);
+
+    os_free (res.lat);
+    for (i = 0; sub && i < run->nrd; i++) {
+        (void) dds_delete (rds[i].rd);
+        os_free (rds[i].lat.v);
+    }
+    for (i = 0; pub && i < run->nwr; i++)
+        (void) dds_delete (wrs[i].wr);
+    os_free (rds);
+    os_free (rdents);
+    os_free (wrs);
+    os_free (wrents);
+    (void) dds_delete (tp);
+    if (opt.mode == MODE_PUB) {
+        /* give the subscribers time to notice the end of the run */
+        dds_sleepfor (DDS_MSECS (500));
+    }
+}
+
+/*************************************************************************************************/
+
+static bool parse_list (struct list *l, const char *arg, const char **names)
+{
+    char *copy = os_strdup (arg), *cursor = copy, *tok;
+    l->n = 0;
+    while ((tok = os_strsep (&cursor, ",")) != NULL) {
+        if (l->n == MAX_LIST)
+            goto err;
+        if (names) {
+            uint32_t i;
+            for (i = 0; names[i] && strcmp (names[i], tok) != 0; i++)
+                ;
+            if (names[i] == NULL)
+                goto err;
+            l->v[l->n++] = (i == 0);
+        } else {
+            char *end;
+            unsigned long v = strtoul (tok, &end, 0);
+            if (*tok == 0 || *end != 0 || v > UINT32_MAX)
+                goto err;
+            l->v[l->n++] = (uint32_t) v;
+        }
+    }
+    os_free (copy);
+    return l->n > 0;
+err:
+    os_free (copy);
+    return false;
+}
+
+static void usage (const char *argv0)
+{
+    fprintf (stderr, "\
+usage: %s [OPTIONS] [all|pub|sub]\n\
+\n\
+Runs a benchmark for every combination of the swept parameters, either with\n\
+publishers and subscribers in one process (all, the default), or with \"pub\"\n\
+and \"sub\" processes started with the same options, and prints one record per\n\
+run.\n\
+\n\
+OPTIONS:\n\
+  -s SIZES     payload sizes in bytes (default 0,64,1024,16384)\n\
+  -w COUNTS    numbers of writers (default 1)\n\
+  -r COUNTS    numbers of readers (default 1)\n\
+  -k TYPES     keyed and/or keyless (default keyed,keyless)\n\
+  -R MODES     reliable and/or besteffort (default reliable,besteffort)\n\
+  -n NKEYS     number of instances written with keyed types (default 1)\n\
+  -l RATE      samples/s per writer, 0 for as fast as possible (default 0)\n\
+  -D SECS      duration of each run (default 5)\n\
+  -W SECS      time to wait for the other side to show up (default 10)\n\
+  -t PREFIX    topic name prefix, to separate concurrent sweeps (default ddsperf)\n\
+  -o FORMAT    csv or json (default csv)\n\
+  -f FILE      write records to FILE instead of stdout\n\
+\n\
+Lists are comma-separated. Latencies are measured from write to take using\n\
+the source timestamp in the sample, so across machines they include the\n\
+clock offset.\n", argv0);
+    exit (1);
+}
+
+int main (int argc, char **argv)
+{
+    static const char *keyed_names[] = { "keyed", "keyless", NULL };
+    static const char *reliable_names[] = { "reliable", "besteffort", NULL };
+    const char *outfile = NULL;
+    dds_entity_t pp;
+    unsigned a, b, c, d, e;
+    int c_opt;
+
+    memset (&opt, 0, sizeof (opt));
+    (void) parse_list (&opt.sizes, "0,64,1024,16384", NULL);
+    (void) parse_list (&opt.nwriters, "1", NULL);
+    (void) parse_list (&opt.nreaders, "1", NULL);
+    (void) parse_list (&opt.keyed, "keyed,keyless", keyed_names);
+    (void) parse_list (&opt.reliable, "reliable,besteffort", reliable_names);
+    opt.nkeys = 1;
+    opt.duration = DDS_SECS (5);
+    opt.match_timeout = DDS_SECS (10);
+    opt.prefix = "ddsperf";
+
+    while ((c_opt = os_getopt (argc, argv, "s:w:r:k:R:n:l:D:W:t:o:f:")) != -1) {
+        const char *arg = os_get_optarg ();
+        switch (c_opt) {
+            case 's': if (!parse_list (&opt.sizes, arg, NULL)) usage (argv[0]); break;
+            case 'w': if (!parse_list (&opt.nwriters, arg, NULL)) usage (argv[0]); break;
+            case 'r': if (!parse_list (&opt.nreaders, arg, NULL)) usage (argv[0]); break;
+            case 'k': if (!parse_list (&opt.keyed, arg, keyed_names)) usage (argv[0]); break;
+            case 'R': if (!parse_list (&opt.reliable, arg, reliable_names)) usage (argv[0]); break;
+            case 'n': opt.nkeys = (uint32_t) atoi (arg); break;
+            case 'l': opt.rate = (uint32_t) atoi (arg); break;
+            case 'D': opt.duration = (dds_duration_t) (atof (arg) * 1e9); break;
+            case 'W': opt.match_timeout = (dds_duration_t) (atof (arg) * 1e9); break;
+            case 't': opt.prefix = arg; break;
+            case 'o':
+                if (strcmp (arg, "csv") == 0) opt.json = 0;
+                else if (strcmp (arg, "json") == 0) opt.json = 1;
+                else usage (argv[0]);
+                break;
+            case 'f': outfile = arg; break;
+            default: usage (argv[0]); break;
+        }
+    }
+    if (os_get_optind () < argc) {
+        const char *m = argv[os_get_optind ()];
+        if (strcmp (m, "all") == 0) opt.mode = MODE_ALL;
+        else if (strcmp (m, "pub") == 0) opt.mode = MODE_PUB;
+        else if (strcmp (m, "sub") == 0) opt.mode = MODE_SUB;
+        else usage (argv[0]);
+        if (os_get_optind () + 1 < argc)
+            usage (argv[0]);
+    }
+    for (a = 0; a < opt.nwriters.n; a++)
+        if (opt.nwriters.v[a] == 0)
+            usage (argv[0]);
+    if (opt.nkeys == 0 || opt.duration <= 0)
+        usage (argv[0]);
+
+    if (outfile == NULL)
+        opt.out = stdout;
+    else if ((opt.out = fopen (outfile, "w")) == NULL) {
+        fprintf (stderr, "ddsperf: %s: cannot open for writing\n", outfile);
+        return 2;
+    }
+
+    if ((pp = dds_create_participant (DDS_DOMAIN_DEFAULT, NULL, NULL)) < 0) {
+        fprintf (stderr, "ddsperf: failed to create participant\n");
+        return 2;
+    }
+
+    print_header ();
+    for (a = 0; a < opt.keyed.n; a++)
+        for (b = 0; b < opt.reliable.n; b++)
+            for (c = 0; c < opt.sizes.n; c++)
+                for (d = 0; d < opt.nwriters.n; d++)
+                    for (e = 0; e < opt.nreaders.n; e++) {
+                        struct run run;
+                        run.keyed = opt.keyed.v[a];
+                        run.reliable = opt.reliable.v[b];
+                        run.size = opt.sizes.v[c];
+                        run.nwr = opt.nwriters.v[d];
+                        run.nrd = opt.nreaders.v[e];
+                        do_run (pp, &run);
+                    }
+    print_trailer ();
+
+    (void) dds_delete (pp);
+    if (opt.out != stdout)
+        fclose (opt.out);
+    return 0;
+}
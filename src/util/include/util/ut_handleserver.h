@@ -43,8 +43,8 @@ extern "C" {
  * handle. This will not remove any information within the handleserver, it just prevents
  * new claims. The delete will actually free handleserver internal memory.
  *
- * There's currently a global lock in the handle server that is used with every API call.
- * Maybe the internals can be improved to circumvent the need for that...
+ * Claiming, releasing and closing a handle are lock-free. Only creating and deleting a
+ * handle take the handleserver lock.
  */
 
 
@@ -70,22 +70,27 @@ typedef _Return_type_success_(return == 0) enum ut_handle_retcode_t {
  *      --------------------------------------------------------------------------------------
  *      |    31 |            2 | positive/negative (negative can be used to indicate errors) |
  *      | 24-30 |          127 | handle kind       (value determined by client)              |
- *      |  0-23 |   16.777.215 | index or hash     (maintained by the handleserver)          |
+ *      | 18-23 |           64 | generation        (maintained by the handleserver)          |
+ *      |  0-17 |      262.144 | index             (maintained by the handleserver)          |
  *
  * When the handle is negative, it'll contain a ut_handle_retcode_t error value.
  *
+ * The index of a deleted handle can be reused, the generation then distinguishes
+ * the new handle from the deleted one.
+ *
  * FYI: the entity id within DDSI is also 24 bits...
  */
 typedef _Return_type_success_(return > 0) int32_t ut_handle_t;
 
 /*
  * Handle bits
- *   +kkk kkkk iiii iiii iiii iiii iiii iiii
- * 31|   | 24|                            0|
+ *   +kkk kkkk gggg ggii iiii iiii iiii iiii
+ * 31|   | 24|    | 18|                   0|
  */
 #define UT_HANDLE_SIGN_MASK (0x80000000)
 #define UT_HANDLE_KIND_MASK (0x7F000000)
-#define UT_HANDLE_IDX_MASK  (0x00FFFFFF)
+#define UT_HANDLE_GEN_MASK  (0x00FC0000)
+#define UT_HANDLE_IDX_MASK  (0x0003FFFF)
 
 #define UT_HANDLE_DONTCARE_KIND (0)
 
@@ -0,0 +1,68 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#ifndef UT_TIMERWHEEL_H
+#define UT_TIMERWHEEL_H
+
+#include "os/os.h"
+#include "util/ut_export.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/* Hierarchical timing wheel: insert and delete are O(1), finding the
+   expired timers costs a bounded amount of work per level boundary
+   crossed. Times are signed 64-bit integers (in practice nanoseconds),
+   and are bucketed into ticks of 2^tickshift time units. The exact
+   time of each timer is retained, so timers never fire early, nor
+   late by more than the time between calls to ExtractExpired. */
+
+#define UT_TIMERWHEEL_LEVEL_BITS 6
+#define UT_TIMERWHEEL_SLOTS (1u << UT_TIMERWHEEL_LEVEL_BITS)
+#define UT_TIMERWHEEL_LEVELS 5
+
+typedef struct ut_timerwheelNode {
+  struct ut_timerwheelNode *next, **pprev;
+  int64_t t;
+  uint32_t slot;
+} ut_timerwheelNode_t;
+
+typedef struct ut_timerwheelDef {
+  uintptr_t offset;
+  unsigned tickshift;
+} ut_timerwheelDef_t;
+
+typedef struct ut_timerwheel {
+  int64_t now; /* in ticks; all timers in the wheel are due at or after now */
+  uint32_t count;
+  uint64_t occupied[UT_TIMERWHEEL_LEVELS];
+  /* one list per slot for each level, followed by the overflow list
+     and the list of timers that are known to have expired */
+  ut_timerwheelNode_t *slots[UT_TIMERWHEEL_LEVELS * UT_TIMERWHEEL_SLOTS + 2];
+} ut_timerwheel_t;
+
+#define UT_TIMERWHEELDEF_INITIALIZER(offset, tickshift) { (offset), (tickshift) }
+
+UTIL_EXPORT void ut_timerwheelDefInit (ut_timerwheelDef_t *twdef, uintptr_t offset, unsigned tickshift);
+UTIL_EXPORT void ut_timerwheelInit (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw);
+UTIL_EXPORT int ut_timerwheelIsEmpty (const ut_timerwheel_t *tw);
+UTIL_EXPORT void ut_timerwheelInsert (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode, int64_t t);
+UTIL_EXPORT void ut_timerwheelDelete (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode);
+UTIL_EXPORT void ut_timerwheelReschedule (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode, int64_t t);
+UTIL_EXPORT int64_t ut_timerwheelEarliest (const ut_timerwheelDef_t *twdef, const ut_timerwheel_t *tw); /* lower bound, INT64_MAX if empty */
+UTIL_EXPORT void *ut_timerwheelExtractExpired (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, int64_t tnow);
+
+#if defined (__cplusplus)
+}
+#endif
+
+#endif /* UT_TIMERWHEEL_H */
@@ -14,22 +14,43 @@
 #include "os/os.h"
 #include "util/ut_handleserver.h"
 
-/* Arbitrarily number of max handles. Should be enough for the mock. */
-#define MAX_NR_OF_HANDLES  (1000)
-
-#define HDL_FLAG_NONE      (0x00)
-#define HDL_FLAG_CLOSED    (0x01)
+/*
+ * The handle links are stored in blocks that are allocated on demand and never
+ * moved or freed until the handleserver is destroyed. That allows claim, release,
+ * close and status to work on a link without taking the mutex, which is only
+ * needed for creating and deleting handles.
+ *
+ * The index part of a deleted handle is reused for new handles, but with the next
+ * generation, so that the old handle is still recognised as deleted. To make it
+ * unlikely that the generation wraps around while an old handle is still in use,
+ * deleted links are only reused when there are enough of them.
+ */
+#define HDL_BLOCK_SHIFT    (10)
+#define HDL_BLOCK_SIZE     (1u << HDL_BLOCK_SHIFT)
+#define HDL_MAX_HANDLES    ((uint32_t)UT_HANDLE_IDX_MASK + 1)
+#define HDL_MAX_BLOCKS     (HDL_MAX_HANDLES / HDL_BLOCK_SIZE)
+#define HDL_REUSE_MIN      (HDL_BLOCK_SIZE)
+#define HDL_GEN_SHIFT      (18)
+#define HDL_NO_INDEX       (UINT32_MAX)
+
+/* Part of the count: set when no new claims are allowed. */
+#define HDL_FLAG_CLOSED    (0x80000000u)
+#define HDL_COUNT_MASK     (0x7fffffffu)
 
 typedef struct ut_handlelink {
-    ut_handle_t hdl;
+    os_atomic_uint32_t hdl;   /* 0 when the link isn't in use */
+    os_atomic_uint32_t cnt;   /* active claims | HDL_FLAG_CLOSED */
     void *arg;
-    uint32_t cnt;
-    uint8_t flags;
+    uint32_t gen;
+    uint32_t next_free;
 } ut_handlelink;
 
 typedef struct ut_handleserver {
-    ut_handlelink *hdls[MAX_NR_OF_HANDLES];
-    int32_t last;
+    ut_handlelink *blocks[HDL_MAX_BLOCKS];
+    os_atomic_uint32_t last;  /* number of links ever handed out */
+    uint32_t free_first;      /* deleted links, oldest first */
+    uint32_t free_last;
+    uint32_t free_count;
     os_mutex mutex;
 } ut_handleserver;
 
@@ -41,11 +62,14 @@ static ut_handleserver *hs = NULL;
 _Check_return_ static ut_handle_retcode_t
 lookup_handle(_In_  ut_handle_t hdl, _In_  int32_t kind, _Out_ ut_handlelink **link);
 
-_Check_return_ static ut_handle_t
-check_handle(_In_ ut_handle_t hdl, _In_ int32_t kind);
+_Check_return_ static ut_handle_retcode_t
+check_handle(_In_ ut_handle_t hdl, _In_ int32_t kind, _In_ const ut_handlelink *info);
+
+static ut_handlelink*
+index_to_link(_In_ uint32_t idx);
 
 static void
-delete_handle(_In_ int32_t idx);
+delete_handle(_In_ ut_handlelink *info, _In_ uint32_t idx);
 
 
 _Check_return_ ut_handle_retcode_t
@@ -55,7 +79,11 @@ ut_handleserver_init(void)
     /* TODO CHAM-138: Allow re-entry (something like os_osInit()). */
     assert(hs == NULL);
     hs = os_malloc(sizeof(ut_handleserver));
-    hs->last = 0;
+    memset(hs->blocks, 0, sizeof(hs->blocks));
+    os_atomic_st32(&hs->last, 0);
+    hs->free_first = HDL_NO_INDEX;
+    hs->free_last = HDL_NO_INDEX;
+    hs->free_count = 0;
     os_mutexInit(&hs->mutex);
     return UT_HANDLE_OK;
 }
@@ -64,17 +92,15 @@ ut_handleserver_init(void)
 void
 ut_handleserver_fini(void)
 {
-    int32_t i;
+    uint32_t i;
 
     /* TODO CHAM-138: Only destroy when this is the last fini (something like os_osExit()). */
     assert(hs);
 
-    /* Every handle should have been deleted, but make sure. */
-    for (i = 0; i < hs->last; i++) {
-        if (hs->hdls[i] != NULL) {
-            /* TODO CHAM-138: Print warning. */
-            os_free(hs->hdls[i]);
-        }
+    /* Every handle should have been deleted, but the links are freed regardless. */
+    for (i = 0; i < HDL_MAX_BLOCKS && hs->blocks[i] != NULL; i++) {
+        /* TODO CHAM-138: Print warning for links still in use. */
+        os_free(hs->blocks[i]);
     }
     os_mutexDestroy(&hs->mutex);
     os_free(hs);
@@ -91,6 +117,8 @@ ut_handle_create(
         _In_ void *arg)
 {
     ut_handle_t hdl = (ut_handle_t)UT_HANDLE_OUT_OF_RESOURCES;
+    ut_handlelink *info = NULL;
+    uint32_t idx = HDL_NO_INDEX;
 
     /* A kind is obligatory. */
     assert(kind & UT_HANDLE_KIND_MASK);
@@ -103,16 +131,42 @@ ut_handle_create(
 
     os_mutexLock(&hs->mutex);
 
-    /* TODO CHAM-138: Improve the creation and management of handles. */
-    if (hs->last < MAX_NR_OF_HANDLES) {
-        hdl  = hs->last;
+    if (hs->free_count >= HDL_REUSE_MIN || (hs->free_count > 0 && os_atomic_ld32(&hs->last) == HDL_MAX_HANDLES)) {
+        idx = hs->free_first;
+        info = index_to_link(idx);
+        hs->free_first = info->next_free;
+        if (--hs->free_count == 0) {
+            hs->free_last = HDL_NO_INDEX;
+        }
+    } else if (os_atomic_ld32(&hs->last) < HDL_MAX_HANDLES) {
+        idx = os_atomic_ld32(&hs->last);
+        if ((idx % HDL_BLOCK_SIZE) == 0) {
+            ut_handlelink *block = os_malloc(HDL_BLOCK_SIZE * sizeof(ut_handlelink));
+            uint32_t i;
+            for (i = 0; i < HDL_BLOCK_SIZE; i++) {
+                os_atomic_st32(&block[i].hdl, 0);
+                os_atomic_st32(&block[i].cnt, 0);
+                block[i].arg = NULL;
+                block[i].gen = 0;
+                block[i].next_free = HDL_NO_INDEX;
+            }
+            hs->blocks[idx >> HDL_BLOCK_SHIFT] = block;
+        }
+        info = index_to_link(idx);
+        /* Lookups only touch links below last, so the link must be complete first. */
+        os_atomic_fence_rel();
+        os_atomic_st32(&hs->last, idx + 1);
+    }
+
+    if (info != NULL) {
+        hdl  = (ut_handle_t)(idx | (info->gen << HDL_GEN_SHIFT));
         hdl |= kind;
-        hs->hdls[hs->last] = os_malloc(sizeof(ut_handlelink));
-        hs->hdls[hs->last]->cnt   = 0;
-        hs->hdls[hs->last]->arg   = arg;
-        hs->hdls[hs->last]->hdl   = hdl;
-        hs->hdls[hs->last]->flags = HDL_FLAG_NONE;
-        hs->last++;
+        info->arg = arg;
+        /* A claim that lost the race with the deletion of the previous use of the
+         * link may still be undoing its increment, so only the flag is reset. */
+        os_atomic_and32(&info->cnt, ~HDL_FLAG_CLOSED);
+        os_atomic_fence_rel();
+        os_atomic_st32(&info->hdl, (uint32_t)hdl);
     }
 
     os_mutexUnlock(&hs->mutex);
@@ -127,20 +181,18 @@ ut_handle_close(
         _Inout_opt_ struct ut_handlelink *link)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     assert(hs);
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, UT_HANDLE_DONTCARE_KIND, &info);
+    } else {
+        ret = check_handle(hdl, UT_HANDLE_DONTCARE_KIND, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        info->flags |= HDL_FLAG_CLOSED;
+        os_atomic_or32(&info->cnt, HDL_FLAG_CLOSED);
     }
-    os_mutexUnlock(&hs->mutex);
 }
 
 
@@ -151,38 +203,39 @@ ut_handle_delete(
         _In_                        os_time timeout)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     assert(hs);
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, UT_HANDLE_DONTCARE_KIND, &info);
+    } else {
+        ret = check_handle(hdl, UT_HANDLE_DONTCARE_KIND, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        info->flags |= HDL_FLAG_CLOSED;
+        os_atomic_or32(&info->cnt, HDL_FLAG_CLOSED);
 
         /* TODO CHAM-138: Replace this polling with conditional wait. */
-        os_mutexUnlock(&hs->mutex);
         {
             const os_time zero  = { 0,        0 };
             const os_time delay = { 0, 10000000 };
-            while ((info->cnt != 0) && (os_timeCompare(timeout, zero) > 0)) {
+            while (((os_atomic_ld32(&info->cnt) & HDL_COUNT_MASK) != 0) && (os_timeCompare(timeout, zero) > 0)) {
                 os_nanoSleep(delay);
                 timeout = os_timeSub(timeout, delay);
             }
         }
-        os_mutexLock(&hs->mutex);
 
-        if (info->cnt == 0) {
-            delete_handle(hdl & UT_HANDLE_IDX_MASK);
+        os_mutexLock(&hs->mutex);
+        if (os_atomic_ld32(&info->hdl) != (uint32_t)hdl) {
+            /* Somebody else deleted it in the meantime. */
+            ret = UT_HANDLE_DELETED;
+        } else if ((os_atomic_ld32(&info->cnt) & HDL_COUNT_MASK) == 0) {
+            delete_handle(info, (uint32_t)hdl & UT_HANDLE_IDX_MASK);
         } else {
             ret = UT_HANDLE_TIMEOUT;
         }
+        os_mutexUnlock(&hs->mutex);
     }
-    os_mutexUnlock(&hs->mutex);
 
     return ret;
 }
@@ -196,24 +249,22 @@ ut_handle_status(
         _In_        int32_t kind)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     if (hs == NULL) {
         return (ut_handle_t)UT_HANDLE_INVALID;
     }
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, kind, &info);
+    } else {
+        ret = check_handle(hdl, kind, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        if (info->flags & HDL_FLAG_CLOSED) {
+        if (os_atomic_ld32(&info->cnt) & HDL_FLAG_CLOSED) {
             ret = UT_HANDLE_CLOSED;
         }
     }
-    os_mutexUnlock(&hs->mutex);
 
     return ret;
 }
@@ -228,7 +279,7 @@ ut_handle_claim(
         _Out_opt_   void **arg)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     if (arg != NULL) {
         *arg = NULL;
@@ -238,24 +289,27 @@ ut_handle_claim(
         return (ut_handle_t)UT_HANDLE_INVALID;
     }
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, kind, &info);
+    } else {
+        ret = check_handle(hdl, kind, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        if (info->flags & HDL_FLAG_CLOSED) {
+        /* Claim first and check afterwards: when the handle was closed or deleted
+         * in the meantime, the claim is undone. A deletion waits for that. */
+        uint32_t cnt = os_atomic_inc32_nv(&info->cnt);
+        if (os_atomic_ld32(&info->hdl) != (uint32_t)hdl) {
+            ret = UT_HANDLE_DELETED;
+        } else if (cnt & HDL_FLAG_CLOSED) {
             ret = UT_HANDLE_CLOSED;
         }
-    }
-    if (ret == UT_HANDLE_OK) {
-        info->cnt++;
-        if (arg != NULL) {
+        if (ret != UT_HANDLE_OK) {
+            os_atomic_dec32(&info->cnt);
+        } else if (arg != NULL) {
+            os_atomic_fence_acq();
             *arg = info->arg;
         }
     }
-    os_mutexUnlock(&hs->mutex);
 
     return ret;
 }
@@ -267,21 +321,19 @@ ut_handle_release(
         _Inout_opt_ struct ut_handlelink *link)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     assert(hs);
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, UT_HANDLE_DONTCARE_KIND, &info);
+    } else {
+        ret = check_handle(hdl, UT_HANDLE_DONTCARE_KIND, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        assert(info->cnt > 0);
-        info->cnt--;
+        assert((os_atomic_ld32(&info->cnt) & HDL_COUNT_MASK) > 0);
+        os_atomic_dec32(&info->cnt);
     }
-    os_mutexUnlock(&hs->mutex);
 }
 
 
@@ -291,22 +343,20 @@ ut_handle_is_closed(
         _Inout_opt_ struct ut_handlelink *link)
 {
     struct ut_handlelink *info = link;
-    ut_handle_retcode_t   ret = UT_HANDLE_OK;
+    ut_handle_retcode_t   ret;
 
     assert(hs);
 
-    os_mutexLock(&hs->mutex);
     if (info == NULL) {
         ret = lookup_handle(hdl, UT_HANDLE_DONTCARE_KIND, &info);
+    } else {
+        ret = check_handle(hdl, UT_HANDLE_DONTCARE_KIND, info);
     }
     if (ret == UT_HANDLE_OK) {
-        assert(info);
-        assert(hdl == info->hdl);
-        if (info->flags & HDL_FLAG_CLOSED) {
+        if (os_atomic_ld32(&info->cnt) & HDL_FLAG_CLOSED) {
             ret = UT_HANDLE_CLOSED;
         }
     }
-    os_mutexUnlock(&hs->mutex);
 
     /* Simulate closed for every error. */
     return (ret != UT_HANDLE_OK);
@@ -322,11 +372,10 @@ ut_handle_get_link(
 
     assert(hs);
 
-    os_mutexLock(&hs->mutex);
     ret = lookup_handle(hdl, UT_HANDLE_DONTCARE_KIND, &info);
     assert(((ret == UT_HANDLE_OK) && (info != NULL)) ||
            ((ret != UT_HANDLE_OK) && (info == NULL)) );
-    os_mutexUnlock(&hs->mutex);
+    (void)ret;
 
     return info;
 }
@@ -338,45 +387,49 @@ lookup_handle(
         _In_  int32_t kind,
         _Out_ ut_handlelink **link)
 {
-    ut_handle_retcode_t ret;
+    ut_handle_retcode_t ret = UT_HANDLE_OK;
     *link = NULL;
-    ret = check_handle(hdl, kind);
-    if (ret == UT_HANDLE_OK) {
-        int32_t idx = (hdl & UT_HANDLE_IDX_MASK);
-        assert(idx < MAX_NR_OF_HANDLES);
-        *link = hs->hdls[idx];
+    if (hdl > 0) {
+        uint32_t idx = ((uint32_t)hdl & UT_HANDLE_IDX_MASK);
+        if (idx < os_atomic_ld32(&hs->last)) {
+            ut_handlelink *info;
+            os_atomic_fence_acq();
+            info = index_to_link(idx);
+            ret = check_handle(hdl, kind, info);
+            if (ret == UT_HANDLE_OK) {
+                *link = info;
+            }
+        } else {
+            ret = UT_HANDLE_INVALID;
+        }
+    } else if (hdl == 0) {
+        ret = UT_HANDLE_INVALID;
+    } else {
+        /* When handle is negative, it contains a retcode. */
+        ret = (ut_handle_retcode_t)hdl;
     }
     return ret;
 }
 
-_Check_return_ static ut_handle_t
+_Check_return_ static ut_handle_retcode_t
 check_handle(
         _In_ ut_handle_t hdl,
-        _In_ int32_t kind)
+        _In_ int32_t kind,
+        _In_ const ut_handlelink *info)
 {
-    /* When handle is negative, it contains a retcode. */
     ut_handle_retcode_t ret = UT_HANDLE_OK;
     if (hdl > 0) {
         if (hdl & UT_HANDLE_KIND_MASK) {
-            int32_t idx = (hdl & UT_HANDLE_IDX_MASK);
-            if (idx < hs->last) {
-                assert(idx < MAX_NR_OF_HANDLES);
-                ut_handlelink *info = hs->hdls[idx];
-                if (info != NULL) {
-                    if ((info->hdl & UT_HANDLE_KIND_MASK) == (hdl & UT_HANDLE_KIND_MASK)) {
-                        if ((kind != UT_HANDLE_DONTCARE_KIND) &&
-                            (kind != (hdl & UT_HANDLE_KIND_MASK))) {
-                            /* It's a valid handle, but the caller expected a different kind. */
-                            ret = UT_HANDLE_UNEQUAL_KIND;
-                        }
-                    } else {
-                        ret = UT_HANDLE_UNEQUAL_KIND;
-                    }
-                } else {
-                    ret = UT_HANDLE_DELETED;
-                }
-            } else {
-                ret = UT_HANDLE_INVALID;
+            const uint32_t cur = os_atomic_ld32(&info->hdl);
+            if (cur == 0 || (cur & ~(uint32_t)UT_HANDLE_KIND_MASK) != ((uint32_t)hdl & ~(uint32_t)UT_HANDLE_KIND_MASK)) {
+                /* Deleted, possibly reused with a different generation. */
+                ret = UT_HANDLE_DELETED;
+            } else if ((cur & UT_HANDLE_KIND_MASK) != ((uint32_t)hdl & UT_HANDLE_KIND_MASK)) {
+                ret = UT_HANDLE_UNEQUAL_KIND;
+            } else if ((kind != UT_HANDLE_DONTCARE_KIND) &&
+                       (kind != (hdl & UT_HANDLE_KIND_MASK))) {
+                /* It's a valid handle, but the caller expected a different kind. */
+                ret = UT_HANDLE_UNEQUAL_KIND;
             }
         } else {
             ret = UT_HANDLE_INVALID;
@@ -390,11 +443,28 @@ check_handle(
     return ret;
 }
 
+static ut_handlelink*
+index_to_link(_In_ uint32_t idx)
+{
+    assert(idx < HDL_MAX_HANDLES);
+    assert(hs->blocks[idx >> HDL_BLOCK_SHIFT] != NULL);
+    return &hs->blocks[idx >> HDL_BLOCK_SHIFT][idx % HDL_BLOCK_SIZE];
+}
+
 static void
-delete_handle(_In_ int32_t idx)
+delete_handle(_In_ ut_handlelink *info, _In_ uint32_t idx)
 {
     assert(hs);
-    assert(idx < MAX_NR_OF_HANDLES);
-    os_free(hs->hdls[idx]);
-    hs->hdls[idx] = NULL;
+    assert(info == index_to_link(idx));
+    os_atomic_st32(&info->hdl, 0);
+    info->arg = NULL;
+    info->gen = (info->gen + 1) & ((uint32_t)UT_HANDLE_GEN_MASK >> HDL_GEN_SHIFT);
+    info->next_free = HDL_NO_INDEX;
+    if (hs->free_last == HDL_NO_INDEX) {
+        hs->free_first = idx;
+    } else {
+        index_to_link(hs->free_last)->next_free = idx;
+    }
+    hs->free_last = idx;
+    hs->free_count++;
 }
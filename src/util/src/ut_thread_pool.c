@@ -32,6 +32,8 @@ struct ut_thread_pool_s
     uint32_t m_waiting;               /* Number of threads waiting for a job */
     uint32_t m_job_count;             /* Number of queued jobs */
     uint32_t m_job_max;               /* Maximum number of jobs to queue */
+    uint32_t m_purge;                 /* Number of idle threads asked to exit */
+    bool m_stop;                       /* Set when pool is being freed */
     unsigned short m_count;            /* Counter for thread name */
     os_threadAttr m_attr;              /* Thread creation attribute */
     os_cond m_cv;                    /* Thread wait semaphore */
@@ -43,16 +45,12 @@ static uint32_t ut_thread_start_fn (_In_ void * arg)
     ddsi_work_queue_job_t job;
     ut_thread_pool pool = (ut_thread_pool) arg;
 
-    /* Thread loops, pulling jobs from queue */
+    /* Thread loops, pulling jobs from queue until pool deleted or the
+       thread is purged; queued jobs always get done first */
 
     os_mutexLock (&pool->m_mutex);
 
-    while (pool->m_jobs != NULL) {
-        /* Wait for job */
-        os_condWait (&pool->m_cv, &pool->m_mutex);
-
-        /* Check if pool deleted or being purged */
-
+    for (;;) {
         if (pool->m_jobs) {
             /* Take job from queue head */
 
@@ -73,13 +71,21 @@ static uint32_t ut_thread_start_fn (_In_ void * arg)
             pool->m_waiting++;
             job->m_next_job = pool->m_free;
             pool->m_free = job;
+        } else if (pool->m_stop) {
+            break;
+        } else if (pool->m_purge > 0) {
+            pool->m_purge--;
+            break;
+        } else {
+            /* Wait for job */
+            os_condWait (&pool->m_cv, &pool->m_mutex);
         }
     }
 
-    if (--pool->m_threads) {
-        /* last to leave triggers thread_pool_free */
-        os_condBroadcast (&pool->m_cv);
-    }
+    pool->m_waiting--;
+    pool->m_threads--;
+    /* thread_pool_free waits for the last one to leave */
+    os_condBroadcast (&pool->m_cv);
     os_mutexUnlock (&pool->m_mutex);
     return 0;
 }
@@ -95,12 +101,12 @@ static os_result ut_thread_pool_new_thread (ut_thread_pool pool)
     (void) snprintf (name, sizeof (name), "OSPL-%u-%u", pools++, pool->m_count++);
     res = os_threadCreate (&id, name, &pool->m_attr, &ut_thread_start_fn, pool);
 
+    /* pool->m_mutex is held by the caller, the new thread can't look at
+       the counters before they've been updated */
     if (res == os_resultSuccess)
     {
-        os_mutexLock (&pool->m_mutex);
         pool->m_threads++;
         pool->m_waiting++;
-        os_mutexUnlock (&pool->m_mutex);
     }
 
     return res;
@@ -138,18 +144,20 @@ ut_thread_pool ut_thread_pool_new (uint32_t threads, uint32_t max_threads, uint3
 
     /* Create initial threads and jobs */
 
+    os_mutexLock (&pool->m_mutex);
     while (threads--)
     {
         if (ut_thread_pool_new_thread (pool) != os_resultSuccess)
         {
+            os_mutexUnlock (&pool->m_mutex);
             ut_thread_pool_free (pool);
-            pool = NULL;
-            break;
+            return NULL;
         }
         job = os_malloc (sizeof (*job));
         job->m_next_job = pool->m_free;
         pool->m_free = job;
     }
+    os_mutexUnlock (&pool->m_mutex);
 
     return pool;
 }
@@ -176,13 +184,11 @@ void ut_thread_pool_free (ut_thread_pool pool)
 
     /* Wake all waiting threads */
 
+    pool->m_stop = true;
     os_condBroadcast (&pool->m_cv);
 
-    os_mutexUnlock (&pool->m_mutex);
-
     /* Wait for threads to complete */
 
-    os_mutexLock (&pool->m_mutex);
     while (pool->m_threads != 0)
         os_condWait (&pool->m_cv, &pool->m_mutex);
     os_mutexUnlock (&pool->m_mutex);
@@ -267,15 +273,13 @@ os_result ut_thread_pool_submit (ut_thread_pool pool, void (*fn) (void *arg), vo
 
 void ut_thread_pool_purge (ut_thread_pool pool)
 {
-    uint32_t total;
+    uint32_t excess;
+
+    /* Ask idle threads above the minimum to exit */
 
     os_mutexLock (&pool->m_mutex);
-    total = pool->m_threads;
-    while (pool->m_waiting && (total > pool->m_thread_min))
-    {
-        pool->m_waiting--;
-        total--;
-    }
+    excess = (pool->m_threads > pool->m_thread_min) ? pool->m_threads - pool->m_thread_min : 0;
+    pool->m_purge = (pool->m_waiting < excess) ? pool->m_waiting : excess;
     os_condBroadcast (&pool->m_cv);
     os_mutexUnlock (&pool->m_mutex);
 }
@@ -0,0 +1,281 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stddef.h>
+#include <assert.h>
+
+#include "util/ut_timerwheel.h"
+
+/* A timer due at tick T is kept at the lowest level L for which
+   (T >> 6L) - (now >> 6L) < 64, in slot (T >> 6L) % 64. For L > 0,
+   that difference is at least 1, so the level-L slot is emptied
+   ("cascaded" to the lower levels) exactly when now crosses the
+   multiple of 64^L at which the difference drops to 0. Timers beyond
+   the top level go on the overflow list, which is reconsidered every
+   time the top level cascades. Level 0 slots each hold a single tick,
+   and once now moves past a slot, its contents go onto the expired
+   list. */
+
+#define BITS UT_TIMERWHEEL_LEVEL_BITS
+#define NSLOTS UT_TIMERWHEEL_SLOTS
+#define NLEVELS UT_TIMERWHEEL_LEVELS
+#define SLOT_OVERFLOW (NLEVELS * NSLOTS)
+#define SLOT_EXPIRED (NLEVELS * NSLOTS + 1)
+
+static ut_timerwheelNode_t *node_of (const ut_timerwheelDef_t *twdef, const void *vnode)
+{
+    return (ut_timerwheelNode_t *) ((char *) vnode + twdef->offset);
+}
+
+static void *obj_of (const ut_timerwheelDef_t *twdef, ut_timerwheelNode_t *node)
+{
+    return (char *) node - twdef->offset;
+}
+
+static unsigned lowest_set_bit (uint64_t x)
+{
+    assert (x != 0);
+#if defined (__GNUC__)
+    return (unsigned) __builtin_ctzll (x);
+#else
+    {
+        unsigned n = 0;
+        while ((x & 1) == 0) {
+            x >>= 1;
+            n++;
+        }
+        return n;
+    }
+#endif
+}
+
+static uint64_t rotate_right (uint64_t x, unsigned r)
+{
+    return (r == 0) ? x : (x >> r) | (x << (64 - r));
+}
+
+static unsigned slot_index (unsigned level, int64_t tick)
+{
+    return level * NSLOTS + (unsigned) ((tick >> (level * BITS)) & (NSLOTS - 1));
+}
+
+static void link_node (ut_timerwheel_t *tw, ut_timerwheelNode_t *node, uint32_t slot)
+{
+    node->slot = slot;
+    node->pprev = &tw->slots[slot];
+    if ((node->next = tw->slots[slot]) != NULL)
+        node->next->pprev = &node->next;
+    tw->slots[slot] = node;
+    if (slot < SLOT_OVERFLOW)
+        tw->occupied[slot / NSLOTS] |= (uint64_t) 1 << (slot % NSLOTS);
+}
+
+static void unlink_node (ut_timerwheel_t *tw, ut_timerwheelNode_t *node)
+{
+    const uint32_t slot = node->slot;
+    if ((*node->pprev = node->next) != NULL)
+        node->next->pprev = node->pprev;
+    if (slot < SLOT_OVERFLOW && tw->slots[slot] == NULL)
+        tw->occupied[slot / NSLOTS] &= ~((uint64_t) 1 << (slot % NSLOTS));
+}
+
+static void place_node (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, ut_timerwheelNode_t *node)
+{
+    const int64_t tick = node->t >> twdef->tickshift;
+    unsigned level;
+    if (tick <= tw->now) {
+        link_node (tw, node, slot_index (0, tw->now));
+        return;
+    }
+    for (level = 0; level < NLEVELS; level++) {
+        if ((tick >> (level * BITS)) - (tw->now >> (level * BITS)) < (int64_t) NSLOTS) {
+            link_node (tw, node, slot_index (level, tick));
+            return;
+        }
+    }
+    link_node (tw, node, SLOT_OVERFLOW);
+}
+
+static ut_timerwheelNode_t *detach_slot (ut_timerwheel_t *tw, uint32_t slot)
+{
+    ut_timerwheelNode_t *list = tw->slots[slot];
+    tw->slots[slot] = NULL;
+    if (slot < SLOT_OVERFLOW)
+        tw->occupied[slot / NSLOTS] &= ~((uint64_t) 1 << (slot % NSLOTS));
+    return list;
+}
+
+static void cascade (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, uint32_t slot)
+{
+    ut_timerwheelNode_t *n = detach_slot (tw, slot), *next;
+    for (; n; n = next) {
+        next = n->next;
+        place_node (twdef, tw, n);
+    }
+}
+
+static void expire_slot (ut_timerwheel_t *tw, uint32_t slot)
+{
+    ut_timerwheelNode_t *n = detach_slot (tw, slot), *next;
+    for (; n; n = next) {
+        next = n->next;
+        link_node (tw, n, SLOT_EXPIRED);
+    }
+}
+
+static void advance (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, int64_t target)
+{
+    while (tw->now < target) {
+        const unsigned cur = (unsigned) (tw->now & (NSLOTS - 1));
+        int64_t next = target;
+        unsigned level;
+
+        /* Moving past the current tick: whatever is in its slot is due */
+        if (tw->slots[cur])
+            expire_slot (tw, cur);
+
+        /* Jump to the first tick at which something can happen: the next
+           occupied level-0 slot or the next boundary of the lowest
+           occupied higher level, whichever comes first */
+        if (tw->occupied[0]) {
+            const uint64_t occ = rotate_right (tw->occupied[0], (cur + 1) % NSLOTS);
+            const int64_t t = tw->now + 1 + lowest_set_bit (occ);
+            if (t < next)
+                next = t;
+        }
+        for (level = 1; level < NLEVELS; level++) {
+            if (tw->occupied[level])
+                break;
+        }
+        if (level == NLEVELS && tw->slots[SLOT_OVERFLOW])
+            level = NLEVELS - 1;
+        if (level < NLEVELS) {
+            const unsigned sh = level * BITS;
+            const int64_t t = ((tw->now >> sh) + 1) << sh;
+            if (t < next)
+                next = t;
+        }
+
+        tw->now = next;
+        for (level = NLEVELS - 1; level > 0; level--) {
+            const unsigned sh = level * BITS;
+            if ((next & (((int64_t) 1 << sh) - 1)) == 0) {
+                if (level == NLEVELS - 1)
+                    cascade (twdef, tw, SLOT_OVERFLOW);
+                cascade (twdef, tw, slot_index (level, next));
+            }
+        }
+    }
+}
+
+void ut_timerwheelDefInit (ut_timerwheelDef_t *twdef, uintptr_t offset, unsigned tickshift)
+{
+    twdef->offset = offset;
+    twdef->tickshift = tickshift;
+}
+
+void ut_timerwheelInit (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw)
+{
+    size_t i;
+    OS_UNUSED_ARG (twdef);
+    tw->now = 0;
+    tw->count = 0;
+    for (i = 0; i < NLEVELS; i++)
+        tw->occupied[i] = 0;
+    for (i = 0; i < sizeof (tw->slots) / sizeof (tw->slots[0]); i++)
+        tw->slots[i] = NULL;
+}
+
+int ut_timerwheelIsEmpty (const ut_timerwheel_t *tw)
+{
+    return tw->count == 0;
+}
+
+void ut_timerwheelInsert (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode, int64_t t)
+{
+    ut_timerwheelNode_t *node = node_of (twdef, vnode);
+    node->t = t;
+    place_node (twdef, tw, node);
+    tw->count++;
+}
+
+void ut_timerwheelDelete (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode)
+{
+    ut_timerwheelNode_t *node = node_of (twdef, vnode);
+    assert (tw->count > 0);
+    unlink_node (tw, node);
+    tw->count--;
+}
+
+void ut_timerwheelReschedule (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, const void *vnode, int64_t t)
+{
+    ut_timerwheelNode_t *node = node_of (twdef, vnode);
+    unlink_node (tw, node);
+    node->t = t;
+    place_node (twdef, tw, node);
+}
+
+int64_t ut_timerwheelEarliest (const ut_timerwheelDef_t *twdef, const ut_timerwheel_t *tw)
+{
+    /* Exact for level 0, the start of the first occupied slot for the
+       higher levels: waking up at that time causes the slot to be
+       cascaded, after which the estimate improves. */
+    const ut_timerwheelNode_t *n;
+    int64_t tmin = INT64_MAX;
+    unsigned level;
+    if ((n = tw->slots[SLOT_EXPIRED]) != NULL)
+        return n->t;
+    if (tw->occupied[0]) {
+        const unsigned cur = (unsigned) (tw->now & (NSLOTS - 1));
+        const unsigned slot = (cur + lowest_set_bit (rotate_right (tw->occupied[0], cur))) % NSLOTS;
+        for (n = tw->slots[slot]; n; n = n->next) {
+            if (n->t < tmin)
+                tmin = n->t;
+        }
+    }
+    for (level = 1; level < NLEVELS; level++) {
+        if (tw->occupied[level]) {
+            const unsigned sh = level * BITS;
+            const unsigned cur = (unsigned) ((tw->now >> sh) & (NSLOTS - 1));
+            const int64_t k = 1 + lowest_set_bit (rotate_right (tw->occupied[level], (cur + 1) % NSLOTS));
+            const int64_t t = (((tw->now >> sh) + k) << sh) << twdef->tickshift;
+            if (t < tmin)
+                tmin = t;
+        }
+    }
+    if (tw->slots[SLOT_OVERFLOW]) {
+        const unsigned sh = (NLEVELS - 1) * BITS;
+        const int64_t t = (((tw->now >> sh) + 1) << sh) << twdef->tickshift;
+        if (t < tmin)
+            tmin = t;
+    }
+    return tmin;
+}
+
+void *ut_timerwheelExtractExpired (const ut_timerwheelDef_t *twdef, ut_timerwheel_t *tw, int64_t tnow)
+{
+    ut_timerwheelNode_t *n;
+    if (tw->count == 0)
+        return NULL;
+    advance (twdef, tw, tnow >> twdef->tickshift);
+    if ((n = tw->slots[SLOT_EXPIRED]) == NULL) {
+        /* current tick may have timers that are due, but not all need be */
+        for (n = tw->slots[slot_index (0, tw->now)]; n; n = n->next) {
+            if (n->t <= tnow)
+                break;
+        }
+        if (n == NULL)
+            return NULL;
+    }
+    unlink_node (tw, n);
+    tw->count--;
+    return obj_of (twdef, n);
+}
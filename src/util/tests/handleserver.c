@@ -216,6 +216,52 @@ Test(util_handleserver, timeout)
 }
 
 
+/*****************************************************************************************/
+#define MANY_HANDLES (5000)
+
+Test(util_handleserver, many)
+{
+    const os_time zero  = { 0, 0 };
+    int32_t kind = 0x10000000;
+    ut_handle_retcode_t ret;
+    static ut_handle_t hdls[MANY_HANDLES];
+    ut_handle_t hdl;
+    int arg = 1;
+    void *argx;
+    int i, round;
+
+    ret = ut_handleserver_init();
+    cr_assert_eq(ret, UT_HANDLE_OK, "ut_handleserver_init");
+
+    /* Deleting and creating many handles reuses the indices, but never the handles. */
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < MANY_HANDLES; i++) {
+            hdls[i] = ut_handle_create(kind, (void*)&arg);
+            cr_assert(hdls[i] > 0, "ut_handle_create");
+        }
+        for (i = 0; i < MANY_HANDLES; i++) {
+            ret = ut_handle_delete(hdls[i], NULL, zero);
+            cr_assert_eq(ret, UT_HANDLE_OK, "ut_handle_delete");
+        }
+    }
+
+    hdl = ut_handle_create(kind, (void*)&arg);
+    cr_assert(hdl > 0, "ut_handle_create");
+    for (i = 0; i < MANY_HANDLES; i++) {
+        cr_assert_neq(hdls[i], hdl, "ut_handle_create reused");
+        ret = ut_handle_claim(hdls[i], NULL, kind, &argx);
+        cr_assert_eq(ret, UT_HANDLE_DELETED, "ut_handle_claim ret");
+    }
+    ret = ut_handle_claim(hdl, NULL, kind, &argx);
+    cr_assert_eq(ret, UT_HANDLE_OK, "ut_handle_claim ret");
+    ut_handle_release(hdl, NULL);
+    ret = ut_handle_delete(hdl, NULL, zero);
+    cr_assert_eq(ret, UT_HANDLE_OK, "ut_handle_delete");
+
+    ut_handleserver_fini();
+}
+
+
 /*****************************************************************************************/
 typedef enum thread_state_t {
     STARTING,
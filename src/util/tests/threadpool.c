@@ -0,0 +1,127 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include "os/os.h"
+#include "util/ut_thread_pool.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+struct jobs {
+    os_atomic_uint32_t started;
+    os_atomic_uint32_t finished;
+    os_atomic_uint32_t release;
+};
+
+static void blocking_job (void *varg)
+{
+    const os_time delay = { 0, 1000000 };
+    struct jobs *jobs = varg;
+    os_atomic_inc32 (&jobs->started);
+    while (os_atomic_ld32 (&jobs->release) == 0)
+        os_nanoSleep (delay);
+    os_atomic_inc32 (&jobs->finished);
+}
+
+/* Waits at most 10s for a counter to reach n */
+static bool wait_for (os_atomic_uint32_t *counter, uint32_t n)
+{
+    const os_time delay = { 0, 1000000 };
+    int i;
+    for (i = 0; i < 10000 && os_atomic_ld32 (counter) < n; i++)
+        os_nanoSleep (delay);
+    return os_atomic_ld32 (counter) >= n;
+}
+
+/*****************************************************************************************/
+Test(util_thread_pool, grow)
+{
+    struct jobs jobs = { OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0) };
+    ut_thread_pool pool;
+    int i;
+
+    /* All jobs block until released, so they can only all be running if
+       the pool created threads beyond the initial one */
+    pool = ut_thread_pool_new (1, 4, 0, NULL);
+    cr_assert_not_null (pool, "ut_thread_pool_new");
+    for (i = 0; i < 4; i++)
+        cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    cr_assert (wait_for (&jobs.started, 4), "jobs started: %u", os_atomic_ld32 (&jobs.started));
+
+    /* At the maximum, jobs get queued */
+    cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    os_atomic_st32 (&jobs.release, 1);
+    cr_assert (wait_for (&jobs.finished, 5), "jobs finished: %u", os_atomic_ld32 (&jobs.finished));
+    ut_thread_pool_free (pool);
+}
+
+/*****************************************************************************************/
+Test(util_thread_pool, purge)
+{
+    struct jobs jobs = { OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0) };
+    ut_thread_pool pool;
+    int i;
+
+    pool = ut_thread_pool_new (1, 0, 0, NULL);
+    cr_assert_not_null (pool, "ut_thread_pool_new");
+    for (i = 0; i < 4; i++)
+        cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    cr_assert (wait_for (&jobs.started, 4), "jobs started: %u", os_atomic_ld32 (&jobs.started));
+    os_atomic_st32 (&jobs.release, 1);
+    cr_assert (wait_for (&jobs.finished, 4), "jobs finished: %u", os_atomic_ld32 (&jobs.finished));
+
+    /* Purging an idle pool leaves it working, and repeatedly doing so
+       neither loses the minimum thread nor stops the pool from growing
+       again */
+    for (i = 0; i < 3; i++)
+        ut_thread_pool_purge (pool);
+    os_atomic_st32 (&jobs.release, 0);
+    for (i = 0; i < 4; i++)
+        cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    cr_assert (wait_for (&jobs.started, 8), "jobs started: %u", os_atomic_ld32 (&jobs.started));
+    os_atomic_st32 (&jobs.release, 1);
+    cr_assert (wait_for (&jobs.finished, 8), "jobs finished: %u", os_atomic_ld32 (&jobs.finished));
+    ut_thread_pool_purge (pool);
+    ut_thread_pool_free (pool);
+}
+
+/*****************************************************************************************/
+static void release_job (void *varg)
+{
+    const os_time delay = { 0, 100000000 };
+    struct jobs *jobs = varg;
+    /* give ut_thread_pool_free the time to discard the queued jobs */
+    os_nanoSleep (delay);
+    os_atomic_st32 (&jobs->release, 1);
+}
+
+Test(util_thread_pool, free_with_queued_jobs)
+{
+    struct jobs jobs = { OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0), OS_ATOMIC_UINT32_INIT (0) };
+    ut_thread_pool pool, helper;
+    int i;
+
+    /* With a single thread busy, the other jobs remain queued; freeing the
+       pool discards them, and waits for the running one */
+    pool = ut_thread_pool_new (1, 1, 0, NULL);
+    cr_assert_not_null (pool, "ut_thread_pool_new");
+    cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    cr_assert (wait_for (&jobs.started, 1), "jobs started: %u", os_atomic_ld32 (&jobs.started));
+    for (i = 0; i < 5; i++)
+        cr_assert_eq (ut_thread_pool_submit (pool, blocking_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+
+    helper = ut_thread_pool_new (1, 1, 0, NULL);
+    cr_assert_not_null (helper, "ut_thread_pool_new");
+    cr_assert_eq (ut_thread_pool_submit (helper, release_job, &jobs), os_resultSuccess, "ut_thread_pool_submit");
+    ut_thread_pool_free (pool);
+    cr_assert_eq (os_atomic_ld32 (&jobs.started), 1, "jobs started: %u", os_atomic_ld32 (&jobs.started));
+    cr_assert_eq (os_atomic_ld32 (&jobs.finished), 1, "jobs finished: %u", os_atomic_ld32 (&jobs.finished));
+    ut_thread_pool_free (helper);
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright(c) 2006 to 2018 ADLINK Technology Limited and others
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v. 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0, or the Eclipse Distribution License
+ * v. 1.0 which is available at
+ * http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * SPDX-License-Identifier: EPL-2.0 OR BSD-3-Clause
+ */
+#include <stdlib.h>
+#include "os/os.h"
+#include "util/ut_timerwheel.h"
+#include <criterion/criterion.h>
+#include <criterion/logging.h>
+
+#define NOT_SCHEDULED INT64_MIN
+
+struct timer {
+    ut_timerwheelNode_t twnode;
+    int64_t t;
+    int id;
+};
+
+/* small ticks so that random test times exercise all levels and the overflow list */
+static const ut_timerwheelDef_t twdef = UT_TIMERWHEELDEF_INITIALIZER (offsetof (struct timer, twnode), 4);
+
+static uint64_t prng_state = 0x9e3779b97f4a7c15;
+
+static uint64_t prng (void)
+{
+    prng_state ^= prng_state << 13;
+    prng_state ^= prng_state >> 7;
+    prng_state ^= prng_state << 17;
+    return prng_state;
+}
+
+static int64_t random_delay (void)
+{
+    switch (prng () % 4) {
+        case 0: return (int64_t) (prng () % 64);
+        case 1: return (int64_t) (prng () % 100000);
+        case 2: return (int64_t) (prng () % ((uint64_t) 1 << 28));
+        default: return (int64_t) (prng () % ((uint64_t) 1 << 38));
+    }
+}
+
+/*****************************************************************************************/
+Test(util_timerwheel, basic)
+{
+    struct timer a, b, c;
+    ut_timerwheel_t tw;
+    ut_timerwheelInit (&twdef, &tw);
+    cr_assert (ut_timerwheelIsEmpty (&tw));
+    cr_assert_eq (ut_timerwheelEarliest (&twdef, &tw), INT64_MAX);
+
+    ut_timerwheelInsert (&twdef, &tw, &a, 1000);
+    ut_timerwheelInsert (&twdef, &tw, &b, 10);
+    ut_timerwheelInsert (&twdef, &tw, &c, 5000000);
+    cr_assert (!ut_timerwheelIsEmpty (&tw));
+    cr_assert_eq (ut_timerwheelEarliest (&twdef, &tw), 10);
+
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, 9), NULL);
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, 10), &b);
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, 10), NULL);
+    cr_assert_leq (ut_timerwheelEarliest (&twdef, &tw), 1000);
+
+    ut_timerwheelReschedule (&twdef, &tw, &c, 20);
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, 999), &c);
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, 999), NULL);
+
+    ut_timerwheelDelete (&twdef, &tw, &a);
+    cr_assert (ut_timerwheelIsEmpty (&tw));
+    cr_assert_eq (ut_timerwheelExtractExpired (&twdef, &tw, INT64_MAX), NULL);
+}
+
+/*****************************************************************************************/
+Test(util_timerwheel, random)
+{
+    enum { N = 500, ROUNDS = 20000 };
+    struct timer *timers = malloc (N * sizeof (*timers));
+    ut_timerwheel_t tw;
+    int64_t tnow = 12345;
+    int i, round;
+
+    ut_timerwheelInit (&twdef, &tw);
+    for (i = 0; i < N; i++) {
+        timers[i].t = NOT_SCHEDULED;
+        timers[i].id = i;
+    }
+
+    for (round = 0; round < ROUNDS; round++) {
+        struct timer *x = &timers[prng () % N];
+        int64_t tmin = INT64_MAX;
+        switch (prng () % 3) {
+            case 0:
+                if (x->t == NOT_SCHEDULED) {
+                    x->t = tnow + random_delay () - 10;
+                    ut_timerwheelInsert (&twdef, &tw, x, x->t);
+                } else {
+                    x->t = tnow + random_delay ();
+                    ut_timerwheelReschedule (&twdef, &tw, x, x->t);
+                }
+                break;
+            case 1:
+                if (x->t != NOT_SCHEDULED) {
+                    ut_timerwheelDelete (&twdef, &tw, x);
+                    x->t = NOT_SCHEDULED;
+                }
+                break;
+            case 2:
+                tnow += (prng () % 8 == 0) ? random_delay () : (int64_t) (prng () % 1000);
+                while ((x = ut_timerwheelExtractExpired (&twdef, &tw, tnow)) != NULL) {
+                    cr_assert_neq (x->t, NOT_SCHEDULED, "timer %d extracted but not scheduled", x->id);
+                    cr_assert_leq (x->t, tnow, "timer %d extracted early", x->id);
+                    x->t = NOT_SCHEDULED;
+                }
+                break;
+        }
+
+        for (i = 0; i < N; i++) {
+            if (timers[i].t != NOT_SCHEDULED && timers[i].t < tmin)
+                tmin = timers[i].t;
+        }
+        cr_assert_leq (ut_timerwheelEarliest (&twdef, &tw), tmin, "earliest later than first timer");
+        if (tmin <= tnow) {
+            /* only timers scheduled in the past since the last extraction can be due */
+            x = ut_timerwheelExtractExpired (&twdef, &tw, tnow);
+            cr_assert_neq (x, NULL, "due timer not extracted");
+            cr_assert_leq (x->t, tnow);
+            ut_timerwheelInsert (&twdef, &tw, x, x->t);
+        }
+    }
+
+    for (i = 0; i < N; i++) {
+        if (timers[i].t != NOT_SCHEDULED)
+            ut_timerwheelDelete (&twdef, &tw, &timers[i]);
+    }
+    cr_assert (ut_timerwheelIsEmpty (&tw));
+    free (timers);
+}